@@ -0,0 +1,145 @@
+/*
+ * btreemap.h
+ *
+ * An ordered map implemented as an in-memory B+tree.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+#ifndef LIBCOLL_BTREEMAP_H
+#define LIBCOLL_BTREEMAP_H
+
+/* the maximum number of keys in a single node */
+#define LIBCOLL_BTREEMAP_MAX_KEYS   32
+
+/*
+ * Like the treemap, the B+tree map keeps its keys ordered by a comparator
+ * function and supports ordered iteration in both directions.  Instead of
+ * having one node per key, each node holds up to LIBCOLL_BTREEMAP_MAX_KEYS
+ * keys in an array, which makes the tree only a few levels deep: a lookup
+ * follows a handful of pointers and searches within each node using binary
+ * search.  All entries are stored in the leaves, which are linked to each
+ * other in key order for iteration.
+ *
+ * Since entries move between nodes when the tree gets rebalanced, the map
+ * hands out keys and values instead of pointers to nodes.
+ */
+typedef struct libcoll_btreemap_node {
+    unsigned int count;    /* number of keys in the node */
+    bool is_leaf;
+} libcoll_btreemap_node_t;
+
+typedef struct libcoll_btreemap_leaf {
+    libcoll_btreemap_node_t header;
+    struct libcoll_btreemap_leaf *previous;
+    struct libcoll_btreemap_leaf *next;
+    void *keys[LIBCOLL_BTREEMAP_MAX_KEYS];
+    void *values[LIBCOLL_BTREEMAP_MAX_KEYS];
+} libcoll_btreemap_leaf_t;
+
+/*
+ * An internal node with count keys has count+1 children.  The subtree at
+ * children[i] contains the keys k for which keys[i-1] <= k < keys[i].
+ */
+typedef struct libcoll_btreemap_inner {
+    libcoll_btreemap_node_t header;
+    void *keys[LIBCOLL_BTREEMAP_MAX_KEYS];
+    libcoll_btreemap_node_t *children[LIBCOLL_BTREEMAP_MAX_KEYS + 1];
+} libcoll_btreemap_inner_t;
+
+typedef struct libcoll_btreemap {
+    size_t size;
+    libcoll_btreemap_node_t *root;    /* NULL if the map is empty */
+    libcoll_btreemap_leaf_t *first;
+    libcoll_btreemap_leaf_t *last;
+    int (*key_comparator)(const void *key1, const void *key2);
+} libcoll_btreemap_t;
+
+/*
+ * An iterator is positioned between two entries, or at either end of the map.
+ * The next entry is at index in leaf.
+ */
+typedef struct libcoll_btreemap_iter {
+    libcoll_btreemap_t *tree;
+    libcoll_btreemap_leaf_t *leaf;
+    unsigned int index;
+    void *last_traversed_key;
+    bool has_last_traversed;
+} libcoll_btreemap_iter_t;
+
+
+/* external functions */
+
+libcoll_btreemap_t* libcoll_btreemap_init();
+
+libcoll_btreemap_t* libcoll_btreemap_init_with_comparator(int (*key_comparator)(const void *key1, const void *key2));
+
+void libcoll_btreemap_deinit(libcoll_btreemap_t *tree);
+
+void libcoll_btreemap_deinit_and_delete_contents(libcoll_btreemap_t *tree);
+
+bool libcoll_btreemap_add(libcoll_btreemap_t *tree, void *key, void *value);
+
+void* libcoll_btreemap_get(libcoll_btreemap_t *tree, const void *key);
+
+bool libcoll_btreemap_contains(libcoll_btreemap_t *tree, const void *key);
+
+libcoll_pair_voidptr_t libcoll_btreemap_remove(libcoll_btreemap_t *tree, const void *key);
+
+libcoll_pair_voidptr_t libcoll_btreemap_get_first(libcoll_btreemap_t *tree);
+
+libcoll_pair_voidptr_t libcoll_btreemap_get_last(libcoll_btreemap_t *tree);
+
+libcoll_pair_voidptr_t libcoll_btreemap_get_successor(libcoll_btreemap_t *tree, const void *key);
+
+libcoll_pair_voidptr_t libcoll_btreemap_get_predecessor(libcoll_btreemap_t *tree, const void *key);
+
+size_t libcoll_btreemap_get_size(libcoll_btreemap_t *tree);
+
+char libcoll_btreemap_is_empty(libcoll_btreemap_t *tree);
+
+libcoll_btreemap_iter_t* libcoll_btreemap_get_iterator(libcoll_btreemap_t *tree);
+
+libcoll_btreemap_iter_t* libcoll_btreemap_get_iterator_at(libcoll_btreemap_t *tree, const void *key);
+
+void libcoll_btreemap_free_iterator(libcoll_btreemap_iter_t *iterator);
+
+bool libcoll_btreemap_has_next(libcoll_btreemap_iter_t *iterator);
+
+libcoll_pair_voidptr_t libcoll_btreemap_next(libcoll_btreemap_iter_t *iterator);
+
+bool libcoll_btreemap_has_previous(libcoll_btreemap_iter_t *iterator);
+
+libcoll_pair_voidptr_t libcoll_btreemap_previous(libcoll_btreemap_iter_t *iterator);
+
+libcoll_pair_voidptr_t libcoll_btreemap_remove_last_traversed(libcoll_btreemap_iter_t *iterator);
+
+bool _libcoll_btreemap_verify(libcoll_btreemap_t *tree);
+
+#endif /* LIBCOLL_BTREEMAP_H */
@@ -43,6 +43,31 @@ int libcoll_intptrcmp(const void *value1, const void *value2);
  */
 int libcoll_strcmp_wrapper(const void *value1, const void *value2);
 
+/*
+ * Comparator for byte string (libcoll_bytes_t) keys/values.
+ *
+ * The pointers are treated as pointers to libcoll_bytes_t structs.  Byte
+ * strings are ordered lexicographically by their unsigned bytes, as by
+ * memcmp, with a byte string sorting before any longer byte string it is a
+ * prefix of.  For byte strings without zero bytes, this is the order of
+ * strcmp.
+ */
+int libcoll_bytescmp(const void *value1, const void *value2);
+
+/*
+ * Comparator for looking up string keys using a byte string.
+ *
+ * The first pointer is treated as a pointer to a libcoll_bytes_t and the
+ * second as a NUL-terminated string.  The byte string and the string are
+ * considered equal if they contain the same characters, and are otherwise
+ * ordered as by strcmp.
+ *
+ * This allows looking up C string keys stored in a collection using a
+ * (pointer, length) pair, such as a substring of a larger buffer, without
+ * first copying it into a NUL-terminated string.
+ */
+int libcoll_bytes_strcmp(const void *bytes, const void *str);
+
 /*
  * A comparator function for keys using the memory address of the data as a
  * basis of (in)equality.
@@ -0,0 +1,131 @@
+/*
+ * concurrentsortedmap.h
+ *
+ * An ordered map that can be used by several threads at once, implemented
+ * as a lock-free skip list.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+#ifndef LIBCOLL_CONCURRENT_SORTEDMAP_H
+#define LIBCOLL_CONCURRENT_SORTEDMAP_H
+
+/* the maximum number of levels in the skip list */
+#define LIBCOLL_CONCURRENT_SORTEDMAP_MAX_LEVEL  32
+
+/*
+ * Each node is linked into the lists of levels 0 to height-1.  A node is
+ * removed by marking its next pointers, setting their lowest bit, after which
+ * any thread passing by unlinks it.  Removed nodes are kept on a list of
+ * retired nodes until no thread can be reading them anymore.
+ */
+typedef struct libcoll_concurrent_sortedmap_node {
+    void *key;
+    void *value;
+    struct libcoll_concurrent_sortedmap_node *retired_next;
+    unsigned long retired_epoch;
+    unsigned int state;
+    unsigned int height;
+    struct libcoll_concurrent_sortedmap_node *next[];
+} libcoll_concurrent_sortedmap_node_t;
+
+/*
+ * The state kept for each thread using the map, for epoch-based reclamation
+ * of removed nodes.  A thread announces the epoch it entered the map in, and
+ * nodes retired in an epoch are freed once every thread inside the map has
+ * entered at least two epochs later.
+ */
+typedef struct libcoll_concurrent_sortedmap_thread {
+    struct libcoll_concurrent_sortedmap_thread *next;
+    bool in_use;
+    unsigned long epoch;           /* 0 if the thread is not inside the map */
+    unsigned int nesting;
+    libcoll_concurrent_sortedmap_node_t *retired;
+    size_t retired_count;
+    unsigned long long random;
+} libcoll_concurrent_sortedmap_thread_t;
+
+typedef struct libcoll_concurrent_sortedmap {
+    size_t size;
+    libcoll_concurrent_sortedmap_node_t *head;
+    unsigned long epoch;
+    libcoll_concurrent_sortedmap_thread_t *threads;
+    pthread_key_t thread_key;
+    int (*key_comparator)(const void *key1, const void *key2);
+} libcoll_concurrent_sortedmap_t;
+
+/*
+ * An iterator keeps its thread inside the map from its creation until it is
+ * freed, so that the nodes it visits stay allocated.  It must only be used by
+ * the thread that created it.
+ */
+typedef struct libcoll_concurrent_sortedmap_iter {
+    libcoll_concurrent_sortedmap_t *map;
+    libcoll_concurrent_sortedmap_thread_t *thread;
+    libcoll_concurrent_sortedmap_node_t *next;
+} libcoll_concurrent_sortedmap_iter_t;
+
+
+/* external functions */
+
+libcoll_concurrent_sortedmap_t* libcoll_concurrent_sortedmap_init();
+
+libcoll_concurrent_sortedmap_t* libcoll_concurrent_sortedmap_init_with_comparator(int (*key_comparator)(const void *key1, const void *key2));
+
+void libcoll_concurrent_sortedmap_deinit(libcoll_concurrent_sortedmap_t *map);
+
+void libcoll_concurrent_sortedmap_deinit_and_delete_contents(libcoll_concurrent_sortedmap_t *map);
+
+bool libcoll_concurrent_sortedmap_add(libcoll_concurrent_sortedmap_t *map, void *key, void *value);
+
+void* libcoll_concurrent_sortedmap_get(libcoll_concurrent_sortedmap_t *map, const void *key);
+
+bool libcoll_concurrent_sortedmap_contains(libcoll_concurrent_sortedmap_t *map, const void *key);
+
+libcoll_pair_voidptr_t libcoll_concurrent_sortedmap_remove(libcoll_concurrent_sortedmap_t *map, const void *key);
+
+size_t libcoll_concurrent_sortedmap_get_size(libcoll_concurrent_sortedmap_t *map);
+
+char libcoll_concurrent_sortedmap_is_empty(libcoll_concurrent_sortedmap_t *map);
+
+libcoll_concurrent_sortedmap_iter_t* libcoll_concurrent_sortedmap_get_iterator(libcoll_concurrent_sortedmap_t *map);
+
+libcoll_concurrent_sortedmap_iter_t* libcoll_concurrent_sortedmap_get_iterator_at(libcoll_concurrent_sortedmap_t *map,
+                                                                                const void *key);
+
+void libcoll_concurrent_sortedmap_free_iterator(libcoll_concurrent_sortedmap_iter_t *iterator);
+
+bool libcoll_concurrent_sortedmap_has_next(libcoll_concurrent_sortedmap_iter_t *iterator);
+
+libcoll_pair_voidptr_t libcoll_concurrent_sortedmap_next(libcoll_concurrent_sortedmap_iter_t *iterator);
+
+bool _libcoll_concurrent_sortedmap_verify(libcoll_concurrent_sortedmap_t *map);
+
+#endif /* LIBCOLL_CONCURRENT_SORTEDMAP_H */
@@ -30,6 +30,9 @@
 #ifndef LIBCOLL_HASH_H
 #define LIBCOLL_HASH_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 unsigned long libcoll_hashcode_int(const void *intptr);
 
 unsigned long libcoll_hashcode_str(const void *str);
@@ -40,4 +43,62 @@ unsigned long libcoll_hashcode_str(const void *str);
  */
 unsigned long libcoll_hashcode_memaddr(const void *value);
 
+/*
+ * Hash value functions based on the CRC32C (Castagnoli) checksum.
+ *
+ * On x86 processors supporting SSE4.2, the checksum is computed using the
+ * dedicated crc32 instruction; elsewhere a table-driven software
+ * implementation is used.  The implementation is chosen at runtime on first
+ * use, and both produce identical hash values.
+ *
+ * Compared to libcoll_hashcode_int and libcoll_hashcode_memaddr, these mix
+ * all bits of the key into the low bits of the hash value, which makes them
+ * better suited for keys with regular patterns such as aligned addresses or
+ * multiples of a common stride.
+ */
+unsigned long libcoll_hashcode_crc32c_int(const void *intptr);
+
+unsigned long libcoll_hashcode_crc32c_str(const void *str);
+
+/* The key pointer is treated as a pointer to an uint64_t. */
+unsigned long libcoll_hashcode_crc32c_u64(const void *u64ptr);
+
+unsigned long libcoll_hashcode_crc32c_memaddr(const void *value);
+
+/*
+ * Computes a CRC32C hash value for an arbitrary sequence of bytes.
+ * For a string, the result is equal to that of libcoll_hashcode_crc32c_str.
+ */
+unsigned long libcoll_hashcode_crc32c_bytes(const void *data, size_t length);
+
+/*
+ * A hash value function for byte string (libcoll_bytes_t) keys.
+ *
+ * The hash value of a byte string equals that computed by
+ * libcoll_hashcode_crc32c_str for a C string with the same contents.
+ */
+unsigned long libcoll_hashcode_bytes(const void *bytes);
+
+/*
+ * Batch hashing functions, computing the hash values of n keys at once and
+ * storing them in the out array, which must have room for n values.
+ *
+ * The results are identical to those of calling libcoll_hashcode_crc32c_int,
+ * libcoll_hashcode_crc32c_u64 and libcoll_hashcode_crc32c_str, respectively,
+ * on each key, but the hashing functions are selected only once per batch and
+ * the checksums of several keys are computed in an interleaved fashion,
+ * allowing the processor to overlap their computation.
+ */
+void libcoll_hash_batch_int(const int *keys, size_t n, unsigned long *out);
+
+void libcoll_hash_batch_u64(const uint64_t *keys, size_t n, unsigned long *out);
+
+void libcoll_hash_batch_str(const char *const *keys, size_t n, unsigned long *out);
+
+/*
+ * Computes the same hash value as libcoll_hashcode_crc32c_bytes, always using
+ * the software implementation.  For testing that the implementations agree.
+ */
+unsigned long _libcoll_hashcode_crc32c_software(const void *data, size_t length);
+
 #endif /* LIBCOLL_HASH_H */
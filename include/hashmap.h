@@ -27,8 +27,10 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "keytraits.h"
 #include "linkedlist.h"
 #include "map.h"
 #include "types.h"
@@ -42,6 +44,7 @@
 typedef struct libcoll_hashmap_entry {
     const void *key;
     const void *value;
+    uint64_t hash;  /* the hash value of the key, cached for lookups and resizing */
 } libcoll_hashmap_entry_t;
 
 typedef struct libcoll_hashmap {
@@ -52,6 +55,7 @@ typedef struct libcoll_hashmap {
     unsigned long (*hash_code_function)(const void *key);
     int (*key_comparator_function)(const void *key1, const void *key2);
     int (*value_comparator_function)(const void *value1, const void *value2);
+    libcoll_key_traits_t key_traits;  /* if key_traits.hash is set, it is used instead of hash_code_function */
 } libcoll_hashmap_t;
 
 typedef struct libcoll_hashmap_iter {
@@ -69,8 +73,25 @@ libcoll_hashmap_t* libcoll_hashmap_init_with_params(
         int (*key_comparator_function)(const void *key1, const void *key2),
         int (*value_comparator_function)(const void *value1, const void *value2));
 
+/*
+ * Initializes a new hashmap that hashes and compares keys as described by the
+ * given key traits, such as one of the predefined traits in keytraits.h.
+ * The traits are copied into the map.
+ */
+libcoll_hashmap_t* libcoll_hashmap_init_with_traits(
+        size_t init_capacity,
+        float max_load_factor,
+        const libcoll_key_traits_t *key_traits,
+        int (*value_comparator_function)(const void *value1, const void *value2));
+
 void libcoll_hashmap_deinit(libcoll_hashmap_t *hm);
 
+/*
+ * Computes the hash value of the given key as the hashmap would compute it.
+ * The result can be passed to the *_prehashed functions.
+ */
+uint64_t libcoll_hashmap_hash_key(const libcoll_hashmap_t *hm, const void *key);
+
 libcoll_map_insertion_result_t libcoll_hashmap_put(libcoll_hashmap_t *hm, const void *key, const void *value);
 
 void* libcoll_hashmap_get(const libcoll_hashmap_t *hm, const void *key);
@@ -79,6 +100,36 @@ char libcoll_hashmap_contains(const libcoll_hashmap_t *hm, const void *key);
 
 libcoll_map_removal_result_t libcoll_hashmap_remove(libcoll_hashmap_t *hm, const void *key);
 
+/*
+ * Variants of the functions above that take the hash value of the key from
+ * the caller instead of computing it, for when the caller already knows it.
+ *
+ * The hash value must equal the one the hashmap itself would compute for the
+ * key (see libcoll_hashmap_hash_key); otherwise the entry will not be found.
+ */
+libcoll_map_insertion_result_t libcoll_hashmap_put_prehashed(libcoll_hashmap_t *hm, uint64_t hashcode, const void *key, const void *value);
+
+void* libcoll_hashmap_get_prehashed(const libcoll_hashmap_t *hm, uint64_t hashcode, const void *key);
+
+char libcoll_hashmap_contains_prehashed(const libcoll_hashmap_t *hm, uint64_t hashcode, const void *key);
+
+libcoll_map_removal_result_t libcoll_hashmap_remove_prehashed(libcoll_hashmap_t *hm, uint64_t hashcode, const void *key);
+
+/*
+ * Looks up a value using an alternative representation of the key, such as
+ * a byte string (libcoll_bytes_t) when the map stores C string keys.
+ *
+ * The given hash value must equal the hash value of the matching stored key,
+ * and probe_comparator is called with the probe as the first argument and a
+ * stored key as the second; it must return 0 when they match.
+ *
+ * For example, for a map using libcoll_key_traits_str, a byte string can be
+ * looked up with libcoll_hashcode_bytes as the hash and libcoll_bytes_strcmp
+ * as the probe comparator.
+ */
+void* libcoll_hashmap_get_by(const libcoll_hashmap_t *hm, uint64_t hashcode, const void *probe,
+                             int (*probe_comparator)(const void *probe, const void *key));
+
 size_t libcoll_hashmap_get_capacity(const libcoll_hashmap_t *hm);
 
 size_t libcoll_hashmap_get_size(const libcoll_hashmap_t *hm);
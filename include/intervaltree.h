@@ -0,0 +1,99 @@
+/*
+ * intervaltree.h
+ *
+ * An interval tree for overlap queries, built on the red-black treemap.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "treemap.h"
+
+#ifndef LIBCOLL_INTERVALTREE_H
+#define LIBCOLL_INTERVALTREE_H
+
+/* data types */
+
+/* A closed interval [start, end] with an associated value */
+typedef struct libcoll_interval {
+    long long start;
+    long long end;
+    void *value;
+} libcoll_interval_t;
+
+/*
+ * The intervals are kept in a treemap ordered by their start points, using
+ * the treemap's aggregates to keep the largest end point in each subtree.  A
+ * query skips every subtree whose largest end point is before the queried
+ * range, and stops at the first interval starting after it.
+ *
+ * Intervals are ordered by start point, then by end point, and then by their
+ * addresses, so that equal intervals can be stored.
+ */
+typedef struct libcoll_intervaltree {
+    libcoll_treemap_t *map;
+} libcoll_intervaltree_t;
+
+/* An iterator over the intervals overlapping a given closed range, in the
+ * order of their start points
+ */
+typedef struct libcoll_intervaltree_iter {
+    libcoll_treemap_node_t *next;
+    long long low;
+    long long high;
+} libcoll_intervaltree_iter_t;
+
+
+/* external functions */
+
+libcoll_intervaltree_t* libcoll_intervaltree_init();
+
+void libcoll_intervaltree_deinit(libcoll_intervaltree_t *tree);
+
+libcoll_interval_t* libcoll_intervaltree_add(libcoll_intervaltree_t *tree, long long start, long long end,
+                                             void *value);
+
+void* libcoll_intervaltree_remove(libcoll_intervaltree_t *tree, libcoll_interval_t *interval);
+
+bool libcoll_intervaltree_build(libcoll_intervaltree_t *tree, const libcoll_interval_t *intervals, size_t count);
+
+size_t libcoll_intervaltree_get_size(libcoll_intervaltree_t *tree);
+
+char libcoll_intervaltree_is_empty(libcoll_intervaltree_t *tree);
+
+void libcoll_intervaltree_init_overlap_iterator(libcoll_intervaltree_iter_t *iterator, libcoll_intervaltree_t *tree,
+                                                long long low, long long high);
+
+void libcoll_intervaltree_init_stab_iterator(libcoll_intervaltree_iter_t *iterator, libcoll_intervaltree_t *tree,
+                                             long long point);
+
+bool libcoll_intervaltree_has_next(libcoll_intervaltree_iter_t *iterator);
+
+libcoll_interval_t* libcoll_intervaltree_next(libcoll_intervaltree_iter_t *iterator);
+
+bool _libcoll_intervaltree_verify(libcoll_intervaltree_t *tree);
+
+#endif /* LIBCOLL_INTERVALTREE_H */
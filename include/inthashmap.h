@@ -0,0 +1,143 @@
+/*
+ * inthashmap.h
+ *
+ * A hashmap specialized for integer keys and values, stored unboxed.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "map.h"
+
+#ifndef LIBCOLL_INTHASHMAP_H
+#define LIBCOLL_INTHASHMAP_H
+
+#define LIBCOLL_INTHASHMAP_DEFAULT_INIT_SIZE         32
+#define LIBCOLL_INTHASHMAP_DEFAULT_MAX_LOAD_FACTOR   0.75f
+
+/*
+ * Unlike the generic hashmap, which stores pointers to keys and values, the
+ * integer hashmap stores 64-bit keys and values directly in its slots, using
+ * 16 bytes per slot plus one bit for marking the slot as occupied.
+ * There are no per-entry allocations and no pointers to follow on lookups.
+ *
+ * Keys of narrower integer types (e.g. uint32_t) as well as intptr_t and
+ * uintptr_t keys can be stored by converting them to uint64_t.  Likewise, any
+ * value of at most 64 bits, such as a counter, a pointer or an index into an
+ * array, can be stored as the value.
+ *
+ * Collisions are resolved by linear probing.  The capacity is always a power
+ * of two.
+ */
+typedef struct libcoll_inthashmap_entry {
+    uint64_t key;
+    uint64_t value;
+} libcoll_inthashmap_entry_t;
+
+typedef struct libcoll_inthashmap {
+    libcoll_inthashmap_entry_t *slots;
+    uint64_t *occupied;    /* bitmap of occupied slots */
+    size_t capacity;
+    size_t total_entries;
+    float max_load_factor;
+    unsigned int hash_shift;  /* 64 - log2(capacity) */
+} libcoll_inthashmap_t;
+
+typedef struct libcoll_inthashmap_iter {
+    libcoll_inthashmap_t *hm;
+    size_t next_index;
+} libcoll_inthashmap_iter_t;
+
+libcoll_inthashmap_t* libcoll_inthashmap_init();
+
+/*
+ * Initializes a new integer hashmap.  The initial capacity is rounded up to
+ * the next power of two.
+ */
+libcoll_inthashmap_t* libcoll_inthashmap_init_with_params(size_t init_capacity, float max_load_factor);
+
+void libcoll_inthashmap_deinit(libcoll_inthashmap_t *hm);
+
+/*
+ * Maps the given key to the given value, replacing any previous value.
+ * Returns MAP_ENTRY_ADDED or MAP_ENTRY_REPLACED.
+ */
+libcoll_map_insertion_status libcoll_inthashmap_put(libcoll_inthashmap_t *hm, uint64_t key, uint64_t value);
+
+/*
+ * Retrieves the value mapped to the given key into *value.
+ * Returns true (nonzero) if the key was found, false (zero) if not, in which
+ * case *value is left untouched.
+ */
+char libcoll_inthashmap_get(const libcoll_inthashmap_t *hm, uint64_t key, uint64_t *value);
+
+/*
+ * Returns a pointer to the value mapped to the given key, or NULL if the key
+ * is not found.  The value can be modified in place through the pointer.
+ * The pointer is invalidated by any subsequent insertion or removal.
+ */
+uint64_t* libcoll_inthashmap_get_ref(const libcoll_inthashmap_t *hm, uint64_t key);
+
+/*
+ * Returns a pointer to the value mapped to the given key, first adding the
+ * key with the given initial value if it is not in the map yet.
+ * This makes e.g. counting occurrences a single lookup per key:
+ *
+ *      (*libcoll_inthashmap_get_or_put(counts, id, 0))++;
+ *
+ * The pointer is invalidated by any subsequent insertion or removal.
+ */
+uint64_t* libcoll_inthashmap_get_or_put(libcoll_inthashmap_t *hm, uint64_t key, uint64_t initial_value);
+
+char libcoll_inthashmap_contains(const libcoll_inthashmap_t *hm, uint64_t key);
+
+/*
+ * Removes the given key from the map.  If value is not NULL, the value that
+ * was mapped to the key is stored into it.
+ * Returns true (nonzero) if the key was found and removed, false if not.
+ */
+char libcoll_inthashmap_remove(libcoll_inthashmap_t *hm, uint64_t key, uint64_t *value);
+
+size_t libcoll_inthashmap_get_capacity(const libcoll_inthashmap_t *hm);
+
+size_t libcoll_inthashmap_get_size(const libcoll_inthashmap_t *hm);
+
+char libcoll_inthashmap_is_empty(const libcoll_inthashmap_t *hm);
+
+/*
+ * Iterators over the entries in the map, in no particular order.
+ * The map must not be modified while iterating, except for changing values
+ * through the returned entries.
+ */
+libcoll_inthashmap_iter_t* libcoll_inthashmap_get_iterator(libcoll_inthashmap_t *hm);
+
+void libcoll_inthashmap_free_iterator(libcoll_inthashmap_iter_t *iter);
+
+char libcoll_inthashmap_iter_has_next(libcoll_inthashmap_iter_t *iter);
+
+libcoll_inthashmap_entry_t* libcoll_inthashmap_iter_next(libcoll_inthashmap_iter_t *iter);
+
+#endif  /* LIBCOLL_INTHASHMAP_H */
@@ -0,0 +1,68 @@
+/*
+ * keytraits.h
+ *
+ * Descriptors bundling the functions used for hashing and comparing keys.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#ifndef LIBCOLL_KEYTRAITS_H
+#define LIBCOLL_KEYTRAITS_H
+
+/*
+ * Describes how keys of a particular type are hashed and compared.
+ *
+ * The hash function returns a 64-bit hash value.  The comparator follows the
+ * usual convention of returning 0 for equal keys.
+ *
+ * If hash_determines_equality is nonzero, two keys with equal hash values are
+ * known to be equal (i.e. the hash function is injective for the key type),
+ * and collections may skip calling the comparator when hash values match.
+ */
+typedef struct libcoll_key_traits {
+    uint64_t (*hash)(const void *key);
+    int (*compare)(const void *key1, const void *key2);
+    char hash_determines_equality;
+} libcoll_key_traits_t;
+
+/*
+ * Predefined traits for common key types, using the CRC32C-based hash
+ * functions and the comparators in comparators.h.
+ */
+
+/* NUL-terminated strings (char*) */
+extern const libcoll_key_traits_t libcoll_key_traits_str;
+
+/* byte strings (libcoll_bytes_t*) */
+extern const libcoll_key_traits_t libcoll_key_traits_bytes;
+
+/* integers (int*); the hash alone determines equality for 32-bit ints */
+extern const libcoll_key_traits_t libcoll_key_traits_int;
+
+/* arbitrary pointers compared by memory address */
+extern const libcoll_key_traits_t libcoll_key_traits_memaddr;
+
+#endif /* LIBCOLL_KEYTRAITS_H */
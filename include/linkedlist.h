@@ -140,6 +140,13 @@ char libcoll_linkedlist_contains(libcoll_linkedlist_t *list, void *value);
  */
 char libcoll_linkedlist_remove(libcoll_linkedlist_t *list, void *value);
 
+/*
+ * Removes the given node from the list and frees the memory used by it.
+ * The node must belong to the list.
+ * Note that this does not free any memory allocated for the stored value itself.
+ */
+void libcoll_linkedlist_remove_node(libcoll_linkedlist_t *list, libcoll_linkedlist_node_t *node);
+
 /*
  * Initializes a new iterator for the given list. The new iterator will point
  * in front of the head of the list.
@@ -0,0 +1,136 @@
+/*
+ * persistentmap.h
+ *
+ * An ordered map whose versions can be read by other threads while it is
+ * being modified.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "types.h"
+
+#ifndef LIBCOLL_PERSISTENTMAP_H
+#define LIBCOLL_PERSISTENTMAP_H
+
+/* an upper bound for the height of a tree of any size that fits in memory */
+#define LIBCOLL_PERSISTENTMAP_MAX_HEIGHT    96
+
+/*
+ * The persistent map is an AVL tree whose nodes are never modified once they
+ * are part of a version of the map.  Adding or removing a key creates new
+ * copies of the O(log n) nodes on the path from the root to the key, sharing
+ * the rest of the nodes with the previous version.
+ *
+ * Nodes are shared by any number of versions, and freed when the last version
+ * referring to them is released.  The reference counts are updated using
+ * atomic operations.
+ */
+typedef struct libcoll_persistentmap_node {
+    struct libcoll_persistentmap_node *left;
+    struct libcoll_persistentmap_node *right;
+    void *key;
+    void *value;
+    size_t refcount;
+    int height;
+} libcoll_persistentmap_node_t;
+
+/*
+ * A snapshot is an immutable version of the map.  It stays valid until it
+ * has been released, no matter how the map changes in the meantime or
+ * whether the map itself gets deinitialized.
+ */
+typedef struct libcoll_persistentmap_snapshot {
+    libcoll_persistentmap_node_t *root;
+    size_t size;
+    size_t refcount;
+    int (*key_comparator)(const void *key1, const void *key2);
+} libcoll_persistentmap_snapshot_t;
+
+/*
+ * The map may be modified by a single thread at a time.  Any number of other
+ * threads may take snapshots of it concurrently; taking a snapshot holds the
+ * lock only for as long as it takes to increment a reference count, and
+ * reading a snapshot takes no locks at all.
+ */
+typedef struct libcoll_persistentmap {
+    libcoll_persistentmap_snapshot_t *current;
+    pthread_mutex_t lock;    /* guards replacing and acquiring current */
+    int (*key_comparator)(const void *key1, const void *key2);
+} libcoll_persistentmap_t;
+
+/*
+ * An iterator over a snapshot keeps the path from the root to the next node,
+ * and holds a reference to the snapshot until it is freed.
+ */
+typedef struct libcoll_persistentmap_iter {
+    libcoll_persistentmap_snapshot_t *snapshot;
+    unsigned int depth;
+    libcoll_persistentmap_node_t *path[LIBCOLL_PERSISTENTMAP_MAX_HEIGHT];
+} libcoll_persistentmap_iter_t;
+
+
+/* external functions */
+
+libcoll_persistentmap_t* libcoll_persistentmap_init();
+
+libcoll_persistentmap_t* libcoll_persistentmap_init_with_comparator(int (*key_comparator)(const void *key1, const void *key2));
+
+void libcoll_persistentmap_deinit(libcoll_persistentmap_t *map);
+
+bool libcoll_persistentmap_add(libcoll_persistentmap_t *map, void *key, void *value);
+
+void* libcoll_persistentmap_get(libcoll_persistentmap_t *map, const void *key);
+
+libcoll_pair_voidptr_t libcoll_persistentmap_remove(libcoll_persistentmap_t *map, const void *key);
+
+size_t libcoll_persistentmap_get_size(libcoll_persistentmap_t *map);
+
+libcoll_persistentmap_snapshot_t* libcoll_persistentmap_snapshot(libcoll_persistentmap_t *map);
+
+void libcoll_persistentmap_release_snapshot(libcoll_persistentmap_snapshot_t *snapshot);
+
+void* libcoll_persistentmap_snapshot_get(libcoll_persistentmap_snapshot_t *snapshot, const void *key);
+
+bool libcoll_persistentmap_snapshot_contains(libcoll_persistentmap_snapshot_t *snapshot, const void *key);
+
+size_t libcoll_persistentmap_snapshot_get_size(libcoll_persistentmap_snapshot_t *snapshot);
+
+libcoll_persistentmap_iter_t* libcoll_persistentmap_get_iterator(libcoll_persistentmap_snapshot_t *snapshot);
+
+libcoll_persistentmap_iter_t* libcoll_persistentmap_get_iterator_at(libcoll_persistentmap_snapshot_t *snapshot,
+                                                                    const void *key);
+
+void libcoll_persistentmap_free_iterator(libcoll_persistentmap_iter_t *iterator);
+
+bool libcoll_persistentmap_has_next(libcoll_persistentmap_iter_t *iterator);
+
+libcoll_pair_voidptr_t libcoll_persistentmap_next(libcoll_persistentmap_iter_t *iterator);
+
+bool _libcoll_persistentmap_verify(libcoll_persistentmap_snapshot_t *snapshot);
+
+#endif /* LIBCOLL_PERSISTENTMAP_H */
@@ -0,0 +1,152 @@
+/*
+ * radixtree.h
+ *
+ * An ordered map for byte string keys implemented as an adaptive radix tree.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef LIBCOLL_RADIXTREE_H
+#define LIBCOLL_RADIXTREE_H
+
+/* the number of bytes of a compressed path stored in a node */
+#define LIBCOLL_RADIXTREE_MAX_PREFIX    8
+
+/*
+ * The radix tree branches on one byte of the key at each level, so that
+ * finding a key takes time proportional to the length of the key, and keys
+ * are never compared as a whole except for one final check at a leaf.  Keys
+ * are arbitrary byte strings, which the tree copies into its leaves, and they
+ * are ordered byte by byte, a key coming before any longer key it is a prefix
+ * of.
+ *
+ * Inner nodes come in four sizes, for up to 4, 16, 48 and 256 children, and
+ * grow and shrink as children are added and removed.  A chain of nodes with a
+ * single child each is compressed into a prefix of the node below it; the
+ * first LIBCOLL_RADIXTREE_MAX_PREFIX bytes of the prefix are stored in the
+ * node, and the rest are skipped when searching and checked at the leaf.
+ *
+ * A key ending at an inner node is stored in the terminal leaf of that node.
+ * Pointers to leaves are told apart from pointers to inner nodes by their
+ * lowest bit being set.
+ */
+typedef struct libcoll_radixtree_leaf {
+    void *value;
+    size_t key_length;
+    unsigned char key[];
+} libcoll_radixtree_leaf_t;
+
+typedef struct libcoll_radixtree_node {
+    unsigned char type;
+    unsigned short child_count;
+    size_t prefix_length;
+    unsigned char prefix[LIBCOLL_RADIXTREE_MAX_PREFIX];
+    libcoll_radixtree_leaf_t *terminal;
+} libcoll_radixtree_node_t;
+
+/* children ordered by their key bytes */
+typedef struct libcoll_radixtree_node4 {
+    libcoll_radixtree_node_t header;
+    unsigned char keys[4];
+    libcoll_radixtree_node_t *children[4];
+} libcoll_radixtree_node4_t;
+
+typedef struct libcoll_radixtree_node16 {
+    libcoll_radixtree_node_t header;
+    unsigned char keys[16];
+    libcoll_radixtree_node_t *children[16];
+} libcoll_radixtree_node16_t;
+
+/* child_index holds 1 + the index of the child for each key byte, or 0 */
+typedef struct libcoll_radixtree_node48 {
+    libcoll_radixtree_node_t header;
+    unsigned char child_index[256];
+    libcoll_radixtree_node_t *children[48];
+} libcoll_radixtree_node48_t;
+
+typedef struct libcoll_radixtree_node256 {
+    libcoll_radixtree_node_t header;
+    libcoll_radixtree_node_t *children[256];
+} libcoll_radixtree_node256_t;
+
+typedef struct libcoll_radixtree {
+    size_t size;
+    libcoll_radixtree_node_t *root;
+} libcoll_radixtree_t;
+
+/*
+ * An iterator keeps a stack of the nodes on the path to the next leaf, along
+ * with the position of the next child to visit in each.
+ */
+typedef struct libcoll_radixtree_frame {
+    libcoll_radixtree_node_t *node;
+    int position;     /* -1 before visiting the terminal leaf */
+} libcoll_radixtree_frame_t;
+
+typedef struct libcoll_radixtree_iter {
+    libcoll_radixtree_t *tree;
+    libcoll_radixtree_frame_t *frames;
+    size_t depth;
+    size_t capacity;
+    libcoll_radixtree_leaf_t *next;
+} libcoll_radixtree_iter_t;
+
+
+/* external functions */
+
+libcoll_radixtree_t* libcoll_radixtree_init();
+
+void libcoll_radixtree_deinit(libcoll_radixtree_t *tree);
+
+void libcoll_radixtree_deinit_and_delete_contents(libcoll_radixtree_t *tree);
+
+bool libcoll_radixtree_add(libcoll_radixtree_t *tree, const void *key, size_t length, void *value);
+
+void* libcoll_radixtree_get(libcoll_radixtree_t *tree, const void *key, size_t length);
+
+bool libcoll_radixtree_contains(libcoll_radixtree_t *tree, const void *key, size_t length);
+
+void* libcoll_radixtree_remove(libcoll_radixtree_t *tree, const void *key, size_t length);
+
+size_t libcoll_radixtree_get_size(libcoll_radixtree_t *tree);
+
+char libcoll_radixtree_is_empty(libcoll_radixtree_t *tree);
+
+libcoll_radixtree_iter_t* libcoll_radixtree_get_iterator(libcoll_radixtree_t *tree);
+
+libcoll_radixtree_iter_t* libcoll_radixtree_get_prefix_iterator(libcoll_radixtree_t *tree,
+                                                                const void *prefix, size_t length);
+
+void libcoll_radixtree_free_iterator(libcoll_radixtree_iter_t *iterator);
+
+bool libcoll_radixtree_has_next(libcoll_radixtree_iter_t *iterator);
+
+libcoll_radixtree_leaf_t* libcoll_radixtree_next(libcoll_radixtree_iter_t *iterator);
+
+bool _libcoll_radixtree_verify(libcoll_radixtree_t *tree);
+
+#endif /* LIBCOLL_RADIXTREE_H */
@@ -0,0 +1,176 @@
+/*
+ * sortedfile.h
+ *
+ * A read-only ordered map of byte strings stored in a file of sorted blocks,
+ * and a writer for creating such files.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "treemap.h"
+
+#ifndef LIBCOLL_SORTEDFILE_H
+#define LIBCOLL_SORTEDFILE_H
+
+/* the size that blocks are filled up to unless another size is given */
+#define LIBCOLL_SORTEDFILE_DEFAULT_BLOCK_SIZE   4096
+
+/*
+ * A sorted file maps byte string keys to byte string values, with the keys
+ * ordered byte by byte, a key coming before any longer key it is a prefix of.
+ * The file is mapped into memory when opened and searched in place, so that
+ * opening even a very large file takes no time and the pages of the file are
+ * shared by all processes using it.
+ *
+ * The file starts with a header, followed by the entries in key order,
+ * divided into blocks of about the same size, and ends with the first key of
+ * each block and an index giving the offset and length of each block and of
+ * its first key.  A lookup binary searches the index using the first keys,
+ * which lie next to the index, so that only a single block is read and
+ * scanned.  All integers are stored in little-endian byte order, those
+ * within blocks as variable-length integers of seven bits per byte.
+ *
+ * Each entry consists of the number of leading bytes its key shares with the
+ * key of the previous entry of the block, the numbers of remaining key bytes
+ * and value bytes, and those bytes.  Without prefix compression, the whole
+ * key is always stored, and keys and values are both read in place.  With
+ * prefix compression, keys sharing long prefixes take less space, but
+ * iterators have to put the keys back together in buffers of their own.
+ */
+
+/* Gives the bytes of a key or value to store in a file, setting *length */
+typedef const void* (*libcoll_sortedfile_serializer)(const void *object, size_t *length);
+
+typedef struct libcoll_sortedfile_writer {
+    FILE *file;
+    size_t block_size;
+    bool prefix_compression;
+    bool failed;                /* set if writing failed, see libcoll_sortedfile_writer_close */
+    uint64_t offset;            /* bytes written so far */
+    uint64_t entry_count;
+    size_t max_key_length;
+    unsigned char *block;       /* the entries of the block being filled */
+    size_t block_length;
+    size_t block_capacity;
+    unsigned char *last_key;
+    size_t last_key_length;
+    size_t last_key_capacity;
+    unsigned char *first_keys;  /* the first key of each block, one after another */
+    size_t first_keys_length;
+    size_t first_keys_capacity;
+    size_t block_first_key;     /* offset of the first key of the block being filled */
+    uint64_t *index;            /* offset and length of each block written and of its first key */
+    size_t block_count;
+    size_t index_capacity;
+} libcoll_sortedfile_writer_t;
+
+typedef struct libcoll_sortedfile {
+    const unsigned char *data;
+    size_t length;
+    bool prefix_compression;
+    uint64_t size;
+    uint64_t block_count;
+    size_t max_key_length;
+    const unsigned char *index;
+} libcoll_sortedfile_t;
+
+typedef struct libcoll_sortedfile_entry {
+    const void *key;
+    size_t key_length;
+    const void *value;
+    size_t value_length;
+} libcoll_sortedfile_entry_t;
+
+/*
+ * An iterator reads the entries in key order, one entry ahead, up to the end
+ * of the file or the end key of a range iterator.  In a prefix compressed
+ * file, the keys are put together alternately in two buffers, so that the
+ * key of the entry last returned stays valid until the next call.
+ */
+typedef struct libcoll_sortedfile_iter {
+    const libcoll_sortedfile_t *file;
+    uint64_t block;
+    const unsigned char *position;      /* of the entry after the next one */
+    const unsigned char *block_end;
+    unsigned char *buffers[2];
+    int buffer;                         /* the buffer holding the key of the next entry */
+    const void *end_key;
+    size_t end_key_length;
+    bool bounded;
+    bool has_next;
+    libcoll_sortedfile_entry_t next;
+    libcoll_sortedfile_entry_t current;
+} libcoll_sortedfile_iter_t;
+
+
+/* external functions */
+
+libcoll_sortedfile_writer_t* libcoll_sortedfile_writer_open(const char *path, size_t block_size,
+                                                            bool prefix_compression);
+
+bool libcoll_sortedfile_writer_add(libcoll_sortedfile_writer_t *writer, const void *key, size_t key_length,
+                                   const void *value, size_t value_length);
+
+bool libcoll_sortedfile_writer_close(libcoll_sortedfile_writer_t *writer);
+
+bool libcoll_sortedfile_write_treemap(libcoll_treemap_t *tree, const char *path,
+                                      libcoll_sortedfile_serializer key_bytes,
+                                      libcoll_sortedfile_serializer value_bytes,
+                                      size_t block_size, bool prefix_compression);
+
+const void* libcoll_sortedfile_str_bytes(const void *object, size_t *length);
+
+libcoll_sortedfile_t* libcoll_sortedfile_open(const char *path);
+
+void libcoll_sortedfile_close(libcoll_sortedfile_t *file);
+
+const void* libcoll_sortedfile_get(const libcoll_sortedfile_t *file, const void *key, size_t length,
+                                   size_t *value_length);
+
+bool libcoll_sortedfile_contains(const libcoll_sortedfile_t *file, const void *key, size_t length);
+
+size_t libcoll_sortedfile_get_size(const libcoll_sortedfile_t *file);
+
+bool libcoll_sortedfile_init_iterator(libcoll_sortedfile_iter_t *iterator, const libcoll_sortedfile_t *file);
+
+bool libcoll_sortedfile_init_iterator_at(libcoll_sortedfile_iter_t *iterator, const libcoll_sortedfile_t *file,
+                                         const void *key, size_t length);
+
+bool libcoll_sortedfile_init_range_iterator(libcoll_sortedfile_iter_t *iterator,
+                                            const libcoll_sortedfile_t *file,
+                                            const void *start_key, size_t start_length,
+                                            const void *end_key, size_t end_length);
+
+void libcoll_sortedfile_deinit_iterator(libcoll_sortedfile_iter_t *iterator);
+
+bool libcoll_sortedfile_has_next(libcoll_sortedfile_iter_t *iterator);
+
+const libcoll_sortedfile_entry_t* libcoll_sortedfile_next(libcoll_sortedfile_iter_t *iterator);
+
+#endif /* LIBCOLL_SORTEDFILE_H */
@@ -28,6 +28,7 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "types.h"
@@ -37,33 +38,180 @@
 
 /* data types */
 
+/* An aggregate of the entries in a subtree, such as a count, a sum or a
+ * maximum of the values, computed by a monoid given to the tree
+ */
+typedef union libcoll_treemap_aggregate {
+    long long integer;
+    double real;
+    void *pointer;
+} libcoll_treemap_aggregate_t;
+
+/* A monoid for aggregating the entries of a tree.  combine must be
+ * associative, with identity as its identity element, but need not be
+ * commutative: it is always given the aggregate of smaller keys first.
+ */
+typedef struct libcoll_treemap_monoid {
+    libcoll_treemap_aggregate_t identity;
+    libcoll_treemap_aggregate_t (*of_entry)(const void *key, const void *value);
+    libcoll_treemap_aggregate_t (*combine)(libcoll_treemap_aggregate_t left, libcoll_treemap_aggregate_t right);
+} libcoll_treemap_monoid_t;
+
 /* A type for representing single nodes in the tree */
 typedef struct libcoll_treemap_node {
     struct libcoll_treemap_node *left;
     struct libcoll_treemap_node *right;
     struct libcoll_treemap_node *parent;
+    /* in-order neighbours, linked only in threaded trees and NULL otherwise;
+     * they take up room in the nodes of every tree
+     */
+    struct libcoll_treemap_node *next_in_order;
+    struct libcoll_treemap_node *previous_in_order;
     void *key;
     void *value;
+    size_t subtree_size;    /* number of nodes in the subtree rooted here */
     char color;
+    /* aggregate of the subtree rooted here, kept only if the tree has a monoid;
+     * like subtree_size, it takes up room in the nodes of every tree
+     */
+    libcoll_treemap_aggregate_t aggregate;
 } libcoll_treemap_node_t;
 
+/* Strategies for allocating the nodes of a tree */
+typedef enum {
+    /* each node is allocated and freed separately using malloc and free */
+    LIBCOLL_TREEMAP_ALLOC_MALLOC,
+    /* nodes are carved out of large blocks (slabs) owned by the tree, and
+     * removed nodes are kept on a free list for reuse; all slabs are freed at
+     * once when the tree is deinitialized
+     */
+    LIBCOLL_TREEMAP_ALLOC_SLAB
+} libcoll_treemap_allocation;
+
+/* Policies for keeping a tree balanced */
+typedef enum {
+    /* a red-black tree, whose height is at most 2 log n */
+    LIBCOLL_TREEMAP_BALANCE_RED_BLACK,
+    /* a splay tree, which moves each key added, found or removed to the root,
+     * so that keys used often stay near the top; operations take amortized
+     * O(log n) time, but a single one may take O(n) time
+     */
+    LIBCOLL_TREEMAP_BALANCE_SPLAY,
+    /* a treap, which keeps the nodes in heap order of a pseudo-random
+     * priority derived from the address of each node, for an expected height
+     * of O(log n) with fewer rotations per update than a red-black tree
+     */
+    LIBCOLL_TREEMAP_BALANCE_TREAP
+} libcoll_treemap_balancing;
+
+/* A block of nodes for slab allocation.  The slabs of a tree grow
+ * geometrically up to LIBCOLL_TREEMAP_MAX_SLAB_NODES nodes each.
+ */
+#define LIBCOLL_TREEMAP_MIN_SLAB_NODES  64
+#define LIBCOLL_TREEMAP_MAX_SLAB_NODES  65536
+
+typedef struct libcoll_treemap_slab {
+    struct libcoll_treemap_slab *next;
+    size_t capacity;
+    size_t used;
+    libcoll_treemap_node_t nodes[];
+} libcoll_treemap_slab_t;
+
+/* Counters of the work done by one kind of operation on a tree */
+typedef struct libcoll_treemap_op_counters {
+    uint64_t calls;
+    uint64_t comparisons;   /* calls of the comparator function */
+    uint64_t rotations;
+} libcoll_treemap_op_counters_t;
+
+/* Counters of the work done on a tree since it was initialized or its
+ * counters were reset.  They are only kept if the library is compiled with
+ * ENABLE_TREEMAP_STATS=1 defined and are zero otherwise, but the fields
+ * exist either way, so that programs need not be compiled to match.
+ */
+typedef struct libcoll_treemap_counters {
+    uint64_t comparisons;                       /* by all operations, including bulk ones */
+    uint64_t rotations;                         /* by all operations, including bulk ones */
+    libcoll_treemap_op_counters_t additions;    /* libcoll_treemap_add and libcoll_treemap_add_hint */
+    libcoll_treemap_op_counters_t removals;     /* libcoll_treemap_remove and removals through iterators */
+    libcoll_treemap_op_counters_t lookups;      /* libcoll_treemap_get and libcoll_treemap_contains */
+} libcoll_treemap_counters_t;
+
+/* Statistics on the shape, memory use and work done by a tree.  Nodes at
+ * depth LIBCOLL_TREEMAP_STATS_DEPTHS - 1 or deeper are all counted in the
+ * last element of the depth histogram.
+ */
+#define LIBCOLL_TREEMAP_STATS_DEPTHS    64
+
+typedef struct libcoll_treemap_stats {
+    size_t size;
+    int height;                 /* number of levels, 0 for an empty tree */
+    int black_height;           /* black nodes on any path down from the root, 0 unless red-black */
+    double average_depth;       /* the root being at depth 0 */
+    size_t depth_counts[LIBCOLL_TREEMAP_STATS_DEPTHS];
+    size_t node_size;           /* bytes per node */
+    size_t node_memory;         /* bytes allocated for nodes, including unused slab space */
+    libcoll_treemap_counters_t counters;
+} libcoll_treemap_stats_t;
+
 /* A type for representing the tree itself, for holding useful metadata */
 typedef struct libcoll_treemap {
     size_t size;
     libcoll_treemap_node_t *root;
     int (*key_comparator)(const void *key1, const void *key2);
+    libcoll_treemap_allocation allocation;
+    libcoll_treemap_slab_t *slabs;          /* most recently allocated first */
+    libcoll_treemap_node_t *free_nodes;     /* linked through parent pointers */
+    bool threaded;                          /* see libcoll_treemap_set_threaded */
+    bool parallel;                          /* see libcoll_treemap_set_parallel */
+    const libcoll_treemap_monoid_t *monoid; /* see libcoll_treemap_set_monoid */
+    libcoll_treemap_balancing balancing;    /* see libcoll_treemap_set_balancing */
+    libcoll_treemap_counters_t counters;    /* see libcoll_treemap_get_stats */
 } libcoll_treemap_t;
 
 /* An iterator for iterating through the nodes of a tree in the order of
  * keys as defined by the comparator function (e.g. alphabetical order).
+ *
+ * A range iterator stops at the nodes just outside its range: end is the
+ * first node past the range and before_start the last node before it.
  */
 typedef struct libcoll_treemap_iter {
     libcoll_treemap_t *tree;
     libcoll_treemap_node_t *previous;
     libcoll_treemap_node_t *next;
     libcoll_treemap_node_t *last_traversed_node;
+    libcoll_treemap_node_t *end;
+    libcoll_treemap_node_t *before_start;
 } libcoll_treemap_iter_t;
 
+/* A read-only copy of the entries of a tree, made by libcoll_treemap_freeze.
+ *
+ * The entries are stored in arrays in Eytzinger order, i.e. in the order of a
+ * breadth-first walk of a complete binary search tree, starting from index 1.
+ * The children of the entry at index k are at 2k and 2k + 1, so a search
+ * reads the arrays from the front, and the entries it reads next are found
+ * by arithmetic rather than by following pointers.
+ *
+ * For the built-in comparators that compare integers or addresses, an
+ * order-preserving integer for each key is stored in ordinals, so that
+ * searching does not touch the keys at all.  Otherwise ordinals is NULL.
+ */
+typedef struct libcoll_treemap_frozen {
+    size_t size;
+    void **keys;
+    void **values;
+    uintptr_t *ordinals;
+    int (*key_comparator)(const void *key1, const void *key2);
+} libcoll_treemap_frozen_t;
+
+/* An iterator over a frozen tree, positioned at the index of the next entry,
+ * or at 0 when at the end.
+ */
+typedef struct libcoll_treemap_frozen_iter {
+    const libcoll_treemap_frozen_t *frozen;
+    size_t position;
+} libcoll_treemap_frozen_iter_t;
+
 
 /* external functions */
 
@@ -71,30 +219,95 @@ libcoll_treemap_t* libcoll_treemap_init();
 
 libcoll_treemap_t* libcoll_treemap_init_with_comparator(int (*key_comparator_func)(const void *key1, const void *key2));
 
+libcoll_treemap_t* libcoll_treemap_init_with_params(int (*key_comparator_func)(const void *key1, const void *key2),
+                                                    libcoll_treemap_allocation allocation);
+
 void libcoll_treemap_deinit(libcoll_treemap_t *tree);
 
+bool libcoll_treemap_build_sorted(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs, size_t count);
+
+void libcoll_treemap_set_threaded(libcoll_treemap_t *tree, bool threaded);
+
+void libcoll_treemap_set_parallel(libcoll_treemap_t *tree, bool parallel);
+
+void libcoll_treemap_set_monoid(libcoll_treemap_t *tree, const libcoll_treemap_monoid_t *monoid);
+
+bool libcoll_treemap_set_balancing(libcoll_treemap_t *tree, libcoll_treemap_balancing balancing);
+
+libcoll_treemap_aggregate_t libcoll_treemap_aggregate_range(libcoll_treemap_t *tree, const void *start_key,
+                                                            const void *end_key);
+
+void libcoll_treemap_set_value(libcoll_treemap_t *tree, libcoll_treemap_node_t *node, void *value);
+
+size_t libcoll_treemap_flatten(libcoll_treemap_t *tree, libcoll_pair_voidptr_t *pairs);
+
+libcoll_treemap_t* libcoll_treemap_split(libcoll_treemap_t *tree, const void *key);
+
+bool libcoll_treemap_join(libcoll_treemap_t *tree, libcoll_treemap_t *other);
+
+bool libcoll_treemap_union(libcoll_treemap_t *tree, libcoll_treemap_t *other);
+
+bool libcoll_treemap_intersection(libcoll_treemap_t *tree, libcoll_treemap_t *other);
+
+bool libcoll_treemap_difference(libcoll_treemap_t *tree, libcoll_treemap_t *other);
+
 void libcoll_treemap_deinit_and_delete_contents(libcoll_treemap_t *tree);
 
 libcoll_treemap_node_t* libcoll_treemap_add(libcoll_treemap_t *tree, void *key, void *value);
 
+libcoll_treemap_node_t* libcoll_treemap_add_hint(libcoll_treemap_t *tree, libcoll_treemap_node_t *hint,
+                                                 void *key, void *value);
+
+bool libcoll_treemap_add_batch(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs, size_t count);
+
 libcoll_treemap_node_t* libcoll_treemap_get(libcoll_treemap_t *tree, void *key);
 
 bool libcoll_treemap_contains(libcoll_treemap_t *tree, void *key);
 
 libcoll_pair_voidptr_t libcoll_treemap_remove(libcoll_treemap_t *tree, void *key);
 
+libcoll_treemap_node_t* libcoll_treemap_floor(libcoll_treemap_t *tree, const void *key);
+
+libcoll_treemap_node_t* libcoll_treemap_ceiling(libcoll_treemap_t *tree, const void *key);
+
+libcoll_treemap_node_t* libcoll_treemap_lower_bound(libcoll_treemap_t *tree, const void *key);
+
+libcoll_treemap_node_t* libcoll_treemap_upper_bound(libcoll_treemap_t *tree, const void *key);
+
 libcoll_treemap_node_t* libcoll_treemap_get_successor(libcoll_treemap_node_t *node);
 
 libcoll_treemap_node_t* libcoll_treemap_get_predecessor(libcoll_treemap_node_t *node);
 
+bool libcoll_treemap_is_null_node(const libcoll_treemap_node_t *node);
+
+size_t libcoll_treemap_rank(libcoll_treemap_t *tree, const void *key);
+
+libcoll_treemap_node_t* libcoll_treemap_select(libcoll_treemap_t *tree, size_t index);
+
+size_t libcoll_treemap_count_range(libcoll_treemap_t *tree, const void *start_key, const void *end_key);
+
 int libcoll_treemap_depth_of(libcoll_treemap_t *tree, void *key);
 
 size_t libcoll_treemap_get_size(libcoll_treemap_t *tree);
 
+void libcoll_treemap_get_stats(libcoll_treemap_t *tree, libcoll_treemap_stats_t *stats);
+
+void libcoll_treemap_reset_counters(libcoll_treemap_t *tree);
+
 char libcoll_treemap_is_empty(libcoll_treemap_t *tree);
 
 libcoll_treemap_iter_t* libcoll_treemap_get_iterator(libcoll_treemap_t *tree);
 
+libcoll_treemap_iter_t* libcoll_treemap_get_iterator_at(libcoll_treemap_t *tree, const void *key);
+
+libcoll_treemap_iter_t* libcoll_treemap_get_range_iterator(libcoll_treemap_t *tree, const void *start_key, const void *end_key);
+
+void libcoll_treemap_init_iterator(libcoll_treemap_iter_t *iterator, libcoll_treemap_t *tree);
+
+void libcoll_treemap_init_iterator_at(libcoll_treemap_iter_t *iterator, libcoll_treemap_t *tree, const void *key);
+
+void libcoll_treemap_init_range_iterator(libcoll_treemap_iter_t *iterator, libcoll_treemap_t *tree, const void *start_key, const void *end_key);
+
 void libcoll_treemap_free_iterator(libcoll_treemap_iter_t *iterator);
 
 bool libcoll_treemap_has_next(libcoll_treemap_iter_t *iterator);
@@ -107,6 +320,28 @@ libcoll_treemap_node_t* libcoll_treemap_previous(libcoll_treemap_iter_t *iterato
 
 libcoll_pair_voidptr_t libcoll_treemap_remove_last_traversed(libcoll_treemap_iter_t *iterator);
 
+libcoll_treemap_frozen_t* libcoll_treemap_freeze(libcoll_treemap_t *tree);
+
+void libcoll_treemap_frozen_deinit(libcoll_treemap_frozen_t *frozen);
+
+void* libcoll_treemap_frozen_get(const libcoll_treemap_frozen_t *frozen, const void *key);
+
+bool libcoll_treemap_frozen_contains(const libcoll_treemap_frozen_t *frozen, const void *key);
+
+libcoll_pair_voidptr_t libcoll_treemap_frozen_lower_bound(const libcoll_treemap_frozen_t *frozen, const void *key);
+
+size_t libcoll_treemap_frozen_get_size(const libcoll_treemap_frozen_t *frozen);
+
+void libcoll_treemap_frozen_init_iterator(libcoll_treemap_frozen_iter_t *iterator,
+                                          const libcoll_treemap_frozen_t *frozen);
+
+void libcoll_treemap_frozen_init_iterator_at(libcoll_treemap_frozen_iter_t *iterator,
+                                             const libcoll_treemap_frozen_t *frozen, const void *key);
+
+bool libcoll_treemap_frozen_has_next(libcoll_treemap_frozen_iter_t *iterator);
+
+libcoll_pair_voidptr_t libcoll_treemap_frozen_next(libcoll_treemap_frozen_iter_t *iterator);
+
 bool _libcoll_treemap_verify_red_black_conditions(libcoll_treemap_t *tree);
 
 
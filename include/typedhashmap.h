@@ -0,0 +1,252 @@
+/*
+ * typedhashmap.h
+ *
+ * Macros for generating hashmaps specialized for given key and value types.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "map.h"
+
+#ifndef LIBCOLL_TYPEDHASHMAP_H
+#define LIBCOLL_TYPEDHASHMAP_H
+
+#define LIBCOLL_TYPEDHASHMAP_DEFAULT_INIT_SIZE      16
+
+/* maximum load factor, as a fraction */
+#define LIBCOLL_TYPEDHASHMAP_LOAD_NUMERATOR         3
+#define LIBCOLL_TYPEDHASHMAP_LOAD_DENOMINATOR       4
+
+/* 2^64 divided by the golden ratio, for Fibonacci hashing */
+#define LIBCOLL_TYPEDHASHMAP_MULTIPLIER             0x9E3779B97F4A7C15ULL
+
+/*
+ * Convenience hash and equality functions for use with LIBCOLL_DEFINE_HASHMAP
+ * for key types that can be compared with == and converted to an integer.
+ * An identity hash is sufficient since the hash value is further mixed
+ * by the hashmap.
+ */
+#define LIBCOLL_TYPEDHASHMAP_HASH_INTEGER(key)      ((uint64_t) (key))
+#define LIBCOLL_TYPEDHASHMAP_EQ_DEFAULT(key1, key2) ((key1) == (key2))
+
+/*
+ * Defines a hashmap type called name##_t that maps keys of type K to values
+ * of type V, with both stored by value in the slots of the map, along with
+ * static inline functions for operating on it:
+ *
+ *      name##_t*  name##_init(void)
+ *      name##_t*  name##_init_with_capacity(size_t init_capacity)
+ *      void       name##_deinit(name##_t *hm)
+ *      libcoll_map_insertion_status name##_put(name##_t *hm, K key, V value)
+ *      V*         name##_get(const name##_t *hm, K key)
+ *      char       name##_contains(const name##_t *hm, K key)
+ *      char       name##_remove(name##_t *hm, K key, V *value)
+ *      size_t     name##_get_size(const name##_t *hm)
+ *      name##_entry_t* name##_iter_next(name##_t *hm, size_t *position)
+ *
+ * hash_fn(key) must evaluate to an integer hash value for a key, and
+ * eq_fn(key1, key2) to nonzero if the keys are equal and zero if not.
+ * Either may be a function or a function-like macro.  Since they are called
+ * directly rather than through function pointers, the compiler can inline
+ * them into the lookup loops.
+ *
+ * name##_get returns a pointer to the value stored in the map, which stays
+ * valid until the map is next modified.  For iteration, name##_iter_next is
+ * called with a position initialized to zero until it returns NULL.
+ *
+ * Example:
+ *
+ *      LIBCOLL_DEFINE_HASHMAP(counts, uint64_t, int,
+ *                             LIBCOLL_TYPEDHASHMAP_HASH_INTEGER,
+ *                             LIBCOLL_TYPEDHASHMAP_EQ_DEFAULT)
+ *
+ *      counts_t *map = counts_init();
+ *      counts_put(map, 42, 1);
+ *      int *count = counts_get(map, 42);
+ */
+#define LIBCOLL_DEFINE_HASHMAP(name, K, V, hash_fn, eq_fn)                          \
+typedef struct name##_entry {                                                       \
+    K key;                                                                          \
+    V value;                                                                        \
+} name##_entry_t;                                                                   \
+                                                                                    \
+typedef struct name {                                                               \
+    name##_entry_t *slots;                                                          \
+    unsigned char *occupied;                                                        \
+    size_t capacity;                                                                \
+    size_t total_entries;                                                           \
+    unsigned int hash_shift;                                                        \
+} name##_t;                                                                         \
+                                                                                    \
+static inline size_t name##_home_slot(const name##_t *hm, K key)                    \
+{                                                                                   \
+    uint64_t h = (uint64_t) hash_fn(key);                                           \
+    return (size_t) ((h * LIBCOLL_TYPEDHASHMAP_MULTIPLIER) >> hm->hash_shift);      \
+}                                                                                   \
+                                                                                    \
+static inline name##_t* name##_init_with_capacity(size_t init_capacity)             \
+{                                                                                   \
+    name##_t *hm = malloc(sizeof(name##_t));                                        \
+    size_t capacity = 8;                                                            \
+    unsigned int shift = 61;                                                        \
+    while (capacity < init_capacity) {                                              \
+        capacity *= 2;                                                              \
+        shift--;                                                                    \
+    }                                                                               \
+    hm->slots = malloc(capacity * sizeof(name##_entry_t));                          \
+    hm->occupied = calloc(capacity, 1);                                             \
+    hm->capacity = capacity;                                                        \
+    hm->total_entries = 0;                                                          \
+    hm->hash_shift = shift;                                                         \
+    return hm;                                                                      \
+}                                                                                   \
+                                                                                    \
+static inline name##_t* name##_init(void)                                           \
+{                                                                                   \
+    return name##_init_with_capacity(LIBCOLL_TYPEDHASHMAP_DEFAULT_INIT_SIZE);       \
+}                                                                                   \
+                                                                                    \
+static inline void name##_deinit(name##_t *hm)                                      \
+{                                                                                   \
+    free(hm->slots);                                                                \
+    free(hm->occupied);                                                             \
+    free(hm);                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline size_t name##_find_slot(const name##_t *hm, K key)                    \
+{                                                                                   \
+    size_t mask = hm->capacity - 1;                                                 \
+    size_t index = name##_home_slot(hm, key);                                       \
+    while (hm->occupied[index]) {                                                   \
+        if (eq_fn(hm->slots[index].key, key)) {                                     \
+            return index;                                                           \
+        }                                                                           \
+        index = (index + 1) & mask;                                                 \
+    }                                                                               \
+    return hm->capacity;                                                            \
+}                                                                                   \
+                                                                                    \
+static inline size_t name##_insert_new(name##_t *hm, K key, V value)                \
+{                                                                                   \
+    size_t mask = hm->capacity - 1;                                                 \
+    size_t index = name##_home_slot(hm, key);                                       \
+    while (hm->occupied[index]) {                                                   \
+        index = (index + 1) & mask;                                                 \
+    }                                                                               \
+    hm->slots[index].key = key;                                                     \
+    hm->slots[index].value = value;                                                 \
+    hm->occupied[index] = 1;                                                        \
+    return index;                                                                   \
+}                                                                                   \
+                                                                                    \
+static inline void name##_grow(name##_t *hm)                                        \
+{                                                                                   \
+    size_t old_cap = hm->capacity;                                                  \
+    name##_entry_t *old_slots = hm->slots;                                          \
+    unsigned char *old_occupied = hm->occupied;                                     \
+                                                                                    \
+    hm->capacity = old_cap * 2;                                                     \
+    hm->hash_shift--;                                                               \
+    hm->slots = malloc(hm->capacity * sizeof(name##_entry_t));                      \
+    hm->occupied = calloc(hm->capacity, 1);                                         \
+    for (size_t i=0; i<old_cap; i++) {                                              \
+        if (old_occupied[i]) {                                                      \
+            name##_insert_new(hm, old_slots[i].key, old_slots[i].value);            \
+        }                                                                           \
+    }                                                                               \
+    free(old_slots);                                                                \
+    free(old_occupied);                                                             \
+}                                                                                   \
+                                                                                    \
+static inline V* name##_get(const name##_t *hm, K key)                              \
+{                                                                                   \
+    size_t index = name##_find_slot(hm, key);                                       \
+    return index != hm->capacity ? &hm->slots[index].value : NULL;                  \
+}                                                                                   \
+                                                                                    \
+static inline char name##_contains(const name##_t *hm, K key)                       \
+{                                                                                   \
+    return name##_find_slot(hm, key) != hm->capacity;                               \
+}                                                                                   \
+                                                                                    \
+static inline libcoll_map_insertion_status name##_put(name##_t *hm, K key, V value) \
+{                                                                                   \
+    size_t index = name##_find_slot(hm, key);                                       \
+    if (index != hm->capacity) {                                                    \
+        hm->slots[index].value = value;                                             \
+        return MAP_ENTRY_REPLACED;                                                  \
+    }                                                                               \
+    if ((hm->total_entries + 1) * LIBCOLL_TYPEDHASHMAP_LOAD_DENOMINATOR             \
+            > hm->capacity * LIBCOLL_TYPEDHASHMAP_LOAD_NUMERATOR) {                 \
+        name##_grow(hm);                                                            \
+    }                                                                               \
+    name##_insert_new(hm, key, value);                                              \
+    hm->total_entries++;                                                            \
+    return MAP_ENTRY_ADDED;                                                         \
+}                                                                                   \
+                                                                                    \
+static inline char name##_remove(name##_t *hm, K key, V *value)                     \
+{                                                                                   \
+    size_t mask = hm->capacity - 1;                                                 \
+    size_t hole = name##_find_slot(hm, key);                                        \
+    if (hole == hm->capacity) {                                                     \
+        return 0;                                                                   \
+    }                                                                               \
+    if (NULL != value) {                                                            \
+        *value = hm->slots[hole].value;                                             \
+    }                                                                               \
+    size_t index = (hole + 1) & mask;                                               \
+    while (hm->occupied[index]) {                                                   \
+        size_t home = name##_home_slot(hm, hm->slots[index].key);                   \
+        if (((index - home) & mask) >= ((index - hole) & mask)) {                   \
+            hm->slots[hole] = hm->slots[index];                                     \
+            hole = index;                                                           \
+        }                                                                           \
+        index = (index + 1) & mask;                                                 \
+    }                                                                               \
+    hm->occupied[hole] = 0;                                                         \
+    hm->total_entries--;                                                            \
+    return 1;                                                                       \
+}                                                                                   \
+                                                                                    \
+static inline size_t name##_get_size(const name##_t *hm)                            \
+{                                                                                   \
+    return hm->total_entries;                                                       \
+}                                                                                   \
+                                                                                    \
+static inline name##_entry_t* name##_iter_next(name##_t *hm, size_t *position)      \
+{                                                                                   \
+    while (*position < hm->capacity) {                                              \
+        size_t index = (*position)++;                                               \
+        if (hm->occupied[index]) {                                                  \
+            return &hm->slots[index];                                               \
+        }                                                                           \
+    }                                                                               \
+    return NULL;                                                                    \
+}
+
+#endif  /* LIBCOLL_TYPEDHASHMAP_H */
@@ -0,0 +1,457 @@
+/*
+ * typedtreemap.h
+ *
+ * Macros for generating treemaps specialized for given key and value types.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "map.h"
+
+#ifndef LIBCOLL_TYPEDTREEMAP_H
+#define LIBCOLL_TYPEDTREEMAP_H
+
+#define LIBCOLL_TYPEDTREEMAP_RED    0
+#define LIBCOLL_TYPEDTREEMAP_BLACK  1
+
+/*
+ * Convenience comparison function for use with LIBCOLL_DEFINE_TREEMAP
+ * for key types that can be compared with < and >, such as integers.
+ */
+#define LIBCOLL_TYPEDTREEMAP_CMP_DEFAULT(key1, key2) \
+    (((key1) > (key2)) - ((key1) < (key2)))
+
+/*
+ * Defines a treemap type called name##_t that maps keys of type K to values
+ * of type V, with both stored by value in the nodes of the tree, along with
+ * static inline functions for operating on it:
+ *
+ *      name##_t*  name##_init(void)
+ *      void       name##_deinit(name##_t *tree)
+ *      libcoll_map_insertion_status name##_put(name##_t *tree, K key, V value)
+ *      V*         name##_get(const name##_t *tree, K key)
+ *      name##_node_t* name##_get_node(const name##_t *tree, K key)
+ *      char       name##_contains(const name##_t *tree, K key)
+ *      char       name##_remove(name##_t *tree, K key, V *value)
+ *      void       name##_remove_node(name##_t *tree, name##_node_t *node)
+ *      size_t     name##_get_size(const name##_t *tree)
+ *      name##_node_t* name##_first(const name##_t *tree)
+ *      name##_node_t* name##_last(const name##_t *tree)
+ *      name##_node_t* name##_next(const name##_node_t *node)
+ *      name##_node_t* name##_previous(const name##_node_t *node)
+ *
+ * Like libcoll_treemap_t, the tree is a red-black tree.  cmp_fn(key1, key2)
+ * must evaluate to a negative value, zero or a positive value when key1 is
+ * less than, equal to or greater than key2, respectively.  It may be a
+ * function or a function-like macro, and is called directly, allowing the
+ * compiler to inline it.
+ *
+ * Nodes are iterated in key order by starting from name##_first (or
+ * name##_last) and calling name##_next (or name##_previous) until NULL is
+ * returned.  The key and value of a node are accessible as node->key and
+ * node->value.  Unlike with libcoll_treemap_t, removing a node never moves
+ * the contents of other nodes, so pointers to other nodes stay valid.
+ *
+ * Example:
+ *
+ *      LIBCOLL_DEFINE_TREEMAP(events, int64_t, struct event,
+ *                             LIBCOLL_TYPEDTREEMAP_CMP_DEFAULT)
+ */
+#define LIBCOLL_DEFINE_TREEMAP(name, K, V, cmp_fn)                                                      \
+typedef struct name##_node {                                                                            \
+    struct name##_node *left;                                                                           \
+    struct name##_node *right;                                                                          \
+    struct name##_node *parent;                                                                         \
+    K key;                                                                                              \
+    V value;                                                                                            \
+    char color;                                                                                         \
+} name##_node_t;                                                                                        \
+                                                                                                        \
+typedef struct name {                                                                                   \
+    name##_node_t *root;                                                                                \
+    size_t size;                                                                                        \
+} name##_t;                                                                                             \
+                                                                                                        \
+static inline name##_t* name##_init(void)                                                               \
+{                                                                                                       \
+    name##_t *tree = malloc(sizeof(name##_t));                                                          \
+    tree->root = NULL;                                                                                  \
+    tree->size = 0;                                                                                     \
+    return tree;                                                                                        \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_deinit(name##_t *tree)                                                        \
+{                                                                                                       \
+    /* free nodes iteratively by descending to leaves and freeing upwards */                            \
+    name##_node_t *node = tree->root;                                                                   \
+    while (NULL != node) {                                                                              \
+        if (NULL != node->left) {                                                                       \
+            node = node->left;                                                                          \
+        } else if (NULL != node->right) {                                                               \
+            node = node->right;                                                                         \
+        } else {                                                                                        \
+            name##_node_t *parent = node->parent;                                                       \
+            if (NULL != parent) {                                                                       \
+                if (parent->left == node) {                                                             \
+                    parent->left = NULL;                                                                \
+                } else {                                                                                \
+                    parent->right = NULL;                                                               \
+                }                                                                                       \
+            }                                                                                           \
+            free(node);                                                                                 \
+            node = parent;                                                                              \
+        }                                                                                               \
+    }                                                                                                   \
+    free(tree);                                                                                         \
+}                                                                                                       \
+                                                                                                        \
+static inline char name##_is_red(const name##_node_t *node)                                             \
+{                                                                                                       \
+    return NULL != node && node->color == LIBCOLL_TYPEDTREEMAP_RED;                                     \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_rotate_left(name##_t *tree, name##_node_t *node)                              \
+{                                                                                                       \
+    name##_node_t *pivot = node->right;                                                                 \
+    node->right = pivot->left;                                                                          \
+    if (NULL != pivot->left) {                                                                          \
+        pivot->left->parent = node;                                                                     \
+    }                                                                                                   \
+    pivot->parent = node->parent;                                                                       \
+    if (NULL == node->parent) {                                                                         \
+        tree->root = pivot;                                                                             \
+    } else if (node == node->parent->left) {                                                            \
+        node->parent->left = pivot;                                                                     \
+    } else {                                                                                            \
+        node->parent->right = pivot;                                                                    \
+    }                                                                                                   \
+    pivot->left = node;                                                                                 \
+    node->parent = pivot;                                                                               \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_rotate_right(name##_t *tree, name##_node_t *node)                             \
+{                                                                                                       \
+    name##_node_t *pivot = node->left;                                                                  \
+    node->left = pivot->right;                                                                          \
+    if (NULL != pivot->right) {                                                                         \
+        pivot->right->parent = node;                                                                    \
+    }                                                                                                   \
+    pivot->parent = node->parent;                                                                       \
+    if (NULL == node->parent) {                                                                         \
+        tree->root = pivot;                                                                             \
+    } else if (node == node->parent->right) {                                                           \
+        node->parent->right = pivot;                                                                    \
+    } else {                                                                                            \
+        node->parent->left = pivot;                                                                     \
+    }                                                                                                   \
+    pivot->right = node;                                                                                \
+    node->parent = pivot;                                                                               \
+}                                                                                                       \
+                                                                                                        \
+static inline name##_node_t* name##_get_node(const name##_t *tree, K key)                               \
+{                                                                                                       \
+    name##_node_t *node = tree->root;                                                                   \
+    while (NULL != node) {                                                                              \
+        int cmpval = cmp_fn(key, node->key);                                                            \
+        if (cmpval < 0) {                                                                               \
+            node = node->left;                                                                          \
+        } else if (cmpval > 0) {                                                                        \
+            node = node->right;                                                                         \
+        } else {                                                                                        \
+            return node;                                                                                \
+        }                                                                                               \
+    }                                                                                                   \
+    return NULL;                                                                                        \
+}                                                                                                       \
+                                                                                                        \
+static inline V* name##_get(const name##_t *tree, K key)                                                \
+{                                                                                                       \
+    name##_node_t *node = name##_get_node(tree, key);                                                   \
+    return NULL != node ? &node->value : NULL;                                                          \
+}                                                                                                       \
+                                                                                                        \
+static inline char name##_contains(const name##_t *tree, K key)                                         \
+{                                                                                                       \
+    return NULL != name##_get_node(tree, key);                                                          \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_fix_after_addition(name##_t *tree, name##_node_t *node)                       \
+{                                                                                                       \
+    while (name##_is_red(node->parent)) {                                                               \
+        name##_node_t *parent = node->parent;                                                           \
+        name##_node_t *grandparent = parent->parent;                                                    \
+        if (parent == grandparent->left) {                                                              \
+            name##_node_t *uncle = grandparent->right;                                                  \
+            if (name##_is_red(uncle)) {                                                                 \
+                parent->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                             \
+                uncle->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                              \
+                grandparent->color = LIBCOLL_TYPEDTREEMAP_RED;                                          \
+                node = grandparent;                                                                     \
+            } else {                                                                                    \
+                if (node == parent->right) {                                                            \
+                    node = parent;                                                                      \
+                    name##_rotate_left(tree, node);                                                     \
+                }                                                                                       \
+                node->parent->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                       \
+                node->parent->parent->color = LIBCOLL_TYPEDTREEMAP_RED;                                 \
+                name##_rotate_right(tree, node->parent->parent);                                        \
+            }                                                                                           \
+        } else {                                                                                        \
+            name##_node_t *uncle = grandparent->left;                                                   \
+            if (name##_is_red(uncle)) {                                                                 \
+                parent->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                             \
+                uncle->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                              \
+                grandparent->color = LIBCOLL_TYPEDTREEMAP_RED;                                          \
+                node = grandparent;                                                                     \
+            } else {                                                                                    \
+                if (node == parent->left) {                                                             \
+                    node = parent;                                                                      \
+                    name##_rotate_right(tree, node);                                                    \
+                }                                                                                       \
+                node->parent->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                       \
+                node->parent->parent->color = LIBCOLL_TYPEDTREEMAP_RED;                                 \
+                name##_rotate_left(tree, node->parent->parent);                                         \
+            }                                                                                           \
+        }                                                                                               \
+    }                                                                                                   \
+    tree->root->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                                     \
+}                                                                                                       \
+                                                                                                        \
+static inline libcoll_map_insertion_status name##_put(name##_t *tree, K key, V value)                   \
+{                                                                                                       \
+    name##_node_t *parent = NULL;                                                                       \
+    name##_node_t **link = &tree->root;                                                                 \
+    while (NULL != *link) {                                                                             \
+        parent = *link;                                                                                 \
+        int cmpval = cmp_fn(key, parent->key);                                                          \
+        if (cmpval < 0) {                                                                               \
+            link = &parent->left;                                                                       \
+        } else if (cmpval > 0) {                                                                        \
+            link = &parent->right;                                                                      \
+        } else {                                                                                        \
+            parent->value = value;                                                                      \
+            return MAP_ENTRY_REPLACED;                                                                  \
+        }                                                                                               \
+    }                                                                                                   \
+    name##_node_t *node = malloc(sizeof(name##_node_t));                                                \
+    node->left = node->right = NULL;                                                                    \
+    node->parent = parent;                                                                              \
+    node->key = key;                                                                                    \
+    node->value = value;                                                                                \
+    node->color = LIBCOLL_TYPEDTREEMAP_RED;                                                             \
+    *link = node;                                                                                       \
+    name##_fix_after_addition(tree, node);                                                              \
+    tree->size++;                                                                                       \
+    return MAP_ENTRY_ADDED;                                                                             \
+}                                                                                                       \
+                                                                                                        \
+static inline name##_node_t* name##_first(const name##_t *tree)                                         \
+{                                                                                                       \
+    name##_node_t *node = tree->root;                                                                   \
+    if (NULL != node) {                                                                                 \
+        while (NULL != node->left) {                                                                    \
+            node = node->left;                                                                          \
+        }                                                                                               \
+    }                                                                                                   \
+    return node;                                                                                        \
+}                                                                                                       \
+                                                                                                        \
+static inline name##_node_t* name##_last(const name##_t *tree)                                          \
+{                                                                                                       \
+    name##_node_t *node = tree->root;                                                                   \
+    if (NULL != node) {                                                                                 \
+        while (NULL != node->right) {                                                                   \
+            node = node->right;                                                                         \
+        }                                                                                               \
+    }                                                                                                   \
+    return node;                                                                                        \
+}                                                                                                       \
+                                                                                                        \
+static inline name##_node_t* name##_next(const name##_node_t *node)                                     \
+{                                                                                                       \
+    if (NULL != node->right) {                                                                          \
+        node = node->right;                                                                             \
+        while (NULL != node->left) {                                                                    \
+            node = node->left;                                                                          \
+        }                                                                                               \
+        return (name##_node_t*) node;                                                                   \
+    }                                                                                                   \
+    while (NULL != node->parent && node == node->parent->right) {                                       \
+        node = node->parent;                                                                            \
+    }                                                                                                   \
+    return node->parent;                                                                                \
+}                                                                                                       \
+                                                                                                        \
+static inline name##_node_t* name##_previous(const name##_node_t *node)                                 \
+{                                                                                                       \
+    if (NULL != node->left) {                                                                           \
+        node = node->left;                                                                              \
+        while (NULL != node->right) {                                                                   \
+            node = node->right;                                                                         \
+        }                                                                                               \
+        return (name##_node_t*) node;                                                                   \
+    }                                                                                                   \
+    while (NULL != node->parent && node == node->parent->left) {                                        \
+        node = node->parent;                                                                            \
+    }                                                                                                   \
+    return node->parent;                                                                                \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_transplant(name##_t *tree, name##_node_t *old, name##_node_t *new)            \
+{                                                                                                       \
+    if (NULL == old->parent) {                                                                          \
+        tree->root = new;                                                                               \
+    } else if (old == old->parent->left) {                                                              \
+        old->parent->left = new;                                                                        \
+    } else {                                                                                            \
+        old->parent->right = new;                                                                       \
+    }                                                                                                   \
+    if (NULL != new) {                                                                                  \
+        new->parent = old->parent;                                                                      \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_fix_after_removal(name##_t *tree, name##_node_t *node, name##_node_t *parent) \
+{                                                                                                       \
+    while (node != tree->root && !name##_is_red(node)) {                                                \
+        if (node == parent->left) {                                                                     \
+            name##_node_t *sibling = parent->right;                                                     \
+            if (name##_is_red(sibling)) {                                                               \
+                sibling->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                            \
+                parent->color = LIBCOLL_TYPEDTREEMAP_RED;                                               \
+                name##_rotate_left(tree, parent);                                                       \
+                sibling = parent->right;                                                                \
+            }                                                                                           \
+            if (!name##_is_red(sibling->left) && !name##_is_red(sibling->right)) {                      \
+                sibling->color = LIBCOLL_TYPEDTREEMAP_RED;                                              \
+                node = parent;                                                                          \
+                parent = node->parent;                                                                  \
+            } else {                                                                                    \
+                if (!name##_is_red(sibling->right)) {                                                   \
+                    sibling->left->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                  \
+                    sibling->color = LIBCOLL_TYPEDTREEMAP_RED;                                          \
+                    name##_rotate_right(tree, sibling);                                                 \
+                    sibling = parent->right;                                                            \
+                }                                                                                       \
+                sibling->color = parent->color;                                                         \
+                parent->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                             \
+                sibling->right->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                     \
+                name##_rotate_left(tree, parent);                                                       \
+                node = tree->root;                                                                      \
+            }                                                                                           \
+        } else {                                                                                        \
+            name##_node_t *sibling = parent->left;                                                      \
+            if (name##_is_red(sibling)) {                                                               \
+                sibling->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                            \
+                parent->color = LIBCOLL_TYPEDTREEMAP_RED;                                               \
+                name##_rotate_right(tree, parent);                                                      \
+                sibling = parent->left;                                                                 \
+            }                                                                                           \
+            if (!name##_is_red(sibling->left) && !name##_is_red(sibling->right)) {                      \
+                sibling->color = LIBCOLL_TYPEDTREEMAP_RED;                                              \
+                node = parent;                                                                          \
+                parent = node->parent;                                                                  \
+            } else {                                                                                    \
+                if (!name##_is_red(sibling->left)) {                                                    \
+                    sibling->right->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                 \
+                    sibling->color = LIBCOLL_TYPEDTREEMAP_RED;                                          \
+                    name##_rotate_left(tree, sibling);                                                  \
+                    sibling = parent->left;                                                             \
+                }                                                                                       \
+                sibling->color = parent->color;                                                         \
+                parent->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                             \
+                sibling->left->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                      \
+                name##_rotate_right(tree, parent);                                                      \
+                node = tree->root;                                                                      \
+            }                                                                                           \
+        }                                                                                               \
+    }                                                                                                   \
+    if (NULL != node) {                                                                                 \
+        node->color = LIBCOLL_TYPEDTREEMAP_BLACK;                                                       \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+static inline void name##_remove_node(name##_t *tree, name##_node_t *node)                              \
+{                                                                                                       \
+    name##_node_t *replacement;                                                                         \
+    name##_node_t *replacement_parent;                                                                  \
+    char removed_color = node->color;                                                                   \
+                                                                                                        \
+    if (NULL == node->left) {                                                                           \
+        replacement = node->right;                                                                      \
+        replacement_parent = node->parent;                                                              \
+        name##_transplant(tree, node, node->right);                                                     \
+    } else if (NULL == node->right) {                                                                   \
+        replacement = node->left;                                                                       \
+        replacement_parent = node->parent;                                                              \
+        name##_transplant(tree, node, node->left);                                                      \
+    } else {                                                                                            \
+        name##_node_t *successor = node->right;                                                         \
+        while (NULL != successor->left) {                                                               \
+            successor = successor->left;                                                                \
+        }                                                                                               \
+        removed_color = successor->color;                                                               \
+        replacement = successor->right;                                                                 \
+        if (successor->parent == node) {                                                                \
+            replacement_parent = successor;                                                             \
+        } else {                                                                                        \
+            replacement_parent = successor->parent;                                                     \
+            name##_transplant(tree, successor, successor->right);                                       \
+            successor->right = node->right;                                                             \
+            successor->right->parent = successor;                                                       \
+        }                                                                                               \
+        name##_transplant(tree, node, successor);                                                       \
+        successor->left = node->left;                                                                   \
+        successor->left->parent = successor;                                                            \
+        successor->color = node->color;                                                                 \
+    }                                                                                                   \
+    free(node);                                                                                         \
+    tree->size--;                                                                                       \
+                                                                                                        \
+    if (removed_color == LIBCOLL_TYPEDTREEMAP_BLACK) {                                                  \
+        name##_fix_after_removal(tree, replacement, replacement_parent);                                \
+    }                                                                                                   \
+}                                                                                                       \
+                                                                                                        \
+static inline char name##_remove(name##_t *tree, K key, V *value)                                       \
+{                                                                                                       \
+    name##_node_t *node = name##_get_node(tree, key);                                                   \
+    if (NULL == node) {                                                                                 \
+        return 0;                                                                                       \
+    }                                                                                                   \
+    if (NULL != value) {                                                                                \
+        *value = node->value;                                                                           \
+    }                                                                                                   \
+    name##_remove_node(tree, node);                                                                     \
+    return 1;                                                                                           \
+}                                                                                                       \
+                                                                                                        \
+static inline size_t name##_get_size(const name##_t *tree)                                              \
+{                                                                                                       \
+    return tree->size;                                                                                  \
+}
+
+#endif  /* LIBCOLL_TYPEDTREEMAP_H */
@@ -30,9 +30,25 @@
 #ifndef LIBCOLL_TYPES_H
 #define LIBCOLL_TYPES_H
 
+#include <stddef.h>
+
 typedef struct libcoll_pair_voidptr {
     void *a;
     void *b;
 } libcoll_pair_voidptr_t;
 
+/*
+ * A length-carrying byte string, for use as a key in any of the collections.
+ *
+ * Unlike NUL-terminated strings, the data may contain arbitrary bytes,
+ * including zero bytes, and the length is known without scanning the data.
+ * Collections storing such keys store pointers to libcoll_bytes_t structs,
+ * and should be configured with libcoll_bytescmp as the key comparator and
+ * libcoll_hashcode_bytes as the hash code function where applicable.
+ */
+typedef struct libcoll_bytes {
+    const void *data;
+    size_t length;
+} libcoll_bytes_t;
+
 #endif /* LIBCOLL_TYPES_H */
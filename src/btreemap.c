@@ -0,0 +1,951 @@
+/*
+ * btreemap.c
+ *
+ * An ordered map implemented as an in-memory B+tree.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btreemap.h"
+#include "builtins.h"
+#include "comparators.h"
+
+#include "debug.h"
+
+#define MAX_KEYS    LIBCOLL_BTREEMAP_MAX_KEYS
+
+/* the minimum number of keys in any node except the root */
+#define MIN_KEYS    (MAX_KEYS / 2 - 1)
+
+#define AS_LEAF(node)   ((libcoll_btreemap_leaf_t*) (node))
+#define AS_INNER(node)  ((libcoll_btreemap_inner_t*) (node))
+
+/* declarations of static helper functions for internal use */
+static libcoll_btreemap_leaf_t* create_leaf(void);
+static libcoll_btreemap_inner_t* create_inner(void);
+static void deinit_subtree(libcoll_btreemap_node_t *node);
+static int compare_keys(const libcoll_btreemap_t *tree, const void *key1, const void *key2);
+static unsigned int lower_bound(const libcoll_btreemap_t *tree, void *const *keys,
+                                unsigned int count, const void *key);
+static unsigned int upper_bound(const libcoll_btreemap_t *tree, void *const *keys,
+                                unsigned int count, const void *key);
+static libcoll_btreemap_leaf_t* find_leaf(const libcoll_btreemap_t *tree, const void *key);
+static bool split_child(libcoll_btreemap_t *tree, libcoll_btreemap_inner_t *parent, unsigned int index);
+static unsigned int ensure_spare_key(libcoll_btreemap_t *tree, libcoll_btreemap_inner_t *parent, unsigned int index);
+static void replace_separator(libcoll_btreemap_t *tree, const void *key, void *replacement);
+static void seek(libcoll_btreemap_iter_t *iterator, const void *key);
+
+
+/* external API functions */
+
+/*
+ * Initializes a new B+tree map.
+ * The new map will use the default comparator (comparison by memory address)
+ * for determining the (in)equality and mutual order of keys.
+ *
+ * Returns: a pointer to the newly allocated map, or NULL if allocating memory
+ *          failed
+ */
+libcoll_btreemap_t* libcoll_btreemap_init()
+{
+    return libcoll_btreemap_init_with_comparator(NULL);
+}
+
+/*
+ * Initializes a new B+tree map that uses the given comparator for ordering
+ * its keys.  If the comparator is NULL, keys are compared by their memory
+ * addresses.
+ *
+ * Returns: a pointer to the newly allocated map, or NULL if allocating memory
+ *          failed
+ */
+libcoll_btreemap_t* libcoll_btreemap_init_with_comparator(int (*key_comparator)(const void *key1, const void *key2))
+{
+    libcoll_btreemap_t *tree = malloc(sizeof(libcoll_btreemap_t));
+    if (NULL != tree) {
+        tree->size = 0;
+        tree->root = NULL;
+        tree->first = NULL;
+        tree->last = NULL;
+        tree->key_comparator = NULL != key_comparator ? key_comparator : &libcoll_memaddrcmp;
+    }
+    return tree;
+}
+
+/*
+ * Frees the memory used by the map.  The keys and values stored in the map
+ * are not freed.
+ */
+void libcoll_btreemap_deinit(libcoll_btreemap_t *tree)
+{
+    if (NULL != tree->root) {
+        deinit_subtree(tree->root);
+    }
+    free(tree);
+}
+
+/*
+ * Frees the memory used by the map, including the keys and values stored in it.
+ */
+void libcoll_btreemap_deinit_and_delete_contents(libcoll_btreemap_t *tree)
+{
+    libcoll_btreemap_leaf_t *leaf;
+    for (leaf = tree->first; NULL != leaf; leaf = leaf->next) {
+        for (unsigned int i=0; i<leaf->header.count; i++) {
+            free(leaf->keys[i]);
+            free(leaf->values[i]);
+        }
+    }
+    libcoll_btreemap_deinit(tree);
+}
+
+/*
+ * Adds a new key-value pair into the map.
+ *
+ * Full nodes are split on the way down from the root, so that there is always
+ * room for a new key in the leaf reached.  If memory runs out, the tree is
+ * left in a consistent state.
+ *
+ * Returns: true if the pair was added, or false if the key already exists in
+ *          the map or allocating memory failed
+ */
+bool libcoll_btreemap_add(libcoll_btreemap_t *tree, void *key, void *value)
+{
+    if (NULL == tree->root) {
+        libcoll_btreemap_leaf_t *leaf = create_leaf();
+        if (NULL == leaf)  return false;
+
+        leaf->keys[0] = key;
+        leaf->values[0] = value;
+        leaf->header.count = 1;
+        tree->root = &leaf->header;
+        tree->first = tree->last = leaf;
+        tree->size = 1;
+        return true;
+    } else if (tree->root->count == MAX_KEYS) {
+        libcoll_btreemap_inner_t *new_root = create_inner();
+        if (NULL == new_root)  return false;
+
+        new_root->children[0] = tree->root;
+        if (!split_child(tree, new_root, 0)) {
+            free(new_root);
+            return false;
+        }
+        tree->root = &new_root->header;
+    }
+
+    libcoll_btreemap_node_t *node = tree->root;
+    while (!node->is_leaf) {
+        libcoll_btreemap_inner_t *inner = AS_INNER(node);
+        unsigned int i = upper_bound(tree, inner->keys, node->count, key);
+
+        if (inner->children[i]->count == MAX_KEYS) {
+            if (!split_child(tree, inner, i))  return false;
+
+            if (compare_keys(tree, key, inner->keys[i]) >= 0) {
+                i++;
+            }
+        }
+        node = inner->children[i];
+    }
+
+    libcoll_btreemap_leaf_t *leaf = AS_LEAF(node);
+    unsigned int count = node->count;
+    unsigned int i = lower_bound(tree, leaf->keys, count, key);
+    if (i < count && compare_keys(tree, key, leaf->keys[i]) == 0) {
+        DEBUG("libcoll_btreemap_add: key already exists\n");
+        return false;
+    }
+
+    memmove(&leaf->keys[i+1], &leaf->keys[i], (count - i) * sizeof(void*));
+    memmove(&leaf->values[i+1], &leaf->values[i], (count - i) * sizeof(void*));
+    leaf->keys[i] = key;
+    leaf->values[i] = value;
+    node->count++;
+    tree->size++;
+
+    return true;
+}
+
+/*
+ * Gets the value associated with the given key, or NULL if the key does not
+ * exist in the map.
+ */
+void* libcoll_btreemap_get(libcoll_btreemap_t *tree, const void *key)
+{
+    libcoll_btreemap_leaf_t *leaf = find_leaf(tree, key);
+    if (NULL == leaf) {
+        return NULL;
+    }
+
+    unsigned int i = lower_bound(tree, leaf->keys, leaf->header.count, key);
+    if (i < leaf->header.count && compare_keys(tree, key, leaf->keys[i]) == 0) {
+        return leaf->values[i];
+    }
+    return NULL;
+}
+
+/*
+ * Checks whether the map contains the given key.
+ */
+bool libcoll_btreemap_contains(libcoll_btreemap_t *tree, const void *key)
+{
+    libcoll_btreemap_leaf_t *leaf = find_leaf(tree, key);
+    if (NULL == leaf) {
+        return false;
+    }
+
+    unsigned int i = lower_bound(tree, leaf->keys, leaf->header.count, key);
+    return i < leaf->header.count && compare_keys(tree, key, leaf->keys[i]) == 0;
+}
+
+/*
+ * Removes the given key from the map.
+ *
+ * Nodes with the minimum number of keys are refilled on the way down from
+ * the root, by borrowing a key from a sibling or by merging with a sibling,
+ * so that removing a key from the leaf never leaves it underfull.
+ *
+ * Returns: the removed key and value as a pair, or a pair of NULLs if the key
+ *          was not found
+ */
+libcoll_pair_voidptr_t libcoll_btreemap_remove(libcoll_btreemap_t *tree, const void *key)
+{
+    libcoll_pair_voidptr_t result = { NULL, NULL };
+
+    if (NULL == tree->root) {
+        return result;
+    }
+
+    libcoll_btreemap_node_t *node = tree->root;
+    while (!node->is_leaf) {
+        libcoll_btreemap_inner_t *inner = AS_INNER(node);
+        unsigned int i = upper_bound(tree, inner->keys, node->count, key);
+
+        if (inner->children[i]->count <= MIN_KEYS) {
+            i = ensure_spare_key(tree, inner, i);
+        }
+        node = inner->children[i];
+
+        /* merging the only two children of the root leaves the root empty,
+         * in which case the merged child becomes the new root
+         */
+        if (&inner->header == tree->root && inner->header.count == 0) {
+            tree->root = node;
+            free(inner);
+        }
+    }
+
+    libcoll_btreemap_leaf_t *leaf = AS_LEAF(node);
+    unsigned int count = node->count;
+    unsigned int i = lower_bound(tree, leaf->keys, count, key);
+    if (i == count || compare_keys(tree, key, leaf->keys[i]) != 0) {
+        return result;
+    }
+
+    result.a = leaf->keys[i];
+    result.b = leaf->values[i];
+    memmove(&leaf->keys[i], &leaf->keys[i+1], (count - i - 1) * sizeof(void*));
+    memmove(&leaf->values[i], &leaf->values[i+1], (count - i - 1) * sizeof(void*));
+    node->count--;
+    tree->size--;
+
+    /* only the root can run out of keys */
+    if (node->count == 0) {
+        free(leaf);
+        tree->root = NULL;
+        tree->first = tree->last = NULL;
+    } else if (i == 0) {
+        /* an inner node may use the removed key as a separator, which
+         * must not outlive the key as the caller may free it
+         */
+        replace_separator(tree, key, leaf->keys[0]);
+    }
+
+    return result;
+}
+
+/*
+ * Returns the entry with the smallest key as a pair of key and value, or a
+ * pair of NULLs if the map is empty.
+ */
+libcoll_pair_voidptr_t libcoll_btreemap_get_first(libcoll_btreemap_t *tree)
+{
+    libcoll_pair_voidptr_t result = { NULL, NULL };
+    if (NULL != tree->first) {
+        result.a = tree->first->keys[0];
+        result.b = tree->first->values[0];
+    }
+    return result;
+}
+
+/*
+ * Returns the entry with the largest key as a pair of key and value, or a
+ * pair of NULLs if the map is empty.
+ */
+libcoll_pair_voidptr_t libcoll_btreemap_get_last(libcoll_btreemap_t *tree)
+{
+    libcoll_pair_voidptr_t result = { NULL, NULL };
+    if (NULL != tree->last) {
+        unsigned int i = tree->last->header.count - 1;
+        result.a = tree->last->keys[i];
+        result.b = tree->last->values[i];
+    }
+    return result;
+}
+
+/*
+ * Returns the entry with the smallest key greater than the given key, which
+ * need not exist in the map.  If there is no such entry, a pair of NULLs is
+ * returned.
+ */
+libcoll_pair_voidptr_t libcoll_btreemap_get_successor(libcoll_btreemap_t *tree, const void *key)
+{
+    libcoll_pair_voidptr_t result = { NULL, NULL };
+    libcoll_btreemap_leaf_t *leaf = find_leaf(tree, key);
+    if (NULL == leaf) {
+        return result;
+    }
+
+    unsigned int i = upper_bound(tree, leaf->keys, leaf->header.count, key);
+    if (i == leaf->header.count) {
+        leaf = leaf->next;
+        i = 0;
+    }
+    if (NULL != leaf) {
+        result.a = leaf->keys[i];
+        result.b = leaf->values[i];
+    }
+    return result;
+}
+
+/*
+ * Returns the entry with the largest key less than the given key, which need
+ * not exist in the map.  If there is no such entry, a pair of NULLs is
+ * returned.
+ */
+libcoll_pair_voidptr_t libcoll_btreemap_get_predecessor(libcoll_btreemap_t *tree, const void *key)
+{
+    libcoll_pair_voidptr_t result = { NULL, NULL };
+    libcoll_btreemap_leaf_t *leaf = find_leaf(tree, key);
+    if (NULL == leaf) {
+        return result;
+    }
+
+    unsigned int i = lower_bound(tree, leaf->keys, leaf->header.count, key);
+    if (i == 0) {
+        leaf = leaf->previous;
+        i = NULL != leaf ? leaf->header.count : 0;
+    }
+    if (NULL != leaf) {
+        result.a = leaf->keys[i-1];
+        result.b = leaf->values[i-1];
+    }
+    return result;
+}
+
+/*
+ * Returns the current number of entries in the map.
+ */
+size_t libcoll_btreemap_get_size(libcoll_btreemap_t *tree)
+{
+    return tree->size;
+}
+
+/*
+ * Checks whether the map is empty.
+ *
+ * Returns: 1 if the map is empty, 0 if not
+ */
+char libcoll_btreemap_is_empty(libcoll_btreemap_t *tree)
+{
+    return tree->size == 0;
+}
+
+/*
+ * Gets an iterator for iterating through the entries of the map in the order
+ * of their keys, starting from the smallest key.
+ *
+ * Modifying the map other than through the iterator invalidates the iterator.
+ *
+ * Returns: a pointer to the new iterator, or NULL if allocating memory failed
+ */
+libcoll_btreemap_iter_t* libcoll_btreemap_get_iterator(libcoll_btreemap_t *tree)
+{
+    libcoll_btreemap_iter_t *iterator = malloc(sizeof(libcoll_btreemap_iter_t));
+    if (NULL != iterator) {
+        iterator->tree = tree;
+        iterator->leaf = tree->first;
+        iterator->index = 0;
+        iterator->last_traversed_key = NULL;
+        iterator->has_last_traversed = false;
+    }
+    return iterator;
+}
+
+/*
+ * Gets an iterator positioned just before the smallest key not less than the
+ * given key, so that the first call to libcoll_btreemap_next returns that key
+ * and the first call to libcoll_btreemap_previous returns the key preceding it.
+ *
+ * Returns: a pointer to the new iterator, or NULL if allocating memory failed
+ */
+libcoll_btreemap_iter_t* libcoll_btreemap_get_iterator_at(libcoll_btreemap_t *tree, const void *key)
+{
+    libcoll_btreemap_iter_t *iterator = libcoll_btreemap_get_iterator(tree);
+    if (NULL != iterator) {
+        seek(iterator, key);
+    }
+    return iterator;
+}
+
+void libcoll_btreemap_free_iterator(libcoll_btreemap_iter_t *iterator)
+{
+    free(iterator);
+}
+
+bool libcoll_btreemap_has_next(libcoll_btreemap_iter_t *iterator)
+{
+    return NULL != iterator->leaf
+           && (iterator->index < iterator->leaf->header.count || NULL != iterator->leaf->next);
+}
+
+/*
+ * Moves the iterator forward.
+ *
+ * Returns: the next entry as a pair of key and value, or a pair of NULLs if
+ *          the iterator is already at the end of the map
+ */
+libcoll_pair_voidptr_t libcoll_btreemap_next(libcoll_btreemap_iter_t *iterator)
+{
+    libcoll_pair_voidptr_t result = { NULL, NULL };
+    if (!libcoll_btreemap_has_next(iterator)) {
+        return result;
+    }
+
+    if (iterator->index == iterator->leaf->header.count) {
+        iterator->leaf = iterator->leaf->next;
+        iterator->index = 0;
+    }
+    result.a = iterator->leaf->keys[iterator->index];
+    result.b = iterator->leaf->values[iterator->index];
+    iterator->index++;
+
+    iterator->last_traversed_key = result.a;
+    iterator->has_last_traversed = true;
+    return result;
+}
+
+bool libcoll_btreemap_has_previous(libcoll_btreemap_iter_t *iterator)
+{
+    return NULL != iterator->leaf
+           && (iterator->index > 0 || NULL != iterator->leaf->previous);
+}
+
+/*
+ * Moves the iterator backward.
+ *
+ * Returns: the previous entry as a pair of key and value, or a pair of NULLs
+ *          if the iterator is already at the beginning of the map
+ */
+libcoll_pair_voidptr_t libcoll_btreemap_previous(libcoll_btreemap_iter_t *iterator)
+{
+    libcoll_pair_voidptr_t result = { NULL, NULL };
+    if (!libcoll_btreemap_has_previous(iterator)) {
+        return result;
+    }
+
+    if (iterator->index == 0) {
+        iterator->leaf = iterator->leaf->previous;
+        iterator->index = iterator->leaf->header.count;
+    }
+    iterator->index--;
+    result.a = iterator->leaf->keys[iterator->index];
+    result.b = iterator->leaf->values[iterator->index];
+
+    iterator->last_traversed_key = result.a;
+    iterator->has_last_traversed = true;
+    return result;
+}
+
+/*
+ * Removes the entry last returned by libcoll_btreemap_next or
+ * libcoll_btreemap_previous.  The iterator remains usable and stays positioned
+ * between the neighbours of the removed entry.
+ *
+ * Returns: the removed key and value as a pair, or a pair of NULLs if there
+ *          was no entry to remove
+ */
+libcoll_pair_voidptr_t libcoll_btreemap_remove_last_traversed(libcoll_btreemap_iter_t *iterator)
+{
+    libcoll_pair_voidptr_t result = { NULL, NULL };
+    if (!iterator->has_last_traversed) {
+        return result;
+    }
+
+    /* removal may move entries between leaves, so look up the position of
+     * the removed key again afterwards
+     */
+    void *key = iterator->last_traversed_key;
+    result = libcoll_btreemap_remove(iterator->tree, key);
+    seek(iterator, key);
+    iterator->has_last_traversed = false;
+
+    return result;
+}
+
+
+/* static helper functions */
+
+static libcoll_btreemap_leaf_t* create_leaf(void)
+{
+    libcoll_btreemap_leaf_t *leaf = malloc(sizeof(libcoll_btreemap_leaf_t));
+    if (NULL != leaf) {
+        leaf->header.count = 0;
+        leaf->header.is_leaf = true;
+        leaf->previous = leaf->next = NULL;
+    }
+    return leaf;
+}
+
+static libcoll_btreemap_inner_t* create_inner(void)
+{
+    libcoll_btreemap_inner_t *inner = malloc(sizeof(libcoll_btreemap_inner_t));
+    if (NULL != inner) {
+        inner->header.count = 0;
+        inner->header.is_leaf = false;
+    }
+    return inner;
+}
+
+static void deinit_subtree(libcoll_btreemap_node_t *node)
+{
+    if (!node->is_leaf) {
+        libcoll_btreemap_inner_t *inner = AS_INNER(node);
+        for (unsigned int i=0; i<=node->count; i++) {
+            deinit_subtree(inner->children[i]);
+        }
+    }
+    free(node);
+}
+
+static int compare_keys(const libcoll_btreemap_t *tree, const void *key1, const void *key2)
+{
+    switch (builtin_comparator_kind_of(tree->key_comparator)) {
+    case BUILTIN_CMP_STR:
+        return builtin_strcmp(key1, key2);
+    case BUILTIN_CMP_MEMADDR:
+        return builtin_memaddrcmp(key1, key2);
+    case BUILTIN_CMP_INTPTR:
+        return builtin_intptrcmp(key1, key2);
+    default:
+        return tree->key_comparator(key1, key2);
+    }
+}
+
+/*
+ * Binary searches within a node, meant to be inlined with a constant
+ * comparator so that the built-in comparators get inlined into the loop.
+ *
+ * lower_bound_with returns the index of the first key not less than the given
+ * key, and upper_bound_with the index of the first key greater than it.
+ */
+static inline unsigned int lower_bound_with(void *const *keys, unsigned int count, const void *key,
+                                            builtin_comparator_t comparator)
+{
+    unsigned int low = 0, high = count;
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        if (comparator(key, keys[mid]) > 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static inline unsigned int upper_bound_with(void *const *keys, unsigned int count, const void *key,
+                                            builtin_comparator_t comparator)
+{
+    unsigned int low = 0, high = count;
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        if (comparator(key, keys[mid]) >= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static unsigned int lower_bound(const libcoll_btreemap_t *tree, void *const *keys,
+                                unsigned int count, const void *key)
+{
+    switch (builtin_comparator_kind_of(tree->key_comparator)) {
+    case BUILTIN_CMP_STR:
+        return lower_bound_with(keys, count, key, &builtin_strcmp);
+    case BUILTIN_CMP_MEMADDR:
+        return lower_bound_with(keys, count, key, &builtin_memaddrcmp);
+    case BUILTIN_CMP_INTPTR:
+        return lower_bound_with(keys, count, key, &builtin_intptrcmp);
+    default:
+        return lower_bound_with(keys, count, key, tree->key_comparator);
+    }
+}
+
+static unsigned int upper_bound(const libcoll_btreemap_t *tree, void *const *keys,
+                                unsigned int count, const void *key)
+{
+    switch (builtin_comparator_kind_of(tree->key_comparator)) {
+    case BUILTIN_CMP_STR:
+        return upper_bound_with(keys, count, key, &builtin_strcmp);
+    case BUILTIN_CMP_MEMADDR:
+        return upper_bound_with(keys, count, key, &builtin_memaddrcmp);
+    case BUILTIN_CMP_INTPTR:
+        return upper_bound_with(keys, count, key, &builtin_intptrcmp);
+    default:
+        return upper_bound_with(keys, count, key, tree->key_comparator);
+    }
+}
+
+/*
+ * Finds the leaf whose key range covers the given key, or NULL if the map is
+ * empty.
+ */
+static libcoll_btreemap_leaf_t* find_leaf(const libcoll_btreemap_t *tree, const void *key)
+{
+    libcoll_btreemap_node_t *node = tree->root;
+    if (NULL == node) {
+        return NULL;
+    }
+
+    while (!node->is_leaf) {
+        libcoll_btreemap_inner_t *inner = AS_INNER(node);
+        node = inner->children[upper_bound(tree, inner->keys, node->count, key)];
+    }
+    return AS_LEAF(node);
+}
+
+/*
+ * Splits the full child at the given index of a non-full parent into two,
+ * adding a separator key for the new right half into the parent.
+ *
+ * A leaf is split into halves and the first key of the right half is copied
+ * into the parent as the separator.  An internal node is split around its
+ * middle key, which moves up into the parent.
+ *
+ * Returns: false if allocating memory for the new node failed
+ */
+static bool split_child(libcoll_btreemap_t *tree, libcoll_btreemap_inner_t *parent, unsigned int index)
+{
+    libcoll_btreemap_node_t *child = parent->children[index];
+    libcoll_btreemap_node_t *right;
+    void *separator;
+
+    if (child->is_leaf) {
+        libcoll_btreemap_leaf_t *left_leaf = AS_LEAF(child);
+        libcoll_btreemap_leaf_t *right_leaf = create_leaf();
+        if (NULL == right_leaf)  return false;
+
+        unsigned int half = MAX_KEYS / 2;
+        right_leaf->header.count = MAX_KEYS - half;
+        memcpy(right_leaf->keys, &left_leaf->keys[half], (MAX_KEYS - half) * sizeof(void*));
+        memcpy(right_leaf->values, &left_leaf->values[half], (MAX_KEYS - half) * sizeof(void*));
+        child->count = half;
+
+        right_leaf->previous = left_leaf;
+        right_leaf->next = left_leaf->next;
+        if (NULL != left_leaf->next) {
+            left_leaf->next->previous = right_leaf;
+        } else {
+            tree->last = right_leaf;
+        }
+        left_leaf->next = right_leaf;
+
+        separator = right_leaf->keys[0];
+        right = &right_leaf->header;
+    } else {
+        libcoll_btreemap_inner_t *left_inner = AS_INNER(child);
+        libcoll_btreemap_inner_t *right_inner = create_inner();
+        if (NULL == right_inner)  return false;
+
+        unsigned int mid = MAX_KEYS / 2;
+        right_inner->header.count = MAX_KEYS - mid - 1;
+        memcpy(right_inner->keys, &left_inner->keys[mid+1], (MAX_KEYS - mid - 1) * sizeof(void*));
+        memcpy(right_inner->children, &left_inner->children[mid+1],
+               (MAX_KEYS - mid) * sizeof(libcoll_btreemap_node_t*));
+        child->count = mid;
+
+        separator = left_inner->keys[mid];
+        right = &right_inner->header;
+    }
+
+    unsigned int count = parent->header.count;
+    memmove(&parent->keys[index+1], &parent->keys[index], (count - index) * sizeof(void*));
+    memmove(&parent->children[index+2], &parent->children[index+1],
+            (count - index) * sizeof(libcoll_btreemap_node_t*));
+    parent->keys[index] = separator;
+    parent->children[index+1] = right;
+    parent->header.count++;
+
+    return true;
+}
+
+static void borrow_from_left(libcoll_btreemap_inner_t *parent, unsigned int index)
+{
+    libcoll_btreemap_node_t *child = parent->children[index];
+    libcoll_btreemap_node_t *sibling = parent->children[index-1];
+    unsigned int count = child->count;
+
+    if (child->is_leaf) {
+        libcoll_btreemap_leaf_t *leaf = AS_LEAF(child);
+        libcoll_btreemap_leaf_t *left = AS_LEAF(sibling);
+
+        memmove(&leaf->keys[1], &leaf->keys[0], count * sizeof(void*));
+        memmove(&leaf->values[1], &leaf->values[0], count * sizeof(void*));
+        leaf->keys[0] = left->keys[sibling->count - 1];
+        leaf->values[0] = left->values[sibling->count - 1];
+        parent->keys[index-1] = leaf->keys[0];
+    } else {
+        libcoll_btreemap_inner_t *inner = AS_INNER(child);
+        libcoll_btreemap_inner_t *left = AS_INNER(sibling);
+
+        memmove(&inner->keys[1], &inner->keys[0], count * sizeof(void*));
+        memmove(&inner->children[1], &inner->children[0], (count + 1) * sizeof(libcoll_btreemap_node_t*));
+        inner->keys[0] = parent->keys[index-1];
+        inner->children[0] = left->children[sibling->count];
+        parent->keys[index-1] = left->keys[sibling->count - 1];
+    }
+
+    sibling->count--;
+    child->count++;
+}
+
+static void borrow_from_right(libcoll_btreemap_inner_t *parent, unsigned int index)
+{
+    libcoll_btreemap_node_t *child = parent->children[index];
+    libcoll_btreemap_node_t *sibling = parent->children[index+1];
+    unsigned int count = child->count;
+    unsigned int sibling_count = sibling->count;
+
+    if (child->is_leaf) {
+        libcoll_btreemap_leaf_t *leaf = AS_LEAF(child);
+        libcoll_btreemap_leaf_t *right = AS_LEAF(sibling);
+
+        leaf->keys[count] = right->keys[0];
+        leaf->values[count] = right->values[0];
+        memmove(&right->keys[0], &right->keys[1], (sibling_count - 1) * sizeof(void*));
+        memmove(&right->values[0], &right->values[1], (sibling_count - 1) * sizeof(void*));
+        parent->keys[index] = right->keys[0];
+    } else {
+        libcoll_btreemap_inner_t *inner = AS_INNER(child);
+        libcoll_btreemap_inner_t *right = AS_INNER(sibling);
+
+        inner->keys[count] = parent->keys[index];
+        inner->children[count+1] = right->children[0];
+        parent->keys[index] = right->keys[0];
+        memmove(&right->keys[0], &right->keys[1], (sibling_count - 1) * sizeof(void*));
+        memmove(&right->children[0], &right->children[1], sibling_count * sizeof(libcoll_btreemap_node_t*));
+    }
+
+    sibling->count--;
+    child->count++;
+}
+
+/*
+ * Merges the child at the given index of the parent with its right sibling,
+ * removing the separator between them from the parent.
+ */
+static void merge_children(libcoll_btreemap_t *tree, libcoll_btreemap_inner_t *parent, unsigned int index)
+{
+    libcoll_btreemap_node_t *left = parent->children[index];
+    libcoll_btreemap_node_t *right = parent->children[index+1];
+    unsigned int left_count = left->count;
+    unsigned int right_count = right->count;
+
+    if (left->is_leaf) {
+        libcoll_btreemap_leaf_t *left_leaf = AS_LEAF(left);
+        libcoll_btreemap_leaf_t *right_leaf = AS_LEAF(right);
+
+        memcpy(&left_leaf->keys[left_count], right_leaf->keys, right_count * sizeof(void*));
+        memcpy(&left_leaf->values[left_count], right_leaf->values, right_count * sizeof(void*));
+        left->count = left_count + right_count;
+
+        left_leaf->next = right_leaf->next;
+        if (NULL != right_leaf->next) {
+            right_leaf->next->previous = left_leaf;
+        } else {
+            tree->last = left_leaf;
+        }
+    } else {
+        libcoll_btreemap_inner_t *left_inner = AS_INNER(left);
+        libcoll_btreemap_inner_t *right_inner = AS_INNER(right);
+
+        left_inner->keys[left_count] = parent->keys[index];
+        memcpy(&left_inner->keys[left_count+1], right_inner->keys, right_count * sizeof(void*));
+        memcpy(&left_inner->children[left_count+1], right_inner->children,
+               (right_count + 1) * sizeof(libcoll_btreemap_node_t*));
+        left->count = left_count + right_count + 1;
+    }
+    free(right);
+
+    unsigned int count = parent->header.count;
+    memmove(&parent->keys[index], &parent->keys[index+1], (count - index - 1) * sizeof(void*));
+    memmove(&parent->children[index+1], &parent->children[index+2],
+            (count - index - 1) * sizeof(libcoll_btreemap_node_t*));
+    parent->header.count--;
+}
+
+/*
+ * Makes sure the child at the given index of the parent has more than the
+ * minimum number of keys, so that a key can be removed from its subtree.
+ * The child borrows a key from a sibling if possible, or is merged with
+ * a sibling otherwise.
+ *
+ * Returns: the index of the child now covering the key range of the original
+ *          child
+ */
+static unsigned int ensure_spare_key(libcoll_btreemap_t *tree, libcoll_btreemap_inner_t *parent, unsigned int index)
+{
+    if (index > 0 && parent->children[index-1]->count > MIN_KEYS) {
+        borrow_from_left(parent, index);
+    } else if (index < parent->header.count && parent->children[index+1]->count > MIN_KEYS) {
+        borrow_from_right(parent, index);
+    } else if (index > 0) {
+        merge_children(tree, parent, index-1);
+        index--;
+    } else {
+        merge_children(tree, parent, index);
+    }
+    return index;
+}
+
+/*
+ * Positions the iterator just before the smallest key not less than the given
+ * key.
+ */
+/*
+ * Replaces the separator equal to the given key, if there is one, with the
+ * given key.  A separator is the smallest key of the subtree to its right
+ * when it gets added, so after removing the smallest key of a leaf, the
+ * next key of the leaf can take its place.
+ */
+static void replace_separator(libcoll_btreemap_t *tree, const void *key, void *replacement)
+{
+    libcoll_btreemap_node_t *node = tree->root;
+    while (!node->is_leaf) {
+        libcoll_btreemap_inner_t *inner = AS_INNER(node);
+        unsigned int i = upper_bound(tree, inner->keys, node->count, key);
+        if (i > 0 && compare_keys(tree, key, inner->keys[i-1]) == 0) {
+            inner->keys[i-1] = replacement;
+            return;
+        }
+        node = inner->children[i];
+    }
+}
+
+static void seek(libcoll_btreemap_iter_t *iterator, const void *key)
+{
+    libcoll_btreemap_leaf_t *leaf = find_leaf(iterator->tree, key);
+    iterator->leaf = leaf;
+    iterator->index = NULL != leaf ? lower_bound(iterator->tree, leaf->keys, leaf->header.count, key) : 0;
+}
+
+
+/* functions for testing */
+
+static bool _verify_subtree(libcoll_btreemap_t *tree, libcoll_btreemap_node_t *node,
+                            const void *low, const void *high, int depth, int *leaf_depth,
+                            libcoll_btreemap_leaf_t **previous_leaf, size_t *entry_count)
+{
+    if (node != tree->root && node->count < MIN_KEYS) {
+        return false;
+    }
+    if (node->count > MAX_KEYS) {
+        return false;
+    }
+
+    void *const *keys = node->is_leaf ? AS_LEAF(node)->keys : AS_INNER(node)->keys;
+    for (unsigned int i=0; i<node->count; i++) {
+        if ((NULL != low && compare_keys(tree, keys[i], low) < 0)
+                || (NULL != high && compare_keys(tree, keys[i], high) >= 0)
+                || (i > 0 && compare_keys(tree, keys[i-1], keys[i]) >= 0)) {
+            return false;
+        }
+    }
+
+    if (node->is_leaf) {
+        libcoll_btreemap_leaf_t *leaf = AS_LEAF(node);
+        if (*leaf_depth < 0) {
+            *leaf_depth = depth;
+        }
+        if (depth != *leaf_depth || leaf->previous != *previous_leaf
+                || (NULL != *previous_leaf && (*previous_leaf)->next != leaf)
+                || (NULL == *previous_leaf && tree->first != leaf)) {
+            return false;
+        }
+        *previous_leaf = leaf;
+        *entry_count += node->count;
+        return true;
+    }
+
+    libcoll_btreemap_inner_t *inner = AS_INNER(node);
+    if (node->count == 0) {
+        return false;
+    }
+    for (unsigned int i=0; i<=node->count; i++) {
+        const void *child_low = i > 0 ? inner->keys[i-1] : low;
+        const void *child_high = i < node->count ? inner->keys[i] : high;
+        if (!_verify_subtree(tree, inner->children[i], child_low, child_high,
+                             depth + 1, leaf_depth, previous_leaf, entry_count)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Verifies the structural invariants of the B+tree: key order, node fill,
+ * uniform leaf depth, the leaf links and the entry count.
+ */
+bool _libcoll_btreemap_verify(libcoll_btreemap_t *tree)
+{
+    if (NULL == tree->root) {
+        return tree->size == 0 && NULL == tree->first && NULL == tree->last;
+    }
+
+    int leaf_depth = -1;
+    libcoll_btreemap_leaf_t *previous_leaf = NULL;
+    size_t entry_count = 0;
+
+    return _verify_subtree(tree, tree->root, NULL, NULL, 0, &leaf_depth, &previous_leaf, &entry_count)
+           && previous_leaf == tree->last && NULL == tree->last->next
+           && entry_count == tree->size;
+}
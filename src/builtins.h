@@ -0,0 +1,119 @@
+/*
+ * builtins.h
+ *
+ * Inline versions of the built-in comparators and hash functions, for internal
+ * use by the collections.
+ *
+ * Collections normally call their comparators and hash functions through
+ * function pointers.  When one of the library's own functions is configured,
+ * a collection can instead run a loop that calls the corresponding inline
+ * function below, which the compiler can inline into the loop.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#ifndef LIBCOLL_BUILTINS_H
+#define LIBCOLL_BUILTINS_H
+
+#include "comparators.h"
+#include "hash.h"
+
+typedef int (*builtin_comparator_t)(const void *value1, const void *value2);
+
+typedef enum {
+    BUILTIN_CMP_NONE, BUILTIN_CMP_MEMADDR, BUILTIN_CMP_INTPTR, BUILTIN_CMP_STR
+} builtin_comparator_kind;
+
+typedef enum {
+    BUILTIN_HASH_NONE, BUILTIN_HASH_MEMADDR, BUILTIN_HASH_STR
+} builtin_hash_kind;
+
+static inline int builtin_memaddrcmp(const void *value1, const void *value2)
+{
+    if (value1 == value2) {
+        return 0;
+    }
+    return value1 < value2 ? -1 : 1;
+}
+
+static inline int builtin_intptrcmp(const void *value1, const void *value2)
+{
+    return *(const int*) value1 - *(const int*) value2;
+}
+
+static inline int builtin_strcmp(const void *value1, const void *value2)
+{
+    return strcmp((const char*) value1, (const char*) value2);
+}
+
+static inline unsigned long builtin_hashcode_memaddr(const void *value)
+{
+    return (unsigned long) value;
+}
+
+static inline unsigned long builtin_hashcode_str(const void *str)
+{
+    /* use the djb2 algorithm for computing a hash code for a string;
+     * shamelessly copied from http://www.cse.yorku.ca/~oz/hash.html
+     */
+
+    const char *s = (const char*) str;
+
+    unsigned long hash = 5381;
+    int c;
+    while ((c = *s++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+    return hash;
+}
+
+/*
+ * Identifies which of the built-in comparators, if any, the given function
+ * pointer refers to.
+ */
+static inline builtin_comparator_kind builtin_comparator_kind_of(builtin_comparator_t comparator)
+{
+    if (comparator == &libcoll_memaddrcmp) {
+        return BUILTIN_CMP_MEMADDR;
+    } else if (comparator == &libcoll_strcmp_wrapper) {
+        return BUILTIN_CMP_STR;
+    } else if (comparator == &libcoll_intptrcmp) {
+        return BUILTIN_CMP_INTPTR;
+    }
+    return BUILTIN_CMP_NONE;
+}
+
+static inline builtin_hash_kind builtin_hash_kind_of(unsigned long (*hash_function)(const void *key))
+{
+    if (hash_function == &libcoll_hashcode_memaddr) {
+        return BUILTIN_HASH_MEMADDR;
+    } else if (hash_function == &libcoll_hashcode_str) {
+        return BUILTIN_HASH_STR;
+    }
+    return BUILTIN_HASH_NONE;
+}
+
+#endif  /* LIBCOLL_BUILTINS_H */
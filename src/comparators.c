@@ -28,30 +28,56 @@
 
 #include <string.h>
 
+#include "builtins.h"
+#include "types.h"
+
 int libcoll_intptrcmp(const void *value1, const void *value2)
 {
-    int *a = (int*) value1;
-    int *b = (int*) value2;
-    return *a - *b;
+    return builtin_intptrcmp(value1, value2);
 }
 
 int libcoll_strcmp_wrapper(const void *value1, const void *value2)
 {
-    char *s1 = (char*) value1;
-    char *s2 = (char*) value2;
+    return builtin_strcmp(value1, value2);
+}
+
+int libcoll_bytescmp(const void *value1, const void *value2)
+{
+    const libcoll_bytes_t *b1 = (const libcoll_bytes_t*) value1;
+    const libcoll_bytes_t *b2 = (const libcoll_bytes_t*) value2;
+
+    size_t common_length = b1->length < b2->length ? b1->length : b2->length;
+    if (0 != common_length) {
+        int cmpval = memcmp(b1->data, b2->data, common_length);
+        if (0 != cmpval) {
+            return cmpval;
+        }
+    }
+    if (b1->length != b2->length) {
+        return b1->length < b2->length ? -1 : 1;
+    }
+    return 0;
+}
+
+int libcoll_bytes_strcmp(const void *bytes, const void *str)
+{
+    const libcoll_bytes_t *b = (const libcoll_bytes_t*) bytes;
+    const unsigned char *data = (const unsigned char*) b->data;
+    const unsigned char *s = (const unsigned char*) str;
 
-    return strcmp(s1, s2);
+    /* compare at most up to the terminating NUL of the string */
+    for (size_t i=0; i<b->length; i++) {
+        if (data[i] != s[i]) {
+            return data[i] < s[i] ? -1 : 1;
+        } else if (s[i] == '\0') {
+            /* the byte string contains a zero byte, which a C string can't */
+            return 1;
+        }
+    }
+    return s[b->length] == '\0' ? 0 : -1;
 }
 
 int libcoll_memaddrcmp(const void *value1, const void *value2)
 {
-    int cmpval;
-    if (value1 == value2) {
-        cmpval = 0;
-    } else if (value1 < value2) {
-        cmpval = -1;
-    } else {
-        cmpval = 1;
-    }
-    return cmpval;
+    return builtin_memaddrcmp(value1, value2);
 }
@@ -0,0 +1,780 @@
+/*
+ * concurrentsortedmap.c
+ *
+ * An ordered map that can be used by several threads at once, implemented
+ * as a lock-free skip list.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "concurrentsortedmap.h"
+#include "builtins.h"
+#include "comparators.h"
+
+#include "debug.h"
+
+#define MAX_LEVEL   LIBCOLL_CONCURRENT_SORTEDMAP_MAX_LEVEL
+
+/* the number of retired nodes a thread collects before trying to free them */
+#define RETIRE_THRESHOLD    64
+
+/* flags in the state of a node, telling which of its adder and its remover
+ * are done with it; whichever finishes last retires the node */
+#define STATE_LINKED    1
+#define STATE_REMOVED   2
+
+/* the lowest bit of a next pointer marks the node holding it as removed */
+#define IS_MARKED(ptr)  (((uintptr_t) (ptr)) & 1)
+#define MARKED(ptr)     ((libcoll_concurrent_sortedmap_node_t*) (((uintptr_t) (ptr)) | 1))
+#define UNMARKED(ptr)   ((libcoll_concurrent_sortedmap_node_t*) (((uintptr_t) (ptr)) & ~(uintptr_t) 1))
+
+#define LOAD(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define CAS(ptr, expected, desired) \
+    __atomic_compare_exchange_n(ptr, expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+/* declarations of static helper functions for internal use */
+static libcoll_concurrent_sortedmap_node_t* create_node(void *key, void *value, unsigned int height);
+static libcoll_concurrent_sortedmap_thread_t* enter(libcoll_concurrent_sortedmap_t *map);
+static void leave(libcoll_concurrent_sortedmap_thread_t *thread);
+static libcoll_concurrent_sortedmap_thread_t* claim_thread(libcoll_concurrent_sortedmap_t *map);
+static void release_thread(void *thread);
+static void retire(libcoll_concurrent_sortedmap_t *map, libcoll_concurrent_sortedmap_thread_t *thread,
+                   libcoll_concurrent_sortedmap_node_t *node);
+static void free_retired(libcoll_concurrent_sortedmap_t *map, libcoll_concurrent_sortedmap_thread_t *thread);
+static unsigned int random_height(libcoll_concurrent_sortedmap_thread_t *thread);
+static bool find(libcoll_concurrent_sortedmap_t *map, const void *key,
+                 libcoll_concurrent_sortedmap_node_t **preds, libcoll_concurrent_sortedmap_node_t **succs);
+static bool search_level(libcoll_concurrent_sortedmap_t *map, const void *key, unsigned int level,
+                         libcoll_concurrent_sortedmap_node_t **pred, libcoll_concurrent_sortedmap_node_t **succ);
+static libcoll_concurrent_sortedmap_node_t* first_unmarked(libcoll_concurrent_sortedmap_node_t *node);
+static void finish_with_node(libcoll_concurrent_sortedmap_t *map, libcoll_concurrent_sortedmap_thread_t *thread,
+                             libcoll_concurrent_sortedmap_node_t *node, unsigned int flag);
+static int compare_keys(const libcoll_concurrent_sortedmap_t *map, const void *key1, const void *key2);
+
+
+/* external API functions */
+
+/*
+ * Initializes a new concurrent sorted map.
+ * The new map will use the default comparator (comparison by memory address)
+ * for determining the (in)equality and mutual order of keys.
+ *
+ * Returns: a pointer to the newly allocated map, or NULL if allocating memory
+ *          failed
+ */
+libcoll_concurrent_sortedmap_t* libcoll_concurrent_sortedmap_init()
+{
+    return libcoll_concurrent_sortedmap_init_with_comparator(NULL);
+}
+
+/*
+ * Initializes a new concurrent sorted map that uses the given comparator for
+ * ordering its keys.  If the comparator is NULL, keys are compared by their
+ * memory addresses.
+ *
+ * Each map uses a thread-specific data key for finding the state of the
+ * calling thread, so the number of maps existing at once is limited by
+ * PTHREAD_KEYS_MAX.
+ *
+ * Returns: a pointer to the newly allocated map, or NULL if allocating memory
+ *          or a thread-specific data key failed
+ */
+libcoll_concurrent_sortedmap_t* libcoll_concurrent_sortedmap_init_with_comparator(int (*key_comparator)(const void *key1, const void *key2))
+{
+    libcoll_concurrent_sortedmap_t *map = malloc(sizeof(libcoll_concurrent_sortedmap_t));
+    if (NULL == map) {
+        return NULL;
+    }
+
+    map->head = create_node(NULL, NULL, MAX_LEVEL);
+    if (NULL == map->head || 0 != pthread_key_create(&map->thread_key, &release_thread)) {
+        free(map->head);
+        free(map);
+        return NULL;
+    }
+
+    map->size = 0;
+    map->epoch = 1;
+    map->threads = NULL;
+    map->key_comparator = NULL != key_comparator ? key_comparator : &libcoll_memaddrcmp;
+    return map;
+}
+
+/*
+ * Frees the memory used by the map.  The keys and values stored in the map
+ * are not freed.  No other thread may be using the map anymore.
+ */
+void libcoll_concurrent_sortedmap_deinit(libcoll_concurrent_sortedmap_t *map)
+{
+    pthread_key_delete(map->thread_key);
+
+    libcoll_concurrent_sortedmap_node_t *node = map->head;
+    while (NULL != node) {
+        libcoll_concurrent_sortedmap_node_t *next = UNMARKED(node->next[0]);
+        free(node);
+        node = next;
+    }
+
+    libcoll_concurrent_sortedmap_thread_t *thread = map->threads;
+    while (NULL != thread) {
+        libcoll_concurrent_sortedmap_thread_t *next = thread->next;
+        for (node = thread->retired; NULL != node; ) {
+            libcoll_concurrent_sortedmap_node_t *next_retired = node->retired_next;
+            free(node);
+            node = next_retired;
+        }
+        free(thread);
+        thread = next;
+    }
+
+    free(map);
+}
+
+/*
+ * Frees the memory used by the map, including the keys and values stored in it.
+ * Keys and values of removed nodes are not freed, since they were handed
+ * over to the caller when removing them.
+ */
+void libcoll_concurrent_sortedmap_deinit_and_delete_contents(libcoll_concurrent_sortedmap_t *map)
+{
+    for (libcoll_concurrent_sortedmap_node_t *node = UNMARKED(map->head->next[0]);
+            NULL != node; node = UNMARKED(node->next[0])) {
+        if (!IS_MARKED(node->next[0])) {
+            free(node->key);
+            free(node->value);
+        }
+    }
+    libcoll_concurrent_sortedmap_deinit(map);
+}
+
+/*
+ * Adds a new key-value pair into the map.  The pair becomes visible to other
+ * threads as soon as it is linked into the lowest level of the skip list; the
+ * higher levels are linked afterwards.
+ *
+ * Returns: true if the pair was added, or false if the key already exists in
+ *          the map or allocating memory failed
+ */
+bool libcoll_concurrent_sortedmap_add(libcoll_concurrent_sortedmap_t *map, void *key, void *value)
+{
+    libcoll_concurrent_sortedmap_thread_t *thread = enter(map);
+    if (NULL == thread) {
+        return false;
+    }
+
+    libcoll_concurrent_sortedmap_node_t *preds[MAX_LEVEL];
+    libcoll_concurrent_sortedmap_node_t *succs[MAX_LEVEL];
+    libcoll_concurrent_sortedmap_node_t *node = NULL;
+    unsigned int height = random_height(thread);
+
+    for (;;) {
+        if (find(map, key, preds, succs)) {
+            DEBUG("libcoll_concurrent_sortedmap_add: key already exists\n");
+            free(node);
+            leave(thread);
+            return false;
+        }
+        if (NULL == node) {
+            node = create_node(key, value, height);
+            if (NULL == node) {
+                leave(thread);
+                return false;
+            }
+        }
+        for (unsigned int level=0; level<height; level++) {
+            node->next[level] = succs[level];
+        }
+
+        libcoll_concurrent_sortedmap_node_t *expected = succs[0];
+        if (CAS(&preds[0]->next[0], &expected, node)) {
+            break;
+        }
+    }
+    __atomic_add_fetch(&map->size, 1, __ATOMIC_RELAXED);
+
+    /* stop linking the higher levels if the node gets removed meanwhile */
+    for (unsigned int level=1; level<height; level++) {
+        for (;;) {
+            libcoll_concurrent_sortedmap_node_t *next = LOAD(&node->next[level]);
+            if (IS_MARKED(next)) {
+                level = height;
+                break;
+            }
+            if (next != succs[level] && !CAS(&node->next[level], &next, succs[level])) {
+                continue;
+            }
+
+            libcoll_concurrent_sortedmap_node_t *expected = succs[level];
+            if (CAS(&preds[level]->next[level], &expected, node)) {
+                break;
+            }
+            find(map, key, preds, succs);
+        }
+    }
+
+    finish_with_node(map, thread, node, STATE_LINKED);
+    leave(thread);
+    return true;
+}
+
+/*
+ * Retrieves the value associated with the given key.
+ *
+ * Returns: the value for the key, or NULL if the key is not in the map
+ */
+void* libcoll_concurrent_sortedmap_get(libcoll_concurrent_sortedmap_t *map, const void *key)
+{
+    libcoll_concurrent_sortedmap_thread_t *thread = enter(map);
+    if (NULL == thread) {
+        return NULL;
+    }
+
+    libcoll_concurrent_sortedmap_node_t *preds[MAX_LEVEL];
+    libcoll_concurrent_sortedmap_node_t *succs[MAX_LEVEL];
+    void *value = find(map, key, preds, succs) ? succs[0]->value : NULL;
+
+    leave(thread);
+    return value;
+}
+
+/*
+ * Returns: true if the given key is in the map, false if it is not
+ */
+bool libcoll_concurrent_sortedmap_contains(libcoll_concurrent_sortedmap_t *map, const void *key)
+{
+    libcoll_concurrent_sortedmap_thread_t *thread = enter(map);
+    if (NULL == thread) {
+        return false;
+    }
+
+    libcoll_concurrent_sortedmap_node_t *preds[MAX_LEVEL];
+    libcoll_concurrent_sortedmap_node_t *succs[MAX_LEVEL];
+    bool found = find(map, key, preds, succs);
+
+    leave(thread);
+    return found;
+}
+
+/*
+ * Removes the given key from the map.  The node is marked as removed at every
+ * level, top down, and the thread that marks its lowest level owns the
+ * removal.  The node is freed once no other thread can be reading it.
+ *
+ * Returns: the removed key and value, or a pair of NULLs if the key was not
+ *          found
+ */
+libcoll_pair_voidptr_t libcoll_concurrent_sortedmap_remove(libcoll_concurrent_sortedmap_t *map, const void *key)
+{
+    libcoll_pair_voidptr_t pair = { NULL, NULL };
+    libcoll_concurrent_sortedmap_thread_t *thread = enter(map);
+    if (NULL == thread) {
+        return pair;
+    }
+
+    libcoll_concurrent_sortedmap_node_t *preds[MAX_LEVEL];
+    libcoll_concurrent_sortedmap_node_t *succs[MAX_LEVEL];
+    if (!find(map, key, preds, succs)) {
+        leave(thread);
+        return pair;
+    }
+
+    libcoll_concurrent_sortedmap_node_t *node = succs[0];
+    for (unsigned int level=node->height-1; level>0; level--) {
+        libcoll_concurrent_sortedmap_node_t *next = LOAD(&node->next[level]);
+        while (!IS_MARKED(next) && !CAS(&node->next[level], &next, MARKED(next))) {
+        }
+    }
+
+    libcoll_concurrent_sortedmap_node_t *next = LOAD(&node->next[0]);
+    for (;;) {
+        if (IS_MARKED(next)) {
+            /* another thread removed the node first */
+            leave(thread);
+            return pair;
+        }
+        if (CAS(&node->next[0], &next, MARKED(next))) {
+            break;
+        }
+    }
+    __atomic_sub_fetch(&map->size, 1, __ATOMIC_RELAXED);
+
+    pair.a = node->key;
+    pair.b = node->value;
+    finish_with_node(map, thread, node, STATE_REMOVED);
+
+    leave(thread);
+    return pair;
+}
+
+/*
+ * Returns: the number of keys in the map.  While other threads are modifying
+ *          the map, this may be off by the number of ongoing operations.
+ */
+size_t libcoll_concurrent_sortedmap_get_size(libcoll_concurrent_sortedmap_t *map)
+{
+    return __atomic_load_n(&map->size, __ATOMIC_RELAXED);
+}
+
+/*
+ * Returns: 1 if the map contains no keys, 0 otherwise
+ */
+char libcoll_concurrent_sortedmap_is_empty(libcoll_concurrent_sortedmap_t *map)
+{
+    return libcoll_concurrent_sortedmap_get_size(map) == 0;
+}
+
+/*
+ * Creates an iterator over the map in key order, starting from the smallest
+ * key.  The iteration is weakly consistent: it sees every key that is in the
+ * map during the whole iteration, and may or may not see keys added or
+ * removed while iterating.
+ *
+ * Returns: a new iterator, or NULL if allocating memory failed
+ */
+libcoll_concurrent_sortedmap_iter_t* libcoll_concurrent_sortedmap_get_iterator(libcoll_concurrent_sortedmap_t *map)
+{
+    libcoll_concurrent_sortedmap_iter_t *iterator = malloc(sizeof(libcoll_concurrent_sortedmap_iter_t));
+    if (NULL == iterator) {
+        return NULL;
+    }
+
+    iterator->thread = enter(map);
+    if (NULL == iterator->thread) {
+        free(iterator);
+        return NULL;
+    }
+    iterator->map = map;
+    iterator->next = first_unmarked(UNMARKED(LOAD(&map->head->next[0])));
+    return iterator;
+}
+
+/*
+ * Creates an iterator over the map in key order, starting from the first
+ * key that is greater than or equal to the given key.
+ *
+ * Returns: a new iterator, or NULL if allocating memory failed
+ */
+libcoll_concurrent_sortedmap_iter_t* libcoll_concurrent_sortedmap_get_iterator_at(libcoll_concurrent_sortedmap_t *map,
+                                                                                const void *key)
+{
+    libcoll_concurrent_sortedmap_iter_t *iterator = libcoll_concurrent_sortedmap_get_iterator(map);
+    if (NULL != iterator) {
+        libcoll_concurrent_sortedmap_node_t *preds[MAX_LEVEL];
+        libcoll_concurrent_sortedmap_node_t *succs[MAX_LEVEL];
+        find(map, key, preds, succs);
+        iterator->next = succs[0];
+    }
+    return iterator;
+}
+
+/*
+ * Frees the iterator, letting the nodes it could still see be freed.
+ */
+void libcoll_concurrent_sortedmap_free_iterator(libcoll_concurrent_sortedmap_iter_t *iterator)
+{
+    leave(iterator->thread);
+    free(iterator);
+}
+
+/*
+ * Returns: true if there are more keys to iterate over, false otherwise
+ */
+bool libcoll_concurrent_sortedmap_has_next(libcoll_concurrent_sortedmap_iter_t *iterator)
+{
+    return NULL != iterator->next;
+}
+
+/*
+ * Advances the iterator to the next key.
+ *
+ * Returns: the next key and value, or a pair of NULLs if there are no more keys
+ */
+libcoll_pair_voidptr_t libcoll_concurrent_sortedmap_next(libcoll_concurrent_sortedmap_iter_t *iterator)
+{
+    libcoll_pair_voidptr_t pair = { NULL, NULL };
+    libcoll_concurrent_sortedmap_node_t *node = iterator->next;
+    if (NULL != node) {
+        pair.a = node->key;
+        pair.b = node->value;
+        iterator->next = first_unmarked(UNMARKED(LOAD(&node->next[0])));
+    }
+    return pair;
+}
+
+
+/* static helper functions */
+
+static libcoll_concurrent_sortedmap_node_t* create_node(void *key, void *value, unsigned int height)
+{
+    libcoll_concurrent_sortedmap_node_t *node = malloc(sizeof(libcoll_concurrent_sortedmap_node_t)
+                                                       + height * sizeof(libcoll_concurrent_sortedmap_node_t*));
+    if (NULL != node) {
+        node->key = key;
+        node->value = value;
+        node->retired_next = NULL;
+        node->retired_epoch = 0;
+        node->state = 0;
+        node->height = height;
+        for (unsigned int level=0; level<height; level++) {
+            node->next[level] = NULL;
+        }
+    }
+    return node;
+}
+
+/*
+ * Announces that the calling thread is reading the map, from the current
+ * epoch on.  Calls may be nested; only the outermost one announces an epoch.
+ *
+ * Returns: the state of the calling thread, or NULL if allocating it failed
+ */
+static libcoll_concurrent_sortedmap_thread_t* enter(libcoll_concurrent_sortedmap_t *map)
+{
+    libcoll_concurrent_sortedmap_thread_t *thread = pthread_getspecific(map->thread_key);
+    if (NULL == thread) {
+        thread = claim_thread(map);
+        if (NULL == thread) {
+            return NULL;
+        }
+    }
+
+    if (0 == thread->nesting++) {
+        /* the announced epoch must be current once it is visible */
+        unsigned long epoch;
+        do {
+            epoch = __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&thread->epoch, epoch, __ATOMIC_SEQ_CST);
+        } while (epoch != __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST));
+    }
+    return thread;
+}
+
+/*
+ * Announces that the calling thread has stopped reading the map.
+ */
+static void leave(libcoll_concurrent_sortedmap_thread_t *thread)
+{
+    if (0 == --thread->nesting) {
+        __atomic_store_n(&thread->epoch, 0, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Finds a thread state not in use, or adds a new one, for the calling thread.
+ * The states are never removed from the list before the map is deinitialized;
+ * the state of an exited thread is reused by the next new thread, along with
+ * its retired nodes.
+ */
+static libcoll_concurrent_sortedmap_thread_t* claim_thread(libcoll_concurrent_sortedmap_t *map)
+{
+    libcoll_concurrent_sortedmap_thread_t *thread;
+    for (thread = LOAD(&map->threads); NULL != thread; thread = thread->next) {
+        bool in_use = false;
+        if (!__atomic_load_n(&thread->in_use, __ATOMIC_RELAXED) && CAS(&thread->in_use, &in_use, true)) {
+            break;
+        }
+    }
+
+    if (NULL == thread) {
+        thread = malloc(sizeof(libcoll_concurrent_sortedmap_thread_t));
+        if (NULL == thread) {
+            return NULL;
+        }
+        thread->in_use = true;
+        thread->epoch = 0;
+        thread->nesting = 0;
+        thread->retired = NULL;
+        thread->retired_count = 0;
+        thread->random = (unsigned long long) (uintptr_t) thread * 0x9e3779b97f4a7c15ULL | 1;
+
+        thread->next = LOAD(&map->threads);
+        while (!CAS(&map->threads, &thread->next, thread)) {
+        }
+    }
+
+    if (0 != pthread_setspecific(map->thread_key, thread)) {
+        __atomic_store_n(&thread->in_use, false, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    return thread;
+}
+
+/*
+ * Makes the state of an exiting thread available to other threads.
+ */
+static void release_thread(void *thread)
+{
+    libcoll_concurrent_sortedmap_thread_t *state = thread;
+    state->nesting = 0;
+    __atomic_store_n(&state->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&state->in_use, false, __ATOMIC_RELEASE);
+}
+
+/*
+ * Puts an unlinked node on the list of retired nodes of the calling thread,
+ * freeing the nodes that have become safe to free once enough have gathered.
+ */
+static void retire(libcoll_concurrent_sortedmap_t *map, libcoll_concurrent_sortedmap_thread_t *thread,
+                   libcoll_concurrent_sortedmap_node_t *node)
+{
+    node->retired_epoch = __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST);
+    node->retired_next = thread->retired;
+    thread->retired = node;
+    if (++thread->retired_count >= RETIRE_THRESHOLD) {
+        free_retired(map, thread);
+    }
+}
+
+/*
+ * Advances the epoch if every thread inside the map has entered in the
+ * current epoch, and frees the retired nodes of the calling thread that were
+ * retired at least two epochs ago.  No thread can still be reading those,
+ * since every thread reading the map entered after they were unlinked.
+ */
+static void free_retired(libcoll_concurrent_sortedmap_t *map, libcoll_concurrent_sortedmap_thread_t *thread)
+{
+    unsigned long epoch = __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST);
+    bool all_current = true;
+    for (libcoll_concurrent_sortedmap_thread_t *other = LOAD(&map->threads); NULL != other; other = other->next) {
+        unsigned long other_epoch = __atomic_load_n(&other->epoch, __ATOMIC_SEQ_CST);
+        if (0 != other_epoch && epoch != other_epoch) {
+            all_current = false;
+            break;
+        }
+    }
+    if (all_current && __atomic_compare_exchange_n(&map->epoch, &epoch, epoch + 1, false,
+                                                   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        epoch++;
+    }
+
+    /* the list is ordered from the newest to the oldest */
+    libcoll_concurrent_sortedmap_node_t **link = &thread->retired;
+    while (NULL != *link && (*link)->retired_epoch + 2 > epoch) {
+        link = &(*link)->retired_next;
+    }
+    libcoll_concurrent_sortedmap_node_t *node = *link;
+    *link = NULL;
+    while (NULL != node) {
+        libcoll_concurrent_sortedmap_node_t *next = node->retired_next;
+        free(node);
+        thread->retired_count--;
+        node = next;
+    }
+}
+
+/*
+ * Picks the height of a new node, with a probability of 1/2 for each level
+ * above the lowest one.
+ */
+static unsigned int random_height(libcoll_concurrent_sortedmap_thread_t *thread)
+{
+    /* xorshift64 */
+    unsigned long long x = thread->random;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    thread->random = x;
+
+    return 1 + __builtin_ctzll(x | (1ULL << (MAX_LEVEL - 1)));
+}
+
+/*
+ * Finds the nodes between which the given key belongs on every level of the
+ * skip list, unlinking removed nodes on the way.  On each level, preds gets
+ * the last node with a key less than the given key, and succs the node
+ * following it.
+ *
+ * Returns: true if succs[0] has the given key, false otherwise
+ */
+static bool find(libcoll_concurrent_sortedmap_t *map, const void *key,
+                 libcoll_concurrent_sortedmap_node_t **preds, libcoll_concurrent_sortedmap_node_t **succs)
+{
+    bool restart;
+    do {
+        restart = false;
+        libcoll_concurrent_sortedmap_node_t *pred = map->head;
+        for (int level=MAX_LEVEL-1; level>=0; level--) {
+            if (!search_level(map, key, level, &pred, &succs[level])) {
+                restart = true;
+                break;
+            }
+            preds[level] = pred;
+        }
+    } while (restart);
+
+    return NULL != succs[0] && compare_keys(map, succs[0]->key, key) == 0;
+}
+
+/*
+ * Moves forward on a single level of the skip list, starting from pred, to
+ * the position of the given key, unlinking removed nodes on the way.  Removed
+ * nodes with keys equal to the given key are unlinked even if they come after
+ * a node with the same key that has been added in the meantime, so that
+ * searching for the key of a removed node unlinks it from every level.
+ *
+ * Returns: false if a concurrent change requires starting over from the head
+ */
+static bool search_level(libcoll_concurrent_sortedmap_t *map, const void *key, unsigned int level,
+                         libcoll_concurrent_sortedmap_node_t **pred, libcoll_concurrent_sortedmap_node_t **succ)
+{
+    libcoll_concurrent_sortedmap_node_t *left = *pred;
+    libcoll_concurrent_sortedmap_node_t *current = UNMARKED(LOAD(&left->next[level]));
+    int cmpval = 1;
+
+    while (NULL != current) {
+        libcoll_concurrent_sortedmap_node_t *next = LOAD(&current->next[level]);
+        if (IS_MARKED(next)) {
+            libcoll_concurrent_sortedmap_node_t *expected = current;
+            if (!CAS(&left->next[level], &expected, UNMARKED(next))) {
+                return false;
+            }
+            current = UNMARKED(next);
+            continue;
+        }
+
+        cmpval = compare_keys(map, current->key, key);
+        if (cmpval >= 0) {
+            break;
+        }
+        left = current;
+        current = next;
+    }
+    *pred = left;
+    *succ = current;
+
+    /* only after a concurrent removal and re-adding can there be several nodes with the key */
+    if (NULL != current && cmpval == 0) {
+        left = current;
+        current = UNMARKED(LOAD(&left->next[level]));
+        while (NULL != current && compare_keys(map, current->key, key) == 0) {
+            libcoll_concurrent_sortedmap_node_t *next = LOAD(&current->next[level]);
+            if (IS_MARKED(next)) {
+                libcoll_concurrent_sortedmap_node_t *expected = current;
+                if (!CAS(&left->next[level], &expected, UNMARKED(next))) {
+                    return false;
+                }
+            } else {
+                left = current;
+            }
+            current = UNMARKED(next);
+        }
+    }
+    return true;
+}
+
+/*
+ * Skips removed nodes on the lowest level, starting from the given node.
+ */
+static libcoll_concurrent_sortedmap_node_t* first_unmarked(libcoll_concurrent_sortedmap_node_t *node)
+{
+    while (NULL != node) {
+        libcoll_concurrent_sortedmap_node_t *next = LOAD(&node->next[0]);
+        if (!IS_MARKED(next)) {
+            break;
+        }
+        node = UNMARKED(next);
+    }
+    return node;
+}
+
+/*
+ * Records that the adder or the remover of a node is done with it, and
+ * retires the node if the other one is done as well.
+ *
+ * The adder may still link the higher levels of a node after its remover has
+ * started unlinking it.  Therefore the remover unlinks the node only after
+ * recording its part, and if the adder finishes after that, the adder unlinks
+ * the node once more.
+ */
+static void finish_with_node(libcoll_concurrent_sortedmap_t *map, libcoll_concurrent_sortedmap_thread_t *thread,
+                             libcoll_concurrent_sortedmap_node_t *node, unsigned int flag)
+{
+    unsigned int state = __atomic_fetch_or(&node->state, flag, __ATOMIC_ACQ_REL);
+    if (STATE_REMOVED == flag || 0 != (state & STATE_REMOVED)) {
+        libcoll_concurrent_sortedmap_node_t *preds[MAX_LEVEL];
+        libcoll_concurrent_sortedmap_node_t *succs[MAX_LEVEL];
+        find(map, node->key, preds, succs);
+    }
+    if (0 != state) {
+        retire(map, thread, node);
+    }
+}
+
+static int compare_keys(const libcoll_concurrent_sortedmap_t *map, const void *key1, const void *key2)
+{
+    switch (builtin_comparator_kind_of(map->key_comparator)) {
+    case BUILTIN_CMP_STR:
+        return builtin_strcmp(key1, key2);
+    case BUILTIN_CMP_MEMADDR:
+        return builtin_memaddrcmp(key1, key2);
+    case BUILTIN_CMP_INTPTR:
+        return builtin_intptrcmp(key1, key2);
+    default:
+        return map->key_comparator(key1, key2);
+    }
+}
+
+
+/* helpers used for testing */
+
+/*
+ * Verifies the structure of the skip list while no other thread is using it:
+ * no removed nodes are left linked, every level is in key order and a subset
+ * of the level below it, and the size matches the number of nodes.
+ */
+bool _libcoll_concurrent_sortedmap_verify(libcoll_concurrent_sortedmap_t *map)
+{
+    size_t count = 0;
+    for (int level=MAX_LEVEL-1; level>=0; level--) {
+        libcoll_concurrent_sortedmap_node_t *below = map->head;
+        libcoll_concurrent_sortedmap_node_t *previous = NULL;
+        for (libcoll_concurrent_sortedmap_node_t *node = map->head->next[level];
+                NULL != node; node = node->next[level]) {
+            if (IS_MARKED(node->next[level]) || node->height <= (unsigned int) level) {
+                return false;
+            }
+            if (NULL != previous && compare_keys(map, previous->key, node->key) >= 0) {
+                DEBUG("_libcoll_concurrent_sortedmap_verify: keys out of order\n");
+                return false;
+            }
+            if (level > 0) {
+                while (NULL != below && below != node) {
+                    below = below->next[level - 1];
+                }
+                if (NULL == below) {
+                    return false;
+                }
+            } else {
+                count++;
+            }
+            previous = node;
+        }
+    }
+    return count == map->size;
+}
@@ -25,9 +25,11 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/types.h>  /* for ssize_t */
 
+#include "builtins.h"
 #include "comparators.h"
 #include "hash.h"
 #include "hashmap.h"
@@ -35,48 +37,108 @@
 
 #include "debug.h"
 
-static size_t hash(const libcoll_hashmap_t *hm, const size_t hashcode)
+static size_t hash(const libcoll_hashmap_t *hm, const uint64_t hashcode)
 {
     /* trivial distribution for now */
     return hashcode % hm->capacity;
 }
 
-static libcoll_linkedlist_t* find_collision_list(const libcoll_hashmap_t *hm, const void *key)
+/*
+ * Computes the hash code of the given key.  The built-in hash functions are
+ * called inline rather than through the function pointer.
+ */
+static uint64_t compute_hash(const libcoll_hashmap_t *hm, const void *key)
 {
-    size_t slot_index = hash(hm, hm->hash_code_function(key));
-    DEBUGF("find_collision_list: hashed to bucket %lu\n", slot_index);
-    libcoll_linkedlist_t *collision_list = hm->buckets[slot_index];
+    if (NULL != hm->key_traits.hash) {
+        return hm->key_traits.hash(key);
+    }
 
-    return collision_list;
+    switch (builtin_hash_kind_of(hm->hash_code_function)) {
+    case BUILTIN_HASH_STR:
+        return (uint64_t) builtin_hashcode_str(key);
+    case BUILTIN_HASH_MEMADDR:
+        return (uint64_t) builtin_hashcode_memaddr(key);
+    default:
+        return (uint64_t) hm->hash_code_function(key);
+    }
 }
 
-static libcoll_hashmap_entry_t* find_entry(const libcoll_hashmap_t *hm, const void *key)
+/*
+ * Walks a collision list looking for the entry with the given key, comparing
+ * keys with the given comparator.  The cached hash values are compared first,
+ * so that the comparator only gets called for entries whose keys are likely
+ * equal.  Meant to be inlined into find_entry_node with a constant
+ * comparator, so that the built-in comparators get inlined into the loop.
+ */
+static inline libcoll_linkedlist_node_t* search_chain(const libcoll_hashmap_t *hm,
+                                                      libcoll_linkedlist_node_t *node,
+                                                      uint64_t hashcode,
+                                                      const void *key,
+                                                      builtin_comparator_t comparator)
 {
-    libcoll_hashmap_entry_t *matching_entry = NULL;
-    libcoll_linkedlist_t *collision_list = find_collision_list(hm, key);
+    /* walk the nodes directly rather than through a heap-allocated
+     * iterator, since this is on the path of every lookup
+     */
+    for (; NULL != node; node = node->next) {
+        const libcoll_hashmap_entry_t *entry = node->value;
+        if (entry->hash == hashcode
+                && (hm->key_traits.hash_determines_equality || comparator(key, entry->key) == 0)) {
+            return node;
+        }
+    }
+    return NULL;
+}
 
-    if (NULL != collision_list) {
-        DEBUGF("find_entry: found collision list for key %p\n", key);
-        libcoll_linkedlist_iter_t *iter = libcoll_linkedlist_get_iter(collision_list);
+static libcoll_linkedlist_node_t* find_entry_node(const libcoll_hashmap_t *hm,
+                                                  uint64_t hashcode,
+                                                  const void *key)
+{
+    size_t slot_index = hash(hm, hashcode);
+    DEBUGF("find_entry_node: hashed to bucket %lu\n", slot_index);
+    libcoll_linkedlist_t *collision_list = hm->buckets[slot_index];
 
-        while (libcoll_linkedlist_iter_has_next(iter)) {
-            libcoll_hashmap_entry_t *entry_tmp;
-            const void *key_tmp;
+    if (NULL == collision_list) {
+        DEBUGF("find_entry_node: no collision list found for key %p\n", key);
+        return NULL;
+    }
+    DEBUGF("find_entry_node: found collision list for key %p\n", key);
+
+    /* the comparator is identified once per lookup rather than per entry */
+    libcoll_linkedlist_node_t *head = collision_list->head;
+    switch (builtin_comparator_kind_of(hm->key_comparator_function)) {
+    case BUILTIN_CMP_STR:
+        return search_chain(hm, head, hashcode, key, builtin_strcmp);
+    case BUILTIN_CMP_MEMADDR:
+        return search_chain(hm, head, hashcode, key, builtin_memaddrcmp);
+    case BUILTIN_CMP_INTPTR:
+        return search_chain(hm, head, hashcode, key, builtin_intptrcmp);
+    default:
+        return search_chain(hm, head, hashcode, key, hm->key_comparator_function);
+    }
+}
 
-            entry_tmp = libcoll_linkedlist_iter_next(iter);
-            key_tmp = entry_tmp->key;
+static libcoll_hashmap_entry_t* find_entry(const libcoll_hashmap_t *hm, uint64_t hashcode, const void *key)
+{
+    libcoll_linkedlist_node_t *node = find_entry_node(hm, hashcode, key);
+    return NULL != node ? (libcoll_hashmap_entry_t*) node->value : NULL;
+}
 
-            if (hm->key_comparator_function(key, key_tmp) == 0) {
-                matching_entry = entry_tmp;
-                break;
-            }
-        }
-        libcoll_linkedlist_free_iter(iter);
-    } else {
-        DEBUGF("find_entry: no collision list found for key %p\n", key);
+/*
+ * Appends an existing entry into the collision list of the bucket its
+ * hash value maps to.
+ */
+static void insert_entry(libcoll_hashmap_t *hm, libcoll_hashmap_entry_t *entry)
+{
+    size_t slot_index = hash(hm, entry->hash);
+    DEBUGF("insert_entry: inserting at bucket %lu\n", slot_index);
+    libcoll_linkedlist_t *collision_list = hm->buckets[slot_index];
+
+    if (NULL == collision_list) {
+        collision_list = libcoll_linkedlist_init_with_comparator(hm->key_comparator_function);
+        hm->buckets[slot_index] = collision_list;
     }
 
-    return matching_entry;
+    libcoll_linkedlist_append(collision_list, entry);
 }
 
 /*
@@ -86,7 +148,7 @@ static libcoll_hashmap_entry_t* find_entry(const libcoll_hashmap_t *hm, const vo
  * Returns: an insertion result indicating whether an existing entry was
  * replaced or a new entry added, or whether there was an error.
  */
-static libcoll_map_insertion_result_t insert_new(libcoll_hashmap_t *hm, const void *key, const void *value)
+static libcoll_map_insertion_result_t insert_new(libcoll_hashmap_t *hm, uint64_t hashcode, const void *key, const void *value)
 {
     libcoll_map_insertion_result_t result;
 
@@ -96,41 +158,24 @@ static libcoll_map_insertion_result_t insert_new(libcoll_hashmap_t *hm, const vo
         return result;
     }
 
-    size_t slot_index = hash(hm, hm->hash_code_function(key));
-    DEBUGF("insert_new: inserting at bucket %lu\n", slot_index);
-    libcoll_linkedlist_t *collision_list = hm->buckets[slot_index];
-
-    if (NULL == collision_list) {
-        collision_list = libcoll_linkedlist_init_with_comparator(hm->key_comparator_function);
-        hm->buckets[slot_index] = collision_list;
-    }
+    libcoll_hashmap_entry_t *entry = find_entry(hm, hashcode, key);
 
-    libcoll_linkedlist_iter_t *iter = libcoll_linkedlist_get_iter(collision_list);
-    libcoll_hashmap_entry_t *entry;
-    char key_exists = 0;
-
-    while ((entry = (libcoll_hashmap_entry_t*) libcoll_linkedlist_iter_next(iter)) != NULL) {
-        if (hm->key_comparator_function(key, entry->key) == 0) {
-            DEBUG("insert_new: replacing existing entry with matching key\n");
-            result.old_key = (void*) entry->key;
-            result.old_value = (void*) entry->value;
-            entry->key = key;
-            entry->value = value;
-
-            result.status = MAP_ENTRY_REPLACED;
-            result.error = MAP_ERROR_NONE;
-            key_exists = 1;
-            break;
-        }
-    }
-    libcoll_linkedlist_free_iter(iter);
+    if (NULL != entry) {
+        DEBUG("insert_new: replacing existing entry with matching key\n");
+        result.old_key = (void*) entry->key;
+        result.old_value = (void*) entry->value;
+        entry->key = key;
+        entry->value = value;
 
-    if (!key_exists) {
+        result.status = MAP_ENTRY_REPLACED;
+        result.error = MAP_ERROR_NONE;
+    } else {
         libcoll_hashmap_entry_t *new_entry = malloc(sizeof(libcoll_hashmap_entry_t));
         new_entry->key = key;
         new_entry->value = value;
+        new_entry->hash = hashcode;
 
-        libcoll_linkedlist_append(collision_list, new_entry);
+        insert_entry(hm, new_entry);
         result.status = MAP_ENTRY_ADDED;
         result.error = MAP_ERROR_NONE;
     }
@@ -152,20 +197,13 @@ static void resize(libcoll_hashmap_t *hm, size_t capacity)
         libcoll_linkedlist_t *list = old_buckets[i];
         if (NULL != list) {
             DEBUG("resize: nonempty list\n");
-            libcoll_linkedlist_iter_t *iter = libcoll_linkedlist_get_iter(list);
-            libcoll_hashmap_entry_t *old_entry;
-            while ((old_entry = libcoll_linkedlist_iter_next(iter)) != NULL) {
-                DEBUG("resize: reallocating list entry\n");
-                /* TODO: There shouldn't be any need to allocate all-new entries
-                 * and freeing the old ones. Could be improved, requires a bit
-                 * of reorganization.
+            libcoll_linkedlist_node_t *node;
+            for (node = list->head; NULL != node; node = node->next) {
+                /* entries carry their hash values, so they can be moved
+                 * over as they are, without calling the hash function
                  */
-                libcoll_map_insertion_result_t res = insert_new(hm, old_entry->key, old_entry->value);
-                DEBUGF("resize: insertion result: status=%d, error=%d\n", res.status, res.error);
-
-                free(old_entry);
+                insert_entry(hm, (libcoll_hashmap_entry_t*) node->value);
             }
-            libcoll_linkedlist_free_iter(iter);
             libcoll_linkedlist_deinit(list);
         }
     }
@@ -227,6 +265,9 @@ libcoll_hashmap_t* libcoll_hashmap_init_with_params(
     hm->max_load_factor = max_load_factor;
     hm->capacity = init_capacity;
     hm->total_entries = 0;
+    hm->key_traits.hash = NULL;
+    hm->key_traits.compare = NULL;
+    hm->key_traits.hash_determines_equality = 0;
 
     if (NULL != hash_code_function) {
         hm->hash_code_function = hash_code_function;
@@ -249,6 +290,25 @@ libcoll_hashmap_t* libcoll_hashmap_init_with_params(
     return hm;
 }
 
+libcoll_hashmap_t* libcoll_hashmap_init_with_traits(
+        size_t init_capacity,
+        float max_load_factor,
+        const libcoll_key_traits_t *key_traits,
+        int (*value_comparator_function)(const void *value1, const void *value2))
+{
+    libcoll_hashmap_t *hm = libcoll_hashmap_init_with_params(
+        init_capacity,
+        max_load_factor,
+        NULL,
+        key_traits->compare,
+        value_comparator_function);
+
+    hm->key_traits = *key_traits;
+    hm->key_traits.compare = hm->key_comparator_function;
+
+    return hm;
+}
+
 void libcoll_hashmap_deinit(libcoll_hashmap_t *hm)
 {
     for (size_t i=0; i<hm->capacity; i++) {
@@ -274,9 +334,20 @@ void libcoll_hashmap_deinit(libcoll_hashmap_t *hm)
     free(hm);
 }
 
+uint64_t libcoll_hashmap_hash_key(const libcoll_hashmap_t *hm, const void *key)
+{
+    return compute_hash(hm, key);
+}
+
 libcoll_map_insertion_result_t libcoll_hashmap_put(libcoll_hashmap_t *hm, const void *key, const void *value)
 {
-    libcoll_map_insertion_result_t result = insert_new(hm, key, value);
+    uint64_t hashcode = NULL != key ? compute_hash(hm, key) : 0;
+    return libcoll_hashmap_put_prehashed(hm, hashcode, key, value);
+}
+
+libcoll_map_insertion_result_t libcoll_hashmap_put_prehashed(libcoll_hashmap_t *hm, uint64_t hashcode, const void *key, const void *value)
+{
+    libcoll_map_insertion_result_t result = insert_new(hm, hashcode, key, value);
     if (result.status == MAP_ENTRY_ADDED) {
         hm->total_entries++;
         float load = (float) hm->total_entries / hm->capacity;
@@ -290,7 +361,12 @@ libcoll_map_insertion_result_t libcoll_hashmap_put(libcoll_hashmap_t *hm, const
 
 void* libcoll_hashmap_get(const libcoll_hashmap_t *hm, const void *key)
 {
-    libcoll_hashmap_entry_t *entry = find_entry(hm, key);
+    return libcoll_hashmap_get_prehashed(hm, compute_hash(hm, key), key);
+}
+
+void* libcoll_hashmap_get_prehashed(const libcoll_hashmap_t *hm, uint64_t hashcode, const void *key)
+{
+    libcoll_hashmap_entry_t *entry = find_entry(hm, hashcode, key);
 
     if (NULL != entry) {
         return (void*) entry->value;
@@ -299,13 +375,42 @@ void* libcoll_hashmap_get(const libcoll_hashmap_t *hm, const void *key)
     }
 }
 
+void* libcoll_hashmap_get_by(const libcoll_hashmap_t *hm, uint64_t hashcode, const void *probe,
+                             int (*probe_comparator)(const void *probe, const void *key))
+{
+    libcoll_linkedlist_t *collision_list = hm->buckets[hash(hm, hashcode)];
+
+    if (NULL != collision_list) {
+        libcoll_linkedlist_node_t *node;
+        for (node = collision_list->head; NULL != node; node = node->next) {
+            libcoll_hashmap_entry_t *entry = (libcoll_hashmap_entry_t*) node->value;
+            if (entry->hash == hashcode && probe_comparator(probe, entry->key) == 0) {
+                return (void*) entry->value;
+            }
+        }
+    }
+
+    return NULL;
+}
+
 char libcoll_hashmap_contains(const libcoll_hashmap_t *hm, const void *key)
 {
-    libcoll_hashmap_entry_t *entry = find_entry(hm, key);
+    return libcoll_hashmap_contains_prehashed(hm, compute_hash(hm, key), key);
+}
+
+char libcoll_hashmap_contains_prehashed(const libcoll_hashmap_t *hm, uint64_t hashcode, const void *key)
+{
+    libcoll_hashmap_entry_t *entry = find_entry(hm, hashcode, key);
     return NULL != entry;
 }
 
 libcoll_map_removal_result_t libcoll_hashmap_remove(libcoll_hashmap_t *hm, const void *key)
+{
+    uint64_t hashcode = NULL != key ? compute_hash(hm, key) : 0;
+    return libcoll_hashmap_remove_prehashed(hm, hashcode, key);
+}
+
+libcoll_map_removal_result_t libcoll_hashmap_remove_prehashed(libcoll_hashmap_t *hm, uint64_t hashcode, const void *key)
 {
     libcoll_map_removal_result_t result;
 
@@ -319,24 +424,20 @@ libcoll_map_removal_result_t libcoll_hashmap_remove(libcoll_hashmap_t *hm, const
     result.key = NULL;
     result.value = NULL;
 
-    unsigned long key_hash = hash(hm, hm->hash_code_function(key));
-    size_t slot_index = (key_hash % hm->capacity);
-    libcoll_linkedlist_t *collision_list = hm->buckets[slot_index];
+    libcoll_linkedlist_node_t *node = find_entry_node(hm, hashcode, key);
 
-    if (NULL != collision_list) {
-        libcoll_linkedlist_iter_t *iter = libcoll_linkedlist_get_iter(collision_list);
-        while (libcoll_linkedlist_iter_has_next(iter)) {
-            libcoll_hashmap_entry_t *entry = (libcoll_hashmap_entry_t*) libcoll_linkedlist_iter_next(iter);
-            if (hm->key_comparator_function(key, entry->key) == 0) {
-                result.key = (void*) entry->key;
-                result.value = (void*) entry->value;
-                result.status = MAP_ENTRY_REMOVED;
-                libcoll_linkedlist_iter_remove(iter);
-                hm->total_entries--;
-                free(entry);
-            }
-        }
-        libcoll_linkedlist_free_iter(iter);
+    if (NULL != node) {
+        libcoll_hashmap_entry_t *entry = (libcoll_hashmap_entry_t*) node->value;
+        libcoll_linkedlist_t *collision_list = hm->buckets[hash(hm, hashcode)];
+
+        result.key = (void*) entry->key;
+        result.value = (void*) entry->value;
+        result.status = MAP_ENTRY_REMOVED;
+
+        libcoll_linkedlist_remove_node(collision_list, node);
+
+        hm->total_entries--;
+        free(entry);
     }
 
     return result;
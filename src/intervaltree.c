@@ -0,0 +1,319 @@
+/*
+ * intervaltree.c
+ *
+ * An interval tree for overlap queries, built on the red-black treemap.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "intervaltree.h"
+#include "treemap.h"
+
+#include "debug.h"
+
+/* declarations of static helper functions for internal use */
+static libcoll_treemap_aggregate_t end_of_entry(const void *key, const void *value);
+static libcoll_treemap_aggregate_t max_end(libcoll_treemap_aggregate_t left, libcoll_treemap_aggregate_t right);
+static int compare_intervals(const void *interval1, const void *interval2);
+static int compare_interval_pointers(const void *pointer1, const void *pointer2);
+static long long max_end_of(const libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* first_overlap(libcoll_treemap_node_t *node, long long low, long long high);
+static libcoll_treemap_node_t* next_overlap(libcoll_treemap_node_t *node, long long low, long long high);
+
+static const libcoll_treemap_monoid_t max_end_monoid = { { LLONG_MIN }, end_of_entry, max_end };
+
+
+/* external API functions */
+
+/*
+ * Initializes a new, empty interval tree.
+ *
+ * Returns: a pointer to the new tree, or NULL if allocating memory failed
+ */
+libcoll_intervaltree_t* libcoll_intervaltree_init()
+{
+    libcoll_intervaltree_t *tree = malloc(sizeof(libcoll_intervaltree_t));
+    if (NULL == tree)  return NULL;
+
+    tree->map = libcoll_treemap_init_with_comparator(compare_intervals);
+    if (NULL == tree->map) {
+        free(tree);
+        return NULL;
+    }
+    libcoll_treemap_set_monoid(tree->map, &max_end_monoid);
+    return tree;
+}
+
+/*
+ * Frees the memory used by the tree and its intervals.  The values of the
+ * intervals are not freed.
+ */
+void libcoll_intervaltree_deinit(libcoll_intervaltree_t *tree)
+{
+    /* the intervals are the keys of the map, and its values are unused */
+    libcoll_treemap_deinit_and_delete_contents(tree->map);
+    free(tree);
+}
+
+/*
+ * Adds the closed interval [start, end] with the given value into the tree.
+ *
+ * Returns: the interval stored in the tree, which identifies it for removal,
+ *          or NULL if end is less than start or allocating memory failed
+ */
+libcoll_interval_t* libcoll_intervaltree_add(libcoll_intervaltree_t *tree, long long start, long long end,
+                                             void *value)
+{
+    if (end < start)  return NULL;
+
+    libcoll_interval_t *interval = malloc(sizeof(libcoll_interval_t));
+    if (NULL == interval)  return NULL;
+
+    interval->start = start;
+    interval->end = end;
+    interval->value = value;
+    if (NULL == libcoll_treemap_add(tree->map, interval, NULL)) {
+        free(interval);
+        return NULL;
+    }
+    return interval;
+}
+
+/*
+ * Removes an interval returned by libcoll_intervaltree_add or an iterator
+ * from the tree, and frees it.
+ *
+ * Returns: the value of the interval, or NULL if the interval is not in the
+ *          tree
+ */
+void* libcoll_intervaltree_remove(libcoll_intervaltree_t *tree, libcoll_interval_t *interval)
+{
+    if (NULL == libcoll_treemap_remove(tree->map, interval).a)  return NULL;
+
+    void *value = interval->value;
+    free(interval);
+    return value;
+}
+
+/*
+ * Fills an empty tree with copies of the given intervals in O(n log n) time
+ * for sorting them, building the tree itself in linear time.
+ *
+ * Returns: true if the tree was filled, or false if the tree was not empty,
+ *          an interval ends before it starts or allocating memory failed, in
+ *          which case the tree remains empty
+ */
+bool libcoll_intervaltree_build(libcoll_intervaltree_t *tree, const libcoll_interval_t *intervals, size_t count)
+{
+    if (!libcoll_intervaltree_is_empty(tree))  return false;
+    for (size_t i=0; i<count; i++) {
+        if (intervals[i].end < intervals[i].start)  return false;
+    }
+
+    libcoll_interval_t **copies = malloc(count * sizeof(libcoll_interval_t*));
+    libcoll_pair_voidptr_t *pairs = malloc(count * sizeof(libcoll_pair_voidptr_t));
+    size_t copied = 0;
+    bool built = false;
+
+    if (NULL != copies && NULL != pairs) {
+        while (copied < count && NULL != (copies[copied] = malloc(sizeof(libcoll_interval_t)))) {
+            *copies[copied] = intervals[copied];
+            copied++;
+        }
+    }
+    if (copied == count) {
+        qsort(copies, count, sizeof(libcoll_interval_t*), compare_interval_pointers);
+        for (size_t i=0; i<count; i++) {
+            pairs[i].a = copies[i];
+            pairs[i].b = NULL;
+        }
+        built = libcoll_treemap_build_sorted(tree->map, pairs, count);
+    }
+
+    if (!built) {
+        for (size_t i=0; i<copied; i++) {
+            free(copies[i]);
+        }
+    }
+    free(copies);
+    free(pairs);
+    return built;
+}
+
+size_t libcoll_intervaltree_get_size(libcoll_intervaltree_t *tree)
+{
+    return libcoll_treemap_get_size(tree->map);
+}
+
+char libcoll_intervaltree_is_empty(libcoll_intervaltree_t *tree)
+{
+    return libcoll_treemap_is_empty(tree->map);
+}
+
+/*
+ * Initializes an iterator over the intervals overlapping the closed range
+ * [low, high], i.e. those starting at or before high and ending at or after
+ * low.  Finding each interval takes O(log n) time, regardless of how many
+ * intervals do not overlap the range.
+ *
+ * Modifying the tree invalidates the iterator.
+ */
+void libcoll_intervaltree_init_overlap_iterator(libcoll_intervaltree_iter_t *iterator, libcoll_intervaltree_t *tree,
+                                                long long low, long long high)
+{
+    iterator->low = low;
+    iterator->high = high;
+    iterator->next = low <= high ? first_overlap(tree->map->root, low, high) : NULL;
+}
+
+/*
+ * Initializes an iterator over the intervals containing the given point.
+ */
+void libcoll_intervaltree_init_stab_iterator(libcoll_intervaltree_iter_t *iterator, libcoll_intervaltree_t *tree,
+                                             long long point)
+{
+    libcoll_intervaltree_init_overlap_iterator(iterator, tree, point, point);
+}
+
+bool libcoll_intervaltree_has_next(libcoll_intervaltree_iter_t *iterator)
+{
+    return NULL != iterator->next;
+}
+
+/*
+ * Moves the iterator forward.
+ *
+ * Returns: the next overlapping interval, or NULL if there are no more
+ */
+libcoll_interval_t* libcoll_intervaltree_next(libcoll_intervaltree_iter_t *iterator)
+{
+    libcoll_treemap_node_t *node = iterator->next;
+    if (NULL == node)  return NULL;
+
+    iterator->next = next_overlap(node, iterator->low, iterator->high);
+    return (libcoll_interval_t*) node->key;
+}
+
+
+/* static helper functions */
+
+static libcoll_treemap_aggregate_t end_of_entry(const void *key, const void *value)
+{
+    libcoll_treemap_aggregate_t aggregate;
+    (void) value;
+    aggregate.integer = ((const libcoll_interval_t*) key)->end;
+    return aggregate;
+}
+
+static libcoll_treemap_aggregate_t max_end(libcoll_treemap_aggregate_t left, libcoll_treemap_aggregate_t right)
+{
+    return left.integer >= right.integer ? left : right;
+}
+
+static int compare_intervals(const void *interval1, const void *interval2)
+{
+    const libcoll_interval_t *a = interval1;
+    const libcoll_interval_t *b = interval2;
+    if (a->start != b->start) {
+        return a->start < b->start ? -1 : 1;
+    } else if (a->end != b->end) {
+        return a->end < b->end ? -1 : 1;
+    } else if (a != b) {
+        return a < b ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compare_interval_pointers(const void *pointer1, const void *pointer2)
+{
+    return compare_intervals(*(libcoll_interval_t* const*) pointer1, *(libcoll_interval_t* const*) pointer2);
+}
+
+static long long max_end_of(const libcoll_treemap_node_t *node)
+{
+    return libcoll_treemap_is_null_node(node) ? LLONG_MIN : node->aggregate.integer;
+}
+
+/*
+ * Finds the first interval in order in the given subtree overlapping the
+ * range.  A subtree whose largest end point is not less than low holds an
+ * interval ending at or after low, and the walk ends at the first one of
+ * them, unless it starts after high, in which case so do all the following
+ * intervals.
+ *
+ * Returns: the node of the interval, or NULL if there is none
+ */
+static libcoll_treemap_node_t* first_overlap(libcoll_treemap_node_t *node, long long low, long long high)
+{
+    if (max_end_of(node) < low)  return NULL;
+
+    while (!libcoll_treemap_is_null_node(node)) {
+        const libcoll_interval_t *interval = node->key;
+        if (max_end_of(node->left) >= low) {
+            node = node->left;
+        } else if (interval->start > high) {
+            return NULL;
+        } else if (interval->end >= low) {
+            return node;
+        } else {
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Finds the next interval in order after the given node overlapping the
+ * range, first in its right subtree, and then at each ancestor it is a left
+ * descendant of and in that ancestor's right subtree.
+ *
+ * Returns: the node of the interval, or NULL if there is none
+ */
+static libcoll_treemap_node_t* next_overlap(libcoll_treemap_node_t *node, long long low, long long high)
+{
+    libcoll_treemap_node_t *found = first_overlap(node->right, low, high);
+    while (NULL == found && !libcoll_treemap_is_null_node(node->parent)) {
+        libcoll_treemap_node_t *parent = node->parent;
+        if (node == parent->left) {
+            const libcoll_interval_t *interval = parent->key;
+            if (interval->start > high)  return NULL;
+            if (interval->end >= low)  return parent;
+            found = first_overlap(parent->right, low, high);
+        }
+        node = parent;
+    }
+    return found;
+}
+
+
+/* helpers used for testing */
+
+bool _libcoll_intervaltree_verify(libcoll_intervaltree_t *tree)
+{
+    return _libcoll_treemap_verify_red_black_conditions(tree->map);
+}
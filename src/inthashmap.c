@@ -0,0 +1,320 @@
+/*
+ * inthashmap.c
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>  /* for ssize_t */
+
+#include "inthashmap.h"
+#include "map.h"
+
+#include "debug.h"
+
+#define BITS_PER_WORD   64
+
+/* 2^64 divided by the golden ratio, for Fibonacci hashing */
+#define FIBONACCI_MULTIPLIER    0x9E3779B97F4A7C15ULL
+
+static size_t home_slot(const libcoll_inthashmap_t *hm, uint64_t key)
+{
+    /* multiplicative hashing; the high bits of the product are well mixed
+     * even for sequential keys or keys sharing their low bits
+     */
+    return (size_t) ((key * FIBONACCI_MULTIPLIER) >> hm->hash_shift);
+}
+
+static char is_occupied(const libcoll_inthashmap_t *hm, size_t index)
+{
+    return (hm->occupied[index / BITS_PER_WORD] >> (index % BITS_PER_WORD)) & 1;
+}
+
+static void set_occupied(libcoll_inthashmap_t *hm, size_t index)
+{
+    hm->occupied[index / BITS_PER_WORD] |= (uint64_t) 1 << (index % BITS_PER_WORD);
+}
+
+static void clear_occupied(libcoll_inthashmap_t *hm, size_t index)
+{
+    hm->occupied[index / BITS_PER_WORD] &= ~((uint64_t) 1 << (index % BITS_PER_WORD));
+}
+
+static unsigned int hash_shift_for(size_t capacity)
+{
+    unsigned int shift = 64;
+    while (capacity > 1) {
+        capacity /= 2;
+        shift--;
+    }
+    return shift;
+}
+
+static size_t bitmap_words(size_t capacity)
+{
+    return (capacity + BITS_PER_WORD - 1) / BITS_PER_WORD;
+}
+
+/*
+ * Finds the slot containing the given key.
+ * Returns the index of the slot, or -1 if the key is not in the map.
+ */
+static ssize_t find_slot(const libcoll_inthashmap_t *hm, uint64_t key)
+{
+    size_t mask = hm->capacity - 1;
+    size_t index = home_slot(hm, key);
+
+    /* the load factor is always below 1, so an empty slot terminates this */
+    while (is_occupied(hm, index)) {
+        if (hm->slots[index].key == key) {
+            return (ssize_t) index;
+        }
+        index = (index + 1) & mask;
+    }
+    return -1;
+}
+
+/*
+ * Stores a key-value pair known not to exist in the map yet
+ * into the first free slot in its probe sequence.
+ * Returns the index of the slot used.
+ */
+static size_t insert_new(libcoll_inthashmap_t *hm, uint64_t key, uint64_t value)
+{
+    size_t mask = hm->capacity - 1;
+    size_t index = home_slot(hm, key);
+
+    while (is_occupied(hm, index)) {
+        index = (index + 1) & mask;
+    }
+    hm->slots[index].key = key;
+    hm->slots[index].value = value;
+    set_occupied(hm, index);
+
+    return index;
+}
+
+static void resize(libcoll_inthashmap_t *hm, size_t capacity)
+{
+    DEBUGF("inthashmap resize: %lu -> %lu\n", hm->capacity, capacity);
+
+    size_t old_cap = hm->capacity;
+    libcoll_inthashmap_entry_t *old_slots = hm->slots;
+    uint64_t *old_occupied = hm->occupied;
+
+    hm->slots = malloc(capacity * sizeof(libcoll_inthashmap_entry_t));
+    hm->occupied = calloc(bitmap_words(capacity), sizeof(uint64_t));
+    hm->capacity = capacity;
+    hm->hash_shift = hash_shift_for(capacity);
+
+    for (size_t i=0; i<old_cap; i++) {
+        if ((old_occupied[i / BITS_PER_WORD] >> (i % BITS_PER_WORD)) & 1) {
+            insert_new(hm, old_slots[i].key, old_slots[i].value);
+        }
+    }
+
+    free(old_slots);
+    free(old_occupied);
+}
+
+/*
+ * Grows the map if adding one more entry would exceed the maximum load factor.
+ */
+static void reserve_one(libcoll_inthashmap_t *hm)
+{
+    float load = (float) (hm->total_entries + 1) / hm->capacity;
+    if (load > hm->max_load_factor || hm->total_entries + 1 >= hm->capacity) {
+        resize(hm, hm->capacity * 2);
+    }
+}
+
+libcoll_inthashmap_t* libcoll_inthashmap_init()
+{
+    return libcoll_inthashmap_init_with_params(
+        LIBCOLL_INTHASHMAP_DEFAULT_INIT_SIZE,
+        LIBCOLL_INTHASHMAP_DEFAULT_MAX_LOAD_FACTOR);
+}
+
+libcoll_inthashmap_t* libcoll_inthashmap_init_with_params(size_t init_capacity, float max_load_factor)
+{
+    libcoll_inthashmap_t *hm = malloc(sizeof(libcoll_inthashmap_t));
+
+    size_t capacity = 2;
+    while (capacity < init_capacity) {
+        capacity *= 2;
+    }
+
+    hm->slots = malloc(capacity * sizeof(libcoll_inthashmap_entry_t));
+    hm->occupied = calloc(bitmap_words(capacity), sizeof(uint64_t));
+    hm->capacity = capacity;
+    hm->total_entries = 0;
+    hm->max_load_factor = max_load_factor;
+    hm->hash_shift = hash_shift_for(capacity);
+
+    return hm;
+}
+
+void libcoll_inthashmap_deinit(libcoll_inthashmap_t *hm)
+{
+    free(hm->slots);
+    free(hm->occupied);
+    free(hm);
+}
+
+libcoll_map_insertion_status libcoll_inthashmap_put(libcoll_inthashmap_t *hm, uint64_t key, uint64_t value)
+{
+    ssize_t index = find_slot(hm, key);
+    if (index != -1) {
+        hm->slots[index].value = value;
+        return MAP_ENTRY_REPLACED;
+    }
+
+    reserve_one(hm);
+    insert_new(hm, key, value);
+    hm->total_entries++;
+
+    return MAP_ENTRY_ADDED;
+}
+
+char libcoll_inthashmap_get(const libcoll_inthashmap_t *hm, uint64_t key, uint64_t *value)
+{
+    ssize_t index = find_slot(hm, key);
+    if (index != -1) {
+        *value = hm->slots[index].value;
+        return 1;
+    }
+    return 0;
+}
+
+uint64_t* libcoll_inthashmap_get_ref(const libcoll_inthashmap_t *hm, uint64_t key)
+{
+    ssize_t index = find_slot(hm, key);
+    return index != -1 ? &hm->slots[index].value : NULL;
+}
+
+uint64_t* libcoll_inthashmap_get_or_put(libcoll_inthashmap_t *hm, uint64_t key, uint64_t initial_value)
+{
+    ssize_t index = find_slot(hm, key);
+    if (index == -1) {
+        reserve_one(hm);
+        index = (ssize_t) insert_new(hm, key, initial_value);
+        hm->total_entries++;
+    }
+    return &hm->slots[index].value;
+}
+
+char libcoll_inthashmap_contains(const libcoll_inthashmap_t *hm, uint64_t key)
+{
+    return find_slot(hm, key) != -1;
+}
+
+char libcoll_inthashmap_remove(libcoll_inthashmap_t *hm, uint64_t key, uint64_t *value)
+{
+    ssize_t found = find_slot(hm, key);
+    if (found == -1) {
+        return 0;
+    }
+
+    if (NULL != value) {
+        *value = hm->slots[found].value;
+    }
+
+    /* Backward shift deletion: move later entries of the probe sequence
+     * into the hole as long as that doesn't place them in front of their
+     * home slots.  This keeps probe sequences unbroken without tombstones.
+     */
+    size_t mask = hm->capacity - 1;
+    size_t hole = (size_t) found;
+    size_t index = (hole + 1) & mask;
+
+    while (is_occupied(hm, index)) {
+        size_t home = home_slot(hm, hm->slots[index].key);
+        size_t dist_from_home = (index - home) & mask;
+        size_t dist_from_hole = (index - hole) & mask;
+        if (dist_from_home >= dist_from_hole) {
+            hm->slots[hole] = hm->slots[index];
+            hole = index;
+        }
+        index = (index + 1) & mask;
+    }
+    clear_occupied(hm, hole);
+    hm->total_entries--;
+
+    return 1;
+}
+
+size_t libcoll_inthashmap_get_capacity(const libcoll_inthashmap_t *hm)
+{
+    return hm->capacity;
+}
+
+size_t libcoll_inthashmap_get_size(const libcoll_inthashmap_t *hm)
+{
+    return hm->total_entries;
+}
+
+char libcoll_inthashmap_is_empty(const libcoll_inthashmap_t *hm)
+{
+    return hm->total_entries == 0;
+}
+
+static size_t find_next_occupied_slot(const libcoll_inthashmap_t *hm, size_t start_index)
+{
+    while (start_index < hm->capacity && !is_occupied(hm, start_index)) {
+        start_index++;
+    }
+    return start_index;
+}
+
+libcoll_inthashmap_iter_t* libcoll_inthashmap_get_iterator(libcoll_inthashmap_t *hm)
+{
+    libcoll_inthashmap_iter_t *iter = malloc(sizeof(libcoll_inthashmap_iter_t));
+    iter->hm = hm;
+    iter->next_index = find_next_occupied_slot(hm, 0);
+
+    return iter;
+}
+
+void libcoll_inthashmap_free_iterator(libcoll_inthashmap_iter_t *iter)
+{
+    free(iter);
+}
+
+char libcoll_inthashmap_iter_has_next(libcoll_inthashmap_iter_t *iter)
+{
+    return iter->next_index < iter->hm->capacity;
+}
+
+libcoll_inthashmap_entry_t* libcoll_inthashmap_iter_next(libcoll_inthashmap_iter_t *iter)
+{
+    if (iter->next_index >= iter->hm->capacity) {
+        return NULL;
+    }
+
+    libcoll_inthashmap_entry_t *entry = &iter->hm->slots[iter->next_index];
+    iter->next_index = find_next_occupied_slot(iter->hm, iter->next_index + 1);
+
+    return entry;
+}
@@ -0,0 +1,71 @@
+/*
+ * keytraits.c
+ *
+ * Predefined key traits for common key types.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#include "comparators.h"
+#include "hash.h"
+#include "keytraits.h"
+
+static uint64_t hash_str(const void *key)
+{
+    return libcoll_hashcode_crc32c_str(key);
+}
+
+static uint64_t hash_bytes(const void *key)
+{
+    return libcoll_hashcode_bytes(key);
+}
+
+static uint64_t hash_int(const void *key)
+{
+    return libcoll_hashcode_crc32c_int(key);
+}
+
+static uint64_t hash_memaddr(const void *key)
+{
+    return libcoll_hashcode_crc32c_memaddr(key);
+}
+
+const libcoll_key_traits_t libcoll_key_traits_str = {
+    hash_str, libcoll_strcmp_wrapper, 0
+};
+
+const libcoll_key_traits_t libcoll_key_traits_bytes = {
+    hash_bytes, libcoll_bytescmp, 0
+};
+
+/* a CRC of 32 bits of data is a bijection, so no two such ints collide */
+const libcoll_key_traits_t libcoll_key_traits_int = {
+    hash_int, libcoll_intptrcmp, sizeof(int) == 4
+};
+
+const libcoll_key_traits_t libcoll_key_traits_memaddr = {
+    hash_memaddr, libcoll_memaddrcmp, 0
+};
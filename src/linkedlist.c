@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "builtins.h"
 #include "comparators.h"
 #include "linkedlist.h"
 #include "list.h"
@@ -182,24 +183,50 @@ libcoll_list_replacement_result_t libcoll_linkedlist_replace_at(libcoll_linkedli
     return result;
 }
 
-int libcoll_linkedlist_index_of(libcoll_linkedlist_t *list, void *value)
+/*
+ * Finds the first node with a value equal to the given one, storing its index
+ * in *index.  Meant to be inlined with a constant comparator so that the
+ * built-in comparators get inlined into the loop.
+ */
+static inline libcoll_linkedlist_node_t* find_node_with(libcoll_linkedlist_t *list,
+                                                        const void *value,
+                                                        builtin_comparator_t compare_function,
+                                                        int *index)
 {
-    int retval = -1;
     int counter = 0;
+    libcoll_linkedlist_node_t *node;
 
-    libcoll_linkedlist_node_t *node = list->head;
-
-    while(NULL != node) {
-        if (list->compare_function(value, node->value) == 0) {
-            retval = counter;
+    for (node = list->head; NULL != node; node = node->next) {
+        if (compare_function(value, node->value) == 0) {
             break;
-        } else {
-            node = node->next;
-            counter++;
         }
+        counter++;
+    }
+
+    *index = counter;
+    return node;
+}
+
+static libcoll_linkedlist_node_t* find_node(libcoll_linkedlist_t *list, const void *value, int *index)
+{
+    switch (builtin_comparator_kind_of(list->compare_function)) {
+    case BUILTIN_CMP_MEMADDR:
+        return find_node_with(list, value, &builtin_memaddrcmp, index);
+    case BUILTIN_CMP_STR:
+        return find_node_with(list, value, &builtin_strcmp, index);
+    case BUILTIN_CMP_INTPTR:
+        return find_node_with(list, value, &builtin_intptrcmp, index);
+    default:
+        return find_node_with(list, value, list->compare_function, index);
     }
+}
+
+int libcoll_linkedlist_index_of(libcoll_linkedlist_t *list, void *value)
+{
+    int index;
+    libcoll_linkedlist_node_t *node = find_node(list, value, &index);
 
-    return retval;
+    return NULL != node ? index : -1;
 }
 
 char libcoll_linkedlist_contains(libcoll_linkedlist_t *list, void *value)
@@ -209,22 +236,21 @@ char libcoll_linkedlist_contains(libcoll_linkedlist_t *list, void *value)
 
 char libcoll_linkedlist_remove(libcoll_linkedlist_t *list, void *value)
 {
-    char success = 0;
-    libcoll_linkedlist_iter_t *iter = libcoll_linkedlist_get_iter(list);
+    int index;
+    libcoll_linkedlist_node_t *node = find_node(list, value, &index);
 
-    while (libcoll_linkedlist_iter_has_next(iter) && !success) {
-        void *entry_value = libcoll_linkedlist_iter_next(iter);
-        if (list->compare_function(value, entry_value) == 0) {
-            libcoll_linkedlist_iter_remove(iter);
-            success = 1;
-        }
+    if (NULL == node) {
+        return 0;
     }
 
-    libcoll_linkedlist_free_iter(iter);
-
-    return success;
+    _libcoll_linkedlist_remove_node(list, node);
+    return 1;
 }
 
+void libcoll_linkedlist_remove_node(libcoll_linkedlist_t *list, libcoll_linkedlist_node_t *node)
+{
+    _libcoll_linkedlist_remove_node(list, node);
+}
 
 libcoll_linkedlist_iter_t* libcoll_linkedlist_get_iter(libcoll_linkedlist_t *list)
 {
@@ -0,0 +1,698 @@
+/*
+ * persistentmap.c
+ *
+ * An ordered map whose versions can be read by other threads while it is
+ * being modified.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "persistentmap.h"
+#include "builtins.h"
+#include "comparators.h"
+
+#include "debug.h"
+
+/* outcomes of updating a subtree */
+#define UPDATE_OK           0
+#define UPDATE_EXISTS       1
+#define UPDATE_NOT_FOUND    2
+#define UPDATE_NO_MEMORY    3
+
+/* declarations of static helper functions for internal use */
+static libcoll_persistentmap_node_t* retain_node(libcoll_persistentmap_node_t *node);
+static void release_node(libcoll_persistentmap_node_t *node);
+static int height_of(const libcoll_persistentmap_node_t *node);
+static libcoll_persistentmap_node_t* create_node(void *key, void *value, libcoll_persistentmap_node_t *left,
+                                                 libcoll_persistentmap_node_t *right);
+static libcoll_persistentmap_node_t* create_balanced_node(void *key, void *value,
+                                                          libcoll_persistentmap_node_t *left,
+                                                          libcoll_persistentmap_node_t *right);
+static libcoll_persistentmap_node_t* insert(const libcoll_persistentmap_snapshot_t *version,
+                                            libcoll_persistentmap_node_t *node, void *key, void *value,
+                                            int *status);
+static libcoll_persistentmap_node_t* delete(const libcoll_persistentmap_snapshot_t *version,
+                                            libcoll_persistentmap_node_t *node, const void *key,
+                                            libcoll_persistentmap_node_t **deleted, int *status);
+static libcoll_persistentmap_node_t* delete_minimum(libcoll_persistentmap_node_t *node,
+                                                    libcoll_persistentmap_node_t **minimum, int *status);
+static libcoll_persistentmap_node_t* find_node(const libcoll_persistentmap_snapshot_t *version, const void *key);
+static bool publish(libcoll_persistentmap_t *map, libcoll_persistentmap_node_t *root, size_t size);
+static libcoll_persistentmap_snapshot_t* retain_snapshot(libcoll_persistentmap_snapshot_t *snapshot);
+static int compare_keys(const libcoll_persistentmap_snapshot_t *version, const void *key1, const void *key2);
+static int _verify_subtree(const libcoll_persistentmap_snapshot_t *version, const libcoll_persistentmap_node_t *node,
+                           const void *lower, const void *upper, size_t *count);
+
+
+/* external API functions */
+
+/*
+ * Initializes a new persistent map.
+ * The new map will use the default comparator (comparison by memory address)
+ * for determining the (in)equality and mutual order of keys.
+ *
+ * Returns: a pointer to the newly allocated map, or NULL if allocating memory
+ *          failed
+ */
+libcoll_persistentmap_t* libcoll_persistentmap_init()
+{
+    return libcoll_persistentmap_init_with_comparator(NULL);
+}
+
+/*
+ * Initializes a new persistent map that uses the given comparator for
+ * ordering its keys.  If the comparator is NULL, keys are compared by their
+ * memory addresses.
+ *
+ * Returns: a pointer to the newly allocated map, or NULL if allocating memory
+ *          failed
+ */
+libcoll_persistentmap_t* libcoll_persistentmap_init_with_comparator(int (*key_comparator)(const void *key1, const void *key2))
+{
+    libcoll_persistentmap_t *map = malloc(sizeof(libcoll_persistentmap_t));
+    if (NULL == map) {
+        return NULL;
+    }
+
+    map->key_comparator = NULL != key_comparator ? key_comparator : &libcoll_memaddrcmp;
+    map->current = malloc(sizeof(libcoll_persistentmap_snapshot_t));
+    if (NULL == map->current || 0 != pthread_mutex_init(&map->lock, NULL)) {
+        free(map->current);
+        free(map);
+        return NULL;
+    }
+
+    map->current->root = NULL;
+    map->current->size = 0;
+    map->current->refcount = 1;
+    map->current->key_comparator = map->key_comparator;
+    return map;
+}
+
+/*
+ * Frees the memory used by the map.  The keys and values stored in the map
+ * are not freed.
+ *
+ * Snapshots taken of the map remain valid, and the nodes they share with the
+ * map are only freed when the snapshots are released.
+ */
+void libcoll_persistentmap_deinit(libcoll_persistentmap_t *map)
+{
+    libcoll_persistentmap_release_snapshot(map->current);
+    pthread_mutex_destroy(&map->lock);
+    free(map);
+}
+
+/*
+ * Adds a new key-value pair into the map, creating a new version of it.
+ * The previous version remains unchanged for the snapshots referring to it.
+ *
+ * Returns: true if the pair was added, or false if the key already exists in
+ *          the map or allocating memory failed
+ */
+bool libcoll_persistentmap_add(libcoll_persistentmap_t *map, void *key, void *value)
+{
+    int status = UPDATE_OK;
+    libcoll_persistentmap_node_t *root = insert(map->current, map->current->root, key, value, &status);
+    if (UPDATE_OK != status) {
+        DEBUG("libcoll_persistentmap_add: key already exists or out of memory\n");
+        return false;
+    }
+
+    return publish(map, root, map->current->size + 1);
+}
+
+/*
+ * Retrieves the value associated with the given key in the current version
+ * of the map.  Only the thread modifying the map may use this function;
+ * other threads should take a snapshot instead.
+ *
+ * Returns: the value for the key, or NULL if the key is not in the map
+ */
+void* libcoll_persistentmap_get(libcoll_persistentmap_t *map, const void *key)
+{
+    return libcoll_persistentmap_snapshot_get(map->current, key);
+}
+
+/*
+ * Removes the given key from the map, creating a new version of it.
+ * The previous version remains unchanged for the snapshots referring to it.
+ *
+ * Returns: the removed key and value, or a pair of NULLs if the key was not
+ *          found or allocating memory for the new version failed
+ */
+libcoll_pair_voidptr_t libcoll_persistentmap_remove(libcoll_persistentmap_t *map, const void *key)
+{
+    libcoll_pair_voidptr_t pair = { NULL, NULL };
+    libcoll_persistentmap_node_t *deleted = NULL;
+    int status = UPDATE_OK;
+
+    libcoll_persistentmap_node_t *root = delete(map->current, map->current->root, key, &deleted, &status);
+    if (UPDATE_OK != status) {
+        return pair;
+    }
+
+    /* the deleted node lives on in the previous version until it is published */
+    pair.a = deleted->key;
+    pair.b = deleted->value;
+    if (!publish(map, root, map->current->size - 1)) {
+        pair.a = NULL;
+        pair.b = NULL;
+    }
+    return pair;
+}
+
+/*
+ * Returns: the number of keys in the current version of the map
+ */
+size_t libcoll_persistentmap_get_size(libcoll_persistentmap_t *map)
+{
+    return map->current->size;
+}
+
+/*
+ * Takes a snapshot of the current version of the map.  This takes constant
+ * time, and may be done by any thread while another thread is modifying the
+ * map.  The snapshot must be released using
+ * libcoll_persistentmap_release_snapshot.
+ *
+ * Returns: the current version of the map
+ */
+libcoll_persistentmap_snapshot_t* libcoll_persistentmap_snapshot(libcoll_persistentmap_t *map)
+{
+    pthread_mutex_lock(&map->lock);
+    libcoll_persistentmap_snapshot_t *snapshot = retain_snapshot(map->current);
+    pthread_mutex_unlock(&map->lock);
+    return snapshot;
+}
+
+/*
+ * Releases a snapshot.  When no snapshots, iterators or map refer to
+ * a version anymore, the nodes used only by that version are freed.
+ */
+void libcoll_persistentmap_release_snapshot(libcoll_persistentmap_snapshot_t *snapshot)
+{
+    if (0 == __atomic_sub_fetch(&snapshot->refcount, 1, __ATOMIC_ACQ_REL)) {
+        release_node(snapshot->root);
+        free(snapshot);
+    }
+}
+
+/*
+ * Retrieves the value associated with the given key in the snapshot.
+ *
+ * Returns: the value for the key, or NULL if the key is not in the snapshot
+ */
+void* libcoll_persistentmap_snapshot_get(libcoll_persistentmap_snapshot_t *snapshot, const void *key)
+{
+    libcoll_persistentmap_node_t *node = find_node(snapshot, key);
+    return NULL != node ? node->value : NULL;
+}
+
+/*
+ * Returns: true if the given key is in the snapshot, false if it is not
+ */
+bool libcoll_persistentmap_snapshot_contains(libcoll_persistentmap_snapshot_t *snapshot, const void *key)
+{
+    return NULL != find_node(snapshot, key);
+}
+
+/*
+ * Returns: the number of keys in the snapshot
+ */
+size_t libcoll_persistentmap_snapshot_get_size(libcoll_persistentmap_snapshot_t *snapshot)
+{
+    return snapshot->size;
+}
+
+/*
+ * Creates an iterator over the snapshot in key order, starting from the
+ * smallest key.  The iterator keeps the snapshot alive until the iterator is
+ * freed, so the snapshot itself may be released before that.
+ *
+ * Returns: a new iterator, or NULL if allocating memory failed
+ */
+libcoll_persistentmap_iter_t* libcoll_persistentmap_get_iterator(libcoll_persistentmap_snapshot_t *snapshot)
+{
+    libcoll_persistentmap_iter_t *iterator = malloc(sizeof(libcoll_persistentmap_iter_t));
+    if (NULL != iterator) {
+        iterator->snapshot = retain_snapshot(snapshot);
+        iterator->depth = 0;
+        for (libcoll_persistentmap_node_t *node = snapshot->root; NULL != node; node = node->left) {
+            iterator->path[iterator->depth++] = node;
+        }
+    }
+    return iterator;
+}
+
+/*
+ * Creates an iterator over the snapshot in key order, starting from the first
+ * key that is greater than or equal to the given key.
+ *
+ * Returns: a new iterator, or NULL if allocating memory failed
+ */
+libcoll_persistentmap_iter_t* libcoll_persistentmap_get_iterator_at(libcoll_persistentmap_snapshot_t *snapshot,
+                                                                    const void *key)
+{
+    libcoll_persistentmap_iter_t *iterator = malloc(sizeof(libcoll_persistentmap_iter_t));
+    if (NULL != iterator) {
+        iterator->snapshot = retain_snapshot(snapshot);
+        iterator->depth = 0;
+
+        /* only the nodes not less than the key are left to be visited on the way back up */
+        libcoll_persistentmap_node_t *node = snapshot->root;
+        while (NULL != node) {
+            if (compare_keys(snapshot, key, node->key) <= 0) {
+                iterator->path[iterator->depth++] = node;
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+    }
+    return iterator;
+}
+
+/*
+ * Frees the iterator, and releases its reference to the snapshot.
+ */
+void libcoll_persistentmap_free_iterator(libcoll_persistentmap_iter_t *iterator)
+{
+    libcoll_persistentmap_release_snapshot(iterator->snapshot);
+    free(iterator);
+}
+
+/*
+ * Returns: true if there are more keys to iterate over, false otherwise
+ */
+bool libcoll_persistentmap_has_next(libcoll_persistentmap_iter_t *iterator)
+{
+    return iterator->depth > 0;
+}
+
+/*
+ * Advances the iterator to the next key.
+ *
+ * Returns: the next key and value, or a pair of NULLs if there are no more keys
+ */
+libcoll_pair_voidptr_t libcoll_persistentmap_next(libcoll_persistentmap_iter_t *iterator)
+{
+    libcoll_pair_voidptr_t pair = { NULL, NULL };
+    if (0 == iterator->depth) {
+        return pair;
+    }
+
+    libcoll_persistentmap_node_t *node = iterator->path[--iterator->depth];
+    for (libcoll_persistentmap_node_t *next = node->right; NULL != next; next = next->left) {
+        iterator->path[iterator->depth++] = next;
+    }
+
+    pair.a = node->key;
+    pair.b = node->value;
+    return pair;
+}
+
+
+/* static helper functions */
+
+static libcoll_persistentmap_node_t* retain_node(libcoll_persistentmap_node_t *node)
+{
+    if (NULL != node) {
+        __atomic_add_fetch(&node->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return node;
+}
+
+/*
+ * Drops a reference to a node, freeing the node and dropping its references
+ * to its children if it was the last one.
+ */
+static void release_node(libcoll_persistentmap_node_t *node)
+{
+    while (NULL != node && 0 == __atomic_sub_fetch(&node->refcount, 1, __ATOMIC_ACQ_REL)) {
+        libcoll_persistentmap_node_t *right = node->right;
+        release_node(node->left);
+        free(node);
+        node = right;
+    }
+}
+
+static int height_of(const libcoll_persistentmap_node_t *node)
+{
+    return NULL != node ? node->height : 0;
+}
+
+/*
+ * Creates a node with the given children.  The references to the children
+ * are handed over to the new node, and dropped if allocating memory fails.
+ *
+ * Returns: the new node, or NULL if allocating memory failed
+ */
+static libcoll_persistentmap_node_t* create_node(void *key, void *value, libcoll_persistentmap_node_t *left,
+                                                 libcoll_persistentmap_node_t *right)
+{
+    libcoll_persistentmap_node_t *node = malloc(sizeof(libcoll_persistentmap_node_t));
+    if (NULL == node) {
+        release_node(left);
+        release_node(right);
+        return NULL;
+    }
+
+    node->left = left;
+    node->right = right;
+    node->key = key;
+    node->value = value;
+    node->refcount = 1;
+    int left_height = height_of(left);
+    int right_height = height_of(right);
+    node->height = (left_height > right_height ? left_height : right_height) + 1;
+    return node;
+}
+
+/*
+ * Creates a node with the given children, where the heights of the children
+ * differ by at most two, rebalancing with a single or a double rotation if
+ * they differ by two.  Instead of modifying the existing child nodes, the
+ * rotations create new nodes in their place.
+ *
+ * Like create_node, the references to the children are handed over.
+ *
+ * Returns: the root of the new subtree, or NULL if allocating memory failed
+ */
+static libcoll_persistentmap_node_t* create_balanced_node(void *key, void *value,
+                                                          libcoll_persistentmap_node_t *left,
+                                                          libcoll_persistentmap_node_t *right)
+{
+    libcoll_persistentmap_node_t *outer, *inner, *result;
+
+    if (height_of(left) > height_of(right) + 1) {
+        if (height_of(left->left) >= height_of(left->right)) {
+            inner = create_node(key, value, retain_node(left->right), right);
+            result = NULL != inner ? create_node(left->key, left->value, retain_node(left->left), inner) : NULL;
+        } else {
+            libcoll_persistentmap_node_t *pivot = left->right;
+            outer = create_node(left->key, left->value, retain_node(left->left), retain_node(pivot->left));
+            inner = create_node(key, value, retain_node(pivot->right), right);
+            if (NULL == outer || NULL == inner) {
+                release_node(outer);
+                release_node(inner);
+                result = NULL;
+            } else {
+                result = create_node(pivot->key, pivot->value, outer, inner);
+            }
+        }
+        release_node(left);
+        return result;
+    }
+
+    if (height_of(right) > height_of(left) + 1) {
+        if (height_of(right->right) >= height_of(right->left)) {
+            inner = create_node(key, value, left, retain_node(right->left));
+            result = NULL != inner ? create_node(right->key, right->value, inner, retain_node(right->right)) : NULL;
+        } else {
+            libcoll_persistentmap_node_t *pivot = right->left;
+            inner = create_node(key, value, left, retain_node(pivot->left));
+            outer = create_node(right->key, right->value, retain_node(pivot->right), retain_node(right->right));
+            if (NULL == outer || NULL == inner) {
+                release_node(outer);
+                release_node(inner);
+                result = NULL;
+            } else {
+                result = create_node(pivot->key, pivot->value, inner, outer);
+            }
+        }
+        release_node(right);
+        return result;
+    }
+
+    return create_node(key, value, left, right);
+}
+
+/*
+ * Creates a copy of the subtree with the given key added, copying the nodes on
+ * the path to the key and sharing the rest.  The status is set if the key
+ * already exists or allocating memory fails.
+ *
+ * Returns: a reference to the root of the new subtree
+ */
+static libcoll_persistentmap_node_t* insert(const libcoll_persistentmap_snapshot_t *version,
+                                            libcoll_persistentmap_node_t *node, void *key, void *value,
+                                            int *status)
+{
+    if (NULL == node) {
+        libcoll_persistentmap_node_t *added = create_node(key, value, NULL, NULL);
+        if (NULL == added) {
+            *status = UPDATE_NO_MEMORY;
+        }
+        return added;
+    }
+
+    int cmpval = compare_keys(version, key, node->key);
+    if (cmpval == 0) {
+        *status = UPDATE_EXISTS;
+        return NULL;
+    }
+
+    libcoll_persistentmap_node_t *left, *right;
+    if (cmpval < 0) {
+        left = insert(version, node->left, key, value, status);
+        right = retain_node(node->right);
+    } else {
+        left = retain_node(node->left);
+        right = insert(version, node->right, key, value, status);
+    }
+    if (UPDATE_OK != *status) {
+        release_node(left);
+        release_node(right);
+        return NULL;
+    }
+
+    libcoll_persistentmap_node_t *copy = create_balanced_node(node->key, node->value, left, right);
+    if (NULL == copy) {
+        *status = UPDATE_NO_MEMORY;
+    }
+    return copy;
+}
+
+/*
+ * Creates a copy of the subtree with the given key removed, copying the nodes
+ * on the path to the key and sharing the rest.  The removed node is left
+ * untouched and returned through deleted.  The status is set if the key is not
+ * found or allocating memory fails.
+ *
+ * Returns: a reference to the root of the new subtree, which is NULL if the
+ *          subtree became empty
+ */
+static libcoll_persistentmap_node_t* delete(const libcoll_persistentmap_snapshot_t *version,
+                                            libcoll_persistentmap_node_t *node, const void *key,
+                                            libcoll_persistentmap_node_t **deleted, int *status)
+{
+    if (NULL == node) {
+        *status = UPDATE_NOT_FOUND;
+        return NULL;
+    }
+
+    libcoll_persistentmap_node_t *left, *right;
+    void *node_key = node->key;
+    void *node_value = node->value;
+
+    int cmpval = compare_keys(version, key, node->key);
+    if (cmpval == 0) {
+        *deleted = node;
+        if (NULL == node->left) {
+            return retain_node(node->right);
+        } else if (NULL == node->right) {
+            return retain_node(node->left);
+        }
+
+        /* replace the node with its successor */
+        libcoll_persistentmap_node_t *successor = NULL;
+        left = retain_node(node->left);
+        right = delete_minimum(node->right, &successor, status);
+        if (NULL != successor) {
+            node_key = successor->key;
+            node_value = successor->value;
+        }
+    } else if (cmpval < 0) {
+        left = delete(version, node->left, key, deleted, status);
+        right = retain_node(node->right);
+    } else {
+        left = retain_node(node->left);
+        right = delete(version, node->right, key, deleted, status);
+    }
+    if (UPDATE_OK != *status) {
+        release_node(left);
+        release_node(right);
+        return NULL;
+    }
+
+    libcoll_persistentmap_node_t *copy = create_balanced_node(node_key, node_value, left, right);
+    if (NULL == copy) {
+        *status = UPDATE_NO_MEMORY;
+    }
+    return copy;
+}
+
+/*
+ * Creates a copy of the non-empty subtree with its smallest key removed,
+ * returning the removed node through minimum.
+ */
+static libcoll_persistentmap_node_t* delete_minimum(libcoll_persistentmap_node_t *node,
+                                                    libcoll_persistentmap_node_t **minimum, int *status)
+{
+    if (NULL == node->left) {
+        *minimum = node;
+        return retain_node(node->right);
+    }
+
+    libcoll_persistentmap_node_t *left = delete_minimum(node->left, minimum, status);
+    if (UPDATE_OK != *status) {
+        return NULL;
+    }
+
+    libcoll_persistentmap_node_t *copy = create_balanced_node(node->key, node->value, left,
+                                                              retain_node(node->right));
+    if (NULL == copy) {
+        *status = UPDATE_NO_MEMORY;
+    }
+    return copy;
+}
+
+static libcoll_persistentmap_node_t* find_node(const libcoll_persistentmap_snapshot_t *version, const void *key)
+{
+    libcoll_persistentmap_node_t *node = version->root;
+    while (NULL != node) {
+        int cmpval = compare_keys(version, key, node->key);
+        if (cmpval < 0) {
+            node = node->left;
+        } else if (cmpval > 0) {
+            node = node->right;
+        } else {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Makes a new version with the given root the current version of the map,
+ * and drops the map's reference to the previous version.
+ *
+ * Returns: true if the new version was published, false if allocating memory
+ *          failed, in which case the new nodes are freed
+ */
+static bool publish(libcoll_persistentmap_t *map, libcoll_persistentmap_node_t *root, size_t size)
+{
+    libcoll_persistentmap_snapshot_t *version = malloc(sizeof(libcoll_persistentmap_snapshot_t));
+    if (NULL == version) {
+        release_node(root);
+        return false;
+    }
+    version->root = root;
+    version->size = size;
+    version->refcount = 1;
+    version->key_comparator = map->key_comparator;
+
+    pthread_mutex_lock(&map->lock);
+    libcoll_persistentmap_snapshot_t *previous = map->current;
+    map->current = version;
+    pthread_mutex_unlock(&map->lock);
+
+    libcoll_persistentmap_release_snapshot(previous);
+    return true;
+}
+
+static libcoll_persistentmap_snapshot_t* retain_snapshot(libcoll_persistentmap_snapshot_t *snapshot)
+{
+    __atomic_add_fetch(&snapshot->refcount, 1, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+static int compare_keys(const libcoll_persistentmap_snapshot_t *version, const void *key1, const void *key2)
+{
+    switch (builtin_comparator_kind_of(version->key_comparator)) {
+    case BUILTIN_CMP_STR:
+        return builtin_strcmp(key1, key2);
+    case BUILTIN_CMP_MEMADDR:
+        return builtin_memaddrcmp(key1, key2);
+    case BUILTIN_CMP_INTPTR:
+        return builtin_intptrcmp(key1, key2);
+    default:
+        return version->key_comparator(key1, key2);
+    }
+}
+
+
+/* helpers used for testing */
+
+/*
+ * Verifies that the snapshot is a valid AVL tree: keys are in order, stored
+ * heights are correct, the heights of siblings differ by at most one, and the
+ * size matches the number of nodes.
+ */
+bool _libcoll_persistentmap_verify(libcoll_persistentmap_snapshot_t *snapshot)
+{
+    size_t count = 0;
+    if (_verify_subtree(snapshot, snapshot->root, NULL, NULL, &count) < 0) {
+        return false;
+    }
+    return count == snapshot->size;
+}
+
+/*
+ * Returns: the height of the subtree, or -1 if the subtree is not valid
+ */
+static int _verify_subtree(const libcoll_persistentmap_snapshot_t *version, const libcoll_persistentmap_node_t *node,
+                           const void *lower, const void *upper, size_t *count)
+{
+    if (NULL == node) {
+        return 0;
+    }
+    if ((NULL != lower && compare_keys(version, node->key, lower) <= 0)
+            || (NULL != upper && compare_keys(version, node->key, upper) >= 0)) {
+        DEBUG("_libcoll_persistentmap_verify: keys out of order\n");
+        return -1;
+    }
+    if (0 == node->refcount) {
+        return -1;
+    }
+    (*count)++;
+
+    int left_height = _verify_subtree(version, node->left, lower, node->key, count);
+    int right_height = _verify_subtree(version, node->right, node->key, upper, count);
+    if (left_height < 0 || right_height < 0 || abs(left_height - right_height) > 1) {
+        return -1;
+    }
+
+    int height = (left_height > right_height ? left_height : right_height) + 1;
+    if (height != node->height) {
+        DEBUG("_libcoll_persistentmap_verify: wrong height\n");
+        return -1;
+    }
+    return height;
+}
@@ -0,0 +1,1019 @@
+/*
+ * radixtree.c
+ *
+ * An ordered map for byte string keys implemented as an adaptive radix tree.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "radixtree.h"
+
+#include "debug.h"
+
+#define MAX_PREFIX  LIBCOLL_RADIXTREE_MAX_PREFIX
+
+#define NODE4       0
+#define NODE16      1
+#define NODE48      2
+#define NODE256     3
+
+#define INSERT_ADDED        0
+#define INSERT_EXISTS       1
+#define INSERT_NO_MEMORY    2
+
+#define IS_LEAF(node)   (((uintptr_t) (node)) & 1)
+#define AS_LEAF(node)   ((libcoll_radixtree_leaf_t*) ((uintptr_t) (node) & ~(uintptr_t) 1))
+#define TAG_LEAF(leaf)  ((libcoll_radixtree_node_t*) ((uintptr_t) (leaf) | 1))
+
+#define AS_NODE4(node)      ((libcoll_radixtree_node4_t*) (node))
+#define AS_NODE16(node)     ((libcoll_radixtree_node16_t*) (node))
+#define AS_NODE48(node)     ((libcoll_radixtree_node48_t*) (node))
+#define AS_NODE256(node)    ((libcoll_radixtree_node256_t*) (node))
+
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+
+/* declarations of static helper functions for internal use */
+static libcoll_radixtree_leaf_t* create_leaf(const unsigned char *key, size_t length, void *value);
+static libcoll_radixtree_node_t* create_node(unsigned char type);
+static void copy_header(libcoll_radixtree_node_t *dest, const libcoll_radixtree_node_t *src);
+static void deinit_subtree(libcoll_radixtree_node_t *node, bool delete_contents);
+static bool leaf_matches(const libcoll_radixtree_leaf_t *leaf, const unsigned char *key, size_t length);
+static libcoll_radixtree_leaf_t* minimum_leaf(const libcoll_radixtree_node_t *node);
+static size_t prefix_mismatch(const libcoll_radixtree_node_t *node, const unsigned char *key,
+                              size_t length, size_t depth);
+static libcoll_radixtree_node_t** find_child(libcoll_radixtree_node_t *node, unsigned char byte);
+static unsigned int count_smaller_keys(const unsigned char *keys, unsigned int count, unsigned char byte);
+static bool add_child(libcoll_radixtree_node_t **ref, unsigned char byte, libcoll_radixtree_node_t *child);
+static void remove_child(libcoll_radixtree_node_t *node, unsigned char byte);
+static void shrink(libcoll_radixtree_node_t **ref);
+static void place_leaf(libcoll_radixtree_node_t *node, libcoll_radixtree_leaf_t *leaf, size_t depth);
+static int insert(libcoll_radixtree_node_t **ref, const unsigned char *key, size_t length,
+                  size_t depth, void *value);
+static libcoll_radixtree_leaf_t* delete(libcoll_radixtree_node_t **ref, const unsigned char *key,
+                                        size_t length, size_t depth);
+static libcoll_radixtree_node_t* child_at(const libcoll_radixtree_node_t *node, int *position);
+static bool push_frame(libcoll_radixtree_iter_t *iterator, libcoll_radixtree_node_t *node);
+static libcoll_radixtree_iter_t* create_iterator(libcoll_radixtree_t *tree, libcoll_radixtree_node_t *start);
+static void advance(libcoll_radixtree_iter_t *iterator);
+static bool verify_subtree(const libcoll_radixtree_node_t *node, size_t depth, size_t *leaf_count);
+
+
+/* external API functions */
+
+/*
+ * Initializes a new, empty radix tree map.
+ *
+ * Returns: a pointer to the new map, or NULL if allocating memory failed
+ */
+libcoll_radixtree_t* libcoll_radixtree_init()
+{
+    libcoll_radixtree_t *tree = malloc(sizeof(libcoll_radixtree_t));
+    if (NULL != tree) {
+        tree->size = 0;
+        tree->root = NULL;
+    }
+    return tree;
+}
+
+/*
+ * Frees the memory used by the map, including the copies of the keys.  The
+ * values stored in the map are not freed.
+ */
+void libcoll_radixtree_deinit(libcoll_radixtree_t *tree)
+{
+    deinit_subtree(tree->root, false);
+    free(tree);
+}
+
+/*
+ * Frees the memory used by the map, including the values stored in it.
+ */
+void libcoll_radixtree_deinit_and_delete_contents(libcoll_radixtree_t *tree)
+{
+    deinit_subtree(tree->root, true);
+    free(tree);
+}
+
+/*
+ * Adds a new key-value pair into the map.  The key is copied, so the caller
+ * may free or reuse its own copy afterwards.
+ *
+ * Returns: true if the pair was added, or false if the key already exists in
+ *          the map or allocating memory failed
+ */
+bool libcoll_radixtree_add(libcoll_radixtree_t *tree, const void *key, size_t length, void *value)
+{
+    int result = insert(&tree->root, key, length, 0, value);
+    if (INSERT_ADDED != result) {
+        DEBUGF("libcoll_radixtree_add: %s\n",
+              INSERT_EXISTS == result ? "key already exists" : "out of memory");
+        return false;
+    }
+    tree->size++;
+    return true;
+}
+
+/*
+ * Finds the value for the given key without comparing whole keys until a
+ * leaf is reached.  Bytes of long compressed paths that are not stored in the
+ * nodes are skipped, and checked by comparing the key with the leaf's.
+ *
+ * Returns: the value, or NULL if the key is not in the map
+ */
+void* libcoll_radixtree_get(libcoll_radixtree_t *tree, const void *key, size_t length)
+{
+    const unsigned char *bytes = key;
+    libcoll_radixtree_node_t *node = tree->root;
+    size_t depth = 0;
+
+    while (NULL != node) {
+        if (IS_LEAF(node)) {
+            libcoll_radixtree_leaf_t *leaf = AS_LEAF(node);
+            return leaf_matches(leaf, bytes, length) ? leaf->value : NULL;
+        }
+
+        if (node->prefix_length > 0) {
+            if (node->prefix_length > length - depth)  return NULL;
+
+            size_t stored = MIN(node->prefix_length, MAX_PREFIX);
+            if (0 != memcmp(node->prefix, bytes + depth, stored))  return NULL;
+            depth += node->prefix_length;
+        }
+
+        if (depth == length) {
+            libcoll_radixtree_leaf_t *leaf = node->terminal;
+            return NULL != leaf && leaf_matches(leaf, bytes, length) ? leaf->value : NULL;
+        }
+
+        libcoll_radixtree_node_t **child = find_child(node, bytes[depth]);
+        node = NULL != child ? *child : NULL;
+        depth++;
+    }
+    return NULL;
+}
+
+/*
+ * Checks whether the given key is in the map.  Unlike libcoll_radixtree_get,
+ * this also finds keys whose value is NULL.
+ */
+bool libcoll_radixtree_contains(libcoll_radixtree_t *tree, const void *key, size_t length)
+{
+    const unsigned char *bytes = key;
+    libcoll_radixtree_node_t *node = tree->root;
+    size_t depth = 0;
+
+    while (NULL != node && !IS_LEAF(node)) {
+        if (prefix_mismatch(node, bytes, length, depth) < node->prefix_length)  return false;
+        depth += node->prefix_length;
+
+        if (depth == length)  return NULL != node->terminal;
+
+        libcoll_radixtree_node_t **child = find_child(node, bytes[depth]);
+        node = NULL != child ? *child : NULL;
+        depth++;
+    }
+    return NULL != node && leaf_matches(AS_LEAF(node), bytes, length);
+}
+
+/*
+ * Removes the given key from the map, shrinking the nodes on the way back up
+ * once they have few enough children to fit in a smaller node, and merging a
+ * node left with a single child into the child.
+ *
+ * Returns: the value for the removed key, or NULL if the key was not found
+ */
+void* libcoll_radixtree_remove(libcoll_radixtree_t *tree, const void *key, size_t length)
+{
+    libcoll_radixtree_leaf_t *leaf = delete(&tree->root, key, length, 0);
+    if (NULL == leaf)  return NULL;
+
+    void *value = leaf->value;
+    free(leaf);
+    tree->size--;
+    return value;
+}
+
+size_t libcoll_radixtree_get_size(libcoll_radixtree_t *tree)
+{
+    return tree->size;
+}
+
+char libcoll_radixtree_is_empty(libcoll_radixtree_t *tree)
+{
+    return tree->size == 0;
+}
+
+/*
+ * Gets an iterator for iterating through the entries of the map in the byte
+ * order of their keys.
+ *
+ * Modifying the map invalidates the iterator.
+ *
+ * Returns: a pointer to the new iterator, or NULL if allocating memory failed
+ */
+libcoll_radixtree_iter_t* libcoll_radixtree_get_iterator(libcoll_radixtree_t *tree)
+{
+    return create_iterator(tree, tree->root);
+}
+
+/*
+ * Gets an iterator for iterating through the entries whose keys start with
+ * the given prefix, in the byte order of their keys.  All such keys are in
+ * the subtree reached by following the prefix from the root, so the scan
+ * visits no other entries.
+ *
+ * Modifying the map invalidates the iterator.
+ *
+ * Returns: a pointer to the new iterator, or NULL if allocating memory failed
+ */
+libcoll_radixtree_iter_t* libcoll_radixtree_get_prefix_iterator(libcoll_radixtree_t *tree,
+                                                                const void *prefix, size_t length)
+{
+    const unsigned char *bytes = prefix;
+    libcoll_radixtree_node_t *node = tree->root;
+    libcoll_radixtree_node_t *start = NULL;
+    size_t depth = 0;
+
+    while (NULL != node) {
+        if (IS_LEAF(node)) {
+            libcoll_radixtree_leaf_t *leaf = AS_LEAF(node);
+            if (leaf->key_length >= length && 0 == memcmp(leaf->key, bytes, length)) {
+                start = node;
+            }
+            break;
+        }
+
+        size_t matched = prefix_mismatch(node, bytes, length, depth);
+        if (depth + matched == length) {
+            start = node;
+            break;
+        } else if (matched < node->prefix_length) {
+            break;
+        }
+        depth += node->prefix_length;
+
+        libcoll_radixtree_node_t **child = find_child(node, bytes[depth]);
+        node = NULL != child ? *child : NULL;
+        depth++;
+    }
+    return create_iterator(tree, start);
+}
+
+void libcoll_radixtree_free_iterator(libcoll_radixtree_iter_t *iterator)
+{
+    free(iterator->frames);
+    free(iterator);
+}
+
+bool libcoll_radixtree_has_next(libcoll_radixtree_iter_t *iterator)
+{
+    return NULL != iterator->next;
+}
+
+/*
+ * Moves the iterator forward.
+ *
+ * Returns: the leaf holding the next key and its value, or NULL if the
+ *          iterator is already at the end
+ */
+libcoll_radixtree_leaf_t* libcoll_radixtree_next(libcoll_radixtree_iter_t *iterator)
+{
+    libcoll_radixtree_leaf_t *leaf = iterator->next;
+    if (NULL != leaf) {
+        advance(iterator);
+    }
+    return leaf;
+}
+
+
+/* static helper functions */
+
+static libcoll_radixtree_leaf_t* create_leaf(const unsigned char *key, size_t length, void *value)
+{
+    libcoll_radixtree_leaf_t *leaf = malloc(sizeof(libcoll_radixtree_leaf_t) + length);
+    if (NULL != leaf) {
+        leaf->value = value;
+        leaf->key_length = length;
+        if (length > 0) {
+            memcpy(leaf->key, key, length);
+        }
+    }
+    return leaf;
+}
+
+/*
+ * Allocates a zeroed node, so that every child slot starts out empty.
+ */
+static libcoll_radixtree_node_t* create_node(unsigned char type)
+{
+    static const size_t sizes[] = {
+        sizeof(libcoll_radixtree_node4_t),
+        sizeof(libcoll_radixtree_node16_t),
+        sizeof(libcoll_radixtree_node48_t),
+        sizeof(libcoll_radixtree_node256_t)
+    };
+
+    libcoll_radixtree_node_t *node = calloc(1, sizes[type]);
+    if (NULL != node) {
+        node->type = type;
+    }
+    return node;
+}
+
+static void copy_header(libcoll_radixtree_node_t *dest, const libcoll_radixtree_node_t *src)
+{
+    dest->child_count = src->child_count;
+    dest->prefix_length = src->prefix_length;
+    memcpy(dest->prefix, src->prefix, MAX_PREFIX);
+    dest->terminal = src->terminal;
+}
+
+static void deinit_subtree(libcoll_radixtree_node_t *node, bool delete_contents)
+{
+    if (NULL == node)  return;
+
+    if (IS_LEAF(node)) {
+        libcoll_radixtree_leaf_t *leaf = AS_LEAF(node);
+        if (delete_contents) {
+            free(leaf->value);
+        }
+        free(leaf);
+        return;
+    }
+
+    if (NULL != node->terminal) {
+        deinit_subtree(TAG_LEAF(node->terminal), delete_contents);
+    }
+    int position = 0;
+    libcoll_radixtree_node_t *child;
+    while (NULL != (child = child_at(node, &position))) {
+        deinit_subtree(child, delete_contents);
+    }
+    free(node);
+}
+
+static bool leaf_matches(const libcoll_radixtree_leaf_t *leaf, const unsigned char *key, size_t length)
+{
+    return leaf->key_length == length && (0 == length || 0 == memcmp(leaf->key, key, length));
+}
+
+/*
+ * Finds the leaf with the smallest key in the subtree.  Every key in the
+ * subtree shares the path down to the node, so any leaf will do for
+ * recovering the bytes of a compressed path that are not stored in the node.
+ */
+static libcoll_radixtree_leaf_t* minimum_leaf(const libcoll_radixtree_node_t *node)
+{
+    while (!IS_LEAF(node)) {
+        if (NULL != node->terminal)  return node->terminal;
+
+        int position = 0;
+        node = child_at(node, &position);
+    }
+    return AS_LEAF(node);
+}
+
+/*
+ * Compares the compressed path of the node with the key starting at the given
+ * depth, taking the bytes that do not fit in the node from a leaf below it.
+ *
+ * Returns: the number of leading bytes of the path that match the key, which
+ *          is less than the length of the path if they differ or the key ends
+ *          within the path
+ */
+static size_t prefix_mismatch(const libcoll_radixtree_node_t *node, const unsigned char *key,
+                              size_t length, size_t depth)
+{
+    size_t limit = MIN(node->prefix_length, length - depth);
+    size_t stored = MIN(limit, MAX_PREFIX);
+    size_t i;
+
+    for (i=0; i<stored; i++) {
+        if (node->prefix[i] != key[depth + i])  return i;
+    }
+    if (i < limit) {
+        const libcoll_radixtree_leaf_t *leaf = minimum_leaf(node);
+        for (; i<limit; i++) {
+            if (leaf->key[depth + i] != key[depth + i])  return i;
+        }
+    }
+    return i;
+}
+
+/*
+ * Finds the slot holding the child for the given key byte.  A node with 16
+ * children compares the byte with all of its keys at once when SSE2 is
+ * available.
+ *
+ * Returns: a pointer to the slot, or NULL if there is no such child
+ */
+static libcoll_radixtree_node_t** find_child(libcoll_radixtree_node_t *node, unsigned char byte)
+{
+    switch (node->type) {
+    case NODE4: {
+        libcoll_radixtree_node4_t *n = AS_NODE4(node);
+        for (unsigned int i=0; i<node->child_count; i++) {
+            if (n->keys[i] == byte)  return &n->children[i];
+        }
+        return NULL;
+    }
+    case NODE16: {
+        libcoll_radixtree_node16_t *n = AS_NODE16(node);
+#ifdef __SSE2__
+        __m128i matches = _mm_cmpeq_epi8(_mm_set1_epi8((char) byte),
+                                         _mm_loadu_si128((const __m128i*) n->keys));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(matches) & ((1u << node->child_count) - 1);
+        return 0 != mask ? &n->children[__builtin_ctz(mask)] : NULL;
+#else
+        for (unsigned int i=0; i<node->child_count; i++) {
+            if (n->keys[i] == byte)  return &n->children[i];
+        }
+        return NULL;
+#endif
+    }
+    case NODE48: {
+        libcoll_radixtree_node48_t *n = AS_NODE48(node);
+        unsigned char index = n->child_index[byte];
+        return 0 != index ? &n->children[index - 1] : NULL;
+    }
+    default: {
+        libcoll_radixtree_node256_t *n = AS_NODE256(node);
+        return NULL != n->children[byte] ? &n->children[byte] : NULL;
+    }
+    }
+}
+
+/*
+ * Counts the keys less than the given byte in a sorted key array of a node
+ * with up to 16 children, which is the position where the byte belongs.  The
+ * SSE2 comparison is signed, so both sides are biased by 0x80 first, and as
+ * the keys are sorted, the smaller ones are a run of low bits in the mask.
+ */
+static unsigned int count_smaller_keys(const unsigned char *keys, unsigned int count, unsigned char byte)
+{
+#ifdef __SSE2__
+    if (count > 4) {
+        const __m128i bias = _mm_set1_epi8((char) 0x80);
+        __m128i less = _mm_cmplt_epi8(_mm_xor_si128(_mm_loadu_si128((const __m128i*) keys), bias),
+                                      _mm_xor_si128(_mm_set1_epi8((char) byte), bias));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(less) & ((1u << count) - 1);
+        return (unsigned int) __builtin_ctz(~mask);
+    }
+#endif
+    unsigned int i = 0;
+    while (i < count && keys[i] < byte) {
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Adds a child for a byte that has none in the node, first replacing the node
+ * with the next larger kind if it is full.
+ *
+ * Returns: true if the child was added, or false if allocating memory failed
+ */
+static bool add_child(libcoll_radixtree_node_t **ref, unsigned char byte, libcoll_radixtree_node_t *child)
+{
+    libcoll_radixtree_node_t *node = *ref;
+
+    switch (node->type) {
+    case NODE4:
+    case NODE16: {
+        unsigned int capacity = NODE4 == node->type ? 4 : 16;
+        unsigned char *keys = NODE4 == node->type ? AS_NODE4(node)->keys : AS_NODE16(node)->keys;
+        libcoll_radixtree_node_t **children = NODE4 == node->type ? AS_NODE4(node)->children
+                                                                  : AS_NODE16(node)->children;
+        unsigned int count = node->child_count;
+
+        if (count < capacity) {
+            unsigned int i = count_smaller_keys(keys, count, byte);
+            memmove(keys + i + 1, keys + i, count - i);
+            memmove(children + i + 1, children + i, (count - i) * sizeof(children[0]));
+            keys[i] = byte;
+            children[i] = child;
+            node->child_count++;
+            return true;
+        }
+
+        libcoll_radixtree_node_t *larger = create_node(NODE4 == node->type ? NODE16 : NODE48);
+        if (NULL == larger)  return false;
+        copy_header(larger, node);
+        if (NODE4 == node->type) {
+            memcpy(AS_NODE16(larger)->keys, keys, count);
+            memcpy(AS_NODE16(larger)->children, children, count * sizeof(children[0]));
+        } else {
+            for (unsigned int i=0; i<count; i++) {
+                AS_NODE48(larger)->child_index[keys[i]] = (unsigned char) (i + 1);
+                AS_NODE48(larger)->children[i] = children[i];
+            }
+        }
+        free(node);
+        *ref = larger;
+        return add_child(ref, byte, child);
+    }
+    case NODE48: {
+        libcoll_radixtree_node48_t *n = AS_NODE48(node);
+        if (node->child_count < 48) {
+            unsigned int i = 0;
+            while (NULL != n->children[i]) {
+                i++;
+            }
+            n->children[i] = child;
+            n->child_index[byte] = (unsigned char) (i + 1);
+            node->child_count++;
+            return true;
+        }
+
+        libcoll_radixtree_node_t *larger = create_node(NODE256);
+        if (NULL == larger)  return false;
+        copy_header(larger, node);
+        for (unsigned int b=0; b<256; b++) {
+            if (0 != n->child_index[b]) {
+                AS_NODE256(larger)->children[b] = n->children[n->child_index[b] - 1];
+            }
+        }
+        free(node);
+        *ref = larger;
+        return add_child(ref, byte, child);
+    }
+    default:
+        AS_NODE256(node)->children[byte] = child;
+        node->child_count++;
+        return true;
+    }
+}
+
+static void remove_child(libcoll_radixtree_node_t *node, unsigned char byte)
+{
+    switch (node->type) {
+    case NODE4:
+    case NODE16: {
+        unsigned char *keys = NODE4 == node->type ? AS_NODE4(node)->keys : AS_NODE16(node)->keys;
+        libcoll_radixtree_node_t **children = NODE4 == node->type ? AS_NODE4(node)->children
+                                                                  : AS_NODE16(node)->children;
+        unsigned int count = node->child_count;
+        unsigned int i = count_smaller_keys(keys, count, byte);
+        memmove(keys + i, keys + i + 1, count - i - 1);
+        memmove(children + i, children + i + 1, (count - i - 1) * sizeof(children[0]));
+        break;
+    }
+    case NODE48: {
+        libcoll_radixtree_node48_t *n = AS_NODE48(node);
+        n->children[n->child_index[byte] - 1] = NULL;
+        n->child_index[byte] = 0;
+        break;
+    }
+    default:
+        AS_NODE256(node)->children[byte] = NULL;
+        break;
+    }
+    node->child_count--;
+}
+
+/*
+ * Replaces a node that has become sparse after a removal.  A node left with
+ * only a terminal leaf or a single child is replaced by it, concatenating the
+ * compressed paths when the child is an inner node.  Larger nodes move to the
+ * next smaller kind once well under its capacity, so that a key alternately
+ * added and removed at the boundary does not make the node flip back and
+ * forth.  Shrinking needs no memory beyond the smaller node, and is skipped
+ * if that cannot be allocated.
+ */
+static void shrink(libcoll_radixtree_node_t **ref)
+{
+    libcoll_radixtree_node_t *node = *ref;
+    libcoll_radixtree_node_t *smaller = NULL;
+
+    switch (node->type) {
+    case NODE4: {
+        libcoll_radixtree_node4_t *n = AS_NODE4(node);
+        if (0 == node->child_count) {
+            *ref = NULL != node->terminal ? TAG_LEAF(node->terminal) : NULL;
+            free(node);
+        } else if (1 == node->child_count && NULL == node->terminal) {
+            libcoll_radixtree_node_t *child = n->children[0];
+            if (!IS_LEAF(child)) {
+                unsigned char prefix[MAX_PREFIX];
+                size_t length = MIN(node->prefix_length, MAX_PREFIX);
+                memcpy(prefix, node->prefix, length);
+                if (length < MAX_PREFIX) {
+                    prefix[length++] = n->keys[0];
+                }
+                if (length < MAX_PREFIX) {
+                    size_t from_child = MIN(child->prefix_length, MAX_PREFIX - length);
+                    memcpy(prefix + length, child->prefix, from_child);
+                    length += from_child;
+                }
+                memcpy(child->prefix, prefix, length);
+                child->prefix_length += node->prefix_length + 1;
+            }
+            *ref = child;
+            free(node);
+        }
+        return;
+    }
+    case NODE16:
+        if (node->child_count > 3)  return;
+        smaller = create_node(NODE4);
+        if (NULL == smaller)  return;
+        copy_header(smaller, node);
+        memcpy(AS_NODE4(smaller)->keys, AS_NODE16(node)->keys, node->child_count);
+        memcpy(AS_NODE4(smaller)->children, AS_NODE16(node)->children,
+               node->child_count * sizeof(libcoll_radixtree_node_t*));
+        break;
+    case NODE48: {
+        if (node->child_count > 12)  return;
+        smaller = create_node(NODE16);
+        if (NULL == smaller)  return;
+        copy_header(smaller, node);
+        libcoll_radixtree_node48_t *n = AS_NODE48(node);
+        unsigned int count = 0;
+        for (unsigned int b=0; b<256; b++) {
+            if (0 != n->child_index[b]) {
+                AS_NODE16(smaller)->keys[count] = (unsigned char) b;
+                AS_NODE16(smaller)->children[count] = n->children[n->child_index[b] - 1];
+                count++;
+            }
+        }
+        break;
+    }
+    default: {
+        if (node->child_count > 37)  return;
+        smaller = create_node(NODE48);
+        if (NULL == smaller)  return;
+        copy_header(smaller, node);
+        libcoll_radixtree_node256_t *n = AS_NODE256(node);
+        unsigned int count = 0;
+        for (unsigned int b=0; b<256; b++) {
+            if (NULL != n->children[b]) {
+                AS_NODE48(smaller)->child_index[b] = (unsigned char) (count + 1);
+                AS_NODE48(smaller)->children[count] = n->children[b];
+                count++;
+            }
+        }
+        break;
+    }
+    }
+    free(node);
+    *ref = smaller;
+}
+
+/*
+ * Stores a leaf in a new node with room to spare, either as its terminal leaf
+ * or under the byte of the key following the node's path.
+ */
+static void place_leaf(libcoll_radixtree_node_t *node, libcoll_radixtree_leaf_t *leaf, size_t depth)
+{
+    if (leaf->key_length == depth) {
+        node->terminal = leaf;
+    } else {
+        libcoll_radixtree_node_t *ref = node;
+        add_child(&ref, leaf->key[depth], TAG_LEAF(leaf));
+    }
+}
+
+/*
+ * Inserts a key below the given slot, where depth bytes of the key have been
+ * consumed on the way down.  A leaf in the way is replaced by a node on the
+ * path the two keys share, and a compressed path that the key leaves is split
+ * at the first differing byte.
+ */
+static int insert(libcoll_radixtree_node_t **ref, const unsigned char *key, size_t length,
+                  size_t depth, void *value)
+{
+    libcoll_radixtree_node_t *node = *ref;
+    libcoll_radixtree_leaf_t *leaf;
+
+    if (NULL == node) {
+        leaf = create_leaf(key, length, value);
+        if (NULL == leaf)  return INSERT_NO_MEMORY;
+        *ref = TAG_LEAF(leaf);
+        return INSERT_ADDED;
+    }
+
+    if (IS_LEAF(node)) {
+        libcoll_radixtree_leaf_t *existing = AS_LEAF(node);
+        if (leaf_matches(existing, key, length))  return INSERT_EXISTS;
+
+        leaf = create_leaf(key, length, value);
+        libcoll_radixtree_node_t *parent = create_node(NODE4);
+        if (NULL == leaf || NULL == parent) {
+            free(leaf);
+            free(parent);
+            return INSERT_NO_MEMORY;
+        }
+
+        size_t limit = MIN(existing->key_length, length);
+        size_t common = depth;
+        while (common < limit && existing->key[common] == key[common]) {
+            common++;
+        }
+        parent->prefix_length = common - depth;
+        memcpy(parent->prefix, key + depth, MIN(parent->prefix_length, MAX_PREFIX));
+        place_leaf(parent, existing, common);
+        place_leaf(parent, leaf, common);
+        *ref = parent;
+        return INSERT_ADDED;
+    }
+
+    if (node->prefix_length > 0) {
+        size_t matched = prefix_mismatch(node, key, length, depth);
+        if (matched < node->prefix_length) {
+            leaf = create_leaf(key, length, value);
+            libcoll_radixtree_node_t *parent = create_node(NODE4);
+            if (NULL == leaf || NULL == parent) {
+                free(leaf);
+                free(parent);
+                return INSERT_NO_MEMORY;
+            }
+            parent->prefix_length = matched;
+            memcpy(parent->prefix, node->prefix, MIN(matched, MAX_PREFIX));
+
+            /* the rest of the path, after the byte branching to the node */
+            unsigned char byte;
+            node->prefix_length -= matched + 1;
+            if (node->prefix_length + matched + 1 <= MAX_PREFIX) {
+                byte = node->prefix[matched];
+                memmove(node->prefix, node->prefix + matched + 1, node->prefix_length);
+            } else {
+                const libcoll_radixtree_leaf_t *any = minimum_leaf(node);
+                byte = any->key[depth + matched];
+                memcpy(node->prefix, any->key + depth + matched + 1, MIN(node->prefix_length, MAX_PREFIX));
+            }
+
+            libcoll_radixtree_node_t *slot = parent;
+            add_child(&slot, byte, node);
+            place_leaf(parent, leaf, depth + matched);
+            *ref = parent;
+            return INSERT_ADDED;
+        }
+        depth += node->prefix_length;
+    }
+
+    if (depth == length) {
+        if (NULL != node->terminal)  return INSERT_EXISTS;
+
+        leaf = create_leaf(key, length, value);
+        if (NULL == leaf)  return INSERT_NO_MEMORY;
+        node->terminal = leaf;
+        return INSERT_ADDED;
+    }
+
+    libcoll_radixtree_node_t **child = find_child(node, key[depth]);
+    if (NULL != child) {
+        return insert(child, key, length, depth + 1, value);
+    }
+
+    leaf = create_leaf(key, length, value);
+    if (NULL == leaf)  return INSERT_NO_MEMORY;
+    if (!add_child(ref, key[depth], TAG_LEAF(leaf))) {
+        free(leaf);
+        return INSERT_NO_MEMORY;
+    }
+    return INSERT_ADDED;
+}
+
+/*
+ * Unlinks the leaf for the key below the given slot, shrinking the node it
+ * was unlinked from.  A node below the slot never becomes empty, since one
+ * with a single entry left is replaced by that entry.
+ *
+ * Returns: the unlinked leaf, or NULL if the key was not found
+ */
+static libcoll_radixtree_leaf_t* delete(libcoll_radixtree_node_t **ref, const unsigned char *key,
+                                        size_t length, size_t depth)
+{
+    libcoll_radixtree_node_t *node = *ref;
+    libcoll_radixtree_leaf_t *leaf;
+
+    if (NULL == node)  return NULL;
+
+    if (IS_LEAF(node)) {
+        leaf = AS_LEAF(node);
+        if (!leaf_matches(leaf, key, length))  return NULL;
+        *ref = NULL;
+        return leaf;
+    }
+
+    if (prefix_mismatch(node, key, length, depth) < node->prefix_length)  return NULL;
+    depth += node->prefix_length;
+
+    if (depth == length) {
+        leaf = node->terminal;
+        if (NULL != leaf) {
+            node->terminal = NULL;
+            shrink(ref);
+        }
+        return leaf;
+    }
+
+    libcoll_radixtree_node_t **child = find_child(node, key[depth]);
+    if (NULL == child)  return NULL;
+
+    if (!IS_LEAF(*child)) {
+        return delete(child, key, length, depth + 1);
+    }
+
+    leaf = AS_LEAF(*child);
+    if (!leaf_matches(leaf, key, length))  return NULL;
+    remove_child(node, key[depth]);
+    shrink(ref);
+    return leaf;
+}
+
+/*
+ * Gets the first child at or after the given position in byte order, and
+ * moves the position past it.
+ *
+ * Returns: the child, or NULL if there are no more children
+ */
+static libcoll_radixtree_node_t* child_at(const libcoll_radixtree_node_t *node, int *position)
+{
+    switch (node->type) {
+    case NODE4:
+        return *position < node->child_count ? AS_NODE4(node)->children[(*position)++] : NULL;
+    case NODE16:
+        return *position < node->child_count ? AS_NODE16(node)->children[(*position)++] : NULL;
+    case NODE48: {
+        const libcoll_radixtree_node48_t *n = AS_NODE48(node);
+        while (*position < 256) {
+            unsigned char index = n->child_index[(*position)++];
+            if (0 != index)  return n->children[index - 1];
+        }
+        return NULL;
+    }
+    default: {
+        const libcoll_radixtree_node256_t *n = AS_NODE256(node);
+        while (*position < 256) {
+            libcoll_radixtree_node_t *child = n->children[(*position)++];
+            if (NULL != child)  return child;
+        }
+        return NULL;
+    }
+    }
+}
+
+static bool push_frame(libcoll_radixtree_iter_t *iterator, libcoll_radixtree_node_t *node)
+{
+    if (iterator->depth == iterator->capacity) {
+        size_t capacity = 0 == iterator->capacity ? 16 : iterator->capacity * 2;
+        libcoll_radixtree_frame_t *frames = realloc(iterator->frames, capacity * sizeof(libcoll_radixtree_frame_t));
+        if (NULL == frames)  return false;
+        iterator->frames = frames;
+        iterator->capacity = capacity;
+    }
+    iterator->frames[iterator->depth].node = node;
+    iterator->frames[iterator->depth].position = -1;
+    iterator->depth++;
+    return true;
+}
+
+/*
+ * Creates an iterator over the subtree under the given node, which may be a
+ * leaf or NULL.
+ */
+static libcoll_radixtree_iter_t* create_iterator(libcoll_radixtree_t *tree, libcoll_radixtree_node_t *start)
+{
+    libcoll_radixtree_iter_t *iterator = malloc(sizeof(libcoll_radixtree_iter_t));
+    if (NULL == iterator)  return NULL;
+
+    iterator->tree = tree;
+    iterator->frames = NULL;
+    iterator->depth = 0;
+    iterator->capacity = 0;
+    iterator->next = NULL;
+
+    if (NULL != start) {
+        if (!push_frame(iterator, start)) {
+            free(iterator);
+            return NULL;
+        }
+        advance(iterator);
+    }
+    return iterator;
+}
+
+/*
+ * Finds the next leaf in a depth-first walk, visiting the terminal leaf of a
+ * node before its children, since its key is a prefix of theirs.  If the
+ * stack cannot grow, the iteration ends early.
+ */
+static void advance(libcoll_radixtree_iter_t *iterator)
+{
+    while (iterator->depth > 0) {
+        libcoll_radixtree_frame_t *frame = &iterator->frames[iterator->depth - 1];
+        libcoll_radixtree_node_t *node = frame->node;
+
+        if (IS_LEAF(node)) {
+            iterator->depth--;
+            iterator->next = AS_LEAF(node);
+            return;
+        }
+
+        if (frame->position < 0) {
+            frame->position = 0;
+            if (NULL != node->terminal) {
+                iterator->next = node->terminal;
+                return;
+            }
+        }
+
+        libcoll_radixtree_node_t *child = child_at(node, &frame->position);
+        if (NULL == child) {
+            iterator->depth--;
+        } else if (IS_LEAF(child)) {
+            iterator->next = AS_LEAF(child);
+            return;
+        } else if (!push_frame(iterator, child)) {
+            DEBUG("libcoll_radixtree_next: out of memory\n");
+            break;
+        }
+    }
+    iterator->next = NULL;
+}
+
+/*
+ * Checks that the node kinds, child counts and key order of the subtree are
+ * consistent, and that every leaf is on the path of its key.  The path above
+ * the node is checked against the smallest key below it, which the caller
+ * has checked against its own path.
+ */
+static bool verify_subtree(const libcoll_radixtree_node_t *node, size_t depth, size_t *leaf_count)
+{
+    if (IS_LEAF(node)) {
+        (*leaf_count)++;
+        return true;
+    }
+
+    const libcoll_radixtree_leaf_t *smallest = minimum_leaf(node);
+    size_t end = depth + node->prefix_length;
+    if (smallest->key_length < end
+            || 0 != memcmp(node->prefix, smallest->key + depth, MIN(node->prefix_length, MAX_PREFIX))) {
+        return false;
+    }
+    if (NULL != node->terminal) {
+        if (node->terminal->key_length != end)  return false;
+        (*leaf_count)++;
+    }
+
+    static const unsigned int capacities[] = { 4, 16, 48, 256 };
+    if (node->child_count > capacities[node->type])  return false;
+    if (node->child_count + (NULL != node->terminal ? 1 : 0) < 2)  return false;
+
+    int position = 0;
+    int previous_byte = -1;
+    unsigned int count = 0;
+    const libcoll_radixtree_node_t *child;
+    while (NULL != (child = child_at(node, &position))) {
+        const libcoll_radixtree_leaf_t *first = minimum_leaf(child);
+        if (first->key_length <= end || 0 != memcmp(first->key, smallest->key, end))  return false;
+        if ((int) first->key[end] <= previous_byte)  return false;
+        if (NODE48 <= node->type && position - 1 != first->key[end])  return false;
+
+        previous_byte = first->key[end];
+        count++;
+        if (!verify_subtree(child, end + 1, leaf_count))  return false;
+    }
+    return count == node->child_count;
+}
+
+
+/* helpers used for testing */
+
+bool _libcoll_radixtree_verify(libcoll_radixtree_t *tree)
+{
+    size_t leaf_count = 0;
+    if (NULL != tree->root && !verify_subtree(tree->root, 0, &leaf_count))  return false;
+    return leaf_count == tree->size;
+}
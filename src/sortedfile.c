@@ -0,0 +1,858 @@
+/*
+ * sortedfile.c
+ *
+ * A read-only ordered map of byte strings stored in a file of sorted blocks,
+ * and a writer for creating such files.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sortedfile.h"
+
+#include "debug.h"
+
+#define MAGIC           "LCSORTED"
+#define MAGIC_LENGTH    8
+#define FORMAT_VERSION  2
+#define HEADER_SIZE     64
+
+#define FLAG_PREFIX_COMPRESSION 1
+
+/* byte offsets of the fields of the header */
+#define HEADER_VERSION          8
+#define HEADER_FLAGS            12
+#define HEADER_ENTRY_COUNT      16
+#define HEADER_BLOCK_COUNT      24
+#define HEADER_INDEX_OFFSET     32
+#define HEADER_MAX_KEY_LENGTH   40
+
+/* each block has an offset and a length in the index, and so does its first key */
+#define INDEX_ENTRY_SIZE        32
+
+/* the longest encoding of a 64-bit variable-length integer */
+#define MAX_VARINT_LENGTH       10
+
+/* an entry as stored in a block */
+typedef struct raw_entry {
+    uint64_t shared;
+    uint64_t suffix_length;
+    uint64_t value_length;
+    const unsigned char *suffix;
+    const unsigned char *value;
+} raw_entry_t;
+
+/* declarations of static helper functions for internal use */
+static bool reserve(unsigned char **buffer, size_t *capacity, size_t needed);
+static size_t put_varint(unsigned char *buffer, uint64_t value);
+static void put_u32(unsigned char *buffer, uint32_t value);
+static void put_u64(unsigned char *buffer, uint64_t value);
+static uint32_t get_u32(const unsigned char *buffer);
+static uint64_t get_u64(const unsigned char *buffer);
+static bool write_bytes(libcoll_sortedfile_writer_t *writer, const void *bytes, size_t length);
+static bool flush_block(libcoll_sortedfile_writer_t *writer);
+static void free_writer(libcoll_sortedfile_writer_t *writer);
+static int compare_bytes(const void *bytes1, size_t length1, const void *bytes2, size_t length2);
+static const unsigned char* decode_varint(const unsigned char *position, const unsigned char *end,
+                                          uint64_t *value);
+static const unsigned char* decode_entry(const unsigned char *position, const unsigned char *end,
+                                         raw_entry_t *entry);
+static const unsigned char* block_start(const libcoll_sortedfile_t *file, uint64_t block);
+static const unsigned char* block_end(const libcoll_sortedfile_t *file, uint64_t block);
+static const unsigned char* first_key(const libcoll_sortedfile_t *file, uint64_t block, size_t *length);
+static uint64_t find_block(const libcoll_sortedfile_t *file, const void *key, size_t length);
+static bool start_iterator(libcoll_sortedfile_iter_t *iterator, const libcoll_sortedfile_t *file);
+static void advance(libcoll_sortedfile_iter_t *iterator);
+static void seek(libcoll_sortedfile_iter_t *iterator, const void *key, size_t length);
+
+
+/* external API functions */
+
+/*
+ * Creates a new sorted file at the given path, replacing any existing file,
+ * and returns a writer for adding entries to it in key order.  Entries are
+ * gathered into blocks of the given size, or LIBCOLL_SORTEDFILE_DEFAULT_BLOCK_SIZE
+ * if the size is 0; a block only exceeds the size if a single entry does.
+ * Smaller blocks make lookups scan fewer entries but make the index larger.
+ *
+ * The file is only complete and readable once the writer has been closed.
+ *
+ * Returns: the writer, or NULL if creating the file or allocating memory
+ *          failed
+ */
+libcoll_sortedfile_writer_t* libcoll_sortedfile_writer_open(const char *path, size_t block_size,
+                                                            bool prefix_compression)
+{
+    libcoll_sortedfile_writer_t *writer = calloc(1, sizeof(libcoll_sortedfile_writer_t));
+    if (NULL == writer) {
+        return NULL;
+    }
+    writer->block_size = 0 != block_size ? block_size : LIBCOLL_SORTEDFILE_DEFAULT_BLOCK_SIZE;
+    writer->prefix_compression = prefix_compression;
+
+    writer->file = fopen(path, "wb");
+    if (NULL == writer->file) {
+        DEBUGF("libcoll_sortedfile_writer_open: cannot create %s\n", path);
+        free(writer);
+        return NULL;
+    }
+
+    /* the header is written last, once its contents are known */
+    unsigned char header[HEADER_SIZE] = { 0 };
+    if (!write_bytes(writer, header, HEADER_SIZE)) {
+        fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/*
+ * Adds an entry to the file being written.  Its key must be greater than the
+ * key of the entry added before it.
+ *
+ * Returns: true if the entry was added, false if the key was out of order,
+ *          or if writing or allocating memory failed, in which case the
+ *          writer fails to close as well
+ */
+bool libcoll_sortedfile_writer_add(libcoll_sortedfile_writer_t *writer, const void *key, size_t key_length,
+                                   const void *value, size_t value_length)
+{
+    if (writer->failed) {
+        return false;
+    }
+    if (0 != writer->entry_count
+            && compare_bytes(writer->last_key, writer->last_key_length, key, key_length) >= 0) {
+        DEBUG("libcoll_sortedfile_writer_add: key out of order\n");
+        return false;
+    }
+
+    /* the first entry of each block stores its whole key */
+    size_t shared = 0;
+    if (writer->prefix_compression && 0 != writer->block_length) {
+        size_t limit = writer->last_key_length < key_length ? writer->last_key_length : key_length;
+        while (shared < limit && writer->last_key[shared] == ((const unsigned char*) key)[shared]) {
+            shared++;
+        }
+    }
+
+    size_t suffix_length = key_length - shared;
+    if (!reserve(&writer->block, &writer->block_capacity,
+                 writer->block_length + 3 * MAX_VARINT_LENGTH + suffix_length + value_length)
+            || !reserve(&writer->last_key, &writer->last_key_capacity, key_length)
+            || !reserve(&writer->first_keys, &writer->first_keys_capacity, writer->first_keys_length + key_length)) {
+        writer->failed = true;
+        return false;
+    }
+
+    /* the first key of each block goes into the index as well */
+    if (0 == writer->block_length) {
+        writer->block_first_key = writer->first_keys_length;
+        if (0 != key_length) {
+            memcpy(writer->first_keys + writer->first_keys_length, key, key_length);
+            writer->first_keys_length += key_length;
+        }
+    }
+
+    unsigned char *position = writer->block + writer->block_length;
+    position += put_varint(position, shared);
+    position += put_varint(position, suffix_length);
+    position += put_varint(position, value_length);
+    if (0 != suffix_length) {
+        memcpy(position, (const unsigned char*) key + shared, suffix_length);
+        position += suffix_length;
+    }
+    if (0 != value_length) {
+        memcpy(position, value, value_length);
+        position += value_length;
+    }
+    writer->block_length = position - writer->block;
+
+    if (0 != key_length) {
+        memcpy(writer->last_key, key, key_length);
+    }
+    writer->last_key_length = key_length;
+    if (key_length > writer->max_key_length) {
+        writer->max_key_length = key_length;
+    }
+    writer->entry_count++;
+
+    if (writer->block_length >= writer->block_size) {
+        return flush_block(writer);
+    }
+    return true;
+}
+
+/*
+ * Writes the last block, the first keys of the blocks, the index and the
+ * header of the file, closes the file and frees the writer.
+ *
+ * Returns: true if the file was written completely, false if writing any
+ *          part of it failed
+ */
+bool libcoll_sortedfile_writer_close(libcoll_sortedfile_writer_t *writer)
+{
+    bool written = !writer->failed && flush_block(writer);
+
+    uint64_t first_keys_offset = writer->offset;
+    if (written && 0 != writer->first_keys_length) {
+        written = write_bytes(writer, writer->first_keys, writer->first_keys_length);
+    }
+
+    uint64_t index_offset = writer->offset;
+    for (size_t i=0; written && i<writer->block_count; i++) {
+        unsigned char entry[INDEX_ENTRY_SIZE];
+        put_u64(entry, writer->index[4*i]);
+        put_u64(entry + 8, writer->index[4*i+1]);
+        put_u64(entry + 16, first_keys_offset + writer->index[4*i+2]);
+        put_u64(entry + 24, writer->index[4*i+3]);
+        written = write_bytes(writer, entry, INDEX_ENTRY_SIZE);
+    }
+
+    if (written) {
+        unsigned char header[HEADER_SIZE] = { 0 };
+        memcpy(header, MAGIC, MAGIC_LENGTH);
+        put_u32(header + HEADER_VERSION, FORMAT_VERSION);
+        put_u32(header + HEADER_FLAGS, writer->prefix_compression ? FLAG_PREFIX_COMPRESSION : 0);
+        put_u64(header + HEADER_ENTRY_COUNT, writer->entry_count);
+        put_u64(header + HEADER_BLOCK_COUNT, writer->block_count);
+        put_u64(header + HEADER_INDEX_OFFSET, index_offset);
+        put_u64(header + HEADER_MAX_KEY_LENGTH, writer->max_key_length);
+        written = 0 == fseek(writer->file, 0, SEEK_SET) && write_bytes(writer, header, HEADER_SIZE);
+    }
+
+    if (0 != fclose(writer->file)) {
+        written = false;
+    }
+    free_writer(writer);
+    return written;
+}
+
+/*
+ * Writes the entries of a tree into a new sorted file in key order, turning
+ * keys and values into bytes with the given functions.  The bytes of the
+ * keys must be in the same order as the keys are in the tree, which holds
+ * e.g. for strings with libcoll_sortedfile_str_bytes in a tree using
+ * libcoll_strcmp_wrapper, or for unsigned integers stored most significant
+ * byte first.
+ *
+ * Returns: true if the file was written, false if the keys were out of
+ *          order or writing the file failed
+ */
+bool libcoll_sortedfile_write_treemap(libcoll_treemap_t *tree, const char *path,
+                                      libcoll_sortedfile_serializer key_bytes,
+                                      libcoll_sortedfile_serializer value_bytes,
+                                      size_t block_size, bool prefix_compression)
+{
+    libcoll_sortedfile_writer_t *writer = libcoll_sortedfile_writer_open(path, block_size, prefix_compression);
+    if (NULL == writer) {
+        return false;
+    }
+
+    libcoll_treemap_iter_t iterator;
+    libcoll_treemap_init_iterator(&iterator, tree);
+    while (libcoll_treemap_has_next(&iterator)) {
+        libcoll_treemap_node_t *node = libcoll_treemap_next(&iterator);
+        size_t key_length, value_length;
+        const void *key = key_bytes(node->key, &key_length);
+        const void *value = value_bytes(node->value, &value_length);
+        if (!libcoll_sortedfile_writer_add(writer, key, key_length, value, value_length)) {
+            writer->failed = true;
+            break;
+        }
+    }
+    return libcoll_sortedfile_writer_close(writer);
+}
+
+/*
+ * A serializer for strings, giving their bytes along with the terminating
+ * null byte.  The bytes of strings are then ordered as by strcmp, and the
+ * keys and values read from the file can be used as strings in place.
+ */
+const void* libcoll_sortedfile_str_bytes(const void *object, size_t *length)
+{
+    *length = strlen(object) + 1;
+    return object;
+}
+
+/*
+ * Opens a sorted file for reading by mapping it into memory.  The index is
+ * checked to lie within the file, while the blocks are checked as they are
+ * read, so that a damaged file cannot make reading it go out of bounds.
+ *
+ * Returns: the opened file, or NULL if opening or mapping the file or
+ *          allocating memory failed, or if the file is not a sorted file
+ */
+libcoll_sortedfile_t* libcoll_sortedfile_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        DEBUGF("libcoll_sortedfile_open: cannot open %s\n", path);
+        return NULL;
+    }
+    struct stat status;
+    if (0 != fstat(fd, &status) || status.st_size < HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t length = (size_t) status.st_size;
+    void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == data) {
+        return NULL;
+    }
+
+    const unsigned char *header = data;
+    uint64_t block_count = get_u64(header + HEADER_BLOCK_COUNT);
+    uint64_t index_offset = get_u64(header + HEADER_INDEX_OFFSET);
+    bool valid = 0 == memcmp(header, MAGIC, MAGIC_LENGTH)
+                 && FORMAT_VERSION == get_u32(header + HEADER_VERSION)
+                 && index_offset >= HEADER_SIZE && index_offset <= length
+                 && block_count <= (length - index_offset) / INDEX_ENTRY_SIZE;
+    for (uint64_t i=0; valid && i<block_count; i++) {
+        const unsigned char *entry = header + index_offset + i * INDEX_ENTRY_SIZE;
+        uint64_t offset = get_u64(entry);
+        uint64_t block_length = get_u64(entry + 8);
+        uint64_t key_offset = get_u64(entry + 16);
+        uint64_t key_length = get_u64(entry + 24);
+        valid = offset >= HEADER_SIZE && offset <= index_offset && block_length <= index_offset - offset
+                && key_offset >= HEADER_SIZE && key_offset <= index_offset
+                && key_length <= index_offset - key_offset;
+    }
+
+    libcoll_sortedfile_t *file = valid ? malloc(sizeof(libcoll_sortedfile_t)) : NULL;
+    if (NULL == file) {
+        DEBUGF("libcoll_sortedfile_open: %s is not a valid sorted file\n", path);
+        munmap(data, length);
+        return NULL;
+    }
+    file->data = data;
+    file->length = length;
+    file->prefix_compression = 0 != (get_u32(header + HEADER_FLAGS) & FLAG_PREFIX_COMPRESSION);
+    file->size = get_u64(header + HEADER_ENTRY_COUNT);
+    file->block_count = block_count;
+    file->max_key_length = get_u64(header + HEADER_MAX_KEY_LENGTH);
+    file->index = header + index_offset;
+    return file;
+}
+
+/*
+ * Unmaps and closes the file.  Pointers to keys and values in the file become
+ * invalid.
+ */
+void libcoll_sortedfile_close(libcoll_sortedfile_t *file)
+{
+    munmap((void*) file->data, file->length);
+    free(file);
+}
+
+/*
+ * Gets the value of the given key.  The index is binary searched for the
+ * block whose range of keys covers the key, and only that block is read.  In a
+ * prefix compressed file, the keys are compared without putting them
+ * together: as long as the key of an entry shares more bytes with the key of
+ * the previous entry than the key sought does, it is smaller than the key
+ * sought, and as soon as it shares fewer, it is greater.
+ *
+ * Returns: a pointer to the value within the mapped file, with its length
+ *          stored in *value_length, or NULL if the key is not in the file
+ */
+const void* libcoll_sortedfile_get(const libcoll_sortedfile_t *file, const void *key, size_t length,
+                                   size_t *value_length)
+{
+    if (0 == file->block_count) {
+        return NULL;
+    }
+    uint64_t block = find_block(file, key, length);
+    const unsigned char *position = block_start(file, block);
+    const unsigned char *end = block_end(file, block);
+    const unsigned char *key_bytes = key;
+
+    /* the number of bytes the key sought shares with the key of the previous entry */
+    size_t matched = 0;
+    while (position < end) {
+        raw_entry_t entry;
+        position = decode_entry(position, end, &entry);
+        if (NULL == position) {
+            return NULL;
+        }
+
+        int cmpval;
+        if (!file->prefix_compression) {
+            cmpval = compare_bytes(entry.suffix, entry.suffix_length, key, length);
+        } else if (entry.shared > matched) {
+            continue;
+        } else if (entry.shared < matched) {
+            return NULL;
+        } else {
+            size_t i = 0;
+            while (i < entry.suffix_length && matched < length && entry.suffix[i] == key_bytes[matched]) {
+                i++;
+                matched++;
+            }
+            if (i == entry.suffix_length) {
+                cmpval = matched == length ? 0 : -1;
+            } else {
+                cmpval = matched == length || entry.suffix[i] > key_bytes[matched] ? 1 : -1;
+            }
+        }
+
+        if (0 == cmpval) {
+            *value_length = entry.value_length;
+            return entry.value;
+        } else if (cmpval > 0) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Checks whether the file contains the given key.
+ */
+bool libcoll_sortedfile_contains(const libcoll_sortedfile_t *file, const void *key, size_t length)
+{
+    size_t value_length;
+    return NULL != libcoll_sortedfile_get(file, key, length, &value_length);
+}
+
+/*
+ * Returns the number of entries in the file.
+ */
+size_t libcoll_sortedfile_get_size(const libcoll_sortedfile_t *file)
+{
+    return file->size;
+}
+
+/*
+ * Initializes an iterator over all entries of the file in key order.
+ *
+ * Returns: true if the iterator was initialized, false if allocating its
+ *          key buffers for a prefix compressed file failed
+ */
+bool libcoll_sortedfile_init_iterator(libcoll_sortedfile_iter_t *iterator, const libcoll_sortedfile_t *file)
+{
+    if (!start_iterator(iterator, file)) {
+        return false;
+    }
+    advance(iterator);
+    return true;
+}
+
+/*
+ * Initializes an iterator starting from the first entry whose key is greater
+ * than or equal to the given key, i.e. from the lower bound of the key.
+ *
+ * Returns: true if the iterator was initialized, false if allocating its
+ *          key buffers for a prefix compressed file failed
+ */
+bool libcoll_sortedfile_init_iterator_at(libcoll_sortedfile_iter_t *iterator, const libcoll_sortedfile_t *file,
+                                         const void *key, size_t length)
+{
+    if (!start_iterator(iterator, file)) {
+        return false;
+    }
+    seek(iterator, key, length);
+    return true;
+}
+
+/*
+ * Initializes an iterator over the entries with keys within the half-open
+ * range [start_key, end_key).
+ *
+ * Returns: true if the iterator was initialized, false if allocating its
+ *          key buffers for a prefix compressed file failed
+ */
+bool libcoll_sortedfile_init_range_iterator(libcoll_sortedfile_iter_t *iterator,
+                                            const libcoll_sortedfile_t *file,
+                                            const void *start_key, size_t start_length,
+                                            const void *end_key, size_t end_length)
+{
+    if (!start_iterator(iterator, file)) {
+        return false;
+    }
+    iterator->end_key = end_key;
+    iterator->end_key_length = end_length;
+    iterator->bounded = true;
+    seek(iterator, start_key, start_length);
+    return true;
+}
+
+/*
+ * Frees the key buffers of an iterator.  The iterator itself is not freed.
+ */
+void libcoll_sortedfile_deinit_iterator(libcoll_sortedfile_iter_t *iterator)
+{
+    free(iterator->buffers[0]);
+    free(iterator->buffers[1]);
+    iterator->buffers[0] = iterator->buffers[1] = NULL;
+    iterator->has_next = false;
+}
+
+bool libcoll_sortedfile_has_next(libcoll_sortedfile_iter_t *iterator)
+{
+    return iterator->has_next;
+}
+
+/*
+ * Moves the iterator to the next entry and returns it.  The entry and the
+ * key and value it points to stay valid until the next call.
+ *
+ * Returns: the next entry, or NULL if there are no more entries
+ */
+const libcoll_sortedfile_entry_t* libcoll_sortedfile_next(libcoll_sortedfile_iter_t *iterator)
+{
+    if (!iterator->has_next) {
+        return NULL;
+    }
+    iterator->current = iterator->next;
+    advance(iterator);
+    return &iterator->current;
+}
+
+
+
+/* static helper functions */
+
+/*
+ * Grows a buffer to hold at least the needed number of bytes.
+ */
+static bool reserve(unsigned char **buffer, size_t *capacity, size_t needed)
+{
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t new_capacity = 0 != *capacity ? *capacity : 64;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    unsigned char *new_buffer = realloc(*buffer, new_capacity);
+    if (NULL == new_buffer) {
+        return false;
+    }
+    *buffer = new_buffer;
+    *capacity = new_capacity;
+    return true;
+}
+
+static size_t put_varint(unsigned char *buffer, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80) {
+        buffer[length++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (unsigned char) value;
+    return length;
+}
+
+static void put_u32(unsigned char *buffer, uint32_t value)
+{
+    for (int i=0; i<4; i++) {
+        buffer[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char *buffer, uint64_t value)
+{
+    for (int i=0; i<8; i++) {
+        buffer[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const unsigned char *buffer)
+{
+    uint32_t value = 0;
+    for (int i=3; i>=0; i--) {
+        value = value << 8 | buffer[i];
+    }
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char *buffer)
+{
+    uint64_t value = 0;
+    for (int i=7; i>=0; i--) {
+        value = value << 8 | buffer[i];
+    }
+    return value;
+}
+
+static bool write_bytes(libcoll_sortedfile_writer_t *writer, const void *bytes, size_t length)
+{
+    if (length != fwrite(bytes, 1, length, writer->file)) {
+        writer->failed = true;
+        return false;
+    }
+    writer->offset += length;
+    return true;
+}
+
+/*
+ * Writes the entries gathered so far as a block and adds the block to the
+ * index.
+ */
+static bool flush_block(libcoll_sortedfile_writer_t *writer)
+{
+    if (0 == writer->block_length) {
+        return true;
+    }
+    if (writer->block_count == writer->index_capacity) {
+        size_t new_capacity = 0 != writer->index_capacity ? 2 * writer->index_capacity : 64;
+        uint64_t *new_index = realloc(writer->index, 4 * new_capacity * sizeof(uint64_t));
+        if (NULL == new_index) {
+            writer->failed = true;
+            return false;
+        }
+        writer->index = new_index;
+        writer->index_capacity = new_capacity;
+    }
+
+    writer->index[4 * writer->block_count] = writer->offset;
+    writer->index[4 * writer->block_count + 1] = writer->block_length;
+    writer->index[4 * writer->block_count + 2] = writer->block_first_key;
+    writer->index[4 * writer->block_count + 3] = writer->first_keys_length - writer->block_first_key;
+    if (!write_bytes(writer, writer->block, writer->block_length)) {
+        return false;
+    }
+    writer->block_count++;
+    writer->block_length = 0;
+    return true;
+}
+
+static void free_writer(libcoll_sortedfile_writer_t *writer)
+{
+    free(writer->block);
+    free(writer->last_key);
+    free(writer->first_keys);
+    free(writer->index);
+    free(writer);
+}
+
+/*
+ * Compares byte strings byte by byte, a string coming before any longer
+ * string it is a prefix of.  An empty string may be given as NULL, which
+ * memcmp must not be passed even for zero bytes.
+ */
+static int compare_bytes(const void *bytes1, size_t length1, const void *bytes2, size_t length2)
+{
+    if (0 == length1 || 0 == length2) {
+        return length1 == length2 ? 0 : (length1 < length2 ? -1 : 1);
+    }
+    int cmpval = memcmp(bytes1, bytes2, length1 < length2 ? length1 : length2);
+    if (0 == cmpval && length1 != length2) {
+        cmpval = length1 < length2 ? -1 : 1;
+    }
+    return cmpval;
+}
+
+static const unsigned char* decode_varint(const unsigned char *position, const unsigned char *end,
+                                          uint64_t *value)
+{
+    *value = 0;
+    for (int shift=0; position < end && shift < 64; shift+=7) {
+        unsigned char byte = *position++;
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (0 == (byte & 0x80)) {
+            return position;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Decodes the entry at the given position of a block.
+ *
+ * Returns: the position of the following entry, or NULL if the entry does
+ *          not fit within the block
+ */
+static const unsigned char* decode_entry(const unsigned char *position, const unsigned char *end,
+                                         raw_entry_t *entry)
+{
+    if (NULL == (position = decode_varint(position, end, &entry->shared))
+            || NULL == (position = decode_varint(position, end, &entry->suffix_length))
+            || NULL == (position = decode_varint(position, end, &entry->value_length))) {
+        return NULL;
+    }
+    size_t remaining = end - position;
+    if (entry->suffix_length > remaining || entry->value_length > remaining - entry->suffix_length) {
+        return NULL;
+    }
+    entry->suffix = position;
+    entry->value = position + entry->suffix_length;
+    return entry->value + entry->value_length;
+}
+
+static const unsigned char* block_start(const libcoll_sortedfile_t *file, uint64_t block)
+{
+    return file->data + get_u64(file->index + block * INDEX_ENTRY_SIZE);
+}
+
+static const unsigned char* block_end(const libcoll_sortedfile_t *file, uint64_t block)
+{
+    return block_start(file, block) + get_u64(file->index + block * INDEX_ENTRY_SIZE + 8);
+}
+
+/*
+ * Gives the first key of a block as stored along with the index, setting
+ * *length.
+ */
+static const unsigned char* first_key(const libcoll_sortedfile_t *file, uint64_t block, size_t *length)
+{
+    const unsigned char *entry = file->index + block * INDEX_ENTRY_SIZE;
+    *length = get_u64(entry + 24);
+    return file->data + get_u64(entry + 16);
+}
+
+/*
+ * Finds the last block whose first key is less than or equal to the given
+ * key, or the first block if there is none.  Only the index and the first
+ * keys next to it are read, not the blocks themselves.
+ */
+static uint64_t find_block(const libcoll_sortedfile_t *file, const void *key, size_t length)
+{
+    uint64_t low = 0, high = file->block_count - 1;
+    while (low < high) {
+        uint64_t mid = low + (high - low + 1) / 2;
+        size_t first_length;
+        const unsigned char *first = first_key(file, mid, &first_length);
+        if (compare_bytes(first, first_length, key, length) > 0) {
+            high = mid - 1;
+        } else {
+            low = mid;
+        }
+    }
+    return low;
+}
+
+/*
+ * Sets up an iterator before the first entry of the file.
+ */
+static bool start_iterator(libcoll_sortedfile_iter_t *iterator, const libcoll_sortedfile_t *file)
+{
+    memset(iterator, 0, sizeof(libcoll_sortedfile_iter_t));
+    iterator->file = file;
+    iterator->block = 0;
+    if (0 != file->block_count) {
+        iterator->position = block_start(file, 0);
+        iterator->block_end = block_end(file, 0);
+    }
+    if (file->prefix_compression) {
+        size_t capacity = 0 != file->max_key_length ? file->max_key_length : 1;
+        iterator->buffers[0] = malloc(capacity);
+        iterator->buffers[1] = malloc(capacity);
+        if (NULL == iterator->buffers[0] || NULL == iterator->buffers[1]) {
+            libcoll_sortedfile_deinit_iterator(iterator);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Reads the entry after the next one into the iterator, moving on to the
+ * following block at the end of a block.  In a prefix compressed file, the
+ * key is put together in the buffer not holding the key of the entry before
+ * it.
+ */
+static void advance(libcoll_sortedfile_iter_t *iterator)
+{
+    const libcoll_sortedfile_t *file = iterator->file;
+    iterator->has_next = false;
+    if (0 == file->block_count) {
+        return;
+    }
+    while (iterator->position >= iterator->block_end) {
+        if (++iterator->block >= file->block_count) {
+            return;
+        }
+        iterator->position = block_start(file, iterator->block);
+        iterator->block_end = block_end(file, iterator->block);
+    }
+
+    raw_entry_t entry;
+    bool first_in_block = iterator->position == block_start(file, iterator->block);
+    iterator->position = decode_entry(iterator->position, iterator->block_end, &entry);
+    if (NULL == iterator->position) {
+        DEBUG("libcoll_sortedfile: damaged block\n");
+        iterator->block = file->block_count;
+        return;
+    }
+
+    libcoll_sortedfile_entry_t *next = &iterator->next;
+    if (file->prefix_compression) {
+        if ((first_in_block && 0 != entry.shared) || entry.shared > next->key_length
+                || entry.suffix_length > file->max_key_length - entry.shared) {
+            DEBUG("libcoll_sortedfile: damaged entry\n");
+            iterator->block = file->block_count;
+            return;
+        }
+        unsigned char *key = iterator->buffers[1 - iterator->buffer];
+        if (0 != entry.shared) {
+            memcpy(key, next->key, entry.shared);
+        }
+        memcpy(key + entry.shared, entry.suffix, entry.suffix_length);
+        iterator->buffer = 1 - iterator->buffer;
+        next->key = key;
+        next->key_length = entry.shared + entry.suffix_length;
+    } else {
+        next->key = entry.suffix;
+        next->key_length = entry.suffix_length;
+    }
+    next->value = entry.value;
+    next->value_length = entry.value_length;
+
+    iterator->has_next = !iterator->bounded
+                         || compare_bytes(next->key, next->key_length,
+                                          iterator->end_key, iterator->end_key_length) < 0;
+}
+
+/*
+ * Moves a newly started iterator to the first entry with a key greater than
+ * or equal to the given key.
+ */
+static void seek(libcoll_sortedfile_iter_t *iterator, const void *key, size_t length)
+{
+    const libcoll_sortedfile_t *file = iterator->file;
+    if (0 != file->block_count) {
+        iterator->block = find_block(file, key, length);
+        iterator->position = block_start(file, iterator->block);
+        iterator->block_end = block_end(file, iterator->block);
+    }
+    advance(iterator);
+    while (iterator->has_next
+           && compare_bytes(iterator->next.key, iterator->next.key_length, key, length) < 0) {
+        advance(iterator);
+    }
+}
@@ -43,9 +43,12 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. *
  */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "builtins.h"
 #include "comparators.h"
 #include "treemap.h"
 
@@ -54,24 +57,146 @@
 #define COLOR_RED   0
 #define COLOR_BLACK 1
 
+/* operations for combine_trees */
+#define COMBINE_JOIN            0
+#define COMBINE_UNION           1
+#define COMBINE_INTERSECTION    2
+#define COMBINE_DIFFERENCE      3
+
+/* bulk operations on subtrees of at least PARALLEL_MIN_NODES nodes hand one
+ * half of the work to a new thread, down to PARALLEL_MAX_DEPTH levels below
+ * the root (i.e. using up to 2^PARALLEL_MAX_DEPTH threads)
+ */
+#define PARALLEL_MIN_NODES  (1 << 16)
+#define PARALLEL_MAX_DEPTH  2
+
+/* batches are sorted by merging runs sorted by insertion sort */
+#define SORT_MIN_MERGE      16
+
+/* searches in a frozen tree prefetch the entries three levels down, which
+ * for pointer-sized entries share a single 64-byte cache line
+ */
+#define FROZEN_PREFETCH_STRIDE  8
+
+#ifdef __GNUC__
+#define PREFETCH(address)       __builtin_prefetch(address)
+#else
+#define PREFETCH(address)
+#endif
+
+/* prefetches an element of an array, which may lie past its end: the address
+ * is computed as an integer, since pointer arithmetic beyond the end of an
+ * array is undefined even where prefetching it is not
+ */
+#define PREFETCH_ELEMENT(array, index) \
+    PREFETCH((const void*) ((uintptr_t) (array) + (index) * sizeof(*(array))))
+
+/* counting the work done on trees is disabled by default;
+ * can be enabled by defining ENABLE_TREEMAP_STATS=1 on the compiler command
+ * line.  Counters are updated atomically, since bulk operations may run in
+ * several threads, and through a non-const pointer, since lookups count too.
+ */
+#ifndef ENABLE_TREEMAP_STATS
+#define ENABLE_TREEMAP_STATS    0
+#endif
+
+#if ENABLE_TREEMAP_STATS
+#ifdef __GNUC__
+#define COUNT(tree, counter, n) \
+    __atomic_fetch_add(&((libcoll_treemap_t*) (tree))->counters.counter, (n), __ATOMIC_RELAXED)
+#else
+#define COUNT(tree, counter, n) (((libcoll_treemap_t*) (tree))->counters.counter += (n))
+#endif
+/* attributes the comparisons and rotations made between the two to an operation */
+#define START_COUNTING(tree) \
+    uint64_t comparisons_before = (tree)->counters.comparisons; \
+    uint64_t rotations_before = (tree)->counters.rotations
+#define STOP_COUNTING(tree, operation) \
+    do { \
+        COUNT(tree, operation.calls, 1); \
+        COUNT(tree, operation.comparisons, (tree)->counters.comparisons - comparisons_before); \
+        COUNT(tree, operation.rotations, (tree)->counters.rotations - rotations_before); \
+    } while (0)
+#else
+#define COUNT(tree, counter, n)
+#define START_COUNTING(tree)
+#define STOP_COUNTING(tree, operation)
+#endif
+
 /* define a null node for use as black leaf nodes in the red-black tree */
 static libcoll_treemap_node_t null_node_struct = {
-    NULL, NULL, NULL, NULL, NULL, COLOR_BLACK
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, COLOR_BLACK, { 0 }
 };
 static libcoll_treemap_node_t *NULL_NODE = &null_node_struct;
 
 /* declarations of static helper functions for internal use */
-static libcoll_treemap_node_t* create_node(void *key, void *value);
+static libcoll_treemap_node_t* create_node(libcoll_treemap_t *tree, void *key, void *value);
+static void release_node(libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* minimum(libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* maximum(libcoll_treemap_node_t *node);
+static inline libcoll_treemap_node_t* successor(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static inline libcoll_treemap_node_t* predecessor(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* walk_to_successor(libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* walk_to_predecessor(libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* find_bound(const libcoll_treemap_t *tree, const void *key,
+                                          bool above, bool inclusive);
+static void free_slabs(libcoll_treemap_t *tree);
+static inline int compare(const libcoll_treemap_t *tree, const void *key1, const void *key2);
+static libcoll_treemap_node_t* find_position(const libcoll_treemap_t *tree, const void *key,
+                                             libcoll_treemap_node_t **parent, int *last_cmpval);
+static libcoll_treemap_node_t* insert_leaf(libcoll_treemap_t *tree, libcoll_treemap_node_t *parent, int cmpval,
+                                           void *key, void *value);
+static libcoll_treemap_node_t* climb_from(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node,
+                                          const void *key, int direction);
 static void remove_node(libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
-static void deinit_subtree(libcoll_treemap_node_t *node, bool free_contents);
+static libcoll_treemap_node_t* add_near(libcoll_treemap_t *tree, libcoll_treemap_node_t *hint,
+                                        void *key, void *value);
+static void deinit_subtree(libcoll_treemap_node_t *node, bool free_contents, bool free_nodes);
+static libcoll_treemap_node_t* build_subtree(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs,
+                                             size_t count, int depth, int red_depth, bool parallel);
+static void flatten_subtree(libcoll_treemap_node_t *node, libcoll_pair_voidptr_t *pairs, int depth, bool parallel);
+static bool build_tree(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs, size_t count);
+static void sort_pairs(const libcoll_treemap_t *tree, libcoll_pair_voidptr_t *pairs,
+                       libcoll_pair_voidptr_t *scratch, size_t count, int depth);
+static libcoll_treemap_node_t* join_nodes(libcoll_treemap_t *tree, libcoll_treemap_node_t *left,
+                                          libcoll_treemap_node_t *middle, libcoll_treemap_node_t *right);
+static libcoll_treemap_node_t* join_without_middle(libcoll_treemap_t *tree, libcoll_treemap_node_t *left,
+                                                   libcoll_treemap_node_t *right);
+static libcoll_treemap_node_t* split_nodes(libcoll_treemap_t *tree, libcoll_treemap_node_t *root, const void *key,
+                                           libcoll_treemap_node_t **left, libcoll_treemap_node_t **right);
+static bool combine_trees(libcoll_treemap_t *tree, libcoll_treemap_t *other, int operation);
+static void thread_subtree(libcoll_treemap_node_t *node, libcoll_treemap_node_t **previous, bool threaded);
+static libcoll_treemap_aggregate_t aggregate_of(const libcoll_treemap_t *tree, const libcoll_treemap_node_t *node);
+static void update_aggregate(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static void update_aggregates_upwards(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static void aggregate_subtree(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* first_in_postorder(libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* next_in_postorder(libcoll_treemap_node_t *node, libcoll_treemap_node_t *root);
+static libcoll_treemap_node_t* build_treap(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs,
+                                           size_t count);
+static void measure_subtree(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static libcoll_treemap_node_t* fill_eytzinger(const libcoll_treemap_t *tree, libcoll_treemap_frozen_t *frozen,
+                                              size_t index, libcoll_treemap_node_t *node);
+static bool ordinal_of(const libcoll_treemap_frozen_t *frozen, const void *key, uintptr_t *ordinal);
+static size_t frozen_lower_bound(const libcoll_treemap_frozen_t *frozen, const void *key);
+static bool frozen_key_equals(const libcoll_treemap_frozen_t *frozen, size_t index, const void *key);
+static size_t eytzinger_successor(size_t index, size_t size);
 static void left_rotate(libcoll_treemap_t *tree, libcoll_treemap_node_t *subtree_orig_root);
 static void right_rotate(libcoll_treemap_t *tree, libcoll_treemap_node_t *subtree_orig_root);
 static void fix_after_addition(libcoll_treemap_t *tree, libcoll_treemap_node_t *added_node);
 static void fix_after_removal(libcoll_treemap_t *tree, libcoll_treemap_node_t *removed_node);
+static void rotate_up(libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static void splay(libcoll_treemap_t *tree, libcoll_treemap_node_t *node);
+static uint64_t priority_of(const libcoll_treemap_node_t *node);
 
 /* declarations of helpers used for testing */
 static bool _verify_child_color_in_subtree(libcoll_treemap_node_t *subtree_root);
 static int  _verify_black_height_of_subtree(libcoll_treemap_node_t *subtree_root);
+static bool _verify_subtree_sizes(libcoll_treemap_node_t *subtree_root);
+static bool _verify_links_in_subtree(libcoll_treemap_node_t *subtree_root, libcoll_treemap_node_t **previous,
+                                     bool threaded);
+static bool _verify_aggregates_in_subtree(const libcoll_treemap_t *tree, libcoll_treemap_node_t *subtree_root);
+static bool _verify_heap_order_in_subtree(libcoll_treemap_node_t *subtree_root);
 
 
 /* external API functions */
@@ -98,6 +223,27 @@ libcoll_treemap_t* libcoll_treemap_init()
  * Returns: a pointer to the newly allocated tree
  */
 libcoll_treemap_t* libcoll_treemap_init_with_comparator (int (*key_comparator)(const void *key1, const void *key2))
+{
+    return libcoll_treemap_init_with_params(key_comparator, LIBCOLL_TREEMAP_ALLOC_MALLOC);
+}
+
+/*
+ * Initializes a new binary tree with the given key comparator function and
+ * node allocation strategy.
+ *
+ * With LIBCOLL_TREEMAP_ALLOC_SLAB, nodes are allocated from large blocks
+ * owned by the tree.  This avoids a malloc call per added key, keeps nodes
+ * close to each other in memory, and makes deinitializing the tree take time
+ * proportional to the number of blocks rather than the number of nodes.
+ * Memory of removed nodes is reused for new nodes but only returned to the
+ * system when the tree is deinitialized.
+ *
+ * If allocating memory for the tree fails, NULL is returned.
+ *
+ * Returns: a pointer to the newly allocated tree
+ */
+libcoll_treemap_t* libcoll_treemap_init_with_params(int (*key_comparator)(const void *key1, const void *key2),
+                                                    libcoll_treemap_allocation allocation)
 {
     DEBUG("treemap initializing\n");
     libcoll_treemap_t *tree = malloc(sizeof(libcoll_treemap_t));
@@ -110,6 +256,14 @@ libcoll_treemap_t* libcoll_treemap_init_with_comparator (int (*key_comparator)(c
             // fall back to the default behaviour of comparison by memory address
             tree->key_comparator = &libcoll_memaddrcmp;
         }
+        tree->allocation = allocation;
+        tree->slabs = NULL;
+        tree->free_nodes = NULL;
+        tree->threaded = false;
+        tree->parallel = false;
+        tree->monoid = NULL;
+        tree->balancing = LIBCOLL_TREEMAP_BALANCE_RED_BLACK;
+        libcoll_treemap_reset_counters(tree);
     }
     return tree;
 }
@@ -129,7 +283,11 @@ libcoll_treemap_t* libcoll_treemap_init_with_comparator (int (*key_comparator)(c
 void libcoll_treemap_deinit(libcoll_treemap_t *tree)
 {
     /* deallocate all nodes first to make sure their memory gets freed */
-    deinit_subtree(tree->root, false);
+    if (LIBCOLL_TREEMAP_ALLOC_SLAB == tree->allocation) {
+        free_slabs(tree);
+    } else {
+        deinit_subtree(tree->root, false, true);
+    }
     free(tree);
 }
 
@@ -145,10 +303,370 @@ void libcoll_treemap_deinit(libcoll_treemap_t *tree)
  */
 void libcoll_treemap_deinit_and_delete_contents(libcoll_treemap_t *tree)
 {
-    deinit_subtree(tree->root, true);
+    if (LIBCOLL_TREEMAP_ALLOC_SLAB == tree->allocation) {
+        deinit_subtree(tree->root, true, false);
+        free_slabs(tree);
+    } else {
+        deinit_subtree(tree->root, true, true);
+    }
     free(tree);
 }
 
+/*
+ * Populates an empty tree from an array of key-value pairs sorted in strictly
+ * ascending order of keys, in O(n) time.
+ *
+ * The tree is built by recursively making the middle pair of each range the
+ * root of a subtree.  All levels of the resulting tree are then full except
+ * possibly the deepest one, whose nodes are colored red and all other nodes
+ * black, which satisfies the red-black conditions.
+ *
+ * If the tree allows parallel bulk operations and uses malloc for allocating
+ * its nodes, large inputs are built using several threads.  Slab-allocated
+ * trees are built in the calling thread.  See libcoll_treemap_set_parallel.
+ * A treap is instead built in key order in a single pass, placing each new
+ * node on the right spine of the tree below the first node with a higher
+ * priority.
+ *
+ * Params:
+ *      tree  -- an empty tree
+ *      pairs -- the keys and values to add, sorted by key
+ *      count -- the number of pairs
+ *
+ * Returns: true if the tree was populated, false if the tree was not empty,
+ *          the keys were not in strictly ascending order or allocating memory
+ *          failed, in which case the tree remains empty
+ */
+bool libcoll_treemap_build_sorted(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs, size_t count)
+{
+    if (0 != tree->size) {
+        return false;
+    }
+    for (size_t i=1; i<count; i++) {
+        if (compare(tree, pairs[i-1].a, pairs[i].a) >= 0) {
+            DEBUGF("libcoll_treemap_build_sorted: keys out of order at index %lu\n", (unsigned long) i);
+            return false;
+        }
+    }
+
+    return build_tree(tree, pairs, count);
+}
+
+
+/*
+ * Turns the threaded mode of the tree on or off.  In a threaded tree, each
+ * node is linked to its in-order successor and predecessor, which are
+ * maintained when adding and removing nodes.  Moving to the next or previous
+ * node, through iterators or libcoll_treemap_get_successor and
+ * libcoll_treemap_get_predecessor, then follows a single link instead of
+ * climbing up and down the tree, and a full ordered scan becomes a walk along
+ * a linked list.
+ *
+ * Turning the mode on or off takes O(n) time.  Room for the links is part of
+ * every node, making each node two pointers larger whether or not its tree is
+ * threaded.  Keeping the links up to date adds a little work to adding and
+ * removing nodes, and union, intersection and difference relink the whole
+ * resulting tree in O(n) time.  Unthreaded trees never read the links.
+ */
+void libcoll_treemap_set_threaded(libcoll_treemap_t *tree, bool threaded)
+{
+    libcoll_treemap_node_t *previous = NULL_NODE;
+    thread_subtree(tree->root, &previous, threaded);
+    if (threaded && NULL_NODE != previous) {
+        previous->next_in_order = NULL_NODE;
+    }
+    tree->threaded = threaded;
+}
+
+/*
+ * Allows or disallows the bulk operations on the tree to use several threads
+ * for large inputs.  Building with libcoll_treemap_build_sorted, flattening
+ * with libcoll_treemap_flatten, adding with libcoll_treemap_add_batch, and the
+ * set operations libcoll_treemap_union, libcoll_treemap_intersection and
+ * libcoll_treemap_difference then split the work between up to four threads,
+ * started for each operation.
+ *
+ * The comparator of the tree, and the functions of its monoid if one is set,
+ * are then called from several threads at once and must be safe to call
+ * concurrently.  By default, all work is done in the calling thread.
+ */
+void libcoll_treemap_set_parallel(libcoll_treemap_t *tree, bool parallel)
+{
+    tree->parallel = parallel;
+}
+
+/*
+ * Makes the tree keep an aggregate of the entries in each subtree using the
+ * given monoid, or stops keeping aggregates if the monoid is NULL.  The
+ * aggregates are kept up to date through additions, removals, rotations and
+ * the bulk operations, each node being recomputed from its children whenever
+ * its subtree changes, so that libcoll_treemap_aggregate_range takes
+ * O(log n) time.  Computing the aggregates for an existing tree takes O(n)
+ * time.
+ *
+ * The aggregate has room in every node, making nodes eight bytes larger
+ * whether or not the tree has a monoid, but is only computed for trees that
+ * have one.
+ *
+ * The monoid is not copied and must outlive its use by the tree.  Joining or
+ * combining trees requires them to use the same monoid.  The aggregates
+ * depend on the values, so values must be changed using
+ * libcoll_treemap_set_value.
+ */
+void libcoll_treemap_set_monoid(libcoll_treemap_t *tree, const libcoll_treemap_monoid_t *monoid)
+{
+    tree->monoid = monoid;
+    if (NULL != monoid) {
+        aggregate_subtree(tree, tree->root);
+    }
+}
+
+/*
+ * Selects the policy for keeping the tree balanced, which can only be changed
+ * while the tree is empty.  The default is a red-black tree.
+ *
+ * A splay tree suits access patterns where a small set of keys is used far
+ * more often than others: adding, removing, or finding a key with
+ * libcoll_treemap_get or libcoll_treemap_contains rotates the node (or, if
+ * the key is missing, the last node visited) to the root.  Lookups then
+ * modify the tree, so a splay tree must not be read from several threads at
+ * once.  Sorted inputs can leave a splay tree as deep as it is large, which
+ * the next accesses undo; functions walking the whole tree do so through the
+ * parent links, needing no stack space however deep the tree is.
+ *
+ * A treap has an expected height within a small factor of a red-black tree
+ * and rebalances with fewer rotations on average, without any further state
+ * per node.
+ *
+ * Splitting, joining and the set operations are only supported for red-black
+ * trees.  All other functions work the same under every policy.
+ *
+ * Returns: true if the policy was set, false if the tree is not empty
+ */
+bool libcoll_treemap_set_balancing(libcoll_treemap_t *tree, libcoll_treemap_balancing balancing)
+{
+    if (0 != tree->size) {
+        return false;
+    }
+    tree->balancing = balancing;
+    return true;
+}
+
+/*
+ * Aggregates the entries with keys within the half-open range
+ * [start_key, end_key) in O(log n) time, combining the aggregates of the
+ * subtrees hanging off the paths to the two ends of the range.
+ *
+ * Returns: the aggregate, or the identity of the monoid if the range is empty
+ *          or the tree has no monoid
+ */
+libcoll_treemap_aggregate_t libcoll_treemap_aggregate_range(libcoll_treemap_t *tree, const void *start_key,
+                                                            const void *end_key)
+{
+    libcoll_treemap_aggregate_t identity = { 0 };
+    const libcoll_treemap_monoid_t *monoid = tree->monoid;
+    if (NULL == monoid) {
+        return identity;
+    }
+    identity = monoid->identity;
+    if (compare(tree, start_key, end_key) >= 0) {
+        return identity;
+    }
+
+    /* find the topmost node within the range, where the paths split */
+    libcoll_treemap_node_t *split = tree->root;
+    while (NULL_NODE != split) {
+        if (compare(tree, split->key, start_key) < 0) {
+            split = split->right;
+        } else if (compare(tree, split->key, end_key) >= 0) {
+            split = split->left;
+        } else {
+            break;
+        }
+    }
+    if (NULL_NODE == split) {
+        return identity;
+    }
+
+    /* the part of the left subtree not less than start_key, collected from
+     * the right, since each piece found is to the left of the previous ones
+     */
+    libcoll_treemap_aggregate_t left = identity;
+    for (libcoll_treemap_node_t *node = split->left; NULL_NODE != node; ) {
+        if (compare(tree, node->key, start_key) >= 0) {
+            libcoll_treemap_aggregate_t piece = monoid->combine(monoid->of_entry(node->key, node->value),
+                                                                aggregate_of(tree, node->right));
+            left = monoid->combine(piece, left);
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+
+    /* the part of the right subtree less than end_key, collected from the left */
+    libcoll_treemap_aggregate_t right = identity;
+    for (libcoll_treemap_node_t *node = split->right; NULL_NODE != node; ) {
+        if (compare(tree, node->key, end_key) < 0) {
+            libcoll_treemap_aggregate_t piece = monoid->combine(aggregate_of(tree, node->left),
+                                                                monoid->of_entry(node->key, node->value));
+            right = monoid->combine(right, piece);
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+
+    return monoid->combine(monoid->combine(left, monoid->of_entry(split->key, split->value)), right);
+}
+
+/*
+ * Changes the value of a node in the tree, updating the aggregates of the
+ * subtrees containing it.  Also useful after changing the contents of a value
+ * in place, by passing the same value again.
+ */
+void libcoll_treemap_set_value(libcoll_treemap_t *tree, libcoll_treemap_node_t *node, void *value)
+{
+    node->value = value;
+    update_aggregates_upwards(tree, node);
+}
+
+/*
+ * Copies the keys and values of the tree in order of keys into the given
+ * array, which must have room for at least libcoll_treemap_get_size(tree)
+ * pairs.  The result can be passed to libcoll_treemap_build_sorted to rebuild
+ * the tree.
+ *
+ * Large trees allowing parallel bulk operations are flattened using several
+ * threads, each writing a separate part of the array located using the
+ * subtree sizes.
+ *
+ * Returns: the number of pairs written
+ */
+size_t libcoll_treemap_flatten(libcoll_treemap_t *tree, libcoll_pair_voidptr_t *pairs)
+{
+    flatten_subtree(tree->root, pairs, 0, tree->parallel);
+    return tree->size;
+}
+
+/*
+ * Splits the tree in two at the given key.  The keys less than the given key
+ * remain in the tree, and the rest are moved into a new tree, which is
+ * returned.  Nodes are moved rather than copied, and the split takes
+ * O(log n) time.
+ *
+ * Splitting is not supported for trees using slab allocation, since the nodes
+ * of such a tree belong to the tree's slabs.
+ *
+ * Returns: a new tree with the keys greater than or equal to the given key,
+ *          or NULL if the tree uses slab allocation or is not a red-black
+ *          tree, or allocating memory failed, in which case the tree is left
+ *          intact
+ */
+libcoll_treemap_t* libcoll_treemap_split(libcoll_treemap_t *tree, const void *key)
+{
+    if (LIBCOLL_TREEMAP_ALLOC_SLAB == tree->allocation || LIBCOLL_TREEMAP_BALANCE_RED_BLACK != tree->balancing) {
+        return NULL;
+    }
+
+    libcoll_treemap_t *upper = libcoll_treemap_init_with_params(tree->key_comparator, tree->allocation);
+    if (NULL == upper) {
+        return NULL;
+    }
+
+    libcoll_treemap_node_t *lower_root, *upper_root;
+    libcoll_treemap_node_t *found = split_nodes(tree, tree->root, key, &lower_root, &upper_root);
+    if (NULL_NODE != found) {
+        /* the node with the key itself goes to the upper tree */
+        upper_root = join_nodes(tree, NULL_NODE, found, upper_root);
+    }
+
+    tree->root = lower_root;
+    tree->size = lower_root->subtree_size;
+    upper->root = upper_root;
+    upper->size = upper_root->subtree_size;
+
+    upper->threaded = tree->threaded;
+    upper->parallel = tree->parallel;
+    upper->monoid = tree->monoid;
+    if (tree->threaded) {
+        if (NULL_NODE != lower_root)  maximum(lower_root)->next_in_order = NULL_NODE;
+        if (NULL_NODE != upper_root)  minimum(upper_root)->previous_in_order = NULL_NODE;
+    }
+
+    return upper;
+}
+
+/*
+ * Moves all nodes of the other tree into the given tree.  All keys in the
+ * other tree must be greater than all keys in the given tree.  Takes
+ * O(log n) time.
+ *
+ * The trees must be two different trees using the same comparator, the same
+ * allocation strategy and the same threaded mode, and both must be red-black
+ * trees.  The other tree is left empty and must still be deinitialized
+ * separately.
+ *
+ * Returns: true if the trees were joined, false if they could not be
+ */
+bool libcoll_treemap_join(libcoll_treemap_t *tree, libcoll_treemap_t *other)
+{
+    if (tree->key_comparator != other->key_comparator || tree->allocation != other->allocation
+            || tree->threaded != other->threaded || tree->monoid != other->monoid) {
+        return false;
+    }
+    if (NULL_NODE != tree->root && NULL_NODE != other->root
+            && compare(tree, maximum(tree->root)->key, minimum(other->root)->key) >= 0) {
+        return false;
+    }
+
+    return combine_trees(tree, other, COMBINE_JOIN);
+}
+
+/*
+ * Merges the other tree into the given tree, so that the given tree contains
+ * the keys of both trees.  Where both trees contain the same key, the node of
+ * the given tree is kept, and the node of the other tree is deleted without
+ * freeing its key and value.
+ *
+ * The set operations work by splitting and joining subtrees, taking
+ * O(m log(n/m + 1)) time for trees of sizes m and n, m <= n.  For large trees
+ * using malloc for allocation, the work is split across several threads if
+ * the given tree allows parallel bulk operations; see
+ * libcoll_treemap_set_parallel.
+ *
+ * The trees must be two different trees using the same comparator, the same
+ * allocation strategy and the same threaded mode, and both must be red-black
+ * trees.  The other tree is left empty and must still be deinitialized
+ * separately.
+ *
+ * Returns: true if the trees were merged, false if they are incompatible or
+ *          the same tree
+ */
+bool libcoll_treemap_union(libcoll_treemap_t *tree, libcoll_treemap_t *other)
+{
+    return combine_trees(tree, other, COMBINE_UNION);
+}
+
+/*
+ * Removes the nodes whose keys are not in the other tree from the given tree.
+ * See libcoll_treemap_union for details; the removed nodes of both trees are
+ * deleted without freeing their keys and values.
+ */
+bool libcoll_treemap_intersection(libcoll_treemap_t *tree, libcoll_treemap_t *other)
+{
+    return combine_trees(tree, other, COMBINE_INTERSECTION);
+}
+
+/*
+ * Removes the nodes whose keys are in the other tree from the given tree.
+ * See libcoll_treemap_union for details; the removed nodes of both trees are
+ * deleted without freeing their keys and values.
+ */
+bool libcoll_treemap_difference(libcoll_treemap_t *tree, libcoll_treemap_t *other)
+{
+    return combine_trees(tree, other, COMBINE_DIFFERENCE);
+}
+
 /*
  * Adds a new node with the given key and value into the tree.
  * No duplicate keys will be stored.  If a node with a key equal to the
@@ -165,54 +683,116 @@ void libcoll_treemap_deinit_and_delete_contents(libcoll_treemap_t *tree)
 libcoll_treemap_node_t* libcoll_treemap_add(libcoll_treemap_t *tree, void *key, void *value)
 {
     DEBUG("Adding new key\n");
-    libcoll_treemap_node_t *new_node;
+    START_COUNTING(tree);
+    libcoll_treemap_node_t *parent;
+    int cmpval;
+    libcoll_treemap_node_t *existing = find_position(tree, key, &parent, &cmpval);
+    libcoll_treemap_node_t *new_node = NULL;
+
+    if (NULL_NODE != existing) {
+        DEBUGF("Found existing node (at %p) with equal key\n", (void*) existing);
+        if (LIBCOLL_TREEMAP_BALANCE_SPLAY == tree->balancing) {
+            splay(tree, existing);
+        }
+    } else {
+        new_node = insert_leaf(tree, parent, cmpval, key, value);
+    }
+    STOP_COUNTING(tree, additions);
+    return new_node;
+}
 
-    libcoll_treemap_node_t *parent = tree->root;
-    if (NULL_NODE == parent) {
-        new_node = create_node(key, value);
-        if (NULL == new_node)  return NULL;
+/*
+ * Adds a new node with the given key and value into the tree, like
+ * libcoll_treemap_add, but searching for its place starting from the given
+ * node instead of the root.  If the new key belongs right next to the hint,
+ * which is the case when keys arrive in order and the hint is the node
+ * added last, only one or two keys are compared.  Otherwise the search climbs
+ * up from the hint until reaching a subtree the key belongs in, and descends
+ * from there, comparing fewer keys the closer the hint is to the key.
+ *
+ * If the hint is NULL, the node with the largest key is used, so that
+ * appending keys larger than all others compares only one key.
+ *
+ * Returns: a pointer to the newly created node, or NULL if adding the node
+ *          failed due to an already existing key or due to malloc failing
+ */
+libcoll_treemap_node_t* libcoll_treemap_add_hint(libcoll_treemap_t *tree, libcoll_treemap_node_t *hint,
+                                                 void *key, void *value)
+{
+    START_COUNTING(tree);
+    libcoll_treemap_node_t *new_node = add_near(tree, hint, key, value);
+    STOP_COUNTING(tree, additions);
+    return new_node;
+}
 
-        tree->root = new_node;
-    } else {
-        bool place_found = false;
-        while (!place_found) {
-            int cmpval = tree->key_comparator(key, parent->key);
-            if (cmpval < 0) {
-                if (NULL_NODE != parent->left) {
-                    parent = parent->left;
-                } else {
-                    new_node = create_node(key, value);
-                    if (NULL == new_node)  return NULL;
-
-                    parent->left = new_node;
-                    new_node->parent = parent;
-                    place_found = true;
-                }
-            } else if (cmpval > 0) {
-                if (NULL_NODE != parent->right) {
-                    parent = parent->right;
-                } else {
-                    new_node = create_node(key, value);
-                    if (NULL == new_node)  return NULL;
-
-                    parent->right = new_node;
-                    new_node->parent = parent;
-                    place_found = true;
-                }
-            } else {
-                DEBUGF("Found existing node (at %p) with equal key\n", (void*) parent);
-                new_node = NULL;
-                place_found = true;
-            }
+/*
+ * Adds the given key-value pairs into the tree, which need not be in any
+ * particular order.  As with libcoll_treemap_add, keys already in the tree
+ * are left as they are, and of equal keys within the pairs the first one is
+ * added.
+ *
+ * Instead of searching for the place of each key from the root, the pairs
+ * are first sorted with a merge sort that skips merging runs already in
+ * order, using several threads for large batches if the tree allows parallel
+ * bulk operations (see libcoll_treemap_set_parallel).  The sorted pairs are
+ * then built into a tree of their own in O(m) time and merged into the tree
+ * with libcoll_treemap_union, in O(m log(n/m + 1)) time for m pairs added to
+ * n nodes.  Threaded trees, which union would relink in O(n) time, and trees
+ * using other balancing policies than red-black instead get the sorted keys
+ * added one by one using the previously added node as the hint.
+ *
+ * Returns: true if the pairs were added, false if allocating memory failed,
+ *          in which case the tree is left intact if it is an unthreaded
+ *          red-black tree, and otherwise holds the keys added so far
+ */
+bool libcoll_treemap_add_batch(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs, size_t count)
+{
+    if (0 == count) {
+        return true;
+    }
+    libcoll_pair_voidptr_t *sorted = malloc(2 * count * sizeof(libcoll_pair_voidptr_t));
+    if (NULL == sorted) {
+        return false;
+    }
+    memcpy(sorted, pairs, count * sizeof(libcoll_pair_voidptr_t));
+    sort_pairs(tree, sorted, sorted + count, count, 0);
+
+    /* the sort is stable, so the first of equal keys comes first */
+    size_t unique = 1;
+    for (size_t i=1; i<count; i++) {
+        if (0 != compare(tree, sorted[unique-1].a, sorted[i].a)) {
+            sorted[unique++] = sorted[i];
         }
     }
-    DEBUG("\n");
-    if (NULL != new_node) {
-        fix_after_addition(tree, new_node);
-        tree->size++;
+
+    bool added = true;
+    if (tree->threaded || LIBCOLL_TREEMAP_BALANCE_RED_BLACK != tree->balancing) {
+        libcoll_treemap_node_t *hint = NULL;
+        for (size_t i=0; i<unique && added; i++) {
+            libcoll_treemap_node_t *node = NULL != hint
+                                           ? libcoll_treemap_add_hint(tree, hint, sorted[i].a, sorted[i].b)
+                                           : libcoll_treemap_add(tree, sorted[i].a, sorted[i].b);
+            if (NULL == node) {
+                /* either the key is already in the tree or allocating failed */
+                libcoll_treemap_node_t *parent;
+                int cmpval;
+                node = find_position(tree, sorted[i].a, &parent, &cmpval);
+                added = NULL_NODE != node;
+            }
+            hint = node;
+        }
+    } else {
+        libcoll_treemap_t *batch = libcoll_treemap_init_with_params(tree->key_comparator, tree->allocation);
+        added = NULL != batch;
+        if (added) {
+            batch->monoid = tree->monoid;
+            added = build_tree(batch, sorted, unique) && combine_trees(tree, batch, COMBINE_UNION);
+            libcoll_treemap_deinit(batch);
+        }
     }
 
-    return new_node;
+    free(sorted);
+    return added;
 }
 
 /*
@@ -227,17 +807,15 @@ libcoll_treemap_node_t* libcoll_treemap_add(libcoll_treemap_t *tree, void *key,
  */
 libcoll_treemap_node_t* libcoll_treemap_get(libcoll_treemap_t *tree, void *key)
 {
-    libcoll_treemap_node_t *node = tree->root;
-    while (NULL_NODE != node) {
-        int cmpval = tree->key_comparator(key, node->key);
-        if (cmpval < 0) {
-            node = node->left;
-        } else if (cmpval > 0) {
-            node = node->right;
-        } else {
-            break;
-        }
+    START_COUNTING(tree);
+    libcoll_treemap_node_t *parent;
+    int cmpval;
+    libcoll_treemap_node_t *node = find_position(tree, key, &parent, &cmpval);
+
+    if (LIBCOLL_TREEMAP_BALANCE_SPLAY == tree->balancing) {
+        splay(tree, NULL_NODE != node ? node : parent);
     }
+    STOP_COUNTING(tree, lookups);
 
     /* let's not expose the internal null node business in the external API,
      * so return an ordinary NULL pointer instead
@@ -276,16 +854,23 @@ bool libcoll_treemap_contains(libcoll_treemap_t *tree, void *key)
  */
 libcoll_pair_voidptr_t libcoll_treemap_remove(libcoll_treemap_t *tree, void *key)
 {
+    START_COUNTING(tree);
     libcoll_pair_voidptr_t pair;
-    libcoll_treemap_node_t *node = libcoll_treemap_get(tree, key);
+    libcoll_treemap_node_t *parent;
+    int cmpval;
+    libcoll_treemap_node_t *node = find_position(tree, key, &parent, &cmpval);
     if (NULL_NODE != node) {
         pair.a = node->key;
         pair.b = node->value;
         remove_node(tree, node);
     } else {
+        if (LIBCOLL_TREEMAP_BALANCE_SPLAY == tree->balancing) {
+            splay(tree, parent);
+        }
         pair.a = NULL;
         pair.b = NULL;
     }
+    STOP_COUNTING(tree, removals);
     return pair;
 }
 
@@ -301,24 +886,9 @@ libcoll_pair_voidptr_t libcoll_treemap_remove(libcoll_treemap_t *tree, void *key
  */
 libcoll_treemap_node_t* libcoll_treemap_get_successor(libcoll_treemap_node_t *node)
 {
-    // algorithm adapted from CLRS
-    DEBUGF("Finding successor for node @ %p\n", (void*) node);
-    libcoll_treemap_node_t *candidate;
-    if (NULL_NODE != node->right) {
-        candidate = node->right;
-        while (NULL_NODE != candidate->left) {
-            candidate = candidate->left;
-        }
-    } else {
-        libcoll_treemap_node_t *parent = node->parent;
-        candidate = node;
-        while (NULL_NODE != parent && candidate == parent->right) {
-            candidate = parent;
-            parent = parent->parent;
-        }
-        candidate = parent;
-    }
-    return candidate;
+    libcoll_treemap_node_t *candidate = NULL != node->next_in_order ? node->next_in_order
+                                                                    : walk_to_successor(node);
+    return NULL_NODE != candidate ? candidate : NULL;
 }
 
 /*
@@ -332,42 +902,151 @@ libcoll_treemap_node_t* libcoll_treemap_get_successor(libcoll_treemap_node_t *no
  */
 libcoll_treemap_node_t* libcoll_treemap_get_predecessor(libcoll_treemap_node_t *node)
 {
-    // algorithm adapted from CLRS
-    DEBUGF("Finding predecessor for node @ %p\n", (void*) node);
-    libcoll_treemap_node_t *candidate;
-    if (NULL_NODE != node->left) {
-        candidate = node->left;
-        while (NULL_NODE != candidate->right) {
-            candidate = candidate->right;
-        }
-    } else {
-        libcoll_treemap_node_t *parent = node->parent;
-        candidate = node;
-        while (NULL_NODE != parent && candidate == parent->left) {
-            candidate = parent;
-            parent = parent->parent;
-        }
-        candidate = parent;
-    }
-    return candidate;
+    libcoll_treemap_node_t *candidate = NULL != node->previous_in_order ? node->previous_in_order
+                                                                        : walk_to_predecessor(node);
+    return NULL_NODE != candidate ? candidate : NULL;
 }
 
 /*
- * Finds the depth of the node that has the given key in the given tree.
- * If there is no such node in the tree, -1 is returned.
+ * Checks whether the given node is the null node, which the tree uses in
+ * place of missing children and as the parent of the root.  Code walking the
+ * left, right and parent links of nodes directly can use this to tell where
+ * the tree ends.
+ */
+bool libcoll_treemap_is_null_node(const libcoll_treemap_node_t *node)
+{
+    return NULL_NODE == node;
+}
+
+/*
+ * Finds the node with the largest key less than or equal to the given key,
+ * which need not exist in the tree.
  *
- * Params:
- *      key -- the key of the node whose depth is to be returned
+ * Returns: the node found, or NULL if all keys in the tree are larger
+ */
+libcoll_treemap_node_t* libcoll_treemap_floor(libcoll_treemap_t *tree, const void *key)
+{
+    libcoll_treemap_node_t *node = find_bound(tree, key, false, true);
+    return NULL_NODE != node ? node : NULL;
+}
+
+/*
+ * Finds the node with the smallest key greater than or equal to the given key,
+ * which need not exist in the tree.
  *
- * Returns: the depth of the node
+ * Returns: the node found, or NULL if all keys in the tree are smaller
  */
-int libcoll_treemap_depth_of(libcoll_treemap_t *tree, void *key)
+libcoll_treemap_node_t* libcoll_treemap_ceiling(libcoll_treemap_t *tree, const void *key)
 {
-    libcoll_treemap_node_t *node = tree->root;
-    int depth = 0;
-    bool found = false;
+    libcoll_treemap_node_t *node = find_bound(tree, key, true, true);
+    return NULL_NODE != node ? node : NULL;
+}
+
+/*
+ * Finds the first node whose key is not less than the given key.
+ * This is the same node as found by libcoll_treemap_ceiling.
+ *
+ * Returns: the node found, or NULL if all keys in the tree are smaller
+ */
+libcoll_treemap_node_t* libcoll_treemap_lower_bound(libcoll_treemap_t *tree, const void *key)
+{
+    return libcoll_treemap_ceiling(tree, key);
+}
+
+/*
+ * Finds the first node whose key is greater than the given key.
+ *
+ * Returns: the node found, or NULL if no key in the tree is greater
+ */
+libcoll_treemap_node_t* libcoll_treemap_upper_bound(libcoll_treemap_t *tree, const void *key)
+{
+    libcoll_treemap_node_t *node = find_bound(tree, key, true, false);
+    return NULL_NODE != node ? node : NULL;
+}
+
+/*
+ * Finds the rank of the given key in the tree, i.e. the number of keys in the
+ * tree that are less than the given key.  The key need not exist in the tree;
+ * if it does, its rank is also its index in the order of keys.
+ *
+ * Takes O(log n) time using the subtree sizes stored in the nodes.
+ */
+size_t libcoll_treemap_rank(libcoll_treemap_t *tree, const void *key)
+{
+    size_t rank = 0;
+    libcoll_treemap_node_t *node = tree->root;
+
+    while (NULL_NODE != node) {
+        int cmpval = compare(tree, key, node->key);
+        if (cmpval <= 0) {
+            if (cmpval == 0) {
+                return rank + node->left->subtree_size;
+            }
+            node = node->left;
+        } else {
+            rank += node->left->subtree_size + 1;
+            node = node->right;
+        }
+    }
+    return rank;
+}
+
+/*
+ * Finds the node at the given index in the order of keys, with the node with
+ * the smallest key at index 0.  Useful e.g. for finding percentiles: the
+ * median of the keys is at index size / 2.
+ *
+ * Returns: the node at the given index, or NULL if the index is not less than
+ *          the size of the tree
+ */
+libcoll_treemap_node_t* libcoll_treemap_select(libcoll_treemap_t *tree, size_t index)
+{
+    libcoll_treemap_node_t *node = tree->root;
+    if (index >= node->subtree_size) {
+        return NULL;
+    }
+
+    for (;;) {
+        size_t left_size = node->left->subtree_size;
+        if (index < left_size) {
+            node = node->left;
+        } else if (index > left_size) {
+            index -= left_size + 1;
+            node = node->right;
+        } else {
+            return node;
+        }
+    }
+}
+
+/*
+ * Counts the keys in the tree within the half-open range [start_key, end_key)
+ * in O(log n) time.
+ */
+size_t libcoll_treemap_count_range(libcoll_treemap_t *tree, const void *start_key, const void *end_key)
+{
+    if (compare(tree, start_key, end_key) >= 0) {
+        return 0;
+    }
+    return libcoll_treemap_rank(tree, end_key) - libcoll_treemap_rank(tree, start_key);
+}
+
+/*
+ * Finds the depth of the node that has the given key in the given tree.
+ * If there is no such node in the tree, -1 is returned.
+ *
+ * Params:
+ *      key -- the key of the node whose depth is to be returned
+ *
+ * Returns: the depth of the node
+ */
+int libcoll_treemap_depth_of(libcoll_treemap_t *tree, void *key)
+{
+    libcoll_treemap_node_t *node = tree->root;
+    int depth = 0;
+    bool found = false;
     while (NULL_NODE != node && !found) {
-        int cmpval = tree->key_comparator(key, node->key);
+        int cmpval = compare(tree, key, node->key);
         if (cmpval == 0) {
             found = true;
         } else if (cmpval < 0) {
@@ -392,6 +1071,86 @@ size_t libcoll_treemap_get_size(libcoll_treemap_t *tree)
     return tree->size;
 }
 
+/*
+ * Fills in statistics on the shape of the tree, the memory used by its nodes
+ * and the work done on it, for finding out whether slow operations are due
+ * to the depth of the tree, the cost of comparisons or rebalancing.  The
+ * shape is computed by walking the whole tree, in O(n) time without
+ * recursion.
+ *
+ * The counters of operations are only kept if the library is compiled with
+ * ENABLE_TREEMAP_STATS=1 defined, and are zero otherwise.  Dividing the
+ * comparisons of a kind of operation by its calls gives the average number
+ * of comparisons per operation.  Counts are approximate while the tree is
+ * used from several threads at once.
+ *
+ * Params:
+ *      tree  -- the tree to examine
+ *      stats -- where to store the statistics
+ */
+void libcoll_treemap_get_stats(libcoll_treemap_t *tree, libcoll_treemap_stats_t *stats)
+{
+    memset(stats, 0, sizeof(libcoll_treemap_stats_t));
+    stats->size = tree->size;
+    stats->node_size = sizeof(libcoll_treemap_node_t);
+    stats->counters = tree->counters;
+
+    if (LIBCOLL_TREEMAP_ALLOC_SLAB == tree->allocation) {
+        for (libcoll_treemap_slab_t *slab = tree->slabs; NULL != slab; slab = slab->next) {
+            stats->node_memory += sizeof(libcoll_treemap_slab_t) + slab->capacity * sizeof(libcoll_treemap_node_t);
+        }
+    } else {
+        stats->node_memory = tree->size * sizeof(libcoll_treemap_node_t);
+    }
+
+    if (LIBCOLL_TREEMAP_BALANCE_RED_BLACK == tree->balancing) {
+        for (libcoll_treemap_node_t *node = tree->root; NULL_NODE != node; node = node->left) {
+            if (COLOR_BLACK == node->color)  stats->black_height++;
+        }
+    }
+
+    /* an in-order walk following parent links, keeping track of the depth */
+    double total_depth = 0;
+    int depth = 0;
+    libcoll_treemap_node_t *node = tree->root;
+    while (NULL_NODE != node && NULL_NODE != node->left) {
+        node = node->left;
+        depth++;
+    }
+    while (NULL_NODE != node) {
+        stats->depth_counts[depth < LIBCOLL_TREEMAP_STATS_DEPTHS ? depth : LIBCOLL_TREEMAP_STATS_DEPTHS - 1]++;
+        total_depth += depth;
+        if (depth + 1 > stats->height)  stats->height = depth + 1;
+
+        if (NULL_NODE != node->right) {
+            node = node->right;
+            depth++;
+            while (NULL_NODE != node->left) {
+                node = node->left;
+                depth++;
+            }
+        } else {
+            while (NULL_NODE != node->parent && node == node->parent->right) {
+                node = node->parent;
+                depth--;
+            }
+            node = node->parent;
+            depth--;
+        }
+    }
+    if (0 != tree->size) {
+        stats->average_depth = total_depth / tree->size;
+    }
+}
+
+/*
+ * Sets all counters of operations on the tree to zero.
+ */
+void libcoll_treemap_reset_counters(libcoll_treemap_t *tree)
+{
+    memset(&tree->counters, 0, sizeof(libcoll_treemap_counters_t));
+}
+
 /*
  * Returns true if the map currently has zero elements, false otherwise.
  */
@@ -424,270 +1183,1806 @@ libcoll_treemap_iter_t* libcoll_treemap_get_iterator(libcoll_treemap_t *tree)
 {
     libcoll_treemap_iter_t *iter = malloc (sizeof(libcoll_treemap_iter_t));
     if (NULL != iter) {
-        iter->tree = tree;
-        libcoll_treemap_node_t *first = tree->root;
-        if (NULL_NODE != first) {
-            while (NULL_NODE != first->left) {
-                first = first->left;
-            }
+        libcoll_treemap_init_iterator(iter, tree);
+    }
+    return iter;
+}
+
+/*
+ * Initializes a new iterator for the tree, set to point in front of the node
+ * with the smallest key greater than or equal to the given key.  The first
+ * call to libcoll_treemap_next returns that node, whereas calling
+ * libcoll_treemap_previous returns the node preceding it.
+ *
+ * Positioning the iterator takes O(log n) time.
+ *
+ * Returns: a pointer to the new iterator, or NULL if allocating memory failed
+ */
+libcoll_treemap_iter_t* libcoll_treemap_get_iterator_at(libcoll_treemap_t *tree, const void *key)
+{
+    libcoll_treemap_iter_t *iter = malloc (sizeof(libcoll_treemap_iter_t));
+    if (NULL != iter) {
+        libcoll_treemap_init_iterator_at(iter, tree, key);
+    }
+    return iter;
+}
+
+/*
+ * Initializes a new iterator over the nodes whose keys are in the half-open
+ * range [start_key, end_key).  The iterator starts in front of the first node
+ * in the range and stops at either end of the range in both directions.
+ *
+ * The iterator remembers the nodes just outside the range, so checking for
+ * the end of the range involves no key comparisons.  Removing nodes through
+ * the iterator is allowed, but the tree must not be otherwise modified while
+ * the iterator is in use.
+ *
+ * Returns: a pointer to the new iterator, or NULL if allocating memory failed
+ */
+libcoll_treemap_iter_t* libcoll_treemap_get_range_iterator(libcoll_treemap_t *tree,
+                                                           const void *start_key,
+                                                           const void *end_key)
+{
+    libcoll_treemap_iter_t *iter = malloc (sizeof(libcoll_treemap_iter_t));
+    if (NULL != iter) {
+        libcoll_treemap_init_range_iterator(iter, tree, start_key, end_key);
+    }
+    return iter;
+}
+
+/*
+ * Initializes an iterator in memory provided by the caller, for example on
+ * the stack, in the same way as libcoll_treemap_get_iterator.  This avoids
+ * allocating memory for short iterations.  An iterator initialized this way
+ * needs no deinitialization and must not be passed to
+ * libcoll_treemap_free_iterator.
+ */
+void libcoll_treemap_init_iterator(libcoll_treemap_iter_t *iterator, libcoll_treemap_t *tree)
+{
+    iterator->tree = tree;
+    iterator->previous = NULL_NODE;
+    iterator->next = minimum(tree->root);
+    iterator->last_traversed_node = NULL_NODE;
+    iterator->end = NULL_NODE;
+    iterator->before_start = NULL_NODE;
+}
+
+/*
+ * Initializes an iterator in memory provided by the caller in the same way as
+ * libcoll_treemap_get_iterator_at.  See libcoll_treemap_init_iterator.
+ */
+void libcoll_treemap_init_iterator_at(libcoll_treemap_iter_t *iterator, libcoll_treemap_t *tree, const void *key)
+{
+    libcoll_treemap_init_iterator(iterator, tree);
+    iterator->next = find_bound(tree, key, true, true);
+    iterator->previous = NULL_NODE != iterator->next ? predecessor(tree, iterator->next) : maximum(tree->root);
+}
+
+/*
+ * Initializes an iterator in memory provided by the caller in the same way as
+ * libcoll_treemap_get_range_iterator.  See libcoll_treemap_init_iterator.
+ */
+void libcoll_treemap_init_range_iterator(libcoll_treemap_iter_t *iterator, libcoll_treemap_t *tree,
+                                         const void *start_key, const void *end_key)
+{
+    libcoll_treemap_init_iterator_at(iterator, tree, start_key);
+    iterator->before_start = iterator->previous;
+    if (compare(tree, start_key, end_key) < 0) {
+        iterator->end = find_bound(tree, end_key, true, true);
+    } else {
+        /* an empty range, with nothing to iterate in either direction */
+        iterator->end = iterator->next;
+    }
+}
+
+/*
+ * Deletes the given iterator and frees the memory allocated for it.
+ *
+ * Params:
+ *      iterator -- the iterator to deinitialize
+ */
+void libcoll_treemap_free_iterator(libcoll_treemap_iter_t *iterator)
+{
+    free(iterator);
+}
+
+/*
+ * Checks whether the given iterator has more nodes left that can be retrieved
+ * by calling tm_next.
+ *
+ * Params:
+ *      iterator -- the iterator to check
+ *
+ * Returns: true if there are more nodes to iterate over, false if not
+ */
+bool libcoll_treemap_has_next(libcoll_treemap_iter_t *iterator)
+{
+    return (iterator->end != iterator->next);
+}
+
+/*
+ * Retrieves the next element in the tree in the order of keys.
+ *
+ * Params:
+ *      iterator -- the iterator whose next element to retrieve
+ *
+ * Returns: the next node in the tree
+ */
+libcoll_treemap_node_t* libcoll_treemap_next(libcoll_treemap_iter_t *iterator)
+{
+    libcoll_treemap_node_t *traversed_node = iterator->next;
+    iterator->previous = traversed_node;
+    iterator->next = successor(iterator->tree, traversed_node);
+    iterator->last_traversed_node = traversed_node;
+
+    return traversed_node;
+}
+
+/*
+ * Checks whether the given iterator has mode nodes left that can be retrieved
+ * by calling tm_previous (i.e. iterating in reverse order of keys).
+ *
+ * Params:
+ *      iterator -- the iterator to check
+ *
+ * Returns: true of there are more nodes to iterate over, false if not
+ */
+bool libcoll_treemap_has_previous(libcoll_treemap_iter_t *iterator)
+{
+    return (iterator->before_start != iterator->previous);
+}
+
+/*
+ * Retrieves the previous element in the tree in the reverse order of keys.
+ *
+ * Params:
+ *      iterator -- the iterator whose previous element to retrieve
+ *
+ * Returns: the previous node in the tree
+ */
+libcoll_treemap_node_t* libcoll_treemap_previous(libcoll_treemap_iter_t *iterator)
+{
+    libcoll_treemap_node_t *traversed_node = iterator->previous;
+    iterator->next = traversed_node;
+    iterator->previous = predecessor(iterator->tree, traversed_node);
+    iterator->last_traversed_node = traversed_node;
+
+    return traversed_node;
+}
+
+/*
+ * Removes the node last traversed and returned by the given iterator from
+ * the tree and frees the memory allocated for it.
+ *
+ * This does not deallocate the stored key and value themselves since
+ * there may still be references to them elsewhere outside of the tree.
+ * The actual objects stored must be separately freed when they are
+ * no longer needed.
+ *
+ * Params:
+ *      iterator -- the iterator whose last traversed node is to be removed
+ *
+ * Returns a struct that contains a pointer to the key as the first member
+ * and a pointer to the value as the second member.
+ */
+libcoll_pair_voidptr_t libcoll_treemap_remove_last_traversed(libcoll_treemap_iter_t *iterator)
+{
+    libcoll_pair_voidptr_t pair;
+    if (NULL_NODE != iterator->last_traversed_node) {
+        libcoll_treemap_node_t *to_be_removed = iterator->last_traversed_node;
+        pair.a = to_be_removed->key;
+        pair.b = to_be_removed->value;
+
+        if (iterator->last_traversed_node == iterator->previous) {
+            iterator->previous = predecessor(iterator->tree, iterator->previous);
+            iterator->last_traversed_node = NULL_NODE;
+        } else {
+            iterator->next = successor(iterator->tree, iterator->next);
+            iterator->last_traversed_node = NULL_NODE;
         }
-        iter->next = first;
+        START_COUNTING(iterator->tree);
+        remove_node(iterator->tree, to_be_removed);
+        STOP_COUNTING(iterator->tree, removals);
+    } else {
+        pair.a = NULL;
+        pair.b = NULL;
+    }
+    return pair;
+}
+
+/*
+ * Makes a read-only copy of the entries of the tree, laid out for fast
+ * searching; see libcoll_treemap_frozen_t.  The copy refers to the same keys
+ * and values as the tree, and is not affected by later changes to the tree.
+ * Freezing takes O(n) time, and the copy takes two or three pointers per
+ * entry instead of a node.
+ *
+ * Returns: the frozen copy, or NULL if allocating memory failed
+ */
+libcoll_treemap_frozen_t* libcoll_treemap_freeze(libcoll_treemap_t *tree)
+{
+    libcoll_treemap_frozen_t *frozen = malloc(sizeof(libcoll_treemap_frozen_t));
+    if (NULL == frozen)  return NULL;
+
+    builtin_comparator_kind kind = builtin_comparator_kind_of(tree->key_comparator);
+    bool use_ordinals = BUILTIN_CMP_INTPTR == kind || BUILTIN_CMP_MEMADDR == kind;
+
+    frozen->size = tree->size;
+    frozen->key_comparator = tree->key_comparator;
+    frozen->keys = malloc((tree->size + 1) * sizeof(void*));
+    frozen->values = malloc((tree->size + 1) * sizeof(void*));
+    frozen->ordinals = use_ordinals ? malloc((tree->size + 1) * sizeof(uintptr_t)) : NULL;
+    if (NULL == frozen->keys || NULL == frozen->values || (use_ordinals && NULL == frozen->ordinals)) {
+        libcoll_treemap_frozen_deinit(frozen);
+        return NULL;
+    }
+
+    fill_eytzinger(tree, frozen, 1, minimum(tree->root));
+    return frozen;
+}
+
+void libcoll_treemap_frozen_deinit(libcoll_treemap_frozen_t *frozen)
+{
+    free(frozen->keys);
+    free(frozen->values);
+    free(frozen->ordinals);
+    free(frozen);
+}
+
+/*
+ * Returns: the value for the given key in the frozen tree, or NULL if the key
+ *          is not there
+ */
+void* libcoll_treemap_frozen_get(const libcoll_treemap_frozen_t *frozen, const void *key)
+{
+    size_t index = frozen_lower_bound(frozen, key);
+    return 0 != index && frozen_key_equals(frozen, index, key) ? frozen->values[index] : NULL;
+}
+
+bool libcoll_treemap_frozen_contains(const libcoll_treemap_frozen_t *frozen, const void *key)
+{
+    size_t index = frozen_lower_bound(frozen, key);
+    return 0 != index && frozen_key_equals(frozen, index, key);
+}
+
+/*
+ * Finds the entry with the smallest key not less than the given key.
+ *
+ * Returns: the entry as a pair of key and value, or a pair of NULLs if all
+ *          keys are less than the given key
+ */
+libcoll_pair_voidptr_t libcoll_treemap_frozen_lower_bound(const libcoll_treemap_frozen_t *frozen, const void *key)
+{
+    libcoll_pair_voidptr_t pair = { NULL, NULL };
+    size_t index = frozen_lower_bound(frozen, key);
+    if (0 != index) {
+        pair.a = frozen->keys[index];
+        pair.b = frozen->values[index];
+    }
+    return pair;
+}
+
+size_t libcoll_treemap_frozen_get_size(const libcoll_treemap_frozen_t *frozen)
+{
+    return frozen->size;
+}
+
+/*
+ * Initializes an iterator for going through the entries of a frozen tree in
+ * the order of their keys, starting from the smallest key.
+ */
+void libcoll_treemap_frozen_init_iterator(libcoll_treemap_frozen_iter_t *iterator,
+                                          const libcoll_treemap_frozen_t *frozen)
+{
+    size_t index = 0;
+    if (frozen->size > 0) {
+        index = 1;
+        while (2 * index <= frozen->size) {
+            index *= 2;
+        }
+    }
+    iterator->frozen = frozen;
+    iterator->position = index;
+}
+
+/*
+ * Initializes an iterator for going through the entries of a frozen tree in
+ * the order of their keys, starting from the smallest key not less than the
+ * given key.
+ */
+void libcoll_treemap_frozen_init_iterator_at(libcoll_treemap_frozen_iter_t *iterator,
+                                             const libcoll_treemap_frozen_t *frozen, const void *key)
+{
+    iterator->frozen = frozen;
+    iterator->position = frozen_lower_bound(frozen, key);
+}
+
+bool libcoll_treemap_frozen_has_next(libcoll_treemap_frozen_iter_t *iterator)
+{
+    return 0 != iterator->position;
+}
+
+/*
+ * Moves the iterator forward.
+ *
+ * Returns: the next entry as a pair of key and value, or a pair of NULLs if
+ *          the iterator is already at the end
+ */
+libcoll_pair_voidptr_t libcoll_treemap_frozen_next(libcoll_treemap_frozen_iter_t *iterator)
+{
+    libcoll_pair_voidptr_t pair = { NULL, NULL };
+    size_t index = iterator->position;
+    if (0 != index) {
+        pair.a = iterator->frozen->keys[index];
+        pair.b = iterator->frozen->values[index];
+        iterator->position = eytzinger_successor(index, iterator->frozen->size);
+    }
+    return pair;
+}
+
+/*
+ * Traverses the given tree and checks whether it is a valid red-black tree.
+ * More specifically, this function checks that the following conditions hold
+ * in the tree:
+ *
+ * 1. The root node is black
+ * 2. If a node is red, both of its children must be black
+ * 3. All paths from a given node down to descendant leaves contain the same
+ *    number of black nodes, i.e. the black-height of every node is well-defined.
+ *
+ * These conditions are as given in CLRS, excluding the two conditions for
+ * every node having a colour and for leaf nodes being black, which are
+ * implicitly satisfied in this implementation.
+ *
+ * The colours are only checked in red-black trees.  In a treap, the
+ * priority of every node is instead checked not to exceed the priority of
+ * its parent.  Subtree sizes, in-order links and aggregates are checked
+ * under every balancing policy.
+ *
+ * Returns true if the tree is a valid r-b tree and false if not.
+ *
+ * This function is for testing purposes.
+ */
+bool _libcoll_treemap_verify_red_black_conditions(libcoll_treemap_t *tree)
+{
+    bool tree_valid = true;
+    if (LIBCOLL_TREEMAP_BALANCE_RED_BLACK == tree->balancing) {
+        if (NULL_NODE != tree->root && COLOR_RED == tree->root->color) {
+            DEBUGF("Tree @ %p is not a valid R-B tree: root node is red\n", (void*) tree);
+            tree_valid = false;
+        }
+        if (! _verify_child_color_in_subtree(tree->root)) {
+            DEBUGF("Child colour condition failed for tree @ %p\n", (void*) tree);
+            tree_valid = false;
+        }
+        int black_height = _verify_black_height_of_subtree(tree->root);
+        if (-1 == black_height) {
+            DEBUGF("Black-height condition failed for tree @ %p\n", (void*) tree);
+            tree_valid = false;
+        }
+    } else if (LIBCOLL_TREEMAP_BALANCE_TREAP == tree->balancing && ! _verify_heap_order_in_subtree(tree->root)) {
+        DEBUGF("Heap order of priorities failed for tree @ %p\n", (void*) tree);
+        tree_valid = false;
+    }
+    if (! _verify_subtree_sizes(tree->root) || tree->root->subtree_size != tree->size) {
+        DEBUGF("Subtree sizes are inconsistent in tree @ %p\n", (void*) tree);
+        tree_valid = false;
+    }
+    libcoll_treemap_node_t *last = NULL_NODE;
+    if (! _verify_links_in_subtree(tree->root, &last, tree->threaded)
+            || (tree->threaded && NULL_NODE != last && NULL_NODE != last->next_in_order)) {
+        DEBUGF("In-order links are inconsistent in tree @ %p\n", (void*) tree);
+        tree_valid = false;
+    }
+    if (NULL != tree->monoid && ! _verify_aggregates_in_subtree(tree, tree->root)) {
+        DEBUGF("Aggregates are inconsistent in tree @ %p\n", (void*) tree);
+        tree_valid = false;
+    }
+
+    return tree_valid;
+}
+
+
+
+/* functions for internal use */
+
+/*
+ * Takes a node from the free list or the most recent slab of the tree,
+ * allocating a new slab if both have run out.
+ */
+static libcoll_treemap_node_t* allocate_from_slab(libcoll_treemap_t *tree)
+{
+    libcoll_treemap_node_t *node = tree->free_nodes;
+    if (NULL != node) {
+        tree->free_nodes = node->parent;
+        return node;
+    }
+
+    libcoll_treemap_slab_t *slab = tree->slabs;
+    if (NULL == slab || slab->used == slab->capacity) {
+        size_t capacity = NULL != slab ? 2 * slab->capacity : LIBCOLL_TREEMAP_MIN_SLAB_NODES;
+        if (capacity > LIBCOLL_TREEMAP_MAX_SLAB_NODES) {
+            capacity = LIBCOLL_TREEMAP_MAX_SLAB_NODES;
+        }
+
+        libcoll_treemap_slab_t *new_slab =
+            malloc(sizeof(libcoll_treemap_slab_t) + capacity * sizeof(libcoll_treemap_node_t));
+        if (NULL == new_slab) {
+            return NULL;
+        }
+        DEBUGF("allocate_from_slab: new slab of %lu nodes\n", (unsigned long) capacity);
+
+        new_slab->next = slab;
+        new_slab->capacity = capacity;
+        new_slab->used = 0;
+        tree->slabs = slab = new_slab;
+    }
+
+    return &slab->nodes[slab->used++];
+}
+
+/*
+ * Allocates and initializes a new node in the tree.
+ */
+static libcoll_treemap_node_t* create_node(libcoll_treemap_t *tree, void *key, void *value)
+{
+    libcoll_treemap_node_t *new_node;
+    if (LIBCOLL_TREEMAP_ALLOC_SLAB == tree->allocation) {
+        new_node = allocate_from_slab(tree);
+    } else {
+        new_node = malloc(sizeof(libcoll_treemap_node_t));
+    }
+
+    if (NULL != new_node) {
+        new_node->key = key;
+        new_node->value = value;
+        new_node->left = new_node->right = new_node->parent = NULL_NODE;
+        new_node->next_in_order = new_node->previous_in_order = NULL;
+        new_node->subtree_size = 1;
+        new_node->color = COLOR_RED;
+    }
+    return new_node;
+}
+
+/*
+ * Frees a node removed from the tree, or puts it on the free list of the tree
+ * when using slab allocation.
+ */
+static void release_node(libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    if (LIBCOLL_TREEMAP_ALLOC_SLAB == tree->allocation) {
+        node->parent = tree->free_nodes;
+        tree->free_nodes = node;
+    } else {
+        free(node);
+    }
+}
+
+/*
+ * Frees all slabs of a tree using slab allocation, and with them all nodes.
+ */
+static void free_slabs(libcoll_treemap_t *tree)
+{
+    libcoll_treemap_slab_t *slab = tree->slabs;
+    while (NULL != slab) {
+        libcoll_treemap_slab_t *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    tree->slabs = NULL;
+    tree->free_nodes = NULL;
+}
+
+static libcoll_treemap_node_t* minimum(libcoll_treemap_node_t *node)
+{
+    if (NULL_NODE != node) {
+        while (NULL_NODE != node->left) {
+            node = node->left;
+        }
+    }
+    return node;
+}
+
+static libcoll_treemap_node_t* maximum(libcoll_treemap_node_t *node)
+{
+    if (NULL_NODE != node) {
+        while (NULL_NODE != node->right) {
+            node = node->right;
+        }
+    }
+    return node;
+}
+
+/*
+ * Finds the successor of the given node, or NULL_NODE if there is none.  The
+ * in-order links are only used in threaded trees, so that other trees don't
+ * load them at all.
+ */
+static inline libcoll_treemap_node_t* successor(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    return tree->threaded ? node->next_in_order : walk_to_successor(node);
+}
+
+static inline libcoll_treemap_node_t* predecessor(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    return tree->threaded ? node->previous_in_order : walk_to_predecessor(node);
+}
+
+/*
+ * Finds the successor of the given node through the tree structure.
+ */
+static libcoll_treemap_node_t* walk_to_successor(libcoll_treemap_node_t *node)
+{
+    // algorithm adapted from CLRS
+    DEBUGF("Finding successor for node @ %p\n", (void*) node);
+    libcoll_treemap_node_t *candidate;
+    if (NULL_NODE != node->right) {
+        candidate = minimum(node->right);
+    } else {
+        libcoll_treemap_node_t *parent = node->parent;
+        candidate = node;
+        while (NULL_NODE != parent && candidate == parent->right) {
+            candidate = parent;
+            parent = parent->parent;
+        }
+        candidate = parent;
+    }
+    return candidate;
+}
+
+/*
+ * Finds the predecessor of the given node through the tree structure.
+ */
+static libcoll_treemap_node_t* walk_to_predecessor(libcoll_treemap_node_t *node)
+{
+    // algorithm adapted from CLRS
+    DEBUGF("Finding predecessor for node @ %p\n", (void*) node);
+    libcoll_treemap_node_t *candidate;
+    if (NULL_NODE != node->left) {
+        candidate = maximum(node->left);
+    } else {
+        libcoll_treemap_node_t *parent = node->parent;
+        candidate = node;
+        while (NULL_NODE != parent && candidate == parent->left) {
+            candidate = parent;
+            parent = parent->parent;
+        }
+        candidate = parent;
+    }
+    return candidate;
+}
+
+/*
+ * Walks down from the root towards the given key, keeping track of the
+ * closest node on the requested side of the key.  With above set, finds the
+ * node with the smallest key greater than (or, if inclusive, equal to) the
+ * given key; otherwise the node with the largest key less than (or equal to)
+ * it.
+ *
+ * Returns: the node found, or NULL_NODE if there is none
+ */
+static libcoll_treemap_node_t* find_bound(const libcoll_treemap_t *tree, const void *key,
+                                          bool above, bool inclusive)
+{
+    libcoll_treemap_node_t *node = tree->root;
+    libcoll_treemap_node_t *bound = NULL_NODE;
+
+    while (NULL_NODE != node) {
+        int cmpval = compare(tree, key, node->key);
+        if (cmpval == 0 && inclusive) {
+            return node;
+        }
+
+        if (above) {
+            if (cmpval < 0) {
+                bound = node;
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        } else {
+            if (cmpval > 0) {
+                bound = node;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+    }
+    return bound;
+}
+
+/*
+ * Walks down from the root of the tree towards the given key, comparing keys
+ * with the given comparator.  Meant to be inlined into find_position with a
+ * constant comparator, so that the built-in comparators get inlined into the
+ * loop.
+ */
+static inline libcoll_treemap_node_t* descend(const libcoll_treemap_t *tree, const void *key,
+                                              builtin_comparator_t comparator,
+                                              libcoll_treemap_node_t **parent, int *last_cmpval)
+{
+    libcoll_treemap_node_t *node = tree->root;
+    libcoll_treemap_node_t *previous = NULL_NODE;
+    int cmpval = 0;
+
+    while (NULL_NODE != node) {
+        cmpval = comparator(key, node->key);
+        COUNT(tree, comparisons, 1);
+        if (cmpval < 0) {
+            previous = node;
+            node = node->left;
+        } else if (cmpval > 0) {
+            previous = node;
+            node = node->right;
+        } else {
+            break;
+        }
+    }
+
+    *parent = previous;
+    *last_cmpval = cmpval;
+    return node;
+}
+
+/*
+ * Compares two keys using the comparator of the tree, counting the call.
+ */
+static inline int compare(const libcoll_treemap_t *tree, const void *key1, const void *key2)
+{
+    COUNT(tree, comparisons, 1);
+    return tree->key_comparator(key1, key2);
+}
+
+/*
+ * Finds the node with the given key.  If there is none, NULL_NODE is returned
+ * and *parent is set to the node under which the key would be inserted
+ * (NULL_NODE for an empty tree), with *last_cmpval telling on which side.
+ *
+ * The built-in comparators are dispatched to specialized copies of the loop.
+ */
+static libcoll_treemap_node_t* find_position(const libcoll_treemap_t *tree, const void *key,
+                                             libcoll_treemap_node_t **parent, int *last_cmpval)
+{
+    switch (builtin_comparator_kind_of(tree->key_comparator)) {
+    case BUILTIN_CMP_STR:
+        return descend(tree, key, &builtin_strcmp, parent, last_cmpval);
+    case BUILTIN_CMP_MEMADDR:
+        return descend(tree, key, &builtin_memaddrcmp, parent, last_cmpval);
+    case BUILTIN_CMP_INTPTR:
+        return descend(tree, key, &builtin_intptrcmp, parent, last_cmpval);
+    default:
+        return descend(tree, key, tree->key_comparator, parent, last_cmpval);
+    }
+}
+
+/*
+ * Links a new node with the given key and value as the child of the given
+ * parent on the side given by cmpval, or as the root if the parent is
+ * NULL_NODE, and rebalances the tree according to its balancing policy.
+ *
+ * Returns: the new node, or NULL if allocating memory failed
+ */
+static libcoll_treemap_node_t* insert_leaf(libcoll_treemap_t *tree, libcoll_treemap_node_t *parent, int cmpval,
+                                           void *key, void *value)
+{
+    libcoll_treemap_node_t *new_node = create_node(tree, key, value);
+    if (NULL == new_node)  return NULL;
+
+    new_node->parent = parent;
+    if (NULL_NODE == parent) {
+        tree->root = new_node;
+    } else if (cmpval < 0) {
+        parent->left = new_node;
+    } else {
+        parent->right = new_node;
+    }
+
+    if (tree->threaded) {
+        /* a new leaf sits right next to its parent in key order */
+        if (NULL_NODE == parent) {
+            new_node->previous_in_order = new_node->next_in_order = NULL_NODE;
+        } else if (cmpval < 0) {
+            new_node->previous_in_order = parent->previous_in_order;
+            new_node->next_in_order = parent;
+        } else {
+            new_node->previous_in_order = parent;
+            new_node->next_in_order = parent->next_in_order;
+        }
+        if (NULL_NODE != new_node->previous_in_order)  new_node->previous_in_order->next_in_order = new_node;
+        if (NULL_NODE != new_node->next_in_order)  new_node->next_in_order->previous_in_order = new_node;
+    }
+
+    update_aggregate(tree, new_node);
+    for (libcoll_treemap_node_t *ancestor = parent; NULL_NODE != ancestor; ancestor = ancestor->parent) {
+        ancestor->subtree_size++;
+        update_aggregate(tree, ancestor);
+    }
+
+    switch (tree->balancing) {
+    case LIBCOLL_TREEMAP_BALANCE_SPLAY:
+        splay(tree, new_node);
+        break;
+    case LIBCOLL_TREEMAP_BALANCE_TREAP:
+        while (NULL_NODE != new_node->parent && priority_of(new_node) > priority_of(new_node->parent)) {
+            rotate_up(tree, new_node);
+        }
+        break;
+    default:
+        fix_after_addition(tree, new_node);
+    }
+    tree->size++;
+    return new_node;
+}
+
+/*
+ * Climbs up from a node towards the root until reaching a subtree whose range
+ * of keys covers the given key, for a finger search.  The key is on the side
+ * of the node given by direction.  Going up from a child on that side needs
+ * no comparison, since the parent is then on the same side of the key as the
+ * child; going up from the other side, the parent bounds the child's subtree.
+ *
+ * Returns: the root of the subtree to search for the key
+ */
+static libcoll_treemap_node_t* climb_from(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node,
+                                          const void *key, int direction)
+{
+    while (NULL_NODE != node->parent) {
+        libcoll_treemap_node_t *parent = node->parent;
+        bool from_far_side = direction > 0 ? node == parent->left : node == parent->right;
+        if (from_far_side) {
+            int cmpval = compare(tree, key, parent->key);
+            if (0 == cmpval)  return parent;
+            if ((cmpval > 0) != (direction > 0))  return node;
+        }
+        node = parent;
+    }
+    return node;
+}
+
+/*
+ * Adds a new node searching for its place starting from the hint.
+ * See libcoll_treemap_add_hint.
+ */
+static libcoll_treemap_node_t* add_near(libcoll_treemap_t *tree, libcoll_treemap_node_t *hint,
+                                        void *key, void *value)
+{
+    if (NULL == hint) {
+        hint = maximum(tree->root);
+        if (NULL_NODE == hint) {
+            return insert_leaf(tree, NULL_NODE, 0, key, value);
+        }
+    }
+
+    int cmpval = compare(tree, key, hint->key);
+    if (0 == cmpval) {
+        return NULL;
+    }
+
+    /* the key goes between the hint and its neighbour if it is less than the
+     * neighbour; the new node then becomes a child of whichever of the two
+     * has a free slot on the side facing the other
+     */
+    libcoll_treemap_node_t *neighbour = cmpval > 0 ? successor(tree, hint) : predecessor(tree, hint);
+    int neighbour_cmpval = NULL_NODE != neighbour ? compare(tree, key, neighbour->key) : -cmpval;
+    if (0 == neighbour_cmpval) {
+        return NULL;
+    } else if ((neighbour_cmpval > 0) != (cmpval > 0)) {
+        if (cmpval > 0) {
+            return NULL_NODE == hint->right ? insert_leaf(tree, hint, 1, key, value)
+                                            : insert_leaf(tree, neighbour, -1, key, value);
+        }
+        return NULL_NODE == hint->left ? insert_leaf(tree, hint, -1, key, value)
+                                       : insert_leaf(tree, neighbour, 1, key, value);
+    }
+
+    libcoll_treemap_node_t *parent = NULL_NODE;
+    libcoll_treemap_node_t *node = climb_from(tree, neighbour, key, cmpval);
+    while (NULL_NODE != node) {
+        cmpval = compare(tree, key, node->key);
+        if (cmpval < 0) {
+            parent = node;
+            node = node->left;
+        } else if (cmpval > 0) {
+            parent = node;
+            node = node->right;
+        } else {
+            return NULL;
+        }
+    }
+    return insert_leaf(tree, parent, cmpval, key, value);
+}
+
+/*
+ * Replaces the subtree rooted at node with the subtree rooted at replacement
+ * in the parent of node.  Part of the removal algorithm from CLRS.
+ */
+static void transplant(libcoll_treemap_t *tree, libcoll_treemap_node_t *node,
+                       libcoll_treemap_node_t *replacement)
+{
+    if (NULL_NODE == node->parent) {
+        tree->root = replacement;
+    } else if (node == node->parent->left) {
+        node->parent->left = replacement;
+    } else {
+        node->parent->right = replacement;
+    }
+
+    /* this might set a parent to a sentinel (null) node, but this helps
+     * the red-black fixup function in that special case and has no negative
+     * side effects since the parent of the null node is never dereferenced
+     * anywhere except in fixup after removal.
+     */
+    replacement->parent = node->parent;
+}
+
+/*
+ * Removes the given node, frees the memory used by it, and rebalances the tree.
+ * If the node does not exist in the tree, the results are undefined, so this
+ * function should only be called on nodes that are guaranteed to exist.
+ *
+ * If the node has two children, its successor is relinked into its place
+ * rather than having its key and value copied over, so that pointers to the
+ * other nodes of the tree (e.g. those held by iterators) remain valid.
+ * In a treap, the node is first rotated down below its children in order of
+ * priority until it has at most one child.
+ *
+ * Algorithm adapted from CLRS.
+ */
+static void remove_node(libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    libcoll_treemap_node_t *replacement_node;
+    char removed_color = node->color;
+
+    DEBUGF("Got request to remove node @ %p\n", (void*) node);
+
+    if (LIBCOLL_TREEMAP_BALANCE_TREAP == tree->balancing) {
+        while (NULL_NODE != node->left && NULL_NODE != node->right) {
+            rotate_up(tree, priority_of(node->left) > priority_of(node->right) ? node->left : node->right);
+        }
+    }
+
+    /* the subtrees losing a node are those rooted at the ancestors of the
+     * node actually unlinked from its position: the node itself, or its
+     * successor if the node has two children
+     */
+    libcoll_treemap_node_t *unlinked = node;
+    if (NULL_NODE != node->left && NULL_NODE != node->right) {
+        unlinked = minimum(node->right);
+    }
+    for (libcoll_treemap_node_t *ancestor = unlinked->parent; NULL_NODE != ancestor; ancestor = ancestor->parent) {
+        ancestor->subtree_size--;
+    }
+
+    /* the lowest node whose subtree changes, from which aggregates are
+     * updated after the node has been unlinked
+     */
+    libcoll_treemap_node_t *lowest_changed = unlinked->parent;
+    if (lowest_changed == node) {
+        lowest_changed = unlinked;
+    }
+
+    if (NULL_NODE == node->left) {
+        replacement_node = node->right;
+        transplant(tree, node, node->right);
+    } else if (NULL_NODE == node->right) {
+        replacement_node = node->left;
+        transplant(tree, node, node->left);
+    } else {
+        /* due to definition of successor, the successor has no left child */
+        libcoll_treemap_node_t *next = minimum(node->right);
+        DEBUGF("Moving successor @ %p into the place of the node\n", (void*) next);
+
+        removed_color = next->color;
+        replacement_node = next->right;
+        if (next->parent == node) {
+            replacement_node->parent = next;
+        } else {
+            transplant(tree, next, next->right);
+            next->right = node->right;
+            next->right->parent = next;
+        }
+        transplant(tree, node, next);
+        next->left = node->left;
+        next->left->parent = next;
+        next->color = node->color;
+        next->subtree_size = node->subtree_size;
+    }
+    update_aggregates_upwards(tree, lowest_changed);
+
+    if (LIBCOLL_TREEMAP_BALANCE_RED_BLACK == tree->balancing && COLOR_BLACK == removed_color) {
+        fix_after_removal(tree, replacement_node);
+    } else if (LIBCOLL_TREEMAP_BALANCE_SPLAY == tree->balancing) {
+        splay(tree, lowest_changed);
+    }
+    if (tree->threaded) {
+        if (NULL_NODE != node->previous_in_order)  node->previous_in_order->next_in_order = node->next_in_order;
+        if (NULL_NODE != node->next_in_order)  node->next_in_order->previous_in_order = node->previous_in_order;
+    }
+    release_node(tree, node);
+    tree->size--;
+}
+
+/*
+ * Recursively removes all nodes in the subtree rooted at the given node.
+ * If free_contents is true, keys and values are also freed, and if free_nodes
+ * is true, the nodes themselves are freed.
+ * Used for bulk removal of nodes when deinitializing a tree.
+ */
+static void deinit_subtree(libcoll_treemap_node_t *node, bool free_contents, bool free_nodes)
+{
+    /* rotating left children up turns the subtree into a list along right
+     * links as it is consumed, which needs no stack even for the deep trees
+     * left behind by splaying
+     */
+    while (NULL_NODE != node) {
+        libcoll_treemap_node_t *left = node->left;
+        if (NULL_NODE != left) {
+            node->left = left->right;
+            left->right = node;
+            node = left;
+            continue;
+        }
+
+        libcoll_treemap_node_t *right = node->right;
+        if (free_contents) {
+            free(node->key);
+            free(node->value);
+        }
+        if (free_nodes) {
+            free(node);
+        }
+        node = right;
+    }
+}
+
+/*
+ * Returns the nodes of a subtree to the allocator, for cleaning up after an
+ * allocation failure or deleting nodes dropped by a set operation.
+ */
+static void release_subtree(libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    /* consumed as in deinit_subtree */
+    while (NULL_NODE != node) {
+        libcoll_treemap_node_t *left = node->left;
+        if (NULL_NODE != left) {
+            node->left = left->right;
+            left->right = node;
+            node = left;
+            continue;
+        }
+
+        libcoll_treemap_node_t *right = node->right;
+        release_node(tree, node);
+        node = right;
+    }
+}
+
+/*
+ * Gets the aggregate of a subtree, which for the null node is the identity of
+ * the monoid; the null node is shared by all trees and has no aggregate.
+ */
+static libcoll_treemap_aggregate_t aggregate_of(const libcoll_treemap_t *tree, const libcoll_treemap_node_t *node)
+{
+    return NULL_NODE != node ? node->aggregate : tree->monoid->identity;
+}
+
+/*
+ * Recomputes the aggregate of a node from those of its children, if the tree
+ * has a monoid.
+ */
+static void update_aggregate(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    const libcoll_treemap_monoid_t *monoid = tree->monoid;
+    if (NULL != monoid) {
+        node->aggregate = monoid->combine(monoid->combine(aggregate_of(tree, node->left),
+                                                          monoid->of_entry(node->key, node->value)),
+                                          aggregate_of(tree, node->right));
+    }
+}
+
+static void update_aggregates_upwards(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    if (NULL == tree->monoid)  return;
+
+    for (; NULL_NODE != node; node = node->parent) {
+        update_aggregate(tree, node);
+    }
+}
+
+/*
+ * Recomputes the aggregates of all nodes in a subtree, children before their
+ * parents.
+ */
+static void aggregate_subtree(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    for (libcoll_treemap_node_t *next = first_in_postorder(node); NULL_NODE != next;
+            next = next_in_postorder(next, node)) {
+        update_aggregate(tree, next);
+    }
+}
+
+/*
+ * Gets the first node of a subtree in post-order, found by going down to the
+ * left child wherever there is one and to the right child otherwise.
+ * Walking the tree in post-order through the parent links needs no stack,
+ * however deep splaying has left the tree.
+ */
+static libcoll_treemap_node_t* first_in_postorder(libcoll_treemap_node_t *node)
+{
+    if (NULL_NODE != node) {
+        while (NULL_NODE != node->left || NULL_NODE != node->right) {
+            node = NULL_NODE != node->left ? node->left : node->right;
+        }
+    }
+    return node;
+}
+
+/*
+ * Gets the node following the given one in post-order within the subtree
+ * rooted at the given root, or NULL_NODE after the root itself.
+ */
+static libcoll_treemap_node_t* next_in_postorder(libcoll_treemap_node_t *node, libcoll_treemap_node_t *root)
+{
+    if (root == node) {
+        return NULL_NODE;
+    }
+    libcoll_treemap_node_t *parent = node->parent;
+    if (node == parent->left && NULL_NODE != parent->right) {
+        return first_in_postorder(parent->right);
+    }
+    return parent;
+}
+
+/*
+ * Builds a treap from pairs sorted by key in O(n) time.  Each node is added
+ * as the largest key so far, on the right spine of the tree: it takes the
+ * place of the highest spine node with a lower priority, which becomes its
+ * left child.  Sizes and aggregates are computed once the shape is final.
+ *
+ * Returns: the root of the treap, or NULL if allocating memory failed
+ */
+static libcoll_treemap_node_t* build_treap(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs,
+                                           size_t count)
+{
+    libcoll_treemap_node_t *root = NULL_NODE;
+    libcoll_treemap_node_t *last = NULL_NODE;
+
+    for (size_t i=0; i<count; i++) {
+        libcoll_treemap_node_t *node = create_node(tree, pairs[i].a, pairs[i].b);
+        if (NULL == node) {
+            release_subtree(tree, root);
+            return NULL;
+        }
+
+        uint64_t priority = priority_of(node);
+        libcoll_treemap_node_t *below = NULL_NODE;
+        while (NULL_NODE != last && priority_of(last) < priority) {
+            below = last;
+            last = last->parent;
+        }
+
+        node->left = below;
+        if (NULL_NODE != below)  below->parent = node;
+        node->parent = last;
+        if (NULL_NODE == last) {
+            root = node;
+        } else {
+            last->right = node;
+        }
+        last = node;
+    }
+
+    measure_subtree(tree, root);
+    return root;
+}
+
+/*
+ * Recomputes the sizes and aggregates of all nodes in a subtree.
+ */
+static void measure_subtree(const libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    for (libcoll_treemap_node_t *next = first_in_postorder(node); NULL_NODE != next;
+            next = next_in_postorder(next, node)) {
+        next->subtree_size = next->left->subtree_size + next->right->subtree_size + 1;
+        update_aggregate(tree, next);
+    }
+}
+
+/*
+ * Fills the subtree of the Eytzinger layout rooted at the given index in
+ * order, taking the entries from the given node and its successors.
+ *
+ * Returns: the node following the last one used
+ */
+static libcoll_treemap_node_t* fill_eytzinger(const libcoll_treemap_t *tree, libcoll_treemap_frozen_t *frozen,
+                                              size_t index, libcoll_treemap_node_t *node)
+{
+    if (index > frozen->size)  return node;
+
+    node = fill_eytzinger(tree, frozen, 2 * index, node);
+    frozen->keys[index] = node->key;
+    frozen->values[index] = node->value;
+    if (NULL != frozen->ordinals) {
+        ordinal_of(frozen, node->key, &frozen->ordinals[index]);
+    }
+    return fill_eytzinger(tree, frozen, 2 * index + 1, successor(tree, node));
+}
+
+/*
+ * Maps a key to an unsigned integer in the same order as the keys, if the
+ * tree uses the built-in comparator for integers or for addresses.  The sign
+ * bit of an integer is flipped, so that negative numbers come first.
+ *
+ * Returns: true if the key was mapped, or false for other comparators
+ */
+static bool ordinal_of(const libcoll_treemap_frozen_t *frozen, const void *key, uintptr_t *ordinal)
+{
+    switch (builtin_comparator_kind_of(frozen->key_comparator)) {
+    case BUILTIN_CMP_INTPTR:
+        *ordinal = (uintptr_t) ((unsigned int) *(const int*) key ^ ~(~0u >> 1));
+        return true;
+    case BUILTIN_CMP_MEMADDR:
+        *ordinal = (uintptr_t) key;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Walks down the implicit tree of a frozen tree, going right past keys less
+ * than the given key.  The walk always takes the full height of the tree, and
+ * the next index is computed from the comparison instead of branching on it.
+ * The path taken is encoded in the bits of the final index, and the last left
+ * turn taken, which is the lower bound, is found by shifting out the right
+ * turns that followed it along with the left turn itself.
+ *
+ * Meant to be inlined with a constant comparator, like descend.
+ */
+static inline size_t eytzinger_lower_bound_with(const libcoll_treemap_frozen_t *frozen, const void *key,
+                                                builtin_comparator_t comparator)
+{
+    void *const *keys = frozen->keys;
+    size_t index = 1;
+    while (index <= frozen->size) {
+        PREFETCH_ELEMENT(keys, FROZEN_PREFETCH_STRIDE * index);
+        index = 2 * index + (comparator(keys[index], key) < 0);
+    }
+    while (index & 1) {
+        index >>= 1;
+    }
+    return index >> 1;
+}
+
+static inline size_t eytzinger_lower_bound_ordinal(const libcoll_treemap_frozen_t *frozen, uintptr_t ordinal)
+{
+    const uintptr_t *ordinals = frozen->ordinals;
+    size_t index = 1;
+    while (index <= frozen->size) {
+        PREFETCH_ELEMENT(ordinals, FROZEN_PREFETCH_STRIDE * index);
+        index = 2 * index + (ordinals[index] < ordinal);
+    }
+    while (index & 1) {
+        index >>= 1;
+    }
+    return index >> 1;
+}
+
+/*
+ * Finds the index of the entry with the smallest key not less than the given
+ * key in a frozen tree, or 0 if there is none.
+ */
+static size_t frozen_lower_bound(const libcoll_treemap_frozen_t *frozen, const void *key)
+{
+    uintptr_t ordinal;
+    if (NULL != frozen->ordinals && ordinal_of(frozen, key, &ordinal)) {
+        return eytzinger_lower_bound_ordinal(frozen, ordinal);
+    } else if (BUILTIN_CMP_STR == builtin_comparator_kind_of(frozen->key_comparator)) {
+        return eytzinger_lower_bound_with(frozen, key, &builtin_strcmp);
+    }
+    return eytzinger_lower_bound_with(frozen, key, frozen->key_comparator);
+}
+
+static bool frozen_key_equals(const libcoll_treemap_frozen_t *frozen, size_t index, const void *key)
+{
+    uintptr_t ordinal;
+    if (NULL != frozen->ordinals && ordinal_of(frozen, key, &ordinal)) {
+        return frozen->ordinals[index] == ordinal;
+    }
+    return 0 == frozen->key_comparator(frozen->keys[index], key);
+}
+
+/*
+ * Finds the index following the given one in order in an Eytzinger layout of
+ * the given size: the leftmost entry of the right subtree if there is one,
+ * and otherwise the closest ancestor whose left subtree holds the entry.
+ *
+ * Returns: the next index, or 0 at the end
+ */
+static size_t eytzinger_successor(size_t index, size_t size)
+{
+    if (2 * index + 1 <= size) {
+        index = 2 * index + 1;
+        while (2 * index <= size) {
+            index *= 2;
+        }
+        return index;
+    }
+    while (index & 1) {
+        index >>= 1;
+    }
+    return index >> 1;
+}
+
+/* arguments and result of building or flattening a subtree in another thread */
+typedef struct subtree_task {
+    libcoll_treemap_t *tree;
+    libcoll_treemap_node_t *node;
+    libcoll_pair_voidptr_t *pairs;
+    const libcoll_pair_voidptr_t *const_pairs;
+    size_t count;
+    int depth;
+    int red_depth;
+} subtree_task_t;
+
+static void* build_subtree_thread(void *arg)
+{
+    subtree_task_t *task = (subtree_task_t*) arg;
+    task->node = build_subtree(task->tree, task->const_pairs, task->count,
+                               task->depth, task->red_depth, true);
+    return NULL;
+}
+
+static void* flatten_subtree_thread(void *arg)
+{
+    subtree_task_t *task = (subtree_task_t*) arg;
+    flatten_subtree(task->node, task->pairs, task->depth, true);
+    return NULL;
+}
+
+/*
+ * Builds a subtree of the given sorted pairs for libcoll_treemap_build_sorted,
+ * coloring the nodes at red_depth red and the rest black.  With parallel set,
+ * the left half of a large subtree is built in a new thread while the calling
+ * thread builds the right half.
+ *
+ * Returns: the root of the subtree, NULL_NODE for an empty subtree, or NULL
+ *          if allocating memory failed
+ */
+static libcoll_treemap_node_t* build_subtree(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs,
+                                             size_t count, int depth, int red_depth, bool parallel)
+{
+    if (0 == count) {
+        return NULL_NODE;
+    }
+
+    size_t mid = count / 2;
+    libcoll_treemap_node_t *node = create_node(tree, pairs[mid].a, pairs[mid].b);
+    if (NULL == node) {
+        return NULL;
+    }
+
+    subtree_task_t left_task = { tree, NULL, NULL, pairs, mid, depth + 1, red_depth };
+    pthread_t thread;
+    bool threaded = parallel && depth < PARALLEL_MAX_DEPTH && count >= PARALLEL_MIN_NODES
+                    && 0 == pthread_create(&thread, NULL, &build_subtree_thread, &left_task);
+    if (!threaded) {
+        left_task.node = build_subtree(tree, pairs, mid, depth + 1, red_depth, parallel);
+    }
+
+    libcoll_treemap_node_t *right = build_subtree(tree, pairs + mid + 1, count - mid - 1,
+                                                  depth + 1, red_depth, parallel);
+    if (threaded) {
+        pthread_join(thread, NULL);
+    }
+    libcoll_treemap_node_t *left = left_task.node;
+
+    if (NULL == left || NULL == right) {
+        if (NULL != left)  release_subtree(tree, left);
+        if (NULL != right)  release_subtree(tree, right);
+        release_node(tree, node);
+        return NULL;
     }
-    return iter;
+
+    node->left = left;
+    node->right = right;
+    if (NULL_NODE != left)  left->parent = node;
+    if (NULL_NODE != right)  right->parent = node;
+    node->subtree_size = count;
+    node->color = depth == red_depth ? COLOR_RED : COLOR_BLACK;
+    update_aggregate(tree, node);
+
+    return node;
 }
 
+
 /*
- * Deletes the given iterator and frees the memory allocated for it.
- *
- * Params:
- *      iterator -- the iterator to deinitialize
+ * Builds the nodes of an empty tree from pairs sorted in strictly ascending
+ * order of keys.  See libcoll_treemap_build_sorted.
  */
-void libcoll_treemap_free_iterator(libcoll_treemap_iter_t *iterator)
+static bool build_tree(libcoll_treemap_t *tree, const libcoll_pair_voidptr_t *pairs, size_t count)
 {
-    free(iterator);
+    /* depth of the deepest level; a lone root stays black */
+    int height = 0;
+    for (size_t c=count; c>1; c/=2) {
+        height++;
+    }
+
+    libcoll_treemap_node_t *root;
+    if (LIBCOLL_TREEMAP_BALANCE_TREAP == tree->balancing) {
+        root = build_treap(tree, pairs, count);
+    } else {
+        bool parallel = tree->parallel && LIBCOLL_TREEMAP_ALLOC_MALLOC == tree->allocation;
+        root = build_subtree(tree, pairs, count, 0, height > 0 ? height : -1, parallel);
+    }
+    if (NULL == root) {
+        return false;
+    }
+
+    tree->root = root;
+    tree->size = count;
+    if (tree->threaded) {
+        libcoll_treemap_set_threaded(tree, true);
+    }
+    return true;
 }
 
-/*
- * Checks whether the given iterator has more nodes left that can be retrieved
- * by calling tm_next.
- *
- * Params:
- *      iterator -- the iterator to check
- *
- * Returns: true if there are more nodes to iterate over, false if not
- */
-bool libcoll_treemap_has_next(libcoll_treemap_iter_t *iterator)
+/* arguments of sorting part of a batch in another thread */
+typedef struct sort_task {
+    const libcoll_treemap_t *tree;
+    libcoll_pair_voidptr_t *pairs;
+    libcoll_pair_voidptr_t *scratch;
+    size_t count;
+    int depth;
+} sort_task_t;
+
+static void* sort_pairs_thread(void *arg)
 {
-    return (NULL_NODE != iterator->next);
+    sort_task_t *task = (sort_task_t*) arg;
+    sort_pairs(task->tree, task->pairs, task->scratch, task->count, task->depth);
+    return NULL;
 }
 
 /*
- * Retrieves the next element in the tree in the order of keys.
- *
- * Params:
- *      iterator -- the iterator whose next element to retrieve
- *
- * Returns: the next node in the tree
+ * Sorts pairs by key with a stable merge sort, using the scratch array of
+ * the same length for merging.  If the tree allows parallel bulk operations,
+ * the first half of a large array is sorted in a new thread.  Halves already
+ * in order relative to each other are not merged, so sorting pairs that are
+ * already sorted takes O(n) comparisons.
  */
-libcoll_treemap_node_t* libcoll_treemap_next(libcoll_treemap_iter_t *iterator)
+static void sort_pairs(const libcoll_treemap_t *tree, libcoll_pair_voidptr_t *pairs,
+                       libcoll_pair_voidptr_t *scratch, size_t count, int depth)
 {
-    libcoll_treemap_node_t *traversed_node = iterator->next;
-    iterator->previous = traversed_node;
-    iterator->next = libcoll_treemap_get_successor(traversed_node);
-    iterator->last_traversed_node = traversed_node;
+    if (count <= SORT_MIN_MERGE) {
+        for (size_t i=1; i<count; i++) {
+            libcoll_pair_voidptr_t pair = pairs[i];
+            size_t j = i;
+            while (j > 0 && compare(tree, pairs[j-1].a, pair.a) > 0) {
+                pairs[j] = pairs[j-1];
+                j--;
+            }
+            pairs[j] = pair;
+        }
+        return;
+    }
 
-    return traversed_node;
+    size_t mid = count / 2;
+    sort_task_t left_task = { tree, pairs, scratch, mid, depth + 1 };
+    pthread_t thread;
+    bool threaded = tree->parallel && depth < PARALLEL_MAX_DEPTH && count >= PARALLEL_MIN_NODES
+                    && 0 == pthread_create(&thread, NULL, &sort_pairs_thread, &left_task);
+    if (!threaded) {
+        sort_pairs(tree, pairs, scratch, mid, depth + 1);
+    }
+    sort_pairs(tree, pairs + mid, scratch + mid, count - mid, depth + 1);
+    if (threaded) {
+        pthread_join(thread, NULL);
+    }
+
+    if (compare(tree, pairs[mid-1].a, pairs[mid].a) <= 0) {
+        return;
+    }
+
+    /* merge the first half, moved out of the way, with the second half */
+    memcpy(scratch, pairs, mid * sizeof(libcoll_pair_voidptr_t));
+    size_t i = 0, j = mid, k = 0;
+    while (i < mid && j < count) {
+        if (compare(tree, pairs[j].a, scratch[i].a) < 0) {
+            pairs[k++] = pairs[j++];
+        } else {
+            pairs[k++] = scratch[i++];
+        }
+    }
+    memcpy(pairs + k, scratch + i, (mid - i) * sizeof(libcoll_pair_voidptr_t));
 }
 
 /*
- * Checks whether the given iterator has mode nodes left that can be retrieved
- * by calling tm_previous (i.e. iterating in reverse order of keys).
- *
- * Params:
- *      iterator -- the iterator to check
- *
- * Returns: true of there are more nodes to iterate over, false if not
+ * Writes the pairs of the given subtree in order into the array, placing the
+ * node itself after the pairs of its left subtree.  With parallel set, the
+ * left subtree of a large subtree is flattened in a new thread, while the
+ * rest is walked in order through the parent links, which needs no stack
+ * however deep the subtree is.
  */
-bool libcoll_treemap_has_previous(libcoll_treemap_iter_t *iterator)
+static void flatten_subtree(libcoll_treemap_node_t *node, libcoll_pair_voidptr_t *pairs, int depth, bool parallel)
 {
-    return (NULL_NODE != iterator->previous);
+    if (parallel && depth < PARALLEL_MAX_DEPTH && node->subtree_size >= PARALLEL_MIN_NODES) {
+        size_t left_size = node->left->subtree_size;
+        subtree_task_t left_task = { NULL, node->left, pairs, NULL, left_size, depth + 1, 0 };
+        pthread_t thread;
+        if (0 == pthread_create(&thread, NULL, &flatten_subtree_thread, &left_task)) {
+            pairs[left_size].a = node->key;
+            pairs[left_size].b = node->value;
+            flatten_subtree(node->right, pairs + left_size + 1, depth + 1, parallel);
+            pthread_join(thread, NULL);
+            return;
+        }
+    }
+
+    size_t count = node->subtree_size;
+    node = minimum(node);
+    for (size_t i=0; i<count; i++) {
+        if (0 != i)  node = walk_to_successor(node);
+        pairs[i].a = node->key;
+        pairs[i].b = node->value;
+    }
 }
 
 /*
- * Retrieves the previous element in the tree in the reverse order of keys.
- *
- * Params:
- *      iterator -- the iterator whose previous element to retrieve
- *
- * Returns: the previous node in the tree
+ * Detaches a subtree from its parent, making it a standalone subtree.
  */
-libcoll_treemap_node_t* libcoll_treemap_previous(libcoll_treemap_iter_t *iterator)
+static libcoll_treemap_node_t* detach(libcoll_treemap_node_t *node)
 {
-    libcoll_treemap_node_t *traversed_node = iterator->previous;
-    iterator->next = traversed_node;
-    iterator->previous = libcoll_treemap_get_predecessor(traversed_node);
-    iterator->last_traversed_node = traversed_node;
-
-    return traversed_node;
+    if (NULL_NODE != node) {
+        node->parent = NULL_NODE;
+    }
+    return node;
 }
 
 /*
- * Removes the node last traversed and returned by the given iterator from
- * the tree and frees the memory allocated for it.
- *
- * This does not deallocate the stored key and value themselves since
- * there may still be references to them elsewhere outside of the tree.
- * The actual objects stored must be separately freed when they are
- * no longer needed.
- *
- * Params:
- *      iterator -- the iterator whose last traversed node is to be removed
- *
- * Returns a struct that contains a pointer to the key as the first member
- * and a pointer to the value as the second member.
+ * Counts the black nodes on the leftmost path from the given node down to
+ * the leaves, including the node itself.
  */
-libcoll_pair_voidptr_t libcoll_treemap_remove_last_traversed(libcoll_treemap_iter_t *iterator)
+static int black_height(libcoll_treemap_node_t *node)
 {
-    libcoll_pair_voidptr_t pair;
-    if (NULL_NODE != iterator->last_traversed_node) {
-        libcoll_treemap_node_t *to_be_removed = iterator->last_traversed_node;
-        pair.a = to_be_removed->key;
-        pair.b = to_be_removed->value;
-
-        if (iterator->last_traversed_node == iterator->previous) {
-            iterator->previous = libcoll_treemap_get_predecessor(iterator->previous);
-            iterator->last_traversed_node = NULL_NODE;
-        } else {
-            iterator->next = libcoll_treemap_get_successor(iterator->next);
-            iterator->last_traversed_node = NULL_NODE;
+    int height = 0;
+    for (; NULL_NODE != node; node = node->left) {
+        if (COLOR_BLACK == node->color) {
+            height++;
         }
-        remove_node(iterator->tree, to_be_removed);
-    } else {
-        pair.a = NULL;
-        pair.b = NULL;
     }
-    return pair;
+    return height;
 }
 
 /*
- * Traverses the given tree and checks whether it is a valid red-black tree.
- * More specifically, this function checks that the following conditions hold
- * in the tree:
- *
- * 1. The root node is black
- * 2. If a node is red, both of its children must be black
- * 3. All paths from a given node down to descendant leaves contain the same
- *    number of black nodes, i.e. the black-height of every node is well-defined.
+ * Joins two standalone subtrees and a middle node into a single subtree,
+ * where all keys in the left subtree are less than the key of the middle node
+ * and all keys in the right subtree greater.
  *
- * These conditions are as given in CLRS, excluding the two conditions for
- * every node having a colour and for leaf nodes being black, which are
- * implicitly satisfied in this implementation.
+ * The middle node is attached as a red node in place of the first black node
+ * on the right spine of the (black-)taller subtree whose black-height equals
+ * that of the shorter subtree, with the shorter subtree as its other child.
+ * This leaves at most a red node with a red parent, which is fixed up in the
+ * same way as after adding a node.  Takes time proportional to the difference
+ * in the black-heights.
  *
- * Returns true if the tree is a valid r-b tree and false if not.
+ * The given tree is only used for its comparator and allocator; its root is
+ * left untouched.
  *
- * This function is for testing purposes.
+ * Returns: the root of the joined subtree
  */
-bool _libcoll_treemap_verify_red_black_conditions(libcoll_treemap_t *tree)
+static libcoll_treemap_node_t* join_nodes(libcoll_treemap_t *tree, libcoll_treemap_node_t *left,
+                                          libcoll_treemap_node_t *middle, libcoll_treemap_node_t *right)
 {
-    bool tree_valid = true;
-    if (NULL_NODE != tree->root && COLOR_RED == tree->root->color) {
-        DEBUGF("Tree @ %p is not a valid R-B tree: root node is red\n", (void*) tree);
-        tree_valid = false;
+    /* rotations and fixups operate on a tree, so use a temporary one; its
+     * counters start from zero rather than being copied, since other threads
+     * of a parallel set operation may be updating those of the tree
+     */
+    libcoll_treemap_t piece = { 0 };
+    piece.key_comparator = tree->key_comparator;
+    piece.allocation = tree->allocation;
+    piece.monoid = tree->monoid;
+    piece.balancing = tree->balancing;
+
+    /* recoloring the root of a subtree black keeps it a valid red-black tree */
+    if (NULL_NODE != left)  left->color = COLOR_BLACK;
+    if (NULL_NODE != right)  right->color = COLOR_BLACK;
+    int left_height = black_height(left);
+    int right_height = black_height(right);
+
+    middle->color = COLOR_RED;
+    middle->left = left;
+    middle->right = right;
+
+    libcoll_treemap_node_t *parent = NULL_NODE;
+    libcoll_treemap_node_t *replaced;
+    size_t added_size;
+    if (left_height >= right_height) {
+        replaced = left;
+        for (int height=left_height; height != right_height || COLOR_RED == replaced->color; ) {
+            if (COLOR_BLACK == replaced->color) {
+                height--;
+            }
+            parent = replaced;
+            replaced = replaced->right;
+        }
+        middle->left = replaced;
+        piece.root = left;
+        added_size = right->subtree_size + 1;
+    } else {
+        replaced = right;
+        for (int height=right_height; height != left_height || COLOR_RED == replaced->color; ) {
+            if (COLOR_BLACK == replaced->color) {
+                height--;
+            }
+            parent = replaced;
+            replaced = replaced->left;
+        }
+        middle->right = replaced;
+        piece.root = right;
+        added_size = left->subtree_size + 1;
     }
-    if (! _verify_child_color_in_subtree(tree->root)) {
-        DEBUGF("Child colour condition failed for tree @ %p\n", (void*) tree);
-        tree_valid = false;
+
+    if (NULL_NODE != middle->left)  middle->left->parent = middle;
+    if (NULL_NODE != middle->right)  middle->right->parent = middle;
+    middle->subtree_size = middle->left->subtree_size + middle->right->subtree_size + 1;
+    update_aggregate(tree, middle);
+
+    middle->parent = parent;
+    if (NULL_NODE == parent) {
+        piece.root = middle;
+    } else if (left_height >= right_height) {
+        parent->right = middle;
+    } else {
+        parent->left = middle;
     }
-    int black_height = _verify_black_height_of_subtree(tree->root);
-    if (-1 == black_height) {
-        DEBUGF("Black-height condition failed for tree @ %p\n", (void*) tree);
-        tree_valid = false;
+    for (libcoll_treemap_node_t *ancestor = parent; NULL_NODE != ancestor; ancestor = ancestor->parent) {
+        ancestor->subtree_size += added_size;
+        update_aggregate(tree, ancestor);
     }
 
-    return tree_valid;
+    fix_after_addition(&piece, middle);
+    COUNT(tree, rotations, piece.counters.rotations);
+    return piece.root;
 }
 
+/*
+ * Joins two standalone subtrees, where all keys in the left subtree are less
+ * than those in the right subtree, by splitting off the largest node of the
+ * left subtree to use as the middle node.
+ */
+static libcoll_treemap_node_t* join_without_middle(libcoll_treemap_t *tree, libcoll_treemap_node_t *left,
+                                                   libcoll_treemap_node_t *right)
+{
+    if (NULL_NODE == left) {
+        return right;
+    } else if (NULL_NODE == right) {
+        return left;
+    }
 
-
-/* functions for internal use */
+    libcoll_treemap_node_t *rest, *empty;
+    libcoll_treemap_node_t *middle = split_nodes(tree, left, maximum(left)->key, &rest, &empty);
+    return join_nodes(tree, rest, middle, right);
+}
 
 /*
- * Allocates and initializes a new node in the tree.
+ * Splits a standalone subtree into subtrees of keys less than and greater
+ * than the given key, by recursively splitting the subtree on the side of the
+ * key and joining the rest of the nodes on the path to either half.
+ *
+ * Returns: the detached node with the given key, or NULL_NODE if there is none
  */
-static libcoll_treemap_node_t* create_node(void *key, void *value)
+static libcoll_treemap_node_t* split_nodes(libcoll_treemap_t *tree, libcoll_treemap_node_t *root, const void *key,
+                                           libcoll_treemap_node_t **left, libcoll_treemap_node_t **right)
 {
-    libcoll_treemap_node_t *new_node = malloc(sizeof(libcoll_treemap_node_t));
-    if (NULL != new_node) {
-        new_node->key = key;
-        new_node->value = value;
-        new_node->left = new_node->right = new_node->parent = NULL_NODE;
-        new_node->color = COLOR_RED;
+    if (NULL_NODE == root) {
+        *left = *right = NULL_NODE;
+        return NULL_NODE;
     }
-    return new_node;
+
+    libcoll_treemap_node_t *left_child = detach(root->left);
+    libcoll_treemap_node_t *right_child = detach(root->right);
+    libcoll_treemap_node_t *found;
+
+    int cmpval = compare(tree, key, root->key);
+    if (cmpval == 0) {
+        *left = left_child;
+        *right = right_child;
+        found = root;
+    } else if (cmpval < 0) {
+        libcoll_treemap_node_t *greater;
+        found = split_nodes(tree, left_child, key, left, &greater);
+        *right = join_nodes(tree, greater, root, right_child);
+    } else {
+        libcoll_treemap_node_t *less;
+        found = split_nodes(tree, right_child, key, &less, right);
+        *left = join_nodes(tree, left_child, root, less);
+    }
+    return found;
+}
+
+/* arguments and result of a set operation on subtrees run in another thread */
+typedef struct combine_task {
+    libcoll_treemap_t *tree;
+    int operation;
+    libcoll_treemap_node_t *a;
+    libcoll_treemap_node_t *b;
+    int depth;
+    libcoll_treemap_node_t *result;
+} combine_task_t;
+
+static libcoll_treemap_node_t* combine_nodes(libcoll_treemap_t *tree, int operation,
+                                             libcoll_treemap_node_t *a, libcoll_treemap_node_t *b,
+                                             int depth);
+
+static void* combine_nodes_thread(void *arg)
+{
+    combine_task_t *task = (combine_task_t*) arg;
+    task->result = combine_nodes(task->tree, task->operation, task->a, task->b, task->depth);
+    return NULL;
 }
 
 /*
- * Removes the given node, frees the memory used by it, and rebalances the tree.
- * If the node does not exist in the tree, the results are undefined, so this
- * function should only be called on nodes that are guaranteed to exist.
+ * Computes the union, intersection or difference of two standalone subtrees.
+ * One subtree is split by the key of the root of the other, the operation is
+ * applied recursively to the halves on each side, and the results are joined.
+ * Nodes not included in the result are deleted.
  *
- * Algorithm adapted from CLRS.
+ * Large subtrees of trees allowing parallel bulk operations and using malloc
+ * are processed in parallel, handing the left halves to new threads.
+ *
+ * Returns: the root of the resulting subtree
  */
-static void remove_node(libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+static libcoll_treemap_node_t* combine_nodes(libcoll_treemap_t *tree, int operation,
+                                             libcoll_treemap_node_t *a, libcoll_treemap_node_t *b,
+                                             int depth)
 {
-    libcoll_treemap_node_t *spliced_out_node;
-    libcoll_treemap_node_t *replacement_node;
-
-    DEBUGF("Got request to remove node @ %p\n", (void*) node);
+    if (NULL_NODE == a || NULL_NODE == b) {
+        switch (operation) {
+        case COMBINE_UNION:
+            return NULL_NODE != a ? a : b;
+        case COMBINE_DIFFERENCE:
+            release_subtree(tree, b);
+            return a;
+        default:
+            release_subtree(tree, a);
+            release_subtree(tree, b);
+            return NULL_NODE;
+        }
+    }
 
-    if (NULL_NODE == node->left || NULL_NODE == node->right) {
-        spliced_out_node = node;
+    bool parallel = tree->parallel && LIBCOLL_TREEMAP_ALLOC_MALLOC == tree->allocation && depth < PARALLEL_MAX_DEPTH
+                    && a->subtree_size + b->subtree_size >= PARALLEL_MIN_NODES;
+
+    /* the difference keeps nodes of a, so a is the one split in that case */
+    libcoll_treemap_node_t *pivot, *duplicate;
+    combine_task_t left_task = { tree, operation, NULL_NODE, NULL_NODE, depth + 1, NULL_NODE };
+    libcoll_treemap_node_t *right_a, *right_b;
+    if (COMBINE_DIFFERENCE == operation) {
+        pivot = b;
+        left_task.b = detach(b->left);
+        right_b = detach(b->right);
+        duplicate = split_nodes(tree, a, pivot->key, &left_task.a, &right_a);
     } else {
-        spliced_out_node = libcoll_treemap_get_successor(node);
+        pivot = a;
+        left_task.a = detach(a->left);
+        right_a = detach(a->right);
+        duplicate = split_nodes(tree, b, pivot->key, &left_task.b, &right_b);
     }
 
-    DEBUGF("Actual node to splice out from the tree is @ %p\n",
-           (void*) spliced_out_node);
+    pthread_t thread;
+    bool threaded = parallel && 0 == pthread_create(&thread, NULL, &combine_nodes_thread, &left_task);
+    if (!threaded) {
+        combine_nodes_thread(&left_task);
+    }
+    libcoll_treemap_node_t *right = combine_nodes(tree, operation, right_a, right_b, depth + 1);
+    if (threaded) {
+        pthread_join(thread, NULL);
+    }
+    libcoll_treemap_node_t *left = left_task.result;
+
+    switch (operation) {
+    case COMBINE_UNION:
+        if (NULL_NODE != duplicate)  release_node(tree, duplicate);
+        return join_nodes(tree, left, pivot, right);
+    case COMBINE_INTERSECTION:
+        if (NULL_NODE != duplicate) {
+            release_node(tree, duplicate);
+            return join_nodes(tree, left, pivot, right);
+        }
+        release_node(tree, pivot);
+        return join_without_middle(tree, left, right);
+    default:
+        if (NULL_NODE != duplicate)  release_node(tree, duplicate);
+        release_node(tree, pivot);
+        return join_without_middle(tree, left, right);
+    }
+}
 
-    /* due to definition of successor, the node to be spliced out has at most
-     * one child at this point
-     */
-    if (NULL_NODE != spliced_out_node->left) {
-        replacement_node = spliced_out_node->left;
-    } else {
-        replacement_node = spliced_out_node->right;
+/*
+ * Moves the nodes of the other tree into the given tree using the given
+ * operation.  The slabs and free nodes of a tree using slab allocation are
+ * handed over as well.
+ */
+static bool combine_trees(libcoll_treemap_t *tree, libcoll_treemap_t *other, int operation)
+{
+    if (tree == other) {
+        return false;
+    }
+    if (tree->key_comparator != other->key_comparator || tree->allocation != other->allocation
+            || tree->threaded != other->threaded || tree->monoid != other->monoid) {
+        return false;
+    }
+    if (LIBCOLL_TREEMAP_BALANCE_RED_BLACK != tree->balancing
+            || LIBCOLL_TREEMAP_BALANCE_RED_BLACK != other->balancing) {
+        return false;
     }
 
-    /* this might set a parent to a sentinel (null) node, but this helps
-     * the red-black fixup function in that special case and has no negative
-     * side effects since the parent of the null node is never dereferenced
-     * anywhere except in fixup after removal.
-     * (part of the algorithm from CLRS)
-     */
-    replacement_node->parent = spliced_out_node->parent;
+    if (NULL != other->slabs) {
+        libcoll_treemap_slab_t **slab_link = &tree->slabs;
+        while (NULL != *slab_link) {
+            slab_link = &(*slab_link)->next;
+        }
+        *slab_link = other->slabs;
 
-    if (NULL_NODE == spliced_out_node->parent) {
-        tree->root = replacement_node;
-    } else {
-        libcoll_treemap_node_t *parent = spliced_out_node->parent;
-        if (spliced_out_node == parent->left) {
-            parent->left = replacement_node;
-        } else {
-            parent->right = replacement_node;
+        libcoll_treemap_node_t **free_link = &tree->free_nodes;
+        while (NULL != *free_link) {
+            free_link = &(*free_link)->parent;
+        }
+        *free_link = other->free_nodes;
+
+        other->slabs = NULL;
+        other->free_nodes = NULL;
+    }
+
+    libcoll_treemap_node_t *root;
+    if (COMBINE_JOIN == operation) {
+        if (tree->threaded && NULL_NODE != tree->root && NULL_NODE != other->root) {
+            libcoll_treemap_node_t *last = maximum(tree->root);
+            libcoll_treemap_node_t *first = minimum(other->root);
+            last->next_in_order = first;
+            first->previous_in_order = last;
         }
+        root = join_without_middle(tree, tree->root, other->root);
+    } else {
+        root = combine_nodes(tree, operation, tree->root, other->root, 0);
     }
 
-    if (spliced_out_node != node) {
-        /* actually spliced out the successor of node rather than node itself,
-         * so copy the payload of the actually spliced out node
-         * on top of those of the node that was supposed to be removed
-         */
-        node->key = spliced_out_node->key;
-        node->value = spliced_out_node->value;
+    if (NULL_NODE != root) {
+        root->color = COLOR_BLACK;
     }
+    tree->root = root;
+    tree->size = root->subtree_size;
+    other->root = NULL_NODE;
+    other->size = 0;
 
-    if (COLOR_BLACK == spliced_out_node->color) {
-        fix_after_removal(tree, replacement_node);
+    if (tree->threaded && COMBINE_JOIN != operation) {
+        libcoll_treemap_set_threaded(tree, true);
     }
-    free(spliced_out_node);
-    tree->size--;
+
+    return true;
 }
 
 /*
- * Recursively removes all nodes in the subtree rooted at the given node.
- * If free_contents is true, keys and values are also freed.
- * Used for bulk removal of nodes when deinitializing a tree.
+ * Links the nodes of a subtree to their in-order neighbours, continuing from
+ * the given previous node, or clears the links if threaded is false.  The
+ * last node of the subtree is left in previous, with its next link unset.
+ * The nodes are walked through the parent links, since the links being set
+ * cannot be relied on yet.
  */
-static void deinit_subtree(libcoll_treemap_node_t *node, bool free_contents)
+static void thread_subtree(libcoll_treemap_node_t *node, libcoll_treemap_node_t **previous, bool threaded)
 {
-    if (NULL_NODE != node) {
-        deinit_subtree(node->left, free_contents);
-        deinit_subtree(node->right, free_contents);
-        if (free_contents) {
-            free(node->key);
-            free(node->value);
+    size_t count = node->subtree_size;
+    node = minimum(node);
+    for (size_t i=0; i<count; i++) {
+        if (0 != i)  node = walk_to_successor(node);
+        if (threaded) {
+            node->previous_in_order = *previous;
+            if (NULL_NODE != *previous)  (*previous)->next_in_order = node;
+        } else {
+            node->previous_in_order = node->next_in_order = NULL;
         }
-        free(node);
+        *previous = node;
     }
 }
 
@@ -700,6 +2995,7 @@ static void deinit_subtree(libcoll_treemap_node_t *node, bool free_contents)
  */
 static void left_rotate(libcoll_treemap_t *tree, libcoll_treemap_node_t *subtree_orig_root)
 {
+    COUNT(tree, rotations, 1);
     libcoll_treemap_node_t *pivot = subtree_orig_root->right;
     subtree_orig_root->right = pivot->left;
 
@@ -720,6 +3016,12 @@ static void left_rotate(libcoll_treemap_t *tree, libcoll_treemap_node_t *subtree
     }
     pivot->left = subtree_orig_root;
     subtree_orig_root->parent = pivot;
+
+    pivot->subtree_size = subtree_orig_root->subtree_size;
+    subtree_orig_root->subtree_size =
+        subtree_orig_root->left->subtree_size + subtree_orig_root->right->subtree_size + 1;
+    update_aggregate(tree, subtree_orig_root);
+    update_aggregate(tree, pivot);
 }
 
 /*
@@ -730,6 +3032,7 @@ static void left_rotate(libcoll_treemap_t *tree, libcoll_treemap_node_t *subtree
  */
 static void right_rotate(libcoll_treemap_t *tree, libcoll_treemap_node_t *subtree_orig_root)
 {
+    COUNT(tree, rotations, 1);
     libcoll_treemap_node_t *pivot = subtree_orig_root->left;
     subtree_orig_root->left = pivot->right;
 
@@ -750,6 +3053,59 @@ static void right_rotate(libcoll_treemap_t *tree, libcoll_treemap_node_t *subtre
     }
     pivot->right = subtree_orig_root;
     subtree_orig_root->parent = pivot;
+
+    pivot->subtree_size = subtree_orig_root->subtree_size;
+    subtree_orig_root->subtree_size =
+        subtree_orig_root->left->subtree_size + subtree_orig_root->right->subtree_size + 1;
+    update_aggregate(tree, subtree_orig_root);
+    update_aggregate(tree, pivot);
+}
+
+/*
+ * Rotates a node above its parent, keeping the order of keys.
+ */
+static void rotate_up(libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    if (node == node->parent->left) {
+        right_rotate(tree, node->parent);
+    } else {
+        left_rotate(tree, node->parent);
+    }
+}
+
+/*
+ * Moves a node to the root of a splay tree.  A node on the same side of its
+ * parent as the parent is of the grandparent (zig-zig) is lifted by rotating
+ * the parent first, which roughly halves the depth of the nodes on the path;
+ * otherwise (zig-zag) the node is rotated up twice.
+ */
+static void splay(libcoll_treemap_t *tree, libcoll_treemap_node_t *node)
+{
+    if (NULL_NODE == node) {
+        return;
+    }
+    while (NULL_NODE != node->parent) {
+        libcoll_treemap_node_t *parent = node->parent;
+        libcoll_treemap_node_t *grandparent = parent->parent;
+        if (NULL_NODE != grandparent) {
+            bool zig_zig = (node == parent->left) == (parent == grandparent->left);
+            rotate_up(tree, zig_zig ? parent : node);
+        }
+        rotate_up(tree, node);
+    }
+}
+
+/*
+ * Gets the priority of a node in a treap by mixing the bits of its address
+ * (the splitmix64 finalizer), so that no priority needs to be stored.  The
+ * mixing is a bijection, so distinct nodes have distinct priorities.
+ */
+static uint64_t priority_of(const libcoll_treemap_node_t *node)
+{
+    uint64_t x = (uint64_t) (uintptr_t) node;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
 }
 
 /*
@@ -972,3 +3328,70 @@ static int _verify_black_height_of_subtree(libcoll_treemap_node_t *subtree_root)
     return subtree_black_height;
 }
 
+static bool _verify_subtree_sizes(libcoll_treemap_node_t *subtree_root)
+{
+    if (NULL_NODE == subtree_root) {
+        return subtree_root->subtree_size == 0;
+    }
+    if (subtree_root->subtree_size
+            != subtree_root->left->subtree_size + subtree_root->right->subtree_size + 1) {
+        DEBUGF("Wrong subtree size %lu at node @ %p\n",
+               (unsigned long) subtree_root->subtree_size, (void*) subtree_root);
+        return false;
+    }
+    return _verify_subtree_sizes(subtree_root->left) && _verify_subtree_sizes(subtree_root->right);
+}
+
+static bool _verify_links_in_subtree(libcoll_treemap_node_t *subtree_root, libcoll_treemap_node_t **previous,
+                                     bool threaded)
+{
+    if (NULL_NODE == subtree_root) {
+        return true;
+    }
+    if (! _verify_links_in_subtree(subtree_root->left, previous, threaded)) {
+        return false;
+    }
+    if (threaded) {
+        if (subtree_root->previous_in_order != *previous
+                || (NULL_NODE != *previous && (*previous)->next_in_order != subtree_root)) {
+            DEBUGF("Wrong in-order links at node @ %p\n", (void*) subtree_root);
+            return false;
+        }
+    } else if (NULL != subtree_root->previous_in_order || NULL != subtree_root->next_in_order) {
+        return false;
+    }
+    *previous = subtree_root;
+    return _verify_links_in_subtree(subtree_root->right, previous, threaded);
+}
+
+static bool _verify_aggregates_in_subtree(const libcoll_treemap_t *tree, libcoll_treemap_node_t *subtree_root)
+{
+    if (NULL_NODE == subtree_root) {
+        return true;
+    }
+    libcoll_treemap_aggregate_t stored = subtree_root->aggregate;
+    update_aggregate(tree, subtree_root);
+    if (0 != memcmp(&stored, &subtree_root->aggregate, sizeof(stored))) {
+        DEBUGF("Wrong aggregate at node @ %p\n", (void*) subtree_root);
+        subtree_root->aggregate = stored;
+        return false;
+    }
+    return _verify_aggregates_in_subtree(tree, subtree_root->left)
+           && _verify_aggregates_in_subtree(tree, subtree_root->right);
+}
+
+/*
+ * Checks that no node of a treap has a higher priority than its parent.
+ */
+static bool _verify_heap_order_in_subtree(libcoll_treemap_node_t *subtree_root)
+{
+    if (NULL_NODE == subtree_root) {
+        return true;
+    }
+    if (NULL_NODE != subtree_root->parent && priority_of(subtree_root) > priority_of(subtree_root->parent)) {
+        DEBUGF("Node @ %p has a higher priority than its parent\n", (void*) subtree_root);
+        return false;
+    }
+    return _verify_heap_order_in_subtree(subtree_root->left)
+           && _verify_heap_order_in_subtree(subtree_root->right);
+}
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <sys/types.h>  /* for ssize_t */
 
+#include "builtins.h"
 #include "comparators.h"
 #include "vector.h"
 
@@ -115,26 +116,60 @@ void* libcoll_vector_pop(libcoll_vector_t *vector)
     return libcoll_vector_remove_at(vector, vector->length-1);
 }
 
-ssize_t libcoll_vector_index_of(libcoll_vector_t *vector, void *value)
+/*
+ * Linear searches, meant to be inlined with a constant comparator so that the
+ * built-in comparators get inlined into the loop.
+ */
+static inline ssize_t find_first(const libcoll_vector_t *vector, const void *value,
+                                 builtin_comparator_t compare_function)
 {
     for (size_t i=0; i<vector->length; i++) {
-        if (!vector->compare_function(value, vector->contents[i])) {
+        if (!compare_function(value, vector->contents[i])) {
             return i;
         }
     }
     return -1;
 }
 
-ssize_t libcoll_vector_last_index_of(libcoll_vector_t *vector, void *value)
+static inline ssize_t find_last(const libcoll_vector_t *vector, const void *value,
+                                builtin_comparator_t compare_function)
 {
     for (size_t i=vector->length; i>0; i--) {
-        if (!vector->compare_function(value, vector->contents[i-1])) {
+        if (!compare_function(value, vector->contents[i-1])) {
             return i-1;
         }
     }
     return -1;
 }
 
+ssize_t libcoll_vector_index_of(libcoll_vector_t *vector, void *value)
+{
+    switch (builtin_comparator_kind_of(vector->compare_function)) {
+    case BUILTIN_CMP_MEMADDR:
+        return find_first(vector, value, &builtin_memaddrcmp);
+    case BUILTIN_CMP_STR:
+        return find_first(vector, value, &builtin_strcmp);
+    case BUILTIN_CMP_INTPTR:
+        return find_first(vector, value, &builtin_intptrcmp);
+    default:
+        return find_first(vector, value, vector->compare_function);
+    }
+}
+
+ssize_t libcoll_vector_last_index_of(libcoll_vector_t *vector, void *value)
+{
+    switch (builtin_comparator_kind_of(vector->compare_function)) {
+    case BUILTIN_CMP_MEMADDR:
+        return find_last(vector, value, &builtin_memaddrcmp);
+    case BUILTIN_CMP_STR:
+        return find_last(vector, value, &builtin_strcmp);
+    case BUILTIN_CMP_INTPTR:
+        return find_last(vector, value, &builtin_intptrcmp);
+    default:
+        return find_last(vector, value, vector->compare_function);
+    }
+}
+
 char libcoll_vector_contains(libcoll_vector_t *vector, void *value)
 {
     return libcoll_vector_index_of(vector, value) != -1;
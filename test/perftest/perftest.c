@@ -18,9 +18,12 @@
 
 #include "../helpers.h"
 
+#include "btreemap.h"
 #include "comparators.h"
 #include "hash.h"
 #include "hashmap.h"
+#include "inthashmap.h"
+#include "radixtree.h"
 #include "treemap.h"
 #include "types.h"
 #include "vector.h"
@@ -33,7 +36,10 @@
 
 typedef enum {
     NONE,
+    BTREEMAP,
     HASHMAP,
+    INTHASHMAP,
+    RADIXTREE,
     TREEMAP,
     VECTOR
 } BenchmarkTarget;
@@ -87,6 +93,22 @@ static void populate_treemap(libcoll_treemap_t *tm, libcoll_pair_voidptr_t *data
     }
 }
 
+static void populate_btreemap(libcoll_btreemap_t *tm, libcoll_pair_voidptr_t *data, size_t n)
+{
+    for (size_t i=0; i<n; i++) {
+        libcoll_pair_voidptr_t kvpair = data[i];
+        libcoll_btreemap_add(tm, kvpair.a, kvpair.b);
+    }
+}
+
+static void populate_radixtree(libcoll_radixtree_t *tree, libcoll_pair_voidptr_t *data, size_t n)
+{
+    for (size_t i=0; i<n; i++) {
+        libcoll_pair_voidptr_t kvpair = data[i];
+        libcoll_radixtree_add(tree, kvpair.a, KEY_STR_LEN, kvpair.b);
+    }
+}
+
 static void populate_vector(libcoll_vector_t *v, libcoll_pair_voidptr_t *data, size_t n)
 {
     for (size_t i=0; i<n; i++) {
@@ -144,6 +166,51 @@ static void benchmark_hashmap(unsigned long testsize)
     libcoll_hashmap_deinit(map);
 }
 
+static void benchmark_inthashmap(unsigned long testsize)
+{
+    clock_t start_time;
+    unsigned long retrieve_count = testsize / BENCHMARK_RETRIEVE_PROPORTION;
+    uint64_t checksum = 0;
+
+    libcoll_inthashmap_t *map = libcoll_inthashmap_init();
+
+    /* integer keys and values are stored directly in the map,
+     * so there's no need to allocate them separately
+     */
+    uint64_t *keys = malloc(testsize * sizeof(uint64_t));
+    srand(BENCHMARK_SEED);
+    for (unsigned long i=0; i<testsize; i++) {
+        keys[i] = ((uint64_t) rand() << 32) | (uint64_t) rand();
+    }
+
+    printf("Populating an integer hashmap with %lu entries... \t", testsize);
+
+    start_time = clock();
+    for (unsigned long i=0; i<testsize; i++) {
+        libcoll_inthashmap_put(map, keys[i], i);
+    }
+    printf("%.3f s\n", ((double) (clock() - start_time) / CLOCKS_PER_SEC));
+
+    start_time = clock();
+    printf("Retrieving %lu items... \t", retrieve_count);
+    for (unsigned long i=0; i<retrieve_count; i++) {
+        size_t key_idx = i * (BENCHMARK_RETRIEVE_PROPORTION);
+        uint64_t value = 0;
+        libcoll_inthashmap_get(map, keys[key_idx], &value);
+        checksum += value;
+    }
+    printf("%.3f s\n", ((double) (clock() - start_time) / CLOCKS_PER_SEC));
+
+    /* use the checksum so that the retrievals can't be optimized out */
+    if (checksum == 0 && retrieve_count > 1) {
+        printf("Unexpected checksum\n");
+    }
+
+    free(keys);
+
+    libcoll_inthashmap_deinit(map);
+}
+
 static void benchmark_treemap(unsigned long testsize)
 {
     clock_t start_time;
@@ -188,6 +255,77 @@ static void benchmark_treemap(unsigned long testsize)
     libcoll_treemap_deinit(map);
 }
 
+static void benchmark_btreemap(unsigned long testsize)
+{
+    clock_t start_time;
+    unsigned long retrieve_count = testsize / BENCHMARK_RETRIEVE_PROPORTION;
+
+    /* null output for printing values retrieved during retrieval tests,
+     * to prevent the compiler from optimizing the retrievals out
+     */
+    FILE *null_out = get_null_output();
+
+    libcoll_btreemap_t *map =
+        libcoll_btreemap_init_with_comparator(libcoll_strcmp_wrapper);
+
+    libcoll_pair_voidptr_t *data = malloc(testsize * sizeof(libcoll_pair_voidptr_t));
+    generate_key_value_data(data, testsize);
+
+    printf("Populating a B+tree map with %lu entries... \t", testsize);
+
+    start_time = clock();
+    populate_btreemap(map, data, testsize);
+    printf("%.3f s\n", ((double) (clock() - start_time) / CLOCKS_PER_SEC));
+
+    start_time = clock();
+    printf("Retrieving %lu items... \t", retrieve_count);
+    for (unsigned long i=0; i<retrieve_count; i++) {
+        size_t key_idx = i * (BENCHMARK_RETRIEVE_PROPORTION);
+        libcoll_btreemap_get(map, data[key_idx].a);
+    }
+    printf("%.3f s\n", ((double) (clock() - start_time) / CLOCKS_PER_SEC));
+
+    fclose(null_out);
+    free(data);
+
+    libcoll_btreemap_deinit(map);
+}
+
+static void benchmark_radixtree(unsigned long testsize)
+{
+    clock_t start_time;
+    unsigned long retrieve_count = testsize / BENCHMARK_RETRIEVE_PROPORTION;
+
+    /* null output for printing values retrieved during retrieval tests,
+     * to prevent the compiler from optimizing the retrievals out
+     */
+    FILE *null_out = get_null_output();
+
+    libcoll_radixtree_t *map = libcoll_radixtree_init();
+
+    libcoll_pair_voidptr_t *data = malloc(testsize * sizeof(libcoll_pair_voidptr_t));
+    generate_key_value_data(data, testsize);
+
+    printf("Populating a radix tree map with %lu entries... \t", testsize);
+
+    start_time = clock();
+    populate_radixtree(map, data, testsize);
+    printf("%.3f s\n", ((double) (clock() - start_time) / CLOCKS_PER_SEC));
+
+    start_time = clock();
+    printf("Retrieving %lu items... \t", retrieve_count);
+    for (unsigned long i=0; i<retrieve_count; i++) {
+        size_t key_idx = i * (BENCHMARK_RETRIEVE_PROPORTION);
+        libcoll_radixtree_get(map, data[key_idx].a, KEY_STR_LEN);
+    }
+    printf("%.3f s\n", ((double) (clock() - start_time) / CLOCKS_PER_SEC));
+
+    fclose(null_out);
+    free(data);
+
+    libcoll_radixtree_deinit(map);
+}
+
 static void benchmark_vector(unsigned long testsize)
 {
     clock_t start_time;
@@ -251,8 +389,14 @@ int main(int argc, char *argv[])
 
     if (argc > optind) {
         char *s = argv[optind];
-        if (strcmp(s, "hashmap") == 0) {
+        if (strcmp(s, "btreemap") == 0) {
+            target = BTREEMAP;
+        } else if (strcmp(s, "hashmap") == 0) {
             target = HASHMAP;
+        } else if (strcmp(s, "inthashmap") == 0) {
+            target = INTHASHMAP;
+        } else if (strcmp(s, "radixtree") == 0) {
+            target = RADIXTREE;
         } else if (strcmp(s, "treemap") == 0) {
             target = TREEMAP;
         } else if (strcmp(s, "vector") == 0) {
@@ -261,12 +405,30 @@ int main(int argc, char *argv[])
     }
 
     switch (target) {
+        case BTREEMAP:
+            for (int i=0; i<benchmark_runs; i++) {
+                printf("Benchmark run %u\n", i+1);
+                benchmark_btreemap(benchmark_size);
+            }
+            break;
         case HASHMAP:
             for (int i=0; i<benchmark_runs; i++) {
                 printf("Benchmark run %u\n", i+1);
                 benchmark_hashmap(benchmark_size);
             }
             break;
+        case INTHASHMAP:
+            for (int i=0; i<benchmark_runs; i++) {
+                printf("Benchmark run %u\n", i+1);
+                benchmark_inthashmap(benchmark_size);
+            }
+            break;
+        case RADIXTREE:
+            for (int i=0; i<benchmark_runs; i++) {
+                printf("Benchmark run %u\n", i+1);
+                benchmark_radixtree(benchmark_size);
+            }
+            break;
         case TREEMAP:
             for (int i=0; i<benchmark_runs; i++) {
                 printf("Benchmark run %u\n", i+1);
@@ -27,13 +27,23 @@
 
 #include <check.h>
 
+#include "test_btreemap.h"
+#include "test_concurrentsortedmap.h"
 #include "test_hashmap.h"
+#include "test_intervaltree.h"
+#include "test_inthashmap.h"
 #include "test_linkedlist.h"
+#include "test_persistentmap.h"
+#include "test_radixtree.h"
+#include "test_sortedfile.h"
 #include "test_treemap.h"
+#include "test_typedhashmap.h"
+#include "test_typedtreemap.h"
 #include "test_vector.h"
 #include "helpers.h"
 
 #include "comparators.h"  /* for the comparator sanity tests */
+#include "hash.h"         /* for the hash function sanity tests */
 
 #include "../src/debug.h"
 
@@ -46,6 +56,83 @@ START_TEST(comparator_self_sanity_check)
 
     ck_assert_int_eq(libcoll_intptrcmp(&a, &b), 0);
     ck_assert_int_lt(libcoll_intptrcmp(&a, &c), 0);
+
+    /* byte strings are ordered lexicographically, not by length */
+    libcoll_bytes_t empty = { NULL, 0 };
+    libcoll_bytes_t bytes_aa = { "aa", 2 };
+    libcoll_bytes_t bytes_ab = { "abc", 2 };
+    libcoll_bytes_t bytes_b = { "b", 1 };
+    ck_assert_int_lt(libcoll_bytescmp(&bytes_aa, &bytes_b), 0);
+    ck_assert_int_gt(libcoll_bytescmp(&bytes_b, &bytes_ab), 0);
+    ck_assert_int_lt(libcoll_bytescmp(&bytes_aa, &bytes_ab), 0);
+    ck_assert_int_lt(libcoll_bytescmp(&empty, &bytes_aa), 0);
+    ck_assert_int_eq(libcoll_bytescmp(&empty, &empty), 0);
+    ck_assert_int_eq(libcoll_bytescmp(&bytes_ab, &bytes_ab), 0);
+}
+END_TEST
+
+START_TEST(crc32c_hash_sanity_check)
+{
+    /* standard check value for CRC32C */
+    ck_assert_uint_eq(libcoll_hashcode_crc32c_str("123456789"), 0xE3069283UL);
+    ck_assert_uint_eq(libcoll_hashcode_crc32c_bytes("123456789", 9), 0xE3069283UL);
+    ck_assert_uint_eq(libcoll_hashcode_crc32c_bytes("", 0), 0);
+
+    int a = 1;
+    int b = 2;
+    ck_assert_uint_eq(libcoll_hashcode_crc32c_int(&a),
+                      libcoll_hashcode_crc32c_bytes(&a, sizeof(int)));
+    ck_assert_uint_ne(libcoll_hashcode_crc32c_int(&a), libcoll_hashcode_crc32c_int(&b));
+}
+END_TEST
+
+/*
+ * Checks that the selected CRC32C implementation agrees with the software
+ * one at every length and alignment handled differently by the crc32
+ * instruction.
+ */
+START_TEST(crc32c_implementations_agree)
+{
+    unsigned char bytes[80];
+    for (int i=0; i<80; i++) {
+        bytes[i] = (unsigned char) (i * 37 + 11);
+    }
+    for (size_t offset=0; offset<8; offset++) {
+        for (size_t length=0; length+offset<=80; length++) {
+            ck_assert_uint_eq(libcoll_hashcode_crc32c_bytes(bytes + offset, length),
+                              _libcoll_hashcode_crc32c_software(bytes + offset, length));
+        }
+    }
+}
+END_TEST
+
+START_TEST(batch_hash_sanity_check)
+{
+    int ints[9];
+    uint64_t u64s[9];
+    const char *strs[9] = { "", "a", "abcdefgh", "abcdefghi", "123456789",
+                            "a somewhat longer string", "x", "yy", "zzzzzzzzzzzzzzzz" };
+    unsigned long out[9];
+
+    for (int i=0; i<9; i++) {
+        ints[i] = i * 1000 - 4000;
+        u64s[i] = (uint64_t) i << 40 | (uint64_t) i;
+    }
+
+    libcoll_hash_batch_int(ints, 9, out);
+    for (int i=0; i<9; i++) {
+        ck_assert_uint_eq(out[i], libcoll_hashcode_crc32c_int(&ints[i]));
+    }
+
+    libcoll_hash_batch_u64(u64s, 9, out);
+    for (int i=0; i<9; i++) {
+        ck_assert_uint_eq(out[i], libcoll_hashcode_crc32c_u64(&u64s[i]));
+    }
+
+    libcoll_hash_batch_str(strs, 9, out);
+    for (int i=0; i<9; i++) {
+        ck_assert_uint_eq(out[i], libcoll_hashcode_crc32c_str(strs[i]));
+    }
 }
 END_TEST
 
@@ -54,6 +141,9 @@ TCase* create_self_sanity_test(void)
     TCase *tc_core;
     tc_core = tcase_create("self_sanity_core");
     tcase_add_test(tc_core, comparator_self_sanity_check);
+    tcase_add_test(tc_core, crc32c_hash_sanity_check);
+    tcase_add_test(tc_core, crc32c_implementations_agree);
+    tcase_add_test(tc_core, batch_hash_sanity_check);
     return tc_core;
 }
 
@@ -64,6 +154,15 @@ Suite* create_libcoll_test_suite(void)
     TCase *vector_tests;
     TCase *hashmap_tests;
     TCase *treemap_tests;
+    TCase *inthashmap_tests;
+    TCase *typedhashmap_tests;
+    TCase *typedtreemap_tests;
+    TCase *btreemap_tests;
+    TCase *persistentmap_tests;
+    TCase *concurrentsortedmap_tests;
+    TCase *radixtree_tests;
+    TCase *intervaltree_tests;
+    TCase *sortedfile_tests;
     TCase *self_sanity_test;
 
     s = suite_create("libcoll");
@@ -71,6 +170,15 @@ Suite* create_libcoll_test_suite(void)
     vector_tests = create_vector_tests();
     hashmap_tests = create_hashmap_tests();
     treemap_tests = create_treemap_tests();
+    inthashmap_tests = create_inthashmap_tests();
+    typedhashmap_tests = create_typedhashmap_tests();
+    typedtreemap_tests = create_typedtreemap_tests();
+    btreemap_tests = create_btreemap_tests();
+    persistentmap_tests = create_persistentmap_tests();
+    concurrentsortedmap_tests = create_concurrentsortedmap_tests();
+    radixtree_tests = create_radixtree_tests();
+    intervaltree_tests = create_intervaltree_tests();
+    sortedfile_tests = create_sortedfile_tests();
     self_sanity_test = create_self_sanity_test();
 
     suite_add_tcase(s, self_sanity_test);
@@ -78,6 +186,15 @@ Suite* create_libcoll_test_suite(void)
     suite_add_tcase(s, vector_tests);
     suite_add_tcase(s, hashmap_tests);
     suite_add_tcase(s, treemap_tests);
+    suite_add_tcase(s, inthashmap_tests);
+    suite_add_tcase(s, typedhashmap_tests);
+    suite_add_tcase(s, typedtreemap_tests);
+    suite_add_tcase(s, btreemap_tests);
+    suite_add_tcase(s, persistentmap_tests);
+    suite_add_tcase(s, concurrentsortedmap_tests);
+    suite_add_tcase(s, radixtree_tests);
+    suite_add_tcase(s, intervaltree_tests);
+    suite_add_tcase(s, sortedfile_tests);
 
     return s;
 }
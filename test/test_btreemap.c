@@ -0,0 +1,278 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+
+#include "test_btreemap.h"
+
+#include "btreemap.h"
+#include "comparators.h"
+
+#include "../src/debug.h"
+
+#define TEST_KEY_COUNT  5000
+
+static int keys[TEST_KEY_COUNT];
+
+/* fills the key array with the even numbers 0, 2, 4, ... in shuffled order */
+static void shuffled_even_keys(void)
+{
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        keys[i] = 2 * i;
+    }
+    srand(1);
+    for (int i=TEST_KEY_COUNT-1; i>0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+/*
+ * Tests that an empty B+tree map gets created correctly.
+ */
+START_TEST(btreemap_create)
+{
+    DEBUG("\n*** Starting btreemap_create\n");
+    libcoll_btreemap_t *tree = libcoll_btreemap_init();
+
+    ck_assert_ptr_nonnull(tree);
+    ck_assert(libcoll_btreemap_is_empty(tree));
+    ck_assert_ptr_null(libcoll_btreemap_get_first(tree).a);
+    ck_assert(_libcoll_btreemap_verify(tree));
+
+    libcoll_btreemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests adding, retrieving and removing enough keys to make the tree several
+ * levels deep, checking the invariants of the tree along the way.
+ */
+START_TEST(btreemap_add_retrieve_and_remove)
+{
+    DEBUG("\n*** Starting btreemap_add_retrieve_and_remove\n");
+    libcoll_btreemap_t *tree = libcoll_btreemap_init_with_comparator(libcoll_intptrcmp);
+    shuffled_even_keys();
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert(libcoll_btreemap_add(tree, &keys[i], &keys[i]));
+    }
+    ck_assert(_libcoll_btreemap_verify(tree));
+    ck_assert_uint_eq(libcoll_btreemap_get_size(tree), TEST_KEY_COUNT);
+
+    int duplicate = keys[0];
+    ck_assert(!libcoll_btreemap_add(tree, &duplicate, NULL));
+    ck_assert_uint_eq(libcoll_btreemap_get_size(tree), TEST_KEY_COUNT);
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        int key = 2 * i;
+        int *value = libcoll_btreemap_get(tree, &key);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_int_eq(*value, key);
+
+        key = 2 * i + 1;
+        ck_assert(!libcoll_btreemap_contains(tree, &key));
+    }
+
+    /* remove all keys in the same shuffled order, which exercises borrowing
+     * from both siblings as well as merging
+     */
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        int missing = keys[i] + 1;
+        ck_assert_ptr_null(libcoll_btreemap_remove(tree, &missing).a);
+
+        libcoll_pair_voidptr_t removed = libcoll_btreemap_remove(tree, &keys[i]);
+        ck_assert_ptr_eq(removed.a, &keys[i]);
+        ck_assert(!libcoll_btreemap_contains(tree, &keys[i]));
+
+        if (i % 100 == 0) {
+            ck_assert(_libcoll_btreemap_verify(tree));
+        }
+    }
+    ck_assert(libcoll_btreemap_is_empty(tree));
+    ck_assert(_libcoll_btreemap_verify(tree));
+
+    libcoll_btreemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests iterating in both directions, starting iteration at a given key and
+ * finding successors and predecessors of keys.
+ */
+START_TEST(btreemap_ordered_iteration)
+{
+    DEBUG("\n*** Starting btreemap_ordered_iteration\n");
+    libcoll_btreemap_t *tree = libcoll_btreemap_init_with_comparator(libcoll_intptrcmp);
+    shuffled_even_keys();
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        libcoll_btreemap_add(tree, &keys[i], &keys[i]);
+    }
+
+    libcoll_btreemap_iter_t *iter = libcoll_btreemap_get_iterator(tree);
+    ck_assert(!libcoll_btreemap_has_previous(iter));
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert(libcoll_btreemap_has_next(iter));
+        ck_assert_int_eq(*(int*) libcoll_btreemap_next(iter).a, 2 * i);
+    }
+    ck_assert(!libcoll_btreemap_has_next(iter));
+    for (int i=TEST_KEY_COUNT-1; i>=0; i--) {
+        ck_assert(libcoll_btreemap_has_previous(iter));
+        ck_assert_int_eq(*(int*) libcoll_btreemap_previous(iter).a, 2 * i);
+    }
+    ck_assert(!libcoll_btreemap_has_previous(iter));
+    libcoll_btreemap_free_iterator(iter);
+
+    int key = 101;
+    iter = libcoll_btreemap_get_iterator_at(tree, &key);
+    ck_assert_int_eq(*(int*) libcoll_btreemap_next(iter).a, 102);
+    ck_assert_int_eq(*(int*) libcoll_btreemap_previous(iter).a, 102);
+    ck_assert_int_eq(*(int*) libcoll_btreemap_previous(iter).a, 100);
+    libcoll_btreemap_free_iterator(iter);
+
+    key = 2 * TEST_KEY_COUNT;
+    iter = libcoll_btreemap_get_iterator_at(tree, &key);
+    ck_assert(!libcoll_btreemap_has_next(iter));
+    ck_assert_int_eq(*(int*) libcoll_btreemap_previous(iter).a, 2 * TEST_KEY_COUNT - 2);
+    libcoll_btreemap_free_iterator(iter);
+
+    for (key=-1; key<2*TEST_KEY_COUNT; key++) {
+        libcoll_pair_voidptr_t successor = libcoll_btreemap_get_successor(tree, &key);
+        libcoll_pair_voidptr_t predecessor = libcoll_btreemap_get_predecessor(tree, &key);
+        int expected_successor = key % 2 == 0 ? key + 2 : key + 1;
+        int expected_predecessor = key % 2 == 0 ? key - 2 : key - 1;
+
+        if (expected_successor < 2 * TEST_KEY_COUNT) {
+            ck_assert_int_eq(*(int*) successor.a, expected_successor);
+        } else {
+            ck_assert_ptr_null(successor.a);
+        }
+        if (expected_predecessor >= 0) {
+            ck_assert_int_eq(*(int*) predecessor.a, expected_predecessor);
+        } else {
+            ck_assert_ptr_null(predecessor.a);
+        }
+    }
+
+    ck_assert_int_eq(*(int*) libcoll_btreemap_get_first(tree).a, 0);
+    ck_assert_int_eq(*(int*) libcoll_btreemap_get_last(tree).a, 2 * TEST_KEY_COUNT - 2);
+
+    libcoll_btreemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests removing every third entry while iterating, and then the rest of the
+ * entries while iterating backwards.
+ */
+START_TEST(btreemap_remove_while_iterating)
+{
+    DEBUG("\n*** Starting btreemap_remove_while_iterating\n");
+    libcoll_btreemap_t *tree = libcoll_btreemap_init_with_comparator(libcoll_intptrcmp);
+    shuffled_even_keys();
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        libcoll_btreemap_add(tree, &keys[i], &keys[i]);
+    }
+
+    libcoll_btreemap_iter_t *iter = libcoll_btreemap_get_iterator(tree);
+    int expected = 0;
+    while (libcoll_btreemap_has_next(iter)) {
+        int key = *(int*) libcoll_btreemap_next(iter).a;
+        ck_assert_int_eq(key, expected);
+        if (key % 3 == 0) {
+            ck_assert_int_eq(*(int*) libcoll_btreemap_remove_last_traversed(iter).a, key);
+        }
+        expected += 2;
+    }
+    ck_assert(_libcoll_btreemap_verify(tree));
+    ck_assert_uint_eq(libcoll_btreemap_get_size(tree), TEST_KEY_COUNT - (TEST_KEY_COUNT + 2) / 3);
+
+    while (libcoll_btreemap_has_previous(iter)) {
+        int key = *(int*) libcoll_btreemap_previous(iter).a;
+        ck_assert(key % 3 != 0);
+        libcoll_btreemap_remove_last_traversed(iter);
+    }
+    ck_assert(libcoll_btreemap_is_empty(tree));
+    ck_assert(!libcoll_btreemap_has_next(iter));
+    libcoll_btreemap_free_iterator(iter);
+
+    libcoll_btreemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests that inner nodes don't keep pointers to removed keys, by freeing each
+ * key when it gets removed and looking up the remaining keys afterwards.
+ */
+START_TEST(btreemap_remove_and_free_keys)
+{
+    DEBUG("\n*** Starting btreemap_remove_and_free_keys\n");
+    libcoll_btreemap_t *tree = libcoll_btreemap_init_with_comparator(libcoll_intptrcmp);
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        int *key = malloc(sizeof(int));
+        *key = i;
+        ck_assert(libcoll_btreemap_add(tree, key, NULL));
+    }
+    for (int i=0; i<TEST_KEY_COUNT; i+=2) {
+        libcoll_pair_voidptr_t removed = libcoll_btreemap_remove(tree, &i);
+        ck_assert_ptr_nonnull(removed.a);
+        ck_assert_int_eq(*(int*) removed.a, i);
+        free(removed.a);
+    }
+    ck_assert(_libcoll_btreemap_verify(tree));
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert(libcoll_btreemap_contains(tree, &i) == (i % 2 == 1));
+    }
+    for (int i=1; i<TEST_KEY_COUNT; i+=2) {
+        free(libcoll_btreemap_remove(tree, &i).a);
+    }
+    ck_assert(libcoll_btreemap_is_empty(tree));
+
+    libcoll_btreemap_deinit(tree);
+}
+END_TEST
+
+TCase* create_btreemap_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("btreemap_core");
+
+    tcase_add_test(tc_core, btreemap_create);
+    tcase_add_test(tc_core, btreemap_add_retrieve_and_remove);
+    tcase_add_test(tc_core, btreemap_ordered_iteration);
+    tcase_add_test(tc_core, btreemap_remove_while_iterating);
+    tcase_add_test(tc_core, btreemap_remove_and_free_keys);
+
+    return tc_core;
+}
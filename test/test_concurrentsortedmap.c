@@ -0,0 +1,174 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "test_concurrentsortedmap.h"
+
+#include "concurrentsortedmap.h"
+#include "comparators.h"
+
+#include "../src/debug.h"
+
+#define TEST_KEY_COUNT  20000
+#define THREAD_COUNT    4
+
+static int keys[TEST_KEY_COUNT];
+
+/*
+ * Tests adding, retrieving, removing and iterating over keys in a single
+ * thread.
+ */
+START_TEST(concurrent_sortedmap_single_thread)
+{
+    DEBUG("\n*** Starting concurrent_sortedmap_single_thread\n");
+    libcoll_concurrent_sortedmap_t *map = libcoll_concurrent_sortedmap_init_with_comparator(libcoll_intptrcmp);
+    ck_assert_ptr_nonnull(map);
+    ck_assert(libcoll_concurrent_sortedmap_is_empty(map));
+
+    /* add in a scrambled order */
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        keys[i] = i;
+    }
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        int *key = &keys[(i * 7919) % TEST_KEY_COUNT];
+        ck_assert(libcoll_concurrent_sortedmap_add(map, key, key));
+    }
+    ck_assert(!libcoll_concurrent_sortedmap_add(map, &keys[5], &keys[5]));
+    ck_assert_uint_eq(libcoll_concurrent_sortedmap_get_size(map), TEST_KEY_COUNT);
+    ck_assert(_libcoll_concurrent_sortedmap_verify(map));
+
+    for (int i=0; i<TEST_KEY_COUNT; i+=2) {
+        ck_assert_ptr_eq(libcoll_concurrent_sortedmap_remove(map, &keys[i]).b, &keys[i]);
+    }
+    ck_assert_ptr_null(libcoll_concurrent_sortedmap_remove(map, &keys[0]).a);
+    ck_assert(_libcoll_concurrent_sortedmap_verify(map));
+    ck_assert(!libcoll_concurrent_sortedmap_contains(map, &keys[10]));
+    ck_assert_ptr_eq(libcoll_concurrent_sortedmap_get(map, &keys[11]), &keys[11]);
+
+    libcoll_concurrent_sortedmap_iter_t *iter = libcoll_concurrent_sortedmap_get_iterator(map);
+    int expected = 1;
+    while (libcoll_concurrent_sortedmap_has_next(iter)) {
+        ck_assert_int_eq(*(int*) libcoll_concurrent_sortedmap_next(iter).a, expected);
+        expected += 2;
+    }
+    ck_assert_int_eq(expected, TEST_KEY_COUNT + 1);
+    libcoll_concurrent_sortedmap_free_iterator(iter);
+
+    iter = libcoll_concurrent_sortedmap_get_iterator_at(map, &keys[100]);
+    ck_assert_int_eq(*(int*) libcoll_concurrent_sortedmap_next(iter).a, 101);
+    libcoll_concurrent_sortedmap_free_iterator(iter);
+
+    libcoll_concurrent_sortedmap_deinit(map);
+}
+END_TEST
+
+/* each thread adds and removes the keys i with i % THREAD_COUNT == its index */
+typedef struct worker {
+    libcoll_concurrent_sortedmap_t *map;
+    int index;
+} worker_t;
+
+static void* add_and_remove(void *arg)
+{
+    worker_t *worker = arg;
+    for (int round=0; round<3; round++) {
+        for (int i=worker->index; i<TEST_KEY_COUNT; i+=THREAD_COUNT) {
+            if (!libcoll_concurrent_sortedmap_add(worker->map, &keys[i], &keys[i])) {
+                return "adding failed";
+            }
+        }
+
+        /* iterating sees the keys in order while others modify the map */
+        libcoll_concurrent_sortedmap_iter_t *iter = libcoll_concurrent_sortedmap_get_iterator(worker->map);
+        int previous = -1;
+        while (libcoll_concurrent_sortedmap_has_next(iter)) {
+            int key = *(int*) libcoll_concurrent_sortedmap_next(iter).a;
+            if (key <= previous) {
+                return "keys out of order";
+            }
+            previous = key;
+        }
+        libcoll_concurrent_sortedmap_free_iterator(iter);
+
+        for (int i=worker->index; i<TEST_KEY_COUNT; i+=THREAD_COUNT) {
+            if (round == 2 && i % 3 == 0) {
+                continue;
+            }
+            if (libcoll_concurrent_sortedmap_remove(worker->map, &keys[i]).a != &keys[i]) {
+                return "removing failed";
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Tests adding and removing keys from several threads at once.
+ */
+START_TEST(concurrent_sortedmap_multiple_threads)
+{
+    DEBUG("\n*** Starting concurrent_sortedmap_multiple_threads\n");
+    libcoll_concurrent_sortedmap_t *map = libcoll_concurrent_sortedmap_init_with_comparator(libcoll_intptrcmp);
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        keys[i] = i;
+    }
+
+    pthread_t threads[THREAD_COUNT];
+    worker_t workers[THREAD_COUNT];
+    for (int i=0; i<THREAD_COUNT; i++) {
+        workers[i].map = map;
+        workers[i].index = i;
+        ck_assert_int_eq(pthread_create(&threads[i], NULL, &add_and_remove, &workers[i]), 0);
+    }
+    for (int i=0; i<THREAD_COUNT; i++) {
+        void *error;
+        pthread_join(threads[i], &error);
+        ck_assert_ptr_null(error);
+    }
+
+    ck_assert(_libcoll_concurrent_sortedmap_verify(map));
+    ck_assert_uint_eq(libcoll_concurrent_sortedmap_get_size(map), (TEST_KEY_COUNT + 2) / 3);
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert(libcoll_concurrent_sortedmap_contains(map, &keys[i]) == (i % 3 == 0));
+    }
+    libcoll_concurrent_sortedmap_deinit(map);
+}
+END_TEST
+
+TCase* create_concurrentsortedmap_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("concurrentsortedmap_core");
+
+    tcase_add_test(tc_core, concurrent_sortedmap_single_thread);
+    tcase_add_test(tc_core, concurrent_sortedmap_multiple_threads);
+
+    return tc_core;
+}
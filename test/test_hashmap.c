@@ -35,6 +35,8 @@
 #include "comparators.h"
 #include "hash.h"
 #include "hashmap.h"
+#include "keytraits.h"
+#include "types.h"
 #include "vector.h"  /* use as a utility type */
 
 #include "../src/debug.h"
@@ -290,6 +292,121 @@ START_TEST(hashmap_resize)
 }
 END_TEST
 
+/*
+ * Tests using byte strings (which may contain zero bytes and share
+ * prefixes) as hashmap keys.
+ */
+START_TEST(hashmap_bytes_keys)
+{
+    DEBUG("\n*** Starting hashmap_bytes_keys\n");
+    libcoll_hashmap_t *hm = libcoll_hashmap_init_with_params(
+            LIBCOLL_HASHMAP_DEFAULT_INIT_SIZE,
+            LIBCOLL_HASHMAP_DEFAULT_MAX_LOAD_FACTOR,
+            libcoll_hashcode_bytes,
+            libcoll_bytescmp,
+            NULL
+    );
+
+    libcoll_bytes_t keys[] = {
+        { "ab\0cd", 5 },
+        { "ab\0ce", 5 },
+        { "ab", 2 },
+        { "ab\0", 3 }
+    };
+    int values[] = { 1, 2, 3, 4 };
+
+    for (int i=0; i<4; i++) {
+        libcoll_hashmap_put(hm, &keys[i], &values[i]);
+    }
+    ck_assert_uint_eq(libcoll_hashmap_get_size(hm), 4);
+
+    for (int i=0; i<4; i++) {
+        /* look up with a copy of the key to make sure contents are compared */
+        libcoll_bytes_t lookup_key = keys[i];
+        int *value = (int*) libcoll_hashmap_get(hm, &lookup_key);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_int_eq(*value, values[i]);
+    }
+
+    libcoll_bytes_t missing_key = { "ab\0cf", 5 };
+    ck_assert(!libcoll_hashmap_contains(hm, &missing_key));
+
+    libcoll_hashmap_deinit(hm);
+}
+END_TEST
+
+/*
+ * Tests a hashmap configured with key traits, including lookups with
+ * caller-supplied hash values and lookups by an alternative key type.
+ */
+START_TEST(hashmap_key_traits_and_prehashed)
+{
+    DEBUG("\n*** Starting hashmap_key_traits_and_prehashed\n");
+    libcoll_hashmap_t *hm = libcoll_hashmap_init_with_traits(
+            4,
+            LIBCOLL_HASHMAP_DEFAULT_MAX_LOAD_FACTOR,
+            &libcoll_key_traits_str,
+            NULL
+    );
+
+    char *keys[] = { "alpha", "beta", "gamma", "delta", "epsilon", "zeta" };
+    int values[] = { 1, 2, 3, 4, 5, 6 };
+
+    for (int i=0; i<6; i++) {
+        libcoll_hashmap_put(hm, keys[i], &values[i]);
+    }
+    ck_assert_uint_eq(libcoll_hashmap_get_size(hm), 6);
+
+    for (int i=0; i<6; i++) {
+        uint64_t hash = libcoll_hashmap_hash_key(hm, keys[i]);
+        int *value = libcoll_hashmap_get_prehashed(hm, hash, keys[i]);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_int_eq(*value, values[i]);
+    }
+
+    /* look up "gamma" using a substring of a larger buffer */
+    const char *buffer = "GET gamma HTTP/1.1";
+    libcoll_bytes_t probe = { buffer + 4, 5 };
+    int *value = libcoll_hashmap_get_by(hm, libcoll_hashcode_bytes(&probe), &probe,
+                                        libcoll_bytes_strcmp);
+    ck_assert_ptr_nonnull(value);
+    ck_assert_int_eq(*value, 3);
+
+    libcoll_bytes_t prefix_probe = { buffer + 4, 4 };
+    ck_assert_ptr_null(libcoll_hashmap_get_by(hm, libcoll_hashcode_bytes(&prefix_probe),
+                                              &prefix_probe, libcoll_bytes_strcmp));
+
+    libcoll_map_removal_result_t result =
+        libcoll_hashmap_remove_prehashed(hm, libcoll_hashmap_hash_key(hm, "beta"), "beta");
+    ck_assert_int_eq(result.status, MAP_ENTRY_REMOVED);
+    ck_assert(!libcoll_hashmap_contains(hm, "beta"));
+    ck_assert_uint_eq(libcoll_hashmap_get_size(hm), 5);
+
+    libcoll_hashmap_deinit(hm);
+
+    /* int keys, where the hash value alone determines key equality */
+    hm = libcoll_hashmap_init_with_traits(
+            LIBCOLL_HASHMAP_DEFAULT_INIT_SIZE,
+            LIBCOLL_HASHMAP_DEFAULT_MAX_LOAD_FACTOR,
+            &libcoll_key_traits_int,
+            NULL
+    );
+    int int_keys[100];
+    for (int i=0; i<100; i++) {
+        int_keys[i] = i * 7919;
+        libcoll_hashmap_put(hm, &int_keys[i], &values[i % 6]);
+    }
+    for (int i=0; i<100; i++) {
+        int lookup_key = i * 7919;
+        ck_assert_ptr_eq(libcoll_hashmap_get(hm, &lookup_key), &values[i % 6]);
+    }
+    int missing_key = 1;
+    ck_assert(!libcoll_hashmap_contains(hm, &missing_key));
+
+    libcoll_hashmap_deinit(hm);
+}
+END_TEST
+
 TCase* create_hashmap_tests(void)
 {
     TCase *tc_core;
@@ -299,6 +416,8 @@ TCase* create_hashmap_tests(void)
     tcase_add_test(tc_core, hashmap_populate_and_retrieve);
     tcase_add_test(tc_core, hashmap_iterate);
     tcase_add_test(tc_core, hashmap_resize);
+    tcase_add_test(tc_core, hashmap_bytes_keys);
+    tcase_add_test(tc_core, hashmap_key_traits_and_prehashed);
 
     return tc_core;
 }
@@ -0,0 +1,180 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+
+#include "test_intervaltree.h"
+
+#include "intervaltree.h"
+
+#include "../src/debug.h"
+
+#define TEST_INTERVAL_COUNT 2000
+#define TEST_RANGE          10000
+
+static libcoll_interval_t intervals[TEST_INTERVAL_COUNT];
+static int values[TEST_INTERVAL_COUNT];
+
+/* random intervals of mostly short and some long lengths, with values
+ * holding their indexes
+ */
+static void random_intervals(void)
+{
+    srand(1);
+    for (int i=0; i<TEST_INTERVAL_COUNT; i++) {
+        long long length = i % 10 == 0 ? rand() % 2000 : rand() % 20;
+        values[i] = i;
+        intervals[i].start = rand() % TEST_RANGE - 100;
+        intervals[i].end = intervals[i].start + length;
+        intervals[i].value = &values[i];
+    }
+}
+
+static bool overlaps(const libcoll_interval_t *interval, long long low, long long high)
+{
+    return interval->start <= high && interval->end >= low;
+}
+
+/*
+ * Checks that an overlap query returns exactly the intervals that are not
+ * marked removed and overlap the range, in the order of start points.
+ */
+static void assert_overlaps(libcoll_intervaltree_t *tree, const bool *removed, long long low, long long high)
+{
+    int expected = 0;
+    for (int i=0; i<TEST_INTERVAL_COUNT; i++) {
+        if (!removed[i] && overlaps(&intervals[i], low, high)) {
+            expected++;
+        }
+    }
+
+    libcoll_intervaltree_iter_t iter;
+    libcoll_intervaltree_init_overlap_iterator(&iter, tree, low, high);
+    int count = 0;
+    long long previous_start = -TEST_RANGE;
+    while (libcoll_intervaltree_has_next(&iter)) {
+        libcoll_interval_t *interval = libcoll_intervaltree_next(&iter);
+        int index = *(int*) interval->value;
+        ck_assert(overlaps(interval, low, high));
+        ck_assert(!removed[index]);
+        ck_assert_int_le(previous_start, interval->start);
+        previous_start = interval->start;
+        count++;
+    }
+    ck_assert_int_eq(count, expected);
+    ck_assert_ptr_null(libcoll_intervaltree_next(&iter));
+}
+
+/*
+ * Tests stabbing and overlap queries against a linear scan, while adding and
+ * removing intervals.
+ */
+START_TEST(intervaltree_queries)
+{
+    DEBUG("\n*** Starting intervaltree_queries\n");
+    libcoll_intervaltree_t *tree = libcoll_intervaltree_init();
+    libcoll_interval_t *stored[TEST_INTERVAL_COUNT];
+    bool removed[TEST_INTERVAL_COUNT] = { false };
+    random_intervals();
+
+    ck_assert(libcoll_intervaltree_is_empty(tree));
+    ck_assert_ptr_null(libcoll_intervaltree_add(tree, 2, 1, NULL));
+    for (int i=0; i<TEST_INTERVAL_COUNT; i++) {
+        stored[i] = libcoll_intervaltree_add(tree, intervals[i].start, intervals[i].end, &values[i]);
+        ck_assert_ptr_nonnull(stored[i]);
+    }
+    ck_assert_uint_eq(libcoll_intervaltree_get_size(tree), TEST_INTERVAL_COUNT);
+    ck_assert(_libcoll_intervaltree_verify(tree));
+
+    for (long long point=-200; point<TEST_RANGE+2000; point+=37) {
+        assert_overlaps(tree, removed, point, point);
+        assert_overlaps(tree, removed, point, point + 150);
+    }
+    assert_overlaps(tree, removed, -TEST_RANGE, 2 * TEST_RANGE);
+
+    libcoll_intervaltree_iter_t iter;
+    libcoll_intervaltree_init_overlap_iterator(&iter, tree, 5, 4);
+    ck_assert(!libcoll_intervaltree_has_next(&iter));
+
+    for (int i=0; i<TEST_INTERVAL_COUNT; i+=3) {
+        ck_assert_ptr_eq(libcoll_intervaltree_remove(tree, stored[i]), &values[i]);
+        removed[i] = true;
+    }
+    ck_assert(_libcoll_intervaltree_verify(tree));
+    for (long long point=-200; point<TEST_RANGE+2000; point+=101) {
+        assert_overlaps(tree, removed, point, point);
+        assert_overlaps(tree, removed, point, point + 500);
+    }
+
+    /* equal intervals are stored separately */
+    libcoll_interval_t *first = libcoll_intervaltree_add(tree, 20000, 20010, &values[0]);
+    libcoll_interval_t *second = libcoll_intervaltree_add(tree, 20000, 20010, &values[1]);
+    libcoll_intervaltree_init_stab_iterator(&iter, tree, 20005);
+    ck_assert_ptr_nonnull(libcoll_intervaltree_next(&iter));
+    ck_assert_ptr_nonnull(libcoll_intervaltree_next(&iter));
+    ck_assert(!libcoll_intervaltree_has_next(&iter));
+    ck_assert_ptr_eq(libcoll_intervaltree_remove(tree, second), &values[1]);
+    ck_assert_ptr_eq(libcoll_intervaltree_remove(tree, first), &values[0]);
+
+    libcoll_intervaltree_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests building a tree from an unsorted array of intervals.
+ */
+START_TEST(intervaltree_build)
+{
+    DEBUG("\n*** Starting intervaltree_build\n");
+    libcoll_intervaltree_t *tree = libcoll_intervaltree_init();
+    bool removed[TEST_INTERVAL_COUNT] = { false };
+    random_intervals();
+
+    ck_assert(libcoll_intervaltree_build(tree, intervals, TEST_INTERVAL_COUNT));
+    ck_assert_uint_eq(libcoll_intervaltree_get_size(tree), TEST_INTERVAL_COUNT);
+    ck_assert(_libcoll_intervaltree_verify(tree));
+    ck_assert(!libcoll_intervaltree_build(tree, intervals, TEST_INTERVAL_COUNT));
+
+    for (long long point=-200; point<TEST_RANGE+2000; point+=53) {
+        assert_overlaps(tree, removed, point, point + 20);
+    }
+
+    libcoll_intervaltree_deinit(tree);
+}
+END_TEST
+
+TCase* create_intervaltree_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("intervaltree_core");
+
+    tcase_add_test(tc_core, intervaltree_queries);
+    tcase_add_test(tc_core, intervaltree_build);
+
+    return tc_core;
+}
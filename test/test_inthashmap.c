@@ -0,0 +1,138 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+
+#include "test_inthashmap.h"
+
+#include "inthashmap.h"
+
+#include "../src/debug.h"
+
+/*
+ * Tests that an empty integer hashmap gets properly created.
+ */
+START_TEST(inthashmap_create)
+{
+    DEBUG("\n*** Starting inthashmap_create\n");
+    libcoll_inthashmap_t *hm = libcoll_inthashmap_init_with_params(100, 0.5f);
+
+    ck_assert_ptr_nonnull(hm);
+    ck_assert_uint_eq(libcoll_inthashmap_get_capacity(hm), 128);
+    ck_assert(libcoll_inthashmap_is_empty(hm));
+
+    libcoll_inthashmap_deinit(hm);
+}
+END_TEST
+
+/*
+ * Tests inserting, replacing, retrieving and removing entries, with enough
+ * entries to trigger several resizes and long probe sequences.
+ */
+START_TEST(inthashmap_populate_retrieve_and_remove)
+{
+    DEBUG("\n*** Starting inthashmap_populate_retrieve_and_remove\n");
+    libcoll_inthashmap_t *hm = libcoll_inthashmap_init_with_params(2, 0.9f);
+    const uint64_t n = 5000;
+
+    for (uint64_t i=0; i<n; i++) {
+        ck_assert_int_eq(libcoll_inthashmap_put(hm, i * 64, i), MAP_ENTRY_ADDED);
+    }
+    ck_assert_int_eq(libcoll_inthashmap_put(hm, 0, 42), MAP_ENTRY_REPLACED);
+    ck_assert_uint_eq(libcoll_inthashmap_get_size(hm), n);
+
+    uint64_t value;
+    ck_assert(libcoll_inthashmap_get(hm, 0, &value));
+    ck_assert_uint_eq(value, 42);
+    for (uint64_t i=1; i<n; i++) {
+        ck_assert(libcoll_inthashmap_get(hm, i * 64, &value));
+        ck_assert_uint_eq(value, i);
+    }
+    ck_assert(!libcoll_inthashmap_contains(hm, 1));
+
+    /* remove every other key, and check that the rest remain reachable */
+    for (uint64_t i=0; i<n; i+=2) {
+        ck_assert(libcoll_inthashmap_remove(hm, i * 64, NULL));
+    }
+    ck_assert(!libcoll_inthashmap_remove(hm, 0, NULL));
+    ck_assert_uint_eq(libcoll_inthashmap_get_size(hm), n / 2);
+
+    for (uint64_t i=0; i<n; i++) {
+        ck_assert_int_eq(libcoll_inthashmap_contains(hm, i * 64), i % 2 == 1);
+    }
+
+    libcoll_inthashmap_deinit(hm);
+}
+END_TEST
+
+/*
+ * Tests counting occurrences with values updated in place.
+ */
+START_TEST(inthashmap_count_in_place)
+{
+    DEBUG("\n*** Starting inthashmap_count_in_place\n");
+    libcoll_inthashmap_t *hm = libcoll_inthashmap_init();
+
+    for (uint64_t i=0; i<1000; i++) {
+        (*libcoll_inthashmap_get_or_put(hm, i % 10, 0))++;
+    }
+    ck_assert_uint_eq(libcoll_inthashmap_get_size(hm), 10);
+
+    uint64_t total = 0;
+    libcoll_inthashmap_iter_t *iter = libcoll_inthashmap_get_iterator(hm);
+    while (libcoll_inthashmap_iter_has_next(iter)) {
+        libcoll_inthashmap_entry_t *entry = libcoll_inthashmap_iter_next(iter);
+        ck_assert_uint_eq(entry->value, 100);
+        total += entry->value;
+    }
+    libcoll_inthashmap_free_iterator(iter);
+    ck_assert_uint_eq(total, 1000);
+
+    uint64_t *count = libcoll_inthashmap_get_ref(hm, 3);
+    ck_assert_ptr_nonnull(count);
+    *count = 7;
+    uint64_t removed;
+    ck_assert(libcoll_inthashmap_remove(hm, 3, &removed));
+    ck_assert_uint_eq(removed, 7);
+    ck_assert_ptr_null(libcoll_inthashmap_get_ref(hm, 3));
+
+    libcoll_inthashmap_deinit(hm);
+}
+END_TEST
+
+TCase* create_inthashmap_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("inthashmap_core");
+
+    tcase_add_test(tc_core, inthashmap_create);
+    tcase_add_test(tc_core, inthashmap_populate_retrieve_and_remove);
+    tcase_add_test(tc_core, inthashmap_count_in_place);
+
+    return tc_core;
+}
@@ -29,6 +29,7 @@
 
 #include "test_linkedlist.h"
 
+#include "comparators.h"
 #include "linkedlist.h"
 #include "../src/debug.h"
 
@@ -130,6 +131,36 @@ START_TEST(linkedlist_populate_and_iterate)
 }
 END_TEST
 
+/*
+ * Tests searching and removing values by equality rather than identity.
+ */
+START_TEST(linkedlist_remove_by_value)
+{
+    DEBUG("\n*** Starting linkedlist_remove_by_value\n");
+    libcoll_linkedlist_t *list = libcoll_linkedlist_init_with_comparator(libcoll_strcmp_wrapper);
+
+    char s1[] = "foo", s2[] = "bar", s3[] = "baz";
+    libcoll_linkedlist_append(list, s1);
+    libcoll_linkedlist_append(list, s2);
+    libcoll_linkedlist_append(list, s3);
+
+    ck_assert_int_eq(libcoll_linkedlist_index_of(list, "baz"), 2);
+    ck_assert_int_eq(libcoll_linkedlist_index_of(list, "qux"), -1);
+
+    ck_assert_int_eq(libcoll_linkedlist_remove(list, "bar"), 1);
+    ck_assert_int_eq(libcoll_linkedlist_remove(list, "bar"), 0);
+    ck_assert_uint_eq(libcoll_linkedlist_length(list), 2);
+    ck_assert_int_eq(libcoll_linkedlist_index_of(list, "baz"), 1);
+
+    ck_assert_int_eq(libcoll_linkedlist_remove(list, "baz"), 1);
+    ck_assert_ptr_eq(list->tail, list->head);
+    ck_assert_int_eq(libcoll_linkedlist_remove(list, "foo"), 1);
+    ck_assert(libcoll_linkedlist_is_empty(list));
+
+    libcoll_linkedlist_deinit(list);
+}
+END_TEST
+
 TCase* create_linkedlist_tests(void)
 {
     TCase *tc_core;
@@ -139,6 +170,7 @@ TCase* create_linkedlist_tests(void)
 
     tcase_add_test(tc_core, linkedlist_create);
     tcase_add_test(tc_core, linkedlist_populate_and_iterate);
+    tcase_add_test(tc_core, linkedlist_remove_by_value);
 
     return tc_core;
 }
\ No newline at end of file
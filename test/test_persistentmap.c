@@ -0,0 +1,214 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "test_persistentmap.h"
+
+#include "persistentmap.h"
+#include "comparators.h"
+
+#include "../src/debug.h"
+
+#define TEST_KEY_COUNT  5000
+
+static int keys[TEST_KEY_COUNT];
+
+/* fills the key array with the numbers 0, 1, 2, ... in shuffled order */
+static void shuffled_keys(void)
+{
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        keys[i] = i;
+    }
+    srand(1);
+    for (int i=TEST_KEY_COUNT-1; i>0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+/* checks that a snapshot holds exactly the keys in [0, count) whose key % step != 0 */
+static void assert_snapshot_keys(libcoll_persistentmap_snapshot_t *snapshot, int count, int step)
+{
+    ck_assert(_libcoll_persistentmap_verify(snapshot));
+
+    libcoll_persistentmap_iter_t *iter = libcoll_persistentmap_get_iterator(snapshot);
+    int expected = 0;
+    while (libcoll_persistentmap_has_next(iter)) {
+        while (step > 0 && expected % step == 0)  expected++;
+        ck_assert_int_eq(*(int*) libcoll_persistentmap_next(iter).a, expected);
+        expected++;
+    }
+    while (step > 0 && expected % step == 0)  expected++;
+    ck_assert_int_ge(expected, count);
+    libcoll_persistentmap_free_iterator(iter);
+}
+
+/*
+ * Tests adding, retrieving and removing keys, and that snapshots keep seeing
+ * the version of the map they were taken of.
+ */
+START_TEST(persistentmap_snapshots)
+{
+    DEBUG("\n*** Starting persistentmap_snapshots\n");
+    shuffled_keys();
+    libcoll_persistentmap_t *map = libcoll_persistentmap_init_with_comparator(libcoll_intptrcmp);
+    ck_assert_ptr_nonnull(map);
+
+    libcoll_persistentmap_snapshot_t *empty = libcoll_persistentmap_snapshot(map);
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert(libcoll_persistentmap_add(map, &keys[i], &keys[i]));
+    }
+    ck_assert(!libcoll_persistentmap_add(map, &keys[0], &keys[0]));
+    ck_assert_uint_eq(libcoll_persistentmap_get_size(map), TEST_KEY_COUNT);
+
+    libcoll_persistentmap_snapshot_t *full = libcoll_persistentmap_snapshot(map);
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        if (keys[i] % 3 == 0) {
+            libcoll_pair_voidptr_t removed = libcoll_persistentmap_remove(map, &keys[i]);
+            ck_assert_ptr_eq(removed.a, &keys[i]);
+            ck_assert_ptr_eq(removed.b, &keys[i]);
+        }
+    }
+    int missing = 3;
+    ck_assert_ptr_null(libcoll_persistentmap_remove(map, &missing).a);
+    ck_assert_ptr_null(libcoll_persistentmap_get(map, &missing));
+    missing = 4;
+    ck_assert_int_eq(*(int*) libcoll_persistentmap_get(map, &missing), 4);
+
+    libcoll_persistentmap_snapshot_t *thinned = libcoll_persistentmap_snapshot(map);
+    ck_assert_uint_eq(libcoll_persistentmap_snapshot_get_size(empty), 0);
+    ck_assert_uint_eq(libcoll_persistentmap_snapshot_get_size(full), TEST_KEY_COUNT);
+    ck_assert_uint_eq(libcoll_persistentmap_snapshot_get_size(thinned), TEST_KEY_COUNT - (TEST_KEY_COUNT + 2) / 3);
+    assert_snapshot_keys(empty, 0, 0);
+    assert_snapshot_keys(full, TEST_KEY_COUNT, 0);
+    assert_snapshot_keys(thinned, TEST_KEY_COUNT, 3);
+
+    missing = 3;
+    ck_assert(libcoll_persistentmap_snapshot_contains(full, &missing));
+    ck_assert(!libcoll_persistentmap_snapshot_contains(thinned, &missing));
+
+    /* seeking, with an iterator that outlives both the snapshot and the map */
+    libcoll_persistentmap_iter_t *iter = libcoll_persistentmap_get_iterator_at(thinned, &missing);
+    libcoll_persistentmap_release_snapshot(thinned);
+    libcoll_persistentmap_release_snapshot(full);
+    libcoll_persistentmap_release_snapshot(empty);
+    libcoll_persistentmap_deinit(map);
+
+    ck_assert_int_eq(*(int*) libcoll_persistentmap_next(iter).a, 4);
+    ck_assert_int_eq(*(int*) libcoll_persistentmap_next(iter).a, 5);
+    ck_assert_int_eq(*(int*) libcoll_persistentmap_next(iter).a, 7);
+    libcoll_persistentmap_free_iterator(iter);
+}
+END_TEST
+
+static bool writer_done;
+
+/* reads snapshots of the map until the writer is done */
+static void* read_snapshots(void *arg)
+{
+    libcoll_persistentmap_t *map = arg;
+    bool done = false;
+    while (!done) {
+        done = __atomic_load_n(&writer_done, __ATOMIC_ACQUIRE);
+        libcoll_persistentmap_snapshot_t *snapshot = libcoll_persistentmap_snapshot(map);
+
+        /* the writer adds keys in order and then removes them in order */
+        size_t count = 0;
+        int previous = -1;
+        libcoll_persistentmap_iter_t *iter = libcoll_persistentmap_get_iterator(snapshot);
+        while (libcoll_persistentmap_has_next(iter)) {
+            int key = *(int*) libcoll_persistentmap_next(iter).a;
+            if (key != previous + 1 && previous >= 0) {
+                return "keys missing in the middle of a snapshot";
+            }
+            previous = key;
+            count++;
+        }
+        libcoll_persistentmap_free_iterator(iter);
+
+        if (count != libcoll_persistentmap_snapshot_get_size(snapshot)) {
+            return "snapshot size does not match its contents";
+        }
+        libcoll_persistentmap_release_snapshot(snapshot);
+    }
+    return NULL;
+}
+
+/*
+ * Tests that readers on other threads see consistent versions of the map
+ * while it is being modified.
+ */
+START_TEST(persistentmap_concurrent_readers)
+{
+    DEBUG("\n*** Starting persistentmap_concurrent_readers\n");
+    static int ordered_keys[TEST_KEY_COUNT];
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ordered_keys[i] = i;
+    }
+
+    libcoll_persistentmap_t *map = libcoll_persistentmap_init_with_comparator(libcoll_intptrcmp);
+    writer_done = false;
+
+    pthread_t readers[4];
+    for (int i=0; i<4; i++) {
+        ck_assert_int_eq(pthread_create(&readers[i], NULL, &read_snapshots, map), 0);
+    }
+
+    for (int round=0; round<3; round++) {
+        for (int i=0; i<TEST_KEY_COUNT; i++) {
+            ck_assert(libcoll_persistentmap_add(map, &ordered_keys[i], &ordered_keys[i]));
+        }
+        for (int i=0; i<TEST_KEY_COUNT; i++) {
+            ck_assert_ptr_eq(libcoll_persistentmap_remove(map, &ordered_keys[i]).a, &ordered_keys[i]);
+        }
+    }
+    __atomic_store_n(&writer_done, true, __ATOMIC_RELEASE);
+
+    for (int i=0; i<4; i++) {
+        void *error;
+        pthread_join(readers[i], &error);
+        ck_assert_ptr_null(error);
+    }
+    libcoll_persistentmap_deinit(map);
+}
+END_TEST
+
+TCase* create_persistentmap_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("persistentmap_core");
+
+    tcase_add_test(tc_core, persistentmap_snapshots);
+    tcase_add_test(tc_core, persistentmap_concurrent_readers);
+
+    return tc_core;
+}
@@ -0,0 +1,260 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_radixtree.h"
+
+#include "radixtree.h"
+
+#include "../src/debug.h"
+
+#define TEST_KEY_COUNT  5000
+#define KEY_SIZE        64
+
+static char keys[TEST_KEY_COUNT][KEY_SIZE];
+static int values[TEST_KEY_COUNT];
+
+/*
+ * Fills the key array with the decimal numbers 0, 1, 2, ... in shuffled
+ * order, so that many keys are prefixes of others.  Every fifth key also gets
+ * a long common tail, so that paths longer than the prefix stored in a node
+ * get compressed.
+ */
+static void shuffled_decimal_keys(void)
+{
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        values[i] = i;
+    }
+    srand(1);
+    for (int i=TEST_KEY_COUNT-1; i>0; i--) {
+        int j = rand() % (i + 1);
+        int tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        sprintf(keys[i], values[i] % 5 == 0 ? "%d/a/long/common/tail/%d" : "%d", values[i], values[i] % 3);
+    }
+}
+
+static int compare_key_strings(const void *key1, const void *key2)
+{
+    return strcmp(*(char* const*) key1, *(char* const*) key2);
+}
+
+/*
+ * Tests adding, retrieving and removing keys, checking the structure of the
+ * tree along the way.
+ */
+START_TEST(radixtree_add_retrieve_and_remove)
+{
+    DEBUG("\n*** Starting radixtree_add_retrieve_and_remove\n");
+    libcoll_radixtree_t *tree = libcoll_radixtree_init();
+    shuffled_decimal_keys();
+
+    ck_assert(libcoll_radixtree_is_empty(tree));
+    ck_assert_ptr_null(libcoll_radixtree_get(tree, "", 0));
+    ck_assert(!libcoll_radixtree_contains(tree, "", 0));
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert(libcoll_radixtree_add(tree, keys[i], strlen(keys[i]), &values[i]));
+    }
+    ck_assert(!libcoll_radixtree_add(tree, keys[0], strlen(keys[0]), &values[0]));
+    ck_assert_int_eq(libcoll_radixtree_get_size(tree), TEST_KEY_COUNT);
+    ck_assert(_libcoll_radixtree_verify(tree));
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert_ptr_eq(libcoll_radixtree_get(tree, keys[i], strlen(keys[i])), &values[i]);
+    }
+    ck_assert_ptr_null(libcoll_radixtree_get(tree, "", 0));
+    ck_assert_ptr_null(libcoll_radixtree_get(tree, "10/a/long/common/tail/2", 23));
+    ck_assert_ptr_null(libcoll_radixtree_get(tree, "10/a/long/common/tail", 21));
+    ck_assert_ptr_null(libcoll_radixtree_get(tree, "12345", 5));
+    ck_assert(!libcoll_radixtree_contains(tree, "10/a/long/common/tail/0", 23));
+    ck_assert(libcoll_radixtree_contains(tree, "10/a/long/common/tail/1", 23));
+
+    ck_assert(libcoll_radixtree_add(tree, "", 0, NULL));
+    ck_assert(libcoll_radixtree_contains(tree, "", 0));
+    ck_assert(_libcoll_radixtree_verify(tree));
+
+    for (int i=0; i<TEST_KEY_COUNT; i+=2) {
+        ck_assert_ptr_eq(libcoll_radixtree_remove(tree, keys[i], strlen(keys[i])), &values[i]);
+        ck_assert_ptr_null(libcoll_radixtree_remove(tree, keys[i], strlen(keys[i])));
+    }
+    ck_assert(_libcoll_radixtree_verify(tree));
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        void *expected = i % 2 == 0 ? NULL : &values[i];
+        ck_assert_ptr_eq(libcoll_radixtree_get(tree, keys[i], strlen(keys[i])), expected);
+    }
+
+    ck_assert_ptr_null(libcoll_radixtree_remove(tree, "", 0));
+    ck_assert(!libcoll_radixtree_contains(tree, "", 0));
+    for (int i=1; i<TEST_KEY_COUNT; i+=2) {
+        ck_assert_ptr_eq(libcoll_radixtree_remove(tree, keys[i], strlen(keys[i])), &values[i]);
+    }
+    ck_assert(libcoll_radixtree_is_empty(tree));
+    ck_assert_ptr_null(tree->root);
+
+    libcoll_radixtree_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests that nodes grow and shrink through all four sizes with binary keys,
+ * including zero bytes.
+ */
+START_TEST(radixtree_node_sizes)
+{
+    DEBUG("\n*** Starting radixtree_node_sizes\n");
+    libcoll_radixtree_t *tree = libcoll_radixtree_init();
+    unsigned char key[3] = { 0, 0, 0 };
+
+    for (int a=0; a<256; a++) {
+        for (int b=0; b<64; b++) {
+            key[0] = (unsigned char) a;
+            key[2] = (unsigned char) b;
+            ck_assert(libcoll_radixtree_add(tree, key, sizeof(key), &values[b]));
+        }
+    }
+    ck_assert_int_eq(libcoll_radixtree_get_size(tree), 256 * 64);
+    ck_assert(_libcoll_radixtree_verify(tree));
+
+    for (int b=63; b>=2; b--) {
+        for (int a=0; a<256; a++) {
+            key[0] = (unsigned char) a;
+            key[2] = (unsigned char) b;
+            ck_assert_ptr_eq(libcoll_radixtree_remove(tree, key, sizeof(key)), &values[b]);
+        }
+        if (b % 4 == 0) {
+            ck_assert(_libcoll_radixtree_verify(tree));
+        }
+    }
+    ck_assert(_libcoll_radixtree_verify(tree));
+
+    for (int a=0; a<256; a++) {
+        key[0] = (unsigned char) a;
+        key[2] = 1;
+        ck_assert_ptr_eq(libcoll_radixtree_get(tree, key, sizeof(key)), &values[1]);
+        key[2] = 2;
+        ck_assert_ptr_null(libcoll_radixtree_get(tree, key, sizeof(key)));
+    }
+
+    libcoll_radixtree_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests iterating through the whole tree and through the keys with a given
+ * prefix, in byte order.
+ */
+START_TEST(radixtree_ordered_and_prefix_iteration)
+{
+    DEBUG("\n*** Starting radixtree_ordered_and_prefix_iteration\n");
+    libcoll_radixtree_t *tree = libcoll_radixtree_init();
+    shuffled_decimal_keys();
+
+    char *sorted[TEST_KEY_COUNT];
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        libcoll_radixtree_add(tree, keys[i], strlen(keys[i]), &values[i]);
+        sorted[i] = keys[i];
+    }
+    qsort(sorted, TEST_KEY_COUNT, sizeof(char*), compare_key_strings);
+
+    libcoll_radixtree_iter_t *iter = libcoll_radixtree_get_iterator(tree);
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert(libcoll_radixtree_has_next(iter));
+        libcoll_radixtree_leaf_t *leaf = libcoll_radixtree_next(iter);
+        ck_assert_int_eq(leaf->key_length, strlen(sorted[i]));
+        ck_assert(0 == memcmp(leaf->key, sorted[i], leaf->key_length));
+    }
+    ck_assert(!libcoll_radixtree_has_next(iter));
+    ck_assert_ptr_null(libcoll_radixtree_next(iter));
+    libcoll_radixtree_free_iterator(iter);
+
+    /* "12", "120" to "129" and "1200" to "1299", some with a tail */
+    iter = libcoll_radixtree_get_prefix_iterator(tree, "12", 2);
+    int count = 0;
+    libcoll_radixtree_leaf_t *previous = NULL;
+    while (libcoll_radixtree_has_next(iter)) {
+        libcoll_radixtree_leaf_t *leaf = libcoll_radixtree_next(iter);
+        ck_assert(0 == memcmp(leaf->key, "12", 2));
+        if (NULL != previous) {
+            size_t length = previous->key_length < leaf->key_length ? previous->key_length : leaf->key_length;
+            int order = memcmp(previous->key, leaf->key, length);
+            ck_assert(order < 0 || (order == 0 && previous->key_length < leaf->key_length));
+        }
+        previous = leaf;
+        count++;
+    }
+    ck_assert_int_eq(count, 111);
+    libcoll_radixtree_free_iterator(iter);
+
+    iter = libcoll_radixtree_get_prefix_iterator(tree, "1000/a/long/com", 15);
+    ck_assert_int_eq(*(int*) libcoll_radixtree_next(iter)->value, 1000);
+    ck_assert(!libcoll_radixtree_has_next(iter));
+    libcoll_radixtree_free_iterator(iter);
+
+    iter = libcoll_radixtree_get_prefix_iterator(tree, "1000/a/wrong", 12);
+    ck_assert(!libcoll_radixtree_has_next(iter));
+    libcoll_radixtree_free_iterator(iter);
+
+    iter = libcoll_radixtree_get_prefix_iterator(tree, "4999", 4);
+    ck_assert_int_eq(*(int*) libcoll_radixtree_next(iter)->value, 4999);
+    ck_assert(!libcoll_radixtree_has_next(iter));
+    libcoll_radixtree_free_iterator(iter);
+
+    iter = libcoll_radixtree_get_prefix_iterator(tree, "5000", 4);
+    ck_assert(!libcoll_radixtree_has_next(iter));
+    libcoll_radixtree_free_iterator(iter);
+
+    iter = libcoll_radixtree_get_prefix_iterator(tree, "", 0);
+    count = 0;
+    while (NULL != libcoll_radixtree_next(iter)) {
+        count++;
+    }
+    ck_assert_int_eq(count, TEST_KEY_COUNT);
+    libcoll_radixtree_free_iterator(iter);
+
+    libcoll_radixtree_deinit(tree);
+}
+END_TEST
+
+TCase* create_radixtree_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("radixtree_core");
+
+    tcase_add_test(tc_core, radixtree_add_retrieve_and_remove);
+    tcase_add_test(tc_core, radixtree_node_sizes);
+    tcase_add_test(tc_core, radixtree_ordered_and_prefix_iteration);
+
+    return tc_core;
+}
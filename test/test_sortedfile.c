@@ -0,0 +1,230 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_sortedfile.h"
+
+#include "sortedfile.h"
+#include "comparators.h"
+#include "treemap.h"
+
+#include "../src/debug.h"
+
+#define TEST_FILE_PATH      "/tmp/libcoll_test_sortedfile.dat"
+#define TEST_KEY_COUNT      2000
+#define TEST_BLOCK_SIZE     64
+#define KEY_SIZE            16
+
+static char keys[TEST_KEY_COUNT][KEY_SIZE];
+
+/*
+ * Writes the keys "key00000", "key00002", ... up to twice the key count, with
+ * each key's number as its value.
+ */
+static void write_even_keys(bool prefix_compression)
+{
+    libcoll_sortedfile_writer_t *writer = libcoll_sortedfile_writer_open(TEST_FILE_PATH, TEST_BLOCK_SIZE,
+                                                                         prefix_compression);
+    ck_assert_ptr_nonnull(writer);
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        sprintf(keys[i], "key%05d", 2*i);
+        ck_assert(libcoll_sortedfile_writer_add(writer, keys[i], strlen(keys[i]), &i, sizeof(int)));
+    }
+    ck_assert(!libcoll_sortedfile_writer_add(writer, keys[0], strlen(keys[0]), NULL, 0));
+    ck_assert(libcoll_sortedfile_writer_close(writer));
+}
+
+static void check_even_keys(bool prefix_compression)
+{
+    char key[KEY_SIZE];
+    size_t value_length;
+
+    write_even_keys(prefix_compression);
+    libcoll_sortedfile_t *file = libcoll_sortedfile_open(TEST_FILE_PATH);
+    ck_assert_ptr_nonnull(file);
+    ck_assert_int_eq(libcoll_sortedfile_get_size(file), TEST_KEY_COUNT);
+    ck_assert(file->block_count > 1);
+
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        const int *value = libcoll_sortedfile_get(file, keys[i], strlen(keys[i]), &value_length);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_int_eq(value_length, sizeof(int));
+        int number;
+        memcpy(&number, value, sizeof(int));
+        ck_assert_int_eq(number, i);
+
+        sprintf(key, "key%05d", 2*i + 1);
+        ck_assert(!libcoll_sortedfile_contains(file, key, strlen(key)));
+    }
+    ck_assert(!libcoll_sortedfile_contains(file, "", 0));
+    ck_assert(!libcoll_sortedfile_contains(file, "a", 1));
+    ck_assert(!libcoll_sortedfile_contains(file, "key", 3));
+    ck_assert(!libcoll_sortedfile_contains(file, "key000000", 9));
+    ck_assert(!libcoll_sortedfile_contains(file, "z", 1));
+
+    libcoll_sortedfile_iter_t iter;
+    ck_assert(libcoll_sortedfile_init_iterator(&iter, file));
+    for (int i=0; i<TEST_KEY_COUNT; i++) {
+        ck_assert(libcoll_sortedfile_has_next(&iter));
+        const libcoll_sortedfile_entry_t *entry = libcoll_sortedfile_next(&iter);
+        ck_assert_int_eq(entry->key_length, strlen(keys[i]));
+        ck_assert(0 == memcmp(entry->key, keys[i], entry->key_length));
+    }
+    ck_assert(!libcoll_sortedfile_has_next(&iter));
+    ck_assert_ptr_null(libcoll_sortedfile_next(&iter));
+    libcoll_sortedfile_deinit_iterator(&iter);
+
+    /* lower bounds of odd keys, and of keys before the first and after the last key */
+    for (int i=0; i<TEST_KEY_COUNT; i+=97) {
+        sprintf(key, "key%05d", 2*i - 1);
+        ck_assert(libcoll_sortedfile_init_iterator_at(&iter, file, key, strlen(key)));
+        ck_assert(libcoll_sortedfile_has_next(&iter));
+        ck_assert(0 == memcmp(libcoll_sortedfile_next(&iter)->key, keys[i], strlen(keys[i])));
+        libcoll_sortedfile_deinit_iterator(&iter);
+    }
+    ck_assert(libcoll_sortedfile_init_iterator_at(&iter, file, "", 0));
+    ck_assert(0 == memcmp(libcoll_sortedfile_next(&iter)->key, keys[0], strlen(keys[0])));
+    libcoll_sortedfile_deinit_iterator(&iter);
+    ck_assert(libcoll_sortedfile_init_iterator_at(&iter, file, "z", 1));
+    ck_assert(!libcoll_sortedfile_has_next(&iter));
+    libcoll_sortedfile_deinit_iterator(&iter);
+
+    /* [key00101, key00400) holds the keys 102, 104, ..., 398 */
+    ck_assert(libcoll_sortedfile_init_range_iterator(&iter, file, "key00101", 8, keys[200], strlen(keys[200])));
+    for (int i=51; i<200; i++) {
+        ck_assert(libcoll_sortedfile_has_next(&iter));
+        const libcoll_sortedfile_entry_t *entry = libcoll_sortedfile_next(&iter);
+        ck_assert(0 == memcmp(entry->key, keys[i], entry->key_length));
+    }
+    ck_assert(!libcoll_sortedfile_has_next(&iter));
+    libcoll_sortedfile_deinit_iterator(&iter);
+
+    libcoll_sortedfile_close(file);
+    remove(TEST_FILE_PATH);
+}
+
+/*
+ * Tests writing and reading a file spanning many blocks, without and with
+ * prefix compression.
+ */
+START_TEST(sortedfile_write_and_read)
+{
+    DEBUG("\n*** Starting sortedfile_write_and_read\n");
+    check_even_keys(false);
+    check_even_keys(true);
+}
+END_TEST
+
+/*
+ * Tests writing a tree of strings into a file, and reading an empty file and
+ * a file that is not a sorted file.
+ */
+START_TEST(sortedfile_treemap_and_invalid_files)
+{
+    DEBUG("\n*** Starting sortedfile_treemap_and_invalid_files\n");
+    static char *words[] = { "pear", "apple", "banana", "apricot", "peach", "plum", "cherry" };
+    size_t word_count = sizeof(words) / sizeof(words[0]);
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_comparator(libcoll_strcmp_wrapper);
+    for (size_t i=0; i<word_count; i++) {
+        libcoll_treemap_add(tree, words[i], words[(i + 1) % word_count]);
+    }
+    ck_assert(libcoll_sortedfile_write_treemap(tree, TEST_FILE_PATH, libcoll_sortedfile_str_bytes,
+                                               libcoll_sortedfile_str_bytes, 16, true));
+
+    libcoll_sortedfile_t *file = libcoll_sortedfile_open(TEST_FILE_PATH);
+    ck_assert_ptr_nonnull(file);
+    ck_assert_int_eq(libcoll_sortedfile_get_size(file), word_count);
+    size_t length;
+    for (size_t i=0; i<word_count; i++) {
+        const char *value = libcoll_sortedfile_get(file, words[i], strlen(words[i]) + 1, &length);
+        ck_assert_ptr_nonnull(value);
+        ck_assert_str_eq(value, words[(i + 1) % word_count]);
+    }
+    ck_assert(!libcoll_sortedfile_contains(file, "apple", 5));
+
+    libcoll_sortedfile_iter_t iter;
+    libcoll_treemap_iter_t tree_iter;
+    ck_assert(libcoll_sortedfile_init_iterator(&iter, file));
+    libcoll_treemap_init_iterator(&tree_iter, tree);
+    while (libcoll_treemap_has_next(&tree_iter)) {
+        ck_assert_str_eq(libcoll_sortedfile_next(&iter)->key, libcoll_treemap_next(&tree_iter)->key);
+    }
+    ck_assert(!libcoll_sortedfile_has_next(&iter));
+    libcoll_sortedfile_deinit_iterator(&iter);
+    libcoll_sortedfile_close(file);
+    libcoll_treemap_deinit(tree);
+
+    libcoll_sortedfile_writer_t *writer = libcoll_sortedfile_writer_open(TEST_FILE_PATH, 0, true);
+    ck_assert(libcoll_sortedfile_writer_close(writer));
+    file = libcoll_sortedfile_open(TEST_FILE_PATH);
+    ck_assert_ptr_nonnull(file);
+    ck_assert_int_eq(libcoll_sortedfile_get_size(file), 0);
+    ck_assert(!libcoll_sortedfile_contains(file, "", 0));
+    ck_assert(libcoll_sortedfile_init_iterator(&iter, file));
+    ck_assert(!libcoll_sortedfile_has_next(&iter));
+    libcoll_sortedfile_deinit_iterator(&iter);
+    libcoll_sortedfile_close(file);
+
+    /* an empty key may be given as NULL, and comes before all other keys */
+    writer = libcoll_sortedfile_writer_open(TEST_FILE_PATH, 0, false);
+    ck_assert(libcoll_sortedfile_writer_add(writer, NULL, 0, "empty", 6));
+    ck_assert(libcoll_sortedfile_writer_add(writer, "a", 1, NULL, 0));
+    ck_assert(!libcoll_sortedfile_writer_add(writer, NULL, 0, NULL, 0));
+    ck_assert(libcoll_sortedfile_writer_close(writer));
+    file = libcoll_sortedfile_open(TEST_FILE_PATH);
+    ck_assert_ptr_nonnull(file);
+    ck_assert_str_eq(libcoll_sortedfile_get(file, NULL, 0, &length), "empty");
+    ck_assert(libcoll_sortedfile_contains(file, "a", 1));
+    ck_assert(!libcoll_sortedfile_contains(file, "b", 1));
+    libcoll_sortedfile_close(file);
+
+    FILE *garbage = fopen(TEST_FILE_PATH, "wb");
+    ck_assert_ptr_nonnull(garbage);
+    for (int i=0; i<100; i++) {
+        fputs("not a sorted file ", garbage);
+    }
+    fclose(garbage);
+    ck_assert_ptr_null(libcoll_sortedfile_open(TEST_FILE_PATH));
+    remove(TEST_FILE_PATH);
+    ck_assert_ptr_null(libcoll_sortedfile_open(TEST_FILE_PATH));
+}
+END_TEST
+
+TCase* create_sortedfile_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("sortedfile_core");
+
+    tcase_add_test(tc_core, sortedfile_write_and_read);
+    tcase_add_test(tc_core, sortedfile_treemap_and_invalid_files);
+
+    return tc_core;
+}
@@ -26,6 +26,7 @@
  */
 
 #include <check.h>
+#include <stdio.h>
 
 #include "test_treemap.h"
 
@@ -96,6 +97,15 @@ START_TEST(treemap_create)
 
     ck_assert_ptr_nonnull(treemap);
     ck_assert_uint_eq(treemap->size, 0);
+    ck_assert(libcoll_treemap_is_null_node(treemap->root));
+
+    /* a lone node has null children and a null parent */
+    int key = 1;
+    libcoll_treemap_node_t *node = libcoll_treemap_add(treemap, &key, NULL);
+    ck_assert(!libcoll_treemap_is_null_node(node));
+    ck_assert(libcoll_treemap_is_null_node(node->left));
+    ck_assert(libcoll_treemap_is_null_node(node->right));
+    ck_assert(libcoll_treemap_is_null_node(node->parent));
 
     libcoll_treemap_deinit(treemap);
 }
@@ -173,6 +183,1091 @@ START_TEST(treemap_iterate)
     libcoll_treemap_free_iterator(iter);
 }
 
+/*
+ * Tests a treemap with slab allocation, removing and re-adding keys so that
+ * nodes get reused from the free list.
+ */
+START_TEST(treemap_slab_allocation)
+{
+    DEBUG("\n*** Starting treemap_slab_allocation\n");
+
+    static int keys[1000];
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_params(libcoll_intptrcmp,
+                                                              LIBCOLL_TREEMAP_ALLOC_SLAB);
+    for (int i=0; i<1000; i++) {
+        keys[i] = (i * 7919) % 1000;
+        ck_assert_ptr_nonnull(libcoll_treemap_add(tree, &keys[i], &keys[i]));
+    }
+    ck_assert_ptr_nonnull(tree->slabs);
+    ck_assert_ptr_nonnull(tree->slabs->next);
+
+    for (int i=0; i<1000; i+=2) {
+        libcoll_pair_voidptr_t removed = libcoll_treemap_remove(tree, &keys[i]);
+        ck_assert_int_eq(*(int*) removed.a, keys[i]);
+    }
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), 500);
+    ck_assert_ptr_nonnull(tree->free_nodes);
+
+    /* re-adding the removed keys takes all nodes from the free list */
+    libcoll_treemap_slab_t *last_slab = tree->slabs;
+    size_t slab_used = last_slab->used;
+    for (int i=0; i<1000; i+=2) {
+        ck_assert_ptr_nonnull(libcoll_treemap_add(tree, &keys[i], &keys[i]));
+    }
+    ck_assert_ptr_null(tree->free_nodes);
+    ck_assert_ptr_eq(tree->slabs, last_slab);
+    ck_assert_uint_eq(tree->slabs->used, slab_used);
+
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    for (int i=0; i<1000; i++) {
+        ck_assert_int_eq(*(int*) libcoll_treemap_get(tree, &i)->value, i);
+    }
+
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+/* even integers 0, 2, ..., 2 * (EVEN_KEY_COUNT - 1) inserted in scrambled order */
+#define EVEN_KEY_COUNT 500
+
+static int even_keys[EVEN_KEY_COUNT];
+
+static libcoll_treemap_t* create_even_key_treemap(void)
+{
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_comparator(libcoll_intptrcmp);
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        even_keys[i] = 2 * ((i * 7919) % EVEN_KEY_COUNT);
+        libcoll_treemap_add(tree, &even_keys[i], &even_keys[i]);
+    }
+    return tree;
+}
+
+static int key_of(libcoll_treemap_node_t *node)
+{
+    return NULL != node ? *(int*) node->key : -1000;
+}
+
+/*
+ * Tests the floor, ceiling and bound lookups and seeking an iterator, for keys
+ * both in the tree and between keys in the tree.
+ */
+START_TEST(treemap_bounds_and_seek)
+{
+    DEBUG("\n*** Starting treemap_bounds_and_seek\n");
+    libcoll_treemap_t *tree = create_even_key_treemap();
+    const int max_key = 2 * (EVEN_KEY_COUNT - 1);
+
+    for (int key=-1; key<=max_key+1; key++) {
+        int even_below = key % 2 == 0 ? key : key - 1;
+        int even_above = key % 2 == 0 ? key : key + 1;
+        int next_even = key % 2 == 0 ? key + 2 : key + 1;
+
+        ck_assert_int_eq(key_of(libcoll_treemap_floor(tree, &key)),
+                         even_below >= 0 ? even_below : -1000);
+        ck_assert_int_eq(key_of(libcoll_treemap_ceiling(tree, &key)),
+                         even_above <= max_key ? even_above : -1000);
+        ck_assert_int_eq(key_of(libcoll_treemap_lower_bound(tree, &key)),
+                         even_above <= max_key ? even_above : -1000);
+        ck_assert_int_eq(key_of(libcoll_treemap_upper_bound(tree, &key)),
+                         next_even <= max_key ? next_even : -1000);
+    }
+
+    int key = 101;
+    libcoll_treemap_iter_t *iter = libcoll_treemap_get_iterator_at(tree, &key);
+    ck_assert_int_eq(key_of(libcoll_treemap_next(iter)), 102);
+    ck_assert_int_eq(key_of(libcoll_treemap_next(iter)), 104);
+    ck_assert_int_eq(key_of(libcoll_treemap_previous(iter)), 104);
+    ck_assert_int_eq(key_of(libcoll_treemap_previous(iter)), 102);
+    ck_assert_int_eq(key_of(libcoll_treemap_previous(iter)), 100);
+    libcoll_treemap_free_iterator(iter);
+
+    key = max_key + 1;
+    iter = libcoll_treemap_get_iterator_at(tree, &key);
+    ck_assert(!libcoll_treemap_has_next(iter));
+    ck_assert_int_eq(key_of(libcoll_treemap_previous(iter)), max_key);
+    libcoll_treemap_free_iterator(iter);
+
+    /* removing a key that does not exist leaves the tree intact */
+    key = 101;
+    ck_assert_ptr_null(libcoll_treemap_remove(tree, &key).a);
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), EVEN_KEY_COUNT);
+
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests iterating over half-open key ranges in both directions, including
+ * empty ranges, and removing nodes through a range iterator.
+ */
+START_TEST(treemap_range_iteration)
+{
+    DEBUG("\n*** Starting treemap_range_iteration\n");
+    libcoll_treemap_t *tree = create_even_key_treemap();
+
+    int start = 99, end = 200;
+    libcoll_treemap_iter_t *iter = libcoll_treemap_get_range_iterator(tree, &start, &end);
+    ck_assert(!libcoll_treemap_has_previous(iter));
+    for (int expected=100; expected<200; expected+=2) {
+        ck_assert(libcoll_treemap_has_next(iter));
+        ck_assert_int_eq(key_of(libcoll_treemap_next(iter)), expected);
+    }
+    ck_assert(!libcoll_treemap_has_next(iter));
+    for (int expected=198; expected>=100; expected-=2) {
+        ck_assert(libcoll_treemap_has_previous(iter));
+        ck_assert_int_eq(key_of(libcoll_treemap_previous(iter)), expected);
+    }
+    ck_assert(!libcoll_treemap_has_previous(iter));
+
+    /* remove every key in the range while iterating forward */
+    while (libcoll_treemap_has_next(iter)) {
+        libcoll_treemap_next(iter);
+        libcoll_treemap_remove_last_traversed(iter);
+    }
+    libcoll_treemap_free_iterator(iter);
+
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), EVEN_KEY_COUNT - 50);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    ck_assert_int_eq(key_of(libcoll_treemap_ceiling(tree, &start)), 200);
+
+    /* empty and reversed ranges */
+    start = 100;
+    iter = libcoll_treemap_get_range_iterator(tree, &start, &end);
+    ck_assert(!libcoll_treemap_has_next(iter));
+    ck_assert(!libcoll_treemap_has_previous(iter));
+    libcoll_treemap_free_iterator(iter);
+
+    start = 500;
+    end = 10;
+    iter = libcoll_treemap_get_range_iterator(tree, &start, &end);
+    ck_assert(!libcoll_treemap_has_next(iter));
+    ck_assert(!libcoll_treemap_has_previous(iter));
+    libcoll_treemap_free_iterator(iter);
+
+    /* a range extending past the largest key */
+    start = 2 * EVEN_KEY_COUNT - 4;
+    end = 5000;
+    iter = libcoll_treemap_get_range_iterator(tree, &start, &end);
+    ck_assert_int_eq(key_of(libcoll_treemap_next(iter)), 2 * EVEN_KEY_COUNT - 4);
+    ck_assert_int_eq(key_of(libcoll_treemap_next(iter)), 2 * EVEN_KEY_COUNT - 2);
+    ck_assert(!libcoll_treemap_has_next(iter));
+    libcoll_treemap_free_iterator(iter);
+
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests rank, select and range counting, also after removing keys.
+ */
+START_TEST(treemap_order_statistics)
+{
+    DEBUG("\n*** Starting treemap_order_statistics\n");
+    libcoll_treemap_t *tree = create_even_key_treemap();
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        int key = 2 * i;
+        ck_assert_uint_eq(libcoll_treemap_rank(tree, &key), i);
+        key = 2 * i + 1;
+        ck_assert_uint_eq(libcoll_treemap_rank(tree, &key), i + 1);
+        ck_assert_int_eq(key_of(libcoll_treemap_select(tree, i)), 2 * i);
+    }
+    ck_assert_ptr_null(libcoll_treemap_select(tree, EVEN_KEY_COUNT));
+
+    int start = 10, end = 21;
+    ck_assert_uint_eq(libcoll_treemap_count_range(tree, &start, &end), 6);
+    ck_assert_uint_eq(libcoll_treemap_count_range(tree, &end, &start), 0);
+
+    /* remove the keys divisible by four */
+    for (int key=0; key<2*EVEN_KEY_COUNT; key+=4) {
+        libcoll_treemap_remove(tree, &key);
+    }
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    for (size_t i=0; i<libcoll_treemap_get_size(tree); i++) {
+        int key = key_of(libcoll_treemap_select(tree, i));
+        ck_assert_int_eq(key, 4 * (int) i + 2);
+        ck_assert_uint_eq(libcoll_treemap_rank(tree, &key), i);
+    }
+    ck_assert_uint_eq(libcoll_treemap_count_range(tree, &start, &end), 3);
+
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests building trees of various sizes from sorted input, including one
+ * large enough to be built and flattened using several threads when the tree
+ * allows it, and flattening them back into arrays.
+ */
+START_TEST(treemap_build_sorted_and_flatten)
+{
+    DEBUG("\n*** Starting treemap_build_sorted_and_flatten\n");
+
+    const size_t max_count = 200000;
+    int *keys = malloc(max_count * sizeof(int));
+    libcoll_pair_voidptr_t *pairs = malloc(max_count * sizeof(libcoll_pair_voidptr_t));
+    libcoll_pair_voidptr_t *flattened = malloc(max_count * sizeof(libcoll_pair_voidptr_t));
+    for (size_t i=0; i<max_count; i++) {
+        keys[i] = (int) i;
+        pairs[i].a = &keys[i];
+        pairs[i].b = &keys[i];
+    }
+
+    size_t counts[] = { 0, 1, 2, 3, 7, 8, 100, 1023, 1024, 1025, max_count };
+    for (size_t c=0; c<sizeof(counts)/sizeof(counts[0]); c++) {
+        size_t count = counts[c];
+        libcoll_treemap_t *tree = libcoll_treemap_init_with_comparator(libcoll_intptrcmp);
+        libcoll_treemap_set_parallel(tree, c % 2 == 0);
+
+        ck_assert(libcoll_treemap_build_sorted(tree, pairs, count));
+        ck_assert_uint_eq(libcoll_treemap_get_size(tree), count);
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+        for (size_t i=0; i<count; i+=97) {
+            ck_assert_ptr_eq(libcoll_treemap_get(tree, &keys[i])->value, &keys[i]);
+        }
+
+        ck_assert_uint_eq(libcoll_treemap_flatten(tree, flattened), count);
+        for (size_t i=0; i<count; i++) {
+            ck_assert_ptr_eq(flattened[i].a, &keys[i]);
+        }
+
+        /* the built tree works normally afterwards */
+        if (count > 2) {
+            libcoll_treemap_remove(tree, &keys[1]);
+            int key = -1;
+            libcoll_treemap_add(tree, &key, &key);
+            ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+        }
+        libcoll_treemap_deinit(tree);
+    }
+
+    /* a non-empty tree or unsorted input is refused */
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_params(libcoll_intptrcmp, LIBCOLL_TREEMAP_ALLOC_SLAB);
+    pairs[5].a = &keys[3];
+    ck_assert(!libcoll_treemap_build_sorted(tree, pairs, 10));
+    ck_assert(libcoll_treemap_is_empty(tree));
+    pairs[5].a = &keys[5];
+    ck_assert(libcoll_treemap_build_sorted(tree, pairs, 10));
+    ck_assert(!libcoll_treemap_build_sorted(tree, pairs, 10));
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    libcoll_treemap_deinit(tree);
+
+    free(keys);
+    free(pairs);
+    free(flattened);
+}
+END_TEST
+
+/* builds a tree of the keys among the first count keys that are multiples of step */
+static libcoll_treemap_t* create_multiples_treemap(int *keys, libcoll_pair_voidptr_t *pairs, size_t count,
+                                                   size_t step, libcoll_treemap_allocation allocation)
+{
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_params(libcoll_intptrcmp, allocation);
+    size_t n = 0;
+    for (size_t i=0; i<count; i+=step) {
+        pairs[n].a = &keys[i];
+        pairs[n].b = &keys[i];
+        n++;
+    }
+    if (LIBCOLL_TREEMAP_ALLOC_SLAB == allocation) {
+        for (size_t i=0; i<n; i++) {
+            libcoll_treemap_add(tree, pairs[i].a, pairs[i].b);
+        }
+    } else {
+        libcoll_treemap_build_sorted(tree, pairs, n);
+    }
+    return tree;
+}
+
+/* checks that the tree holds exactly the first count keys matching the predicate */
+static void assert_treemap_keys(libcoll_treemap_t *tree, int *keys, libcoll_pair_voidptr_t *flattened,
+                                size_t count, bool (*included)(size_t))
+{
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    size_t size = libcoll_treemap_flatten(tree, flattened);
+    size_t n = 0;
+    for (size_t i=0; i<count; i++) {
+        if (included(i)) {
+            ck_assert_uint_lt(n, size);
+            ck_assert_ptr_eq(flattened[n++].a, &keys[i]);
+        }
+    }
+    ck_assert_uint_eq(n, size);
+}
+
+static bool is_union(size_t i)         { return i % 2 == 0 || i % 3 == 0; }
+static bool is_intersection(size_t i)  { return i % 6 == 0; }
+static bool is_difference(size_t i)    { return i % 2 == 0 && i % 3 != 0; }
+
+START_TEST(treemap_split_join_and_set_operations)
+{
+    DEBUG("\n*** Starting treemap_split_join_and_set_operations\n");
+
+    const size_t max_count = 300000;
+    int *keys = malloc(max_count * sizeof(int));
+    libcoll_pair_voidptr_t *pairs = malloc(max_count * sizeof(libcoll_pair_voidptr_t));
+    for (size_t i=0; i<max_count; i++) {
+        keys[i] = (int) i;
+    }
+
+    /* splitting at every position and joining back */
+    const size_t split_count = 300;
+    for (size_t at=0; at<=split_count; at+=7) {
+        libcoll_treemap_t *tree = create_multiples_treemap(keys, pairs, split_count, 1,
+                                                           LIBCOLL_TREEMAP_ALLOC_MALLOC);
+        libcoll_treemap_t *upper = libcoll_treemap_split(tree, &keys[at]);
+        ck_assert_ptr_ne(upper, NULL);
+        ck_assert_uint_eq(libcoll_treemap_get_size(tree), at);
+        ck_assert_uint_eq(libcoll_treemap_get_size(upper), split_count - at);
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(upper));
+        if (at > 0 && at < split_count) {
+            ck_assert_ptr_eq(libcoll_treemap_select(tree, at - 1)->key, &keys[at - 1]);
+            ck_assert_ptr_eq(libcoll_treemap_select(upper, 0)->key, &keys[at]);
+            /* overlapping trees can't be joined */
+            ck_assert(!libcoll_treemap_join(upper, tree));
+        }
+
+        ck_assert(libcoll_treemap_join(tree, upper));
+        ck_assert(libcoll_treemap_is_empty(upper));
+        ck_assert_uint_eq(libcoll_treemap_get_size(tree), split_count);
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+        libcoll_treemap_deinit(upper);
+        libcoll_treemap_deinit(tree);
+    }
+
+    /* set operations on small and on large trees, where the work is parallel
+     * if the tree allows it
+     */
+    size_t counts[] = { 1000, max_count };
+    bool (*expected[])(size_t) = { is_union, is_intersection, is_difference };
+    bool (*operations[])(libcoll_treemap_t*, libcoll_treemap_t*) = {
+        libcoll_treemap_union, libcoll_treemap_intersection, libcoll_treemap_difference
+    };
+    libcoll_pair_voidptr_t *flattened = malloc(max_count * sizeof(libcoll_pair_voidptr_t));
+    for (size_t c=0; c<sizeof(counts)/sizeof(counts[0]); c++) {
+        for (int op=0; op<3; op++) {
+            libcoll_treemap_allocation allocation = c == 0 && op == 0
+                                                   ? LIBCOLL_TREEMAP_ALLOC_SLAB
+                                                   : LIBCOLL_TREEMAP_ALLOC_MALLOC;
+            libcoll_treemap_t *tree = create_multiples_treemap(keys, pairs, counts[c], 2, allocation);
+            libcoll_treemap_t *other = create_multiples_treemap(keys, pairs, counts[c], 3, allocation);
+            libcoll_treemap_set_parallel(tree, op != 2);
+
+            ck_assert(operations[op](tree, other));
+            ck_assert(libcoll_treemap_is_empty(other));
+            assert_treemap_keys(tree, keys, flattened, counts[c], expected[op]);
+
+            libcoll_treemap_deinit(other);
+            libcoll_treemap_deinit(tree);
+        }
+    }
+
+    /* trees with different allocation strategies are refused */
+    libcoll_treemap_t *tree = create_multiples_treemap(keys, pairs, 10, 1, LIBCOLL_TREEMAP_ALLOC_SLAB);
+    libcoll_treemap_t *other = create_multiples_treemap(keys, pairs, 10, 1, LIBCOLL_TREEMAP_ALLOC_MALLOC);
+    ck_assert(!libcoll_treemap_union(tree, other));
+    ck_assert_ptr_eq(libcoll_treemap_split(tree, &keys[5]), NULL);
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), 10);
+    libcoll_treemap_deinit(other);
+
+    /* and so is a tree combined with itself, which is left as it was */
+    ck_assert(!libcoll_treemap_union(tree, tree));
+    ck_assert(!libcoll_treemap_intersection(tree, tree));
+    ck_assert(!libcoll_treemap_difference(tree, tree));
+    ck_assert(!libcoll_treemap_join(tree, tree));
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), 10);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    libcoll_treemap_deinit(tree);
+
+    free(keys);
+    free(pairs);
+    free(flattened);
+}
+END_TEST
+
+
+/*
+ * Tests that the in-order links of a threaded tree stay consistent through
+ * all kinds of modifications, and iterating using iterators initialized in
+ * place.
+ */
+START_TEST(treemap_threaded_iteration)
+{
+    DEBUG("\n*** Starting treemap_threaded_iteration\n");
+    libcoll_treemap_t *tree = create_even_key_treemap();
+    libcoll_treemap_set_threaded(tree, true);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    static int odd_keys[EVEN_KEY_COUNT];
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        odd_keys[i] = 2 * ((i * 7919) % EVEN_KEY_COUNT) + 1;
+        libcoll_treemap_add(tree, &odd_keys[i], &odd_keys[i]);
+    }
+    for (int i=0; i<EVEN_KEY_COUNT; i+=3) {
+        libcoll_treemap_remove(tree, &even_keys[i]);
+    }
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    libcoll_treemap_iter_t iter;
+    libcoll_treemap_init_iterator(&iter, tree);
+    int previous = -1;
+    size_t count = 0;
+    while (libcoll_treemap_has_next(&iter)) {
+        int key = key_of(libcoll_treemap_next(&iter));
+        ck_assert_int_gt(key, previous);
+        previous = key;
+        count++;
+    }
+    ck_assert_uint_eq(count, libcoll_treemap_get_size(tree));
+
+    int start = 100, end = 200;
+    libcoll_treemap_init_range_iterator(&iter, tree, &start, &end);
+    count = 0;
+    while (libcoll_treemap_has_next(&iter)) {
+        int key = key_of(libcoll_treemap_next(&iter));
+        ck_assert(key >= start && key < end);
+        count++;
+    }
+    ck_assert_uint_eq(count, libcoll_treemap_count_range(tree, &start, &end));
+    while (libcoll_treemap_has_previous(&iter)) {
+        libcoll_treemap_previous(&iter);
+        count--;
+    }
+    ck_assert_uint_eq(count, 0);
+
+    /* removing through an iterator, splitting and joining */
+    int middle = 501;
+    libcoll_treemap_init_iterator_at(&iter, tree, &middle);
+    ck_assert_int_eq(key_of(libcoll_treemap_next(&iter)), 501);
+    libcoll_treemap_remove_last_traversed(&iter);
+    ck_assert_int_gt(key_of(libcoll_treemap_next(&iter)), 501);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    libcoll_treemap_t *upper = libcoll_treemap_split(tree, &middle);
+    ck_assert(upper->threaded);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(upper));
+    ck_assert(libcoll_treemap_join(tree, upper));
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    libcoll_treemap_deinit(upper);
+
+    /* set operations need both trees in the same mode */
+    libcoll_treemap_t *other = libcoll_treemap_init_with_comparator(libcoll_intptrcmp);
+    libcoll_pair_voidptr_t pairs[] = { { &even_keys[0], NULL }, { &odd_keys[0], NULL } };
+    if (even_keys[0] > odd_keys[0]) {
+        pairs[0].a = &odd_keys[0];
+        pairs[1].a = &even_keys[0];
+    }
+    ck_assert(libcoll_treemap_build_sorted(other, pairs, 2));
+    ck_assert(!libcoll_treemap_union(tree, other));
+    libcoll_treemap_set_threaded(other, true);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(other));
+    size_t size = libcoll_treemap_get_size(tree);
+    ck_assert(libcoll_treemap_union(tree, other));
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), size + 1);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    libcoll_treemap_deinit(other);
+
+    libcoll_treemap_set_threaded(tree, false);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests searching and iterating a frozen copy of a tree, with ordinal keys,
+ * string keys and keys compared with a custom comparator, and with sizes
+ * that fill the last level of the layout partially.
+ */
+START_TEST(treemap_freeze)
+{
+    DEBUG("\n*** Starting treemap_freeze\n");
+    libcoll_treemap_t *tree = create_even_key_treemap();
+    libcoll_treemap_frozen_t *frozen = libcoll_treemap_freeze(tree);
+    const int max_key = 2 * (EVEN_KEY_COUNT - 1);
+    ck_assert_uint_eq(libcoll_treemap_frozen_get_size(frozen), EVEN_KEY_COUNT);
+
+    for (int key=-1; key<=max_key+1; key++) {
+        libcoll_treemap_node_t *node = libcoll_treemap_lower_bound(tree, &key);
+        libcoll_pair_voidptr_t pair = libcoll_treemap_frozen_lower_bound(frozen, &key);
+        ck_assert_ptr_eq(pair.a, NULL != node ? node->key : NULL);
+        ck_assert_ptr_eq(libcoll_treemap_frozen_get(frozen, &key), key % 2 == 0 && key >= 0 && key <= max_key
+                                                                   ? libcoll_treemap_get(tree, &key)->value : NULL);
+        ck_assert(libcoll_treemap_frozen_contains(frozen, &key) == libcoll_treemap_contains(tree, &key));
+    }
+
+    libcoll_treemap_frozen_iter_t iter;
+    libcoll_treemap_frozen_init_iterator(&iter, frozen);
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        ck_assert(libcoll_treemap_frozen_has_next(&iter));
+        ck_assert_int_eq(*(int*) libcoll_treemap_frozen_next(&iter).a, 2 * i);
+    }
+    ck_assert(!libcoll_treemap_frozen_has_next(&iter));
+    ck_assert_ptr_null(libcoll_treemap_frozen_next(&iter).a);
+
+    int key = 101;
+    libcoll_treemap_frozen_init_iterator_at(&iter, frozen, &key);
+    ck_assert_int_eq(*(int*) libcoll_treemap_frozen_next(&iter).a, 102);
+    ck_assert_int_eq(*(int*) libcoll_treemap_frozen_next(&iter).a, 104);
+
+    /* the frozen copy does not see later changes */
+    libcoll_treemap_remove(tree, &key);
+    key = 100;
+    libcoll_treemap_remove(tree, &key);
+    ck_assert(libcoll_treemap_frozen_contains(frozen, &key));
+    libcoll_treemap_frozen_deinit(frozen);
+    libcoll_treemap_deinit(tree);
+
+    frozen = libcoll_treemap_freeze(string_counts);
+    libcoll_treemap_frozen_init_iterator(&iter, frozen);
+    char *previous = "";
+    while (libcoll_treemap_frozen_has_next(&iter)) {
+        libcoll_pair_voidptr_t pair = libcoll_treemap_frozen_next(&iter);
+        ck_assert_int_lt(strcmp(previous, pair.a), 0);
+        ck_assert_ptr_eq(pair.b, libcoll_treemap_frozen_get(frozen, pair.a));
+        previous = pair.a;
+    }
+    ck_assert_ptr_null(libcoll_treemap_frozen_get(frozen, "bas"));
+    ck_assert_str_eq(libcoll_treemap_frozen_lower_bound(frozen, "bas").a, "foo");
+    libcoll_treemap_frozen_deinit(frozen);
+
+    static char names[40][4];
+    static libcoll_bytes_t bytes_keys[40];
+    for (int i=0; i<40; i++) {
+        sprintf(names[i], "k%02d", i);
+        bytes_keys[i].data = names[i];
+        bytes_keys[i].length = 3;
+    }
+    for (int size=0; size<=40; size++) {
+        tree = libcoll_treemap_init_with_comparator(libcoll_bytescmp);
+        for (int i=size-1; i>=0; i--) {
+            libcoll_treemap_add(tree, &bytes_keys[i], names[i]);
+        }
+        frozen = libcoll_treemap_freeze(tree);
+        ck_assert_ptr_null(frozen->ordinals);
+
+        libcoll_treemap_frozen_init_iterator(&iter, frozen);
+        for (int i=0; i<size; i++) {
+            ck_assert_ptr_eq(libcoll_treemap_frozen_next(&iter).b, names[i]);
+            ck_assert_ptr_eq(libcoll_treemap_frozen_get(frozen, &bytes_keys[i]), names[i]);
+        }
+        ck_assert(!libcoll_treemap_frozen_has_next(&iter));
+
+        libcoll_bytes_t past_end = { "k99", 3 };
+        ck_assert_ptr_null(libcoll_treemap_frozen_lower_bound(frozen, &past_end).a);
+        libcoll_treemap_frozen_deinit(frozen);
+        libcoll_treemap_deinit(tree);
+    }
+}
+END_TEST
+
+static libcoll_treemap_aggregate_t value_of_entry(const void *key, const void *value)
+{
+    libcoll_treemap_aggregate_t aggregate;
+    (void) key;
+    aggregate.integer = *(const int*) value;
+    return aggregate;
+}
+
+static libcoll_treemap_aggregate_t sum(libcoll_treemap_aggregate_t left, libcoll_treemap_aggregate_t right)
+{
+    libcoll_treemap_aggregate_t aggregate;
+    aggregate.integer = left.integer + right.integer;
+    return aggregate;
+}
+
+static libcoll_treemap_aggregate_t key_of_entry(const void *key, const void *value)
+{
+    libcoll_treemap_aggregate_t aggregate;
+    (void) value;
+    aggregate.pointer = (void*) key;
+    return aggregate;
+}
+
+/* not commutative, so that combining in the wrong order gets noticed */
+static libcoll_treemap_aggregate_t leftmost(libcoll_treemap_aggregate_t left, libcoll_treemap_aggregate_t right)
+{
+    return NULL != left.pointer ? left : right;
+}
+
+static const libcoll_treemap_monoid_t sum_of_values = { { 0 }, value_of_entry, sum };
+static const libcoll_treemap_monoid_t first_key = { { 0 }, key_of_entry, leftmost };
+
+/* sums the values in [start, end) by iterating */
+static long long sum_range(libcoll_treemap_t *tree, int start, int end)
+{
+    long long total = 0;
+    libcoll_treemap_iter_t iter;
+    libcoll_treemap_init_range_iterator(&iter, tree, &start, &end);
+    while (libcoll_treemap_has_next(&iter)) {
+        total += *(int*) libcoll_treemap_next(&iter)->value;
+    }
+    return total;
+}
+
+/*
+ * Tests that aggregates stay consistent through modifications of the tree,
+ * and that range aggregates match those computed by iterating.
+ */
+START_TEST(treemap_aggregates)
+{
+    DEBUG("\n*** Starting treemap_aggregates\n");
+    libcoll_treemap_t *tree = create_even_key_treemap();
+    const int max_key = 2 * (EVEN_KEY_COUNT - 1);
+    libcoll_treemap_set_monoid(tree, &sum_of_values);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    for (int start=-3; start<=max_key+3; start+=7) {
+        for (int end=start-2; end<=max_key+3; end+=13) {
+            int start_key = start, end_key = end;
+            ck_assert_int_eq(libcoll_treemap_aggregate_range(tree, &start_key, &end_key).integer,
+                             sum_range(tree, start, end));
+        }
+    }
+
+    static int odd_keys[EVEN_KEY_COUNT];
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        odd_keys[i] = 2 * i + 1;
+        libcoll_treemap_add(tree, &odd_keys[i], &odd_keys[i]);
+    }
+    for (int i=0; i<EVEN_KEY_COUNT; i+=3) {
+        libcoll_treemap_remove(tree, &even_keys[i]);
+    }
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    int start = 100, end = 301;
+    ck_assert_int_eq(libcoll_treemap_aggregate_range(tree, &start, &end).integer, sum_range(tree, start, end));
+    static int replacement = 1000000;
+    libcoll_treemap_set_value(tree, libcoll_treemap_get(tree, &odd_keys[100]), &replacement);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    ck_assert_int_eq(libcoll_treemap_aggregate_range(tree, &start, &end).integer, sum_range(tree, start, end));
+
+    /* split, join and set operations keep the aggregates */
+    libcoll_treemap_t *upper = libcoll_treemap_split(tree, &odd_keys[EVEN_KEY_COUNT / 2]);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(upper));
+    ck_assert(libcoll_treemap_join(tree, upper));
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    libcoll_pair_voidptr_t pairs[EVEN_KEY_COUNT];
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        pairs[i].a = &odd_keys[i];
+        pairs[i].b = &odd_keys[i];
+    }
+    ck_assert_ptr_eq(upper->monoid, &sum_of_values);
+    libcoll_treemap_set_monoid(upper, NULL);
+    libcoll_treemap_build_sorted(upper, pairs, EVEN_KEY_COUNT);
+    ck_assert(!libcoll_treemap_difference(tree, upper));
+    libcoll_treemap_set_monoid(upper, &sum_of_values);
+    ck_assert(libcoll_treemap_difference(tree, upper));
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    ck_assert_int_eq(libcoll_treemap_aggregate_range(tree, &start, &end).integer, sum_range(tree, start, end));
+    libcoll_treemap_deinit(upper);
+
+    /* combining in key order */
+    libcoll_treemap_set_monoid(tree, &first_key);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    for (int key=0; key<max_key; key+=5) {
+        start = key;
+        end = key + 10;
+        libcoll_treemap_node_t *first = libcoll_treemap_lower_bound(tree, &start);
+        void *expected = NULL != first && *(int*) first->key < end ? first->key : NULL;
+        ck_assert_ptr_eq(libcoll_treemap_aggregate_range(tree, &start, &end).pointer, expected);
+    }
+
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+static size_t comparisons;
+
+static int counting_intcmp(const void *key1, const void *key2)
+{
+    comparisons++;
+    return libcoll_intptrcmp(key1, key2);
+}
+
+/*
+ * Tests adding keys with hints: in increasing and decreasing order using the
+ * previously added node, appending without a hint, and with hints far from
+ * the keys.
+ */
+START_TEST(treemap_add_hint)
+{
+    DEBUG("\n*** Starting treemap_add_hint\n");
+    static int keys[3 * EVEN_KEY_COUNT];
+    for (int i=0; i<3*EVEN_KEY_COUNT; i++) {
+        keys[i] = i;
+    }
+
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_comparator(counting_intcmp);
+    libcoll_treemap_set_threaded(tree, true);
+    libcoll_treemap_set_monoid(tree, &sum_of_values);
+    comparisons = 0;
+    libcoll_treemap_node_t *hint = NULL;
+    for (int i=EVEN_KEY_COUNT; i<2*EVEN_KEY_COUNT; i++) {
+        hint = libcoll_treemap_add_hint(tree, hint, &keys[i], &keys[i]);
+        ck_assert_ptr_nonnull(hint);
+    }
+    ck_assert_uint_le(comparisons, 2 * EVEN_KEY_COUNT);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    comparisons = 0;
+    for (int i=EVEN_KEY_COUNT-1; i>=0; i--) {
+        hint = libcoll_treemap_add_hint(tree, hint, &keys[i], &keys[i]);
+        ck_assert_ptr_nonnull(hint);
+    }
+    ck_assert_uint_le(comparisons, 3 * EVEN_KEY_COUNT);
+
+    comparisons = 0;
+    for (int i=2*EVEN_KEY_COUNT; i<3*EVEN_KEY_COUNT; i++) {
+        ck_assert_ptr_nonnull(libcoll_treemap_add_hint(tree, NULL, &keys[i], &keys[i]));
+    }
+    ck_assert_uint_eq(comparisons, EVEN_KEY_COUNT);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+    /* duplicates are rejected, whether next to the hint or not */
+    libcoll_treemap_node_t *first = libcoll_treemap_select(tree, 0);
+    ck_assert_ptr_null(libcoll_treemap_add_hint(tree, first, &keys[0], NULL));
+    ck_assert_ptr_null(libcoll_treemap_add_hint(tree, first, &keys[1], NULL));
+    ck_assert_ptr_null(libcoll_treemap_add_hint(tree, first, &keys[1000], NULL));
+    ck_assert_ptr_null(libcoll_treemap_add_hint(tree, NULL, &keys[0], NULL));
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), 3 * EVEN_KEY_COUNT);
+    libcoll_treemap_deinit(tree);
+
+    /* hints far from the keys */
+    tree = create_even_key_treemap();
+    static int odd_keys[EVEN_KEY_COUNT];
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        odd_keys[i] = 2 * ((i * 7919) % EVEN_KEY_COUNT) + 1;
+        libcoll_treemap_node_t *far = libcoll_treemap_select(tree, (size_t) (i * 31) % libcoll_treemap_get_size(tree));
+        ck_assert_ptr_nonnull(libcoll_treemap_add_hint(tree, far, &odd_keys[i], &odd_keys[i]));
+    }
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    libcoll_treemap_iter_t iter;
+    libcoll_treemap_init_iterator(&iter, tree);
+    for (int key=0; key<2*EVEN_KEY_COUNT; key++) {
+        ck_assert_int_eq(key_of(libcoll_treemap_next(&iter)), key);
+    }
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests the splay and treap balancing policies with additions, removals,
+ * lookups, threading and aggregates, checks that a splayed key ends up at the
+ * root, and builds a treap from sorted pairs.
+ */
+START_TEST(treemap_balancing_policies)
+{
+    DEBUG("\n*** Starting treemap_balancing_policies\n");
+    static int keys[2 * EVEN_KEY_COUNT];
+    for (int i=0; i<2*EVEN_KEY_COUNT; i++) {
+        keys[i] = (i * 7919) % (2 * EVEN_KEY_COUNT);
+    }
+    const libcoll_treemap_balancing policies[] = { LIBCOLL_TREEMAP_BALANCE_SPLAY, LIBCOLL_TREEMAP_BALANCE_TREAP };
+
+    for (int p=0; p<2; p++) {
+        libcoll_treemap_t *tree = libcoll_treemap_init_with_params(libcoll_intptrcmp,
+                                                                   0 == p ? LIBCOLL_TREEMAP_ALLOC_MALLOC
+                                                                          : LIBCOLL_TREEMAP_ALLOC_SLAB);
+        ck_assert(libcoll_treemap_set_balancing(tree, policies[p]));
+        libcoll_treemap_set_threaded(tree, true);
+        libcoll_treemap_set_monoid(tree, &sum_of_values);
+        for (int i=0; i<2*EVEN_KEY_COUNT; i++) {
+            ck_assert_ptr_nonnull(libcoll_treemap_add(tree, &keys[i], &keys[i]));
+        }
+        ck_assert_ptr_null(libcoll_treemap_add(tree, &keys[0], &keys[0]));
+        ck_assert(!libcoll_treemap_set_balancing(tree, LIBCOLL_TREEMAP_BALANCE_RED_BLACK));
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+        for (int i=0; i<2*EVEN_KEY_COUNT; i++) {
+            if (1 == keys[i] % 2) {
+                ck_assert_ptr_eq(libcoll_treemap_remove(tree, &keys[i]).a, &keys[i]);
+            }
+        }
+        int missing = 1;
+        ck_assert_ptr_null(libcoll_treemap_remove(tree, &missing).a);
+        ck_assert_uint_eq(libcoll_treemap_get_size(tree), EVEN_KEY_COUNT);
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+
+        for (int key=0; key<2*EVEN_KEY_COUNT; key++) {
+            ck_assert(libcoll_treemap_contains(tree, &key) == (0 == key % 2));
+        }
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+        libcoll_treemap_iter_t iter;
+        libcoll_treemap_init_iterator(&iter, tree);
+        for (int key=0; key<2*EVEN_KEY_COUNT; key+=2) {
+            ck_assert_int_eq(key_of(libcoll_treemap_next(&iter)), key);
+        }
+        ck_assert(!libcoll_treemap_has_next(&iter));
+
+        int start = 101, end = 733;
+        ck_assert_int_eq(libcoll_treemap_aggregate_range(tree, &start, &end).integer,
+                         sum_range(tree, start, end));
+
+        /* the bulk operations need red-black trees */
+        ck_assert_ptr_null(libcoll_treemap_split(tree, &start));
+        libcoll_treemap_t *other = libcoll_treemap_init_with_params(libcoll_intptrcmp, tree->allocation);
+        libcoll_treemap_set_threaded(other, true);
+        libcoll_treemap_set_monoid(other, &sum_of_values);
+        ck_assert(!libcoll_treemap_union(tree, other));
+        libcoll_treemap_deinit(other);
+        libcoll_treemap_deinit(tree);
+    }
+
+    /* a key looked up in a splay tree moves to the root */
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_comparator(libcoll_intptrcmp);
+    libcoll_treemap_set_balancing(tree, LIBCOLL_TREEMAP_BALANCE_SPLAY);
+    for (int i=0; i<2*EVEN_KEY_COUNT; i++) {
+        libcoll_treemap_add(tree, &keys[i], &keys[i]);
+    }
+    int hot = 123;
+    ck_assert_ptr_nonnull(libcoll_treemap_get(tree, &hot));
+    ck_assert_int_eq(libcoll_treemap_depth_of(tree, &hot), 0);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    libcoll_treemap_deinit(tree);
+
+    /* a treap built from sorted pairs */
+    libcoll_pair_voidptr_t pairs[2 * EVEN_KEY_COUNT];
+    static int sorted_keys[2 * EVEN_KEY_COUNT];
+    for (int i=0; i<2*EVEN_KEY_COUNT; i++) {
+        sorted_keys[i] = i;
+        pairs[i].a = &sorted_keys[i];
+        pairs[i].b = &sorted_keys[i];
+    }
+    tree = libcoll_treemap_init_with_comparator(libcoll_intptrcmp);
+    libcoll_treemap_set_balancing(tree, LIBCOLL_TREEMAP_BALANCE_TREAP);
+    libcoll_treemap_set_monoid(tree, &sum_of_values);
+    ck_assert(libcoll_treemap_build_sorted(tree, pairs, 2 * EVEN_KEY_COUNT));
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), 2 * EVEN_KEY_COUNT);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    for (int i=0; i<2*EVEN_KEY_COUNT; i+=3) {
+        libcoll_treemap_remove(tree, &sorted_keys[i]);
+    }
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    ck_assert_int_eq(libcoll_treemap_aggregate_range(tree, &sorted_keys[10], &sorted_keys[900]).integer,
+                     sum_range(tree, 10, 900));
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests threading, aggregating and flattening a splay tree made as deep as it
+ * is large by adding sorted keys, which must not need stack space in
+ * proportion to the depth.
+ */
+START_TEST(treemap_deep_splay_tree)
+{
+    DEBUG("\n*** Starting treemap_deep_splay_tree\n");
+    const int count = 1000000;
+    int *keys = malloc(count * sizeof(int));
+    libcoll_pair_voidptr_t *pairs = malloc(count * sizeof(libcoll_pair_voidptr_t));
+    ck_assert_ptr_nonnull(keys);
+    ck_assert_ptr_nonnull(pairs);
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_comparator(libcoll_intptrcmp);
+    libcoll_treemap_set_balancing(tree, LIBCOLL_TREEMAP_BALANCE_SPLAY);
+    for (int i=0; i<count; i++) {
+        keys[i] = i;
+        libcoll_treemap_add(tree, &keys[i], &keys[i]);
+    }
+
+    libcoll_treemap_set_threaded(tree, true);
+    libcoll_treemap_node_t *node = libcoll_treemap_get(tree, &keys[0]);
+    for (int i=0; i<count; i++) {
+        ck_assert_ptr_eq(node->key, &keys[i]);
+        node = libcoll_treemap_get_successor(node);
+    }
+    ck_assert_ptr_null(node);
+
+    libcoll_treemap_set_monoid(tree, &sum_of_values);
+    ck_assert(libcoll_treemap_aggregate_range(tree, &keys[0], &keys[count - 1]).integer
+              == (long long) (count - 1) * (count - 2) / 2);
+
+    ck_assert_uint_eq(libcoll_treemap_flatten(tree, pairs), count);
+    for (int i=0; i<count; i++) {
+        ck_assert_ptr_eq(pairs[i].a, &keys[i]);
+    }
+
+    libcoll_treemap_set_threaded(tree, false);
+    libcoll_treemap_deinit(tree);
+    free(pairs);
+    free(keys);
+}
+END_TEST
+
+/*
+ * Tests adding batches of keys, with keys already in the tree and repeated
+ * keys within the batch, into red-black trees using both allocation
+ * strategies and into threaded and treap trees.
+ */
+START_TEST(treemap_add_batch)
+{
+    DEBUG("\n*** Starting treemap_add_batch\n");
+    static int odd_keys[EVEN_KEY_COUNT];
+    static int values[2];
+    libcoll_pair_voidptr_t pairs[2 * EVEN_KEY_COUNT + 1];
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        odd_keys[i] = 2 * ((i * 7919) % EVEN_KEY_COUNT) + 1;
+        pairs[2*i].a = &odd_keys[i];
+        pairs[2*i].b = &values[0];
+        /* every fifth key is repeated, other even keys are already in the tree */
+        pairs[2*i+1].a = 0 == i % 5 ? (void*) &odd_keys[i] : (void*) &even_keys[i];
+        pairs[2*i+1].b = &values[1];
+    }
+
+    for (int variant=0; variant<4; variant++) {
+        libcoll_treemap_t *tree = create_even_key_treemap();
+        libcoll_treemap_t *batch_tree = libcoll_treemap_init_with_params(libcoll_intptrcmp,
+                                                                         1 == variant ? LIBCOLL_TREEMAP_ALLOC_SLAB
+                                                                                      : LIBCOLL_TREEMAP_ALLOC_MALLOC);
+        if (2 == variant) {
+            libcoll_treemap_set_threaded(batch_tree, true);
+        } else if (3 == variant) {
+            libcoll_treemap_set_balancing(batch_tree, LIBCOLL_TREEMAP_BALANCE_TREAP);
+        }
+        libcoll_treemap_set_monoid(batch_tree, &sum_of_values);
+        libcoll_treemap_iter_t iter;
+        libcoll_treemap_init_iterator(&iter, tree);
+        while (libcoll_treemap_has_next(&iter)) {
+            libcoll_treemap_node_t *node = libcoll_treemap_next(&iter);
+            libcoll_treemap_add(batch_tree, node->key, node->value);
+        }
+        libcoll_treemap_deinit(tree);
+
+        ck_assert(libcoll_treemap_add_batch(batch_tree, pairs, 0));
+        ck_assert(libcoll_treemap_add_batch(batch_tree, pairs, 2 * EVEN_KEY_COUNT));
+        ck_assert_uint_eq(libcoll_treemap_get_size(batch_tree), 2 * EVEN_KEY_COUNT);
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(batch_tree));
+
+        libcoll_treemap_init_iterator(&iter, batch_tree);
+        for (int key=0; key<2*EVEN_KEY_COUNT; key++) {
+            libcoll_treemap_node_t *node = libcoll_treemap_next(&iter);
+            ck_assert_int_eq(key_of(node), key);
+            ck_assert_ptr_eq(node->value, 0 == key % 2 ? node->key : &values[0]);
+        }
+        int start = 0, end = 2 * EVEN_KEY_COUNT;
+        ck_assert_int_eq(libcoll_treemap_aggregate_range(batch_tree, &start, &end).integer,
+                         sum_range(batch_tree, start, end));
+
+        /* a batch of keys all in the tree changes nothing */
+        ck_assert(libcoll_treemap_add_batch(batch_tree, pairs, EVEN_KEY_COUNT));
+        ck_assert_uint_eq(libcoll_treemap_get_size(batch_tree), 2 * EVEN_KEY_COUNT);
+        ck_assert(_libcoll_treemap_verify_red_black_conditions(batch_tree));
+        libcoll_treemap_deinit(batch_tree);
+    }
+
+    /* a batch sorted in advance is checked for order in one pass */
+    static int keys[EVEN_KEY_COUNT];
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        keys[i] = i;
+        pairs[i].a = &keys[i];
+        pairs[i].b = &keys[i];
+    }
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_comparator(counting_intcmp);
+    comparisons = 0;
+    ck_assert(libcoll_treemap_add_batch(tree, pairs, EVEN_KEY_COUNT));
+    ck_assert_uint_le(comparisons, 3 * EVEN_KEY_COUNT);
+    ck_assert_uint_eq(libcoll_treemap_get_size(tree), EVEN_KEY_COUNT);
+    ck_assert(_libcoll_treemap_verify_red_black_conditions(tree));
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+/*
+ * Tests the statistics on the shape and memory use of trees, and checks the
+ * operation counters if the library keeps them.
+ */
+START_TEST(treemap_stats)
+{
+    DEBUG("\n*** Starting treemap_stats\n");
+    libcoll_treemap_stats_t stats;
+    libcoll_treemap_t *tree = libcoll_treemap_init_with_comparator(counting_intcmp);
+    libcoll_treemap_get_stats(tree, &stats);
+    ck_assert_uint_eq(stats.size, 0);
+    ck_assert_int_eq(stats.height, 0);
+    ck_assert_uint_eq(stats.node_memory, 0);
+
+    static int keys[7];
+    libcoll_pair_voidptr_t pairs[7];
+    for (int i=0; i<7; i++) {
+        keys[i] = i;
+        pairs[i].a = pairs[i].b = &keys[i];
+    }
+    libcoll_treemap_build_sorted(tree, pairs, 7);
+    libcoll_treemap_get_stats(tree, &stats);
+    ck_assert_int_eq(stats.height, 3);
+    ck_assert_int_eq(stats.black_height, 2);
+    ck_assert_uint_eq(stats.depth_counts[0], 1);
+    ck_assert_uint_eq(stats.depth_counts[1], 2);
+    ck_assert_uint_eq(stats.depth_counts[2], 4);
+    ck_assert(stats.average_depth > 1.42 && stats.average_depth < 1.43);
+    ck_assert_uint_eq(stats.node_memory, 7 * stats.node_size);
+    libcoll_treemap_deinit(tree);
+
+    tree = create_even_key_treemap();
+    libcoll_treemap_reset_counters(tree);
+    static int odd_keys[EVEN_KEY_COUNT];
+    for (int i=0; i<EVEN_KEY_COUNT; i++) {
+        odd_keys[i] = 2 * i + 1;
+        libcoll_treemap_add(tree, &odd_keys[i], &odd_keys[i]);
+    }
+    for (int i=0; i<EVEN_KEY_COUNT; i+=2) {
+        libcoll_treemap_get(tree, &even_keys[i]);
+        libcoll_treemap_remove(tree, &even_keys[i]);
+    }
+    libcoll_treemap_get_stats(tree, &stats);
+    ck_assert_uint_eq(stats.size, libcoll_treemap_get_size(tree));
+    size_t counted = 0;
+    int deepest = 0;
+    for (int depth=0; depth<LIBCOLL_TREEMAP_STATS_DEPTHS; depth++) {
+        counted += stats.depth_counts[depth];
+        if (0 != stats.depth_counts[depth])  deepest = depth;
+    }
+    ck_assert_uint_eq(counted, stats.size);
+    ck_assert_int_eq(stats.height, deepest + 1);
+    libcoll_treemap_iter_t iter;
+    libcoll_treemap_init_iterator(&iter, tree);
+    while (libcoll_treemap_has_next(&iter)) {
+        ck_assert_int_lt(libcoll_treemap_depth_of(tree, libcoll_treemap_next(&iter)->key), stats.height);
+    }
+
+    if (0 != stats.counters.comparisons) {
+        ck_assert_uint_eq(stats.counters.additions.calls, EVEN_KEY_COUNT);
+        ck_assert_uint_eq(stats.counters.lookups.calls, EVEN_KEY_COUNT / 2);
+        ck_assert_uint_eq(stats.counters.removals.calls, EVEN_KEY_COUNT / 2);
+        ck_assert_uint_ge(stats.counters.lookups.comparisons, EVEN_KEY_COUNT / 2);
+        ck_assert_uint_eq(stats.counters.comparisons, stats.counters.additions.comparisons
+                          + stats.counters.lookups.comparisons + stats.counters.removals.comparisons);
+        ck_assert_uint_gt(stats.counters.additions.rotations, 0);
+        ck_assert_uint_eq(stats.counters.rotations, stats.counters.additions.rotations
+                          + stats.counters.removals.rotations);
+    }
+    libcoll_treemap_reset_counters(tree);
+    libcoll_treemap_get_stats(tree, &stats);
+    ck_assert_uint_eq(stats.counters.comparisons, 0);
+    ck_assert_uint_eq(stats.counters.additions.calls, 0);
+
+    /* rotations made while joining subtrees are counted on the tree too */
+    libcoll_treemap_t *upper = libcoll_treemap_split(tree, &odd_keys[EVEN_KEY_COUNT / 3]);
+    libcoll_treemap_get_stats(tree, &stats);
+    uint64_t split_rotations = stats.counters.rotations;
+    libcoll_treemap_union(tree, upper);
+    libcoll_treemap_get_stats(tree, &stats);
+    ck_assert_uint_ge(stats.counters.rotations, split_rotations);
+    if (0 != stats.counters.comparisons) {
+        ck_assert_uint_gt(stats.counters.rotations, split_rotations);
+    }
+    libcoll_treemap_deinit(upper);
+    libcoll_treemap_deinit(tree);
+}
+END_TEST
+
+
 TCase* create_treemap_tests(void)
 {
     TCase *tc_core;
@@ -185,6 +1280,20 @@ TCase* create_treemap_tests(void)
     tcase_add_test(tc_core, treemap_create);
     tcase_add_test(tc_core, treemap_retrieve_and_remove);
     tcase_add_test(tc_core, treemap_iterate);
+    tcase_add_test(tc_core, treemap_slab_allocation);
+    tcase_add_test(tc_core, treemap_bounds_and_seek);
+    tcase_add_test(tc_core, treemap_range_iteration);
+    tcase_add_test(tc_core, treemap_order_statistics);
+    tcase_add_test(tc_core, treemap_build_sorted_and_flatten);
+    tcase_add_test(tc_core, treemap_split_join_and_set_operations);
+    tcase_add_test(tc_core, treemap_threaded_iteration);
+    tcase_add_test(tc_core, treemap_freeze);
+    tcase_add_test(tc_core, treemap_aggregates);
+    tcase_add_test(tc_core, treemap_add_hint);
+    tcase_add_test(tc_core, treemap_balancing_policies);
+    tcase_add_test(tc_core, treemap_deep_splay_tree);
+    tcase_add_test(tc_core, treemap_add_batch);
+    tcase_add_test(tc_core, treemap_stats);
 
     return tc_core;
 }
@@ -0,0 +1,138 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test_typedhashmap.h"
+
+#include "typedhashmap.h"
+
+#include "../src/debug.h"
+
+static uint64_t hash_string(const char *s)
+{
+    uint64_t hash = 5381;
+    while (*s) {
+        hash = hash * 33 + (unsigned char) *s++;
+    }
+    return hash;
+}
+
+#define STRING_EQ(key1, key2)   (strcmp((key1), (key2)) == 0)
+
+LIBCOLL_DEFINE_HASHMAP(u64_int_map, uint64_t, int,
+                       LIBCOLL_TYPEDHASHMAP_HASH_INTEGER,
+                       LIBCOLL_TYPEDHASHMAP_EQ_DEFAULT)
+
+typedef struct point {
+    double x;
+    double y;
+} point_t;
+
+LIBCOLL_DEFINE_HASHMAP(str_point_map, const char*, point_t, hash_string, STRING_EQ)
+
+/*
+ * Tests a hashmap with integer keys and values, with enough entries to
+ * trigger resizing, and with removals in between.
+ */
+START_TEST(typedhashmap_integers)
+{
+    DEBUG("\n*** Starting typedhashmap_integers\n");
+    u64_int_map_t *map = u64_int_map_init();
+
+    for (uint64_t i=0; i<10000; i++) {
+        ck_assert_int_eq(u64_int_map_put(map, i << 8, (int) i), MAP_ENTRY_ADDED);
+    }
+    ck_assert_int_eq(u64_int_map_put(map, 0, -1), MAP_ENTRY_REPLACED);
+    ck_assert_uint_eq(u64_int_map_get_size(map), 10000);
+
+    for (uint64_t i=0; i<10000; i+=3) {
+        int value;
+        ck_assert(u64_int_map_remove(map, i << 8, &value));
+        ck_assert_int_eq(value, i == 0 ? -1 : (int) i);
+    }
+
+    for (uint64_t i=0; i<10000; i++) {
+        int *value = u64_int_map_get(map, i << 8);
+        if (i % 3 == 0) {
+            ck_assert_ptr_null(value);
+        } else {
+            ck_assert_ptr_nonnull(value);
+            ck_assert_int_eq(*value, (int) i);
+        }
+    }
+
+    size_t position = 0;
+    size_t count = 0;
+    while (u64_int_map_iter_next(map, &position) != NULL) {
+        count++;
+    }
+    ck_assert_uint_eq(count, u64_int_map_get_size(map));
+
+    u64_int_map_deinit(map);
+}
+END_TEST
+
+/*
+ * Tests a hashmap with string keys and struct values.
+ */
+START_TEST(typedhashmap_struct_values)
+{
+    DEBUG("\n*** Starting typedhashmap_struct_values\n");
+    str_point_map_t *map = str_point_map_init_with_capacity(2);
+
+    point_t origin = { 0.0, 0.0 };
+    point_t unit = { 1.0, 1.0 };
+    str_point_map_put(map, "origin", origin);
+    str_point_map_put(map, "unit", unit);
+
+    /* look up with a copy of the key to make sure contents are compared */
+    char key[] = "unit";
+    point_t *value = str_point_map_get(map, key);
+    ck_assert_ptr_nonnull(value);
+    ck_assert(value->x == 1.0 && value->y == 1.0);
+
+    value->x = 2.0;
+    ck_assert(str_point_map_get(map, "unit")->x == 2.0);
+    ck_assert(!str_point_map_contains(map, "other"));
+
+    str_point_map_deinit(map);
+}
+END_TEST
+
+TCase* create_typedhashmap_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("typedhashmap_core");
+
+    tcase_add_test(tc_core, typedhashmap_integers);
+    tcase_add_test(tc_core, typedhashmap_struct_values);
+
+    return tc_core;
+}
@@ -0,0 +1,120 @@
+/*
+ * Unit tests for the libcoll library.
+ *
+ * This file is part of libcoll, a generic collections library for C.
+ *
+ * Copyright (c) 2010-2020 Mika Wahlroos (mika.wahlroos@iki.fi)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <check.h>
+#include <stdint.h>
+
+#include "test_typedtreemap.h"
+
+#include "typedtreemap.h"
+
+#include "../src/debug.h"
+
+LIBCOLL_DEFINE_TREEMAP(int_tree, int64_t, int64_t, LIBCOLL_TYPEDTREEMAP_CMP_DEFAULT)
+
+/*
+ * Checks the red-black conditions in the subtree rooted at the given node.
+ * Returns the black-height of the subtree, or -1 if the conditions fail.
+ */
+static int verify_subtree(const int_tree_node_t *node)
+{
+    if (NULL == node) {
+        return 0;
+    }
+    if (node->color == LIBCOLL_TYPEDTREEMAP_RED
+        && (int_tree_is_red(node->left) || int_tree_is_red(node->right))) {
+        return -1;
+    }
+    if ((NULL != node->left && node->left->parent != node)
+        || (NULL != node->right && node->right->parent != node)) {
+        return -1;
+    }
+    int left_height = verify_subtree(node->left);
+    int right_height = verify_subtree(node->right);
+    if (left_height == -1 || left_height != right_height) {
+        return -1;
+    }
+    return left_height + (node->color == LIBCOLL_TYPEDTREEMAP_BLACK);
+}
+
+/*
+ * Tests inserting and removing keys in a scrambled order, checking the
+ * red-black conditions and the iteration order along the way.
+ */
+START_TEST(typedtreemap_add_remove_iterate)
+{
+    DEBUG("\n*** Starting typedtreemap_add_remove_iterate\n");
+    int_tree_t *tree = int_tree_init();
+    const int64_t n = 2000;
+
+    for (int64_t i=0; i<n; i++) {
+        int64_t key = (i * 7919) % n;
+        ck_assert_int_eq(int_tree_put(tree, key, key * 2), MAP_ENTRY_ADDED);
+    }
+    ck_assert_int_eq(int_tree_put(tree, 5, 0), MAP_ENTRY_REPLACED);
+    ck_assert_uint_eq(int_tree_get_size(tree), n);
+    ck_assert_int_ne(verify_subtree(tree->root), -1);
+
+    for (int64_t i=0; i<n; i+=2) {
+        int64_t key = (i * 7919) % n;
+        ck_assert(int_tree_remove(tree, key, NULL));
+        if (i % 100 == 0) {
+            ck_assert_int_ne(verify_subtree(tree->root), -1);
+        }
+    }
+    ck_assert_int_ne(verify_subtree(tree->root), -1);
+    ck_assert_uint_eq(int_tree_get_size(tree), n / 2);
+
+    int64_t previous_key = -1;
+    size_t count = 0;
+    for (int_tree_node_t *node = int_tree_first(tree); NULL != node; node = int_tree_next(node)) {
+        ck_assert_int_gt(node->key, previous_key);
+        ck_assert_int_eq(node->value, node->key == 5 ? 0 : node->key * 2);
+        previous_key = node->key;
+        count++;
+    }
+    ck_assert_uint_eq(count, n / 2);
+
+    count = 0;
+    for (int_tree_node_t *node = int_tree_last(tree); NULL != node; node = int_tree_previous(node)) {
+        count++;
+    }
+    ck_assert_uint_eq(count, n / 2);
+
+    int_tree_deinit(tree);
+}
+END_TEST
+
+TCase* create_typedtreemap_tests(void)
+{
+    TCase *tc_core;
+    tc_core = tcase_create("typedtreemap_core");
+
+    tcase_add_test(tc_core, typedtreemap_add_remove_iterate);
+
+    return tc_core;
+}
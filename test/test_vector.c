@@ -263,6 +263,52 @@ START_TEST(vector_iterator)
     libcoll_vector_deinit(vector);
 }
 
+static int first_char_cmp(const void *value1, const void *value2)
+{
+    return *(const char*) value1 - *(const char*) value2;
+}
+
+/*
+ * Tests searching with each of the built-in comparators, which have their own
+ * search loops, and with a custom comparator.
+ */
+START_TEST(vector_search_with_builtin_comparators)
+{
+    DEBUG("\n*** Starting vector_search_with_builtin_comparators\n");
+
+    char s1[] = "foo", s2[] = "bar", s3[] = "foo";
+    int i1 = 5, i2 = 7, i3 = 5;
+
+    libcoll_vector_t *vector = libcoll_vector_init_with_params(4, libcoll_memaddrcmp);
+    libcoll_vector_append(vector, s1);
+    libcoll_vector_append(vector, s2);
+    libcoll_vector_append(vector, s3);
+    ck_assert_int_eq(libcoll_vector_index_of(vector, s3), 2);
+    ck_assert_int_eq(libcoll_vector_last_index_of(vector, s1), 0);
+    ck_assert(!libcoll_vector_contains(vector, "baz"));
+
+    vector->compare_function = libcoll_strcmp_wrapper;
+    ck_assert_int_eq(libcoll_vector_index_of(vector, s3), 0);
+    ck_assert_int_eq(libcoll_vector_last_index_of(vector, s1), 2);
+    ck_assert_int_eq(libcoll_vector_index_of(vector, "bar"), 1);
+    ck_assert(!libcoll_vector_contains(vector, "baz"));
+
+    vector->compare_function = first_char_cmp;
+    ck_assert_int_eq(libcoll_vector_index_of(vector, "baz"), 1);
+    ck_assert_int_eq(libcoll_vector_last_index_of(vector, "f"), 2);
+    libcoll_vector_deinit(vector);
+
+    vector = libcoll_vector_init_with_params(4, libcoll_intptrcmp);
+    libcoll_vector_append(vector, &i1);
+    libcoll_vector_append(vector, &i2);
+    libcoll_vector_append(vector, &i3);
+    ck_assert_int_eq(libcoll_vector_index_of(vector, &i3), 0);
+    ck_assert_int_eq(libcoll_vector_last_index_of(vector, &i1), 2);
+    ck_assert_int_eq(libcoll_vector_index_of(vector, &i2), 1);
+    libcoll_vector_deinit(vector);
+}
+END_TEST
+
 TCase* create_vector_tests(void)
 {
     TCase *tc_core;
@@ -274,6 +320,7 @@ TCase* create_vector_tests(void)
     tcase_add_test(tc_core, vector_insert);
     tcase_add_test(tc_core, vector_pop);
     tcase_add_test(tc_core, vector_iterator);
+    tcase_add_test(tc_core, vector_search_with_builtin_comparators);
 
     return tc_core;
 }